@@ -375,6 +375,7 @@ BOOL WINAPI ReadFileScatter( HANDLE file, FILE_SEGMENT_ELEMENT *segments, DWORD
     PIO_STATUS_BLOCK io_status;
     LARGE_INTEGER offset;
     NTSTATUS status;
+    LPVOID cvalue = NULL;
 
     TRACE( "(%p %p %u %p)\n", file, segments, count, overlapped );
 
@@ -383,8 +384,9 @@ BOOL WINAPI ReadFileScatter( HANDLE file, FILE_SEGMENT_ELEMENT *segments, DWORD
     io_status = (PIO_STATUS_BLOCK)overlapped;
     io_status->u.Status = STATUS_PENDING;
     io_status->Information = 0;
+    if (((ULONG_PTR)overlapped->hEvent & 1) == 0) cvalue = overlapped;
 
-    status = NtReadFileScatter( file, NULL, NULL, NULL, io_status, segments, count, &offset, NULL );
+    status = NtReadFileScatter( file, overlapped->hEvent, NULL, cvalue, io_status, segments, count, &offset, NULL );
     if (status) SetLastError( RtlNtStatusToDosError(status) );
     return !status;
 }
@@ -514,6 +516,7 @@ BOOL WINAPI WriteFileGather( HANDLE file, FILE_SEGMENT_ELEMENT *segments, DWORD
     PIO_STATUS_BLOCK io_status;
     LARGE_INTEGER offset;
     NTSTATUS status;
+    LPVOID cvalue = NULL;
 
     TRACE( "%p %p %u %p\n", file, segments, count, overlapped );
 
@@ -522,8 +525,9 @@ BOOL WINAPI WriteFileGather( HANDLE file, FILE_SEGMENT_ELEMENT *segments, DWORD
     io_status = (PIO_STATUS_BLOCK)overlapped;
     io_status->u.Status = STATUS_PENDING;
     io_status->Information = 0;
+    if (((ULONG_PTR)overlapped->hEvent & 1) == 0) cvalue = overlapped;
 
-    status = NtWriteFileGather( file, NULL, NULL, NULL, io_status, segments, count, &offset, NULL );
+    status = NtWriteFileGather( file, overlapped->hEvent, NULL, cvalue, io_status, segments, count, &offset, NULL );
     if (status) SetLastError( RtlNtStatusToDosError(status) );
     return !status;
 }
@@ -46,6 +46,8 @@ static HANDLE (WINAPI *pOpenFileById)(HANDLE, LPFILE_ID_DESCRIPTOR, DWORD, DWORD
 static BOOL (WINAPI *pSetFileValidData)(HANDLE, LONGLONG);
 static HRESULT (WINAPI *pCopyFile2)(PCWSTR,PCWSTR,COPYFILE2_EXTENDED_PARAMETERS*);
 static HANDLE (WINAPI *pCreateFile2)(LPCWSTR, DWORD, DWORD, DWORD, CREATEFILE2_EXTENDED_PARAMETERS*);
+static BOOL (WINAPI *pReadFileScatter)(HANDLE, FILE_SEGMENT_ELEMENT*, DWORD, LPDWORD, LPOVERLAPPED);
+static BOOL (WINAPI *pWriteFileGather)(HANDLE, FILE_SEGMENT_ELEMENT*, DWORD, LPDWORD, LPOVERLAPPED);
 
 /* keep filename and filenameW the same */
 static const char filename[] = "testfile.xxx";
@@ -85,6 +87,8 @@ static void InitFunctionPointers(void)
     pSetFileValidData = (void *) GetProcAddress(hkernel32, "SetFileValidData");
     pCopyFile2 = (void *) GetProcAddress(hkernel32, "CopyFile2");
     pCreateFile2 = (void *) GetProcAddress(hkernel32, "CreateFile2");
+    pReadFileScatter = (void *) GetProcAddress(hkernel32, "ReadFileScatter");
+    pWriteFileGather = (void *) GetProcAddress(hkernel32, "WriteFileGather");
 }
 
 static void test__hread( void )
@@ -3186,6 +3190,188 @@ static void test_overlapped(void)
     ok( r == TRUE, "close handle failed\n");
 }
 
+static void test_overlapped_read_stress(void)
+{
+    enum { file_size = 1024 * 1024, block_size = 4096, nb_inflight = 16, nb_reads = 2048 };
+    char temp_path[MAX_PATH], filename[MAX_PATH];
+    OVERLAPPED ov[nb_inflight];
+    DWORD *buffers[nb_inflight], *data, count, start, ticks, i, j, offset;
+    ULONG_PTR key;
+    OVERLAPPED *pov;
+    HANDLE file, port;
+    unsigned int seed = 0x1234, done = 0, completions = 0, errors = 0, pending = 0;
+    BOOL ret;
+
+    GetTempPathA(MAX_PATH, temp_path);
+    GetTempFileNameA(temp_path, "ovl", 0, filename);
+
+    /* each DWORD of the file contains its own offset */
+    data = HeapAlloc(GetProcessHeap(), 0, file_size);
+    for (i = 0; i < file_size / sizeof(DWORD); i++) data[i] = i * sizeof(DWORD);
+    file = CreateFileA(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "CreateFileA failed, error %u\n", GetLastError());
+    ret = WriteFile(file, data, file_size, &count, NULL);
+    ok(ret && count == file_size, "WriteFile failed, error %u\n", GetLastError());
+    CloseHandle(file);
+    HeapFree(GetProcessHeap(), 0, data);
+
+    /* bypass the cache so that the reads have to wait for the disk */
+    file = CreateFileA(filename, GENERIC_READ, 0, NULL, OPEN_EXISTING,
+                       FILE_FLAG_OVERLAPPED | FILE_FLAG_NO_BUFFERING, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "CreateFileA failed, error %u\n", GetLastError());
+    port = CreateIoCompletionPort(file, NULL, 0xdead, 0);
+    ok(port != NULL, "CreateIoCompletionPort failed, error %u\n", GetLastError());
+
+    for (i = 0; i < nb_inflight; i++)
+    {
+        /* unbuffered reads need sector aligned buffers */
+        buffers[i] = VirtualAlloc(NULL, block_size, MEM_COMMIT, PAGE_READWRITE);
+        memset(&ov[i], 0, sizeof(ov[i]));
+        ov[i].hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    }
+
+    start = GetTickCount();
+    for (i = 0; i < nb_reads; i += nb_inflight)
+    {
+        for (j = 0; j < nb_inflight; j++)
+        {
+            seed = seed * 1103515245 + 12345;
+            S(U(ov[j])).Offset = ((seed >> 8) % (file_size / block_size)) * block_size;
+            ret = ReadFile(file, buffers[j], block_size, NULL, &ov[j]);
+            ok(ret || GetLastError() == ERROR_IO_PENDING, "ReadFile failed, error %u\n", GetLastError());
+            if (!ret) pending++;
+        }
+        for (j = 0; j < nb_inflight; j++)
+        {
+            offset = S(U(ov[j])).Offset;
+            ret = GetOverlappedResult(file, &ov[j], &count, TRUE);
+            ok(ret, "GetOverlappedResult failed, error %u\n", GetLastError());
+            ok(count == block_size, "read %u bytes\n", count);
+            if (buffers[j][0] != offset || buffers[j][block_size / sizeof(DWORD) - 1] != offset + block_size - 4)
+                errors++;
+            done++;
+        }
+    }
+    ticks = GetTickCount() - start;
+    ok(!errors, "got wrong data in %u reads\n", errors);
+    /* unbuffered reads go to the disk, so they complete asynchronously */
+    ok(pending == done, "only %u of %u reads were pending\n", pending, done);
+
+    /* every read must also have been reported to the completion port */
+    while (GetQueuedCompletionStatus(port, &count, &key, &pov, 1000))
+    {
+        ok(key == 0xdead, "got key %lx\n", key);
+        ok(count == block_size, "got count %u\n", count);
+        if (++completions == done) break;
+    }
+    ok(completions == done, "got %u completions for %u reads\n", completions, done);
+
+    trace("%u overlapped reads in %u ms\n", done, ticks);
+
+    for (i = 0; i < nb_inflight; i++)
+    {
+        CloseHandle(ov[i].hEvent);
+        VirtualFree(buffers[i], 0, MEM_RELEASE);
+    }
+    CloseHandle(port);
+    CloseHandle(file);
+    DeleteFileA(filename);
+}
+
+static void test_scatter_gather(void)
+{
+    enum { nb_pages = 512, nb_loops = 8 };
+    char temp_path[MAX_PATH], filename[MAX_PATH];
+    FILE_SEGMENT_ELEMENT *segments;
+    OVERLAPPED ov;
+    SYSTEM_INFO si;
+    DWORD *page, count, start, ticks, i, j, size, errors = 0;
+    char *mem;
+    HANDLE file;
+    BOOL ret;
+
+    if (!pReadFileScatter || !pWriteFileGather)
+    {
+        win_skip("ReadFileScatter or WriteFileGather not available\n");
+        return;
+    }
+
+    GetSystemInfo(&si);
+    size = nb_pages * si.dwPageSize;
+    mem = VirtualAlloc(NULL, size, MEM_COMMIT, PAGE_READWRITE);
+    ok(mem != NULL, "VirtualAlloc failed, error %u\n", GetLastError());
+    segments = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (nb_pages + 1) * sizeof(*segments));
+
+    GetTempPathA(MAX_PATH, temp_path);
+    GetTempFileNameA(temp_path, "sgt", 0, filename);
+    file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "CreateFileA failed, error %u\n", GetLastError());
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+    /* write the pages in reverse order; each DWORD contains its own file offset */
+    for (i = 0; i < nb_pages; i++)
+    {
+        page = (DWORD *)(mem + (nb_pages - 1 - i) * si.dwPageSize);
+        for (j = 0; j < si.dwPageSize / sizeof(DWORD); j++) page[j] = i * si.dwPageSize + j * sizeof(DWORD);
+        segments[i].Buffer = page;
+    }
+    start = GetTickCount();
+    for (i = 0; i < nb_loops; i++)
+    {
+        S(U(ov)).Offset = i * size;
+        ret = pWriteFileGather(file, segments, size, NULL, &ov);
+        ok(ret || GetLastError() == ERROR_IO_PENDING, "WriteFileGather failed, error %u\n", GetLastError());
+        ret = GetOverlappedResult(file, &ov, &count, TRUE);
+        ok(ret, "GetOverlappedResult failed, error %u\n", GetLastError());
+        ok(count == size, "wrote %u bytes\n", count);
+    }
+    ticks = GetTickCount() - start;
+    trace("wrote %u pages with WriteFileGather in %u ms\n", nb_pages * nb_loops, ticks);
+
+    /* read them back into every other page first, then the remaining ones */
+    for (i = 0; i < nb_pages; i++)
+    {
+        j = (i < nb_pages / 2) ? i * 2 : (i - nb_pages / 2) * 2 + 1;
+        segments[i].Buffer = mem + j * si.dwPageSize;
+    }
+    start = GetTickCount();
+    for (i = 0; i < nb_loops; i++)
+    {
+        memset(mem, 0xcc, size);
+        S(U(ov)).Offset = i * size;
+        ret = pReadFileScatter(file, segments, size, NULL, &ov);
+        ok(ret || GetLastError() == ERROR_IO_PENDING, "ReadFileScatter failed, error %u\n", GetLastError());
+        ret = GetOverlappedResult(file, &ov, &count, TRUE);
+        ok(ret, "GetOverlappedResult failed, error %u\n", GetLastError());
+        ok(count == size, "read %u bytes\n", count);
+        for (j = 0; j < nb_pages; j++)
+        {
+            page = segments[j].Buffer;
+            if (page[0] != j * si.dwPageSize ||
+                page[si.dwPageSize / sizeof(DWORD) - 1] != (j + 1) * si.dwPageSize - sizeof(DWORD))
+                errors++;
+        }
+    }
+    ticks = GetTickCount() - start;
+    ok(!errors, "got wrong data in %u pages\n", errors);
+    trace("read %u pages with ReadFileScatter in %u ms\n", nb_pages * nb_loops, ticks);
+
+    /* reading past the end of file fails */
+    S(U(ov)).Offset = nb_loops * size;
+    ret = pReadFileScatter(file, segments, si.dwPageSize, NULL, &ov);
+    if (!ret && GetLastError() == ERROR_IO_PENDING) ret = GetOverlappedResult(file, &ov, &count, TRUE);
+    ok(!ret && GetLastError() == ERROR_HANDLE_EOF, "ReadFileScatter returned %d, error %u\n",
+       ret, GetLastError());
+
+    CloseHandle(ov.hEvent);
+    CloseHandle(file);
+    DeleteFileA(filename);
+    HeapFree(GetProcessHeap(), 0, segments);
+    VirtualFree(mem, 0, MEM_RELEASE);
+}
+
 static void test_RemoveDirectory(void)
 {
     int rc;
@@ -4080,6 +4266,8 @@ START_TEST(file)
     test_read_write();
     test_OpenFile();
     test_overlapped();
+    test_overlapped_read_stress();
+    test_scatter_gather();
     test_RemoveDirectory();
     test_ReplaceFileA();
     test_ReplaceFileW();
@@ -38,6 +38,7 @@
 #define HEAP_VALIDATE_PARAMS  0x40000000
 
 static BOOL (WINAPI *pHeapQueryInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T, PSIZE_T);
+static BOOL (WINAPI *pHeapSetInformation)(HANDLE, HEAP_INFORMATION_CLASS, PVOID, SIZE_T);
 static ULONG (WINAPI *pRtlGetNtGlobalFlags)(void);
 
 struct heap_layout
@@ -580,6 +581,99 @@ static void test_HeapQueryInformation(void)
     ok(info == 0 || info == 1 || info == 2, "expected 0, 1 or 2, got %u\n", info);
 }
 
+static DWORD WINAPI lfh_thread( void *arg )
+{
+    HANDLE heap = arg;
+    void *ptrs[64];
+    int i, j;
+
+    for (i = 0; i < 1000; i++)
+    {
+        for (j = 0; j < sizeof(ptrs)/sizeof(ptrs[0]); j++)
+        {
+            ptrs[j] = HeapAlloc( heap, HEAP_ZERO_MEMORY, 1 + (i + j) % 200 );
+            ok( ptrs[j] != NULL, "HeapAlloc failed\n" );
+            ok( !*(BYTE *)ptrs[j], "block %p not zeroed\n", ptrs[j] );
+            *(BYTE *)ptrs[j] = 0xcc;
+        }
+        for (j = 0; j < sizeof(ptrs)/sizeof(ptrs[0]); j++)
+            ok( HeapFree( heap, 0, ptrs[j] ), "HeapFree failed\n" );
+    }
+    return 0;
+}
+
+static void test_HeapSetInformation(void)
+{
+    HANDLE heap, threads[4];
+    ULONG info;
+    SIZE_T size;
+    void *ptr;
+    BOOL ret;
+    int i;
+
+    pHeapSetInformation = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "HeapSetInformation");
+    if (!pHeapSetInformation || !pHeapQueryInformation)
+    {
+        win_skip("HeapSetInformation is not available\n");
+        return;
+    }
+
+    heap = HeapCreate( 0, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+
+    info = 2;
+    SetLastError(0xdeadbeef);
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) - 1 );
+    ok( !ret, "HeapSetInformation should fail\n" );
+
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( ret, "HeapSetInformation error %u\n", GetLastError() );
+
+    info = 0xdeadbeef;
+    ret = pHeapQueryInformation( heap, HeapCompatibilityInformation, &info, sizeof(info), &size );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( info == 2, "expected 2, got %u\n", info );
+
+    ptr = HeapAlloc( heap, 0, 10 );
+    ok( ptr != NULL, "HeapAlloc failed\n" );
+    ok( HeapSize( heap, 0, ptr ) == 10, "wrong size %lu\n", HeapSize( heap, 0, ptr ) );
+    ptr = HeapReAlloc( heap, 0, ptr, 100 );
+    ok( ptr != NULL, "HeapReAlloc failed\n" );
+    ok( HeapSize( heap, 0, ptr ) == 100, "wrong size %lu\n", HeapSize( heap, 0, ptr ) );
+    ok( HeapFree( heap, 0, ptr ), "HeapFree failed\n" );
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+
+    /* blocks around the largest size handled by the front end */
+    for (size = 0x380; size <= 0x480; size += 8)
+    {
+        ptr = HeapAlloc( heap, 0, size );
+        ok( ptr != NULL, "HeapAlloc failed for size %lu\n", size );
+        ok( HeapFree( heap, 0, ptr ), "HeapFree failed for size %lu\n", size );
+    }
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+
+    for (i = 0; i < sizeof(threads)/sizeof(threads[0]); i++)
+        threads[i] = CreateThread( NULL, 0, lfh_thread, heap, 0, NULL );
+    for (i = 0; i < sizeof(threads)/sizeof(threads[0]); i++)
+    {
+        ok( !WaitForSingleObject( threads[i], 60000 ), "thread %d didn't finish\n", i );
+        CloseHandle( threads[i] );
+    }
+    ok( HeapValidate( heap, 0, NULL ), "HeapValidate failed\n" );
+    ok( HeapDestroy( heap ), "HeapDestroy failed\n" );
+
+    heap = HeapCreate( HEAP_NO_SERIALIZE, 0, 0 );
+    ok( heap != NULL, "HeapCreate failed\n" );
+    info = 2;
+    ret = pHeapSetInformation( heap, HeapCompatibilityInformation, &info, sizeof(info) );
+    ok( !ret, "HeapSetInformation should fail on HEAP_NO_SERIALIZE heap\n" );
+    info = 0xdeadbeef;
+    ret = pHeapQueryInformation( heap, HeapCompatibilityInformation, &info, sizeof(info), &size );
+    ok( ret, "HeapQueryInformation error %u\n", GetLastError() );
+    ok( info == 0, "expected 0, got %u\n", info );
+    ok( HeapDestroy( heap ), "HeapDestroy failed\n" );
+}
+
 static void test_heap_checks( DWORD flags )
 {
     BYTE old, *p, *p2;
@@ -897,6 +991,7 @@ START_TEST(heap)
     test_sized_HeapReAlloc((1 << 20), (2 << 20));
     test_sized_HeapReAlloc((1 << 20), 1);
     test_HeapQueryInformation();
+    test_HeapSetInformation();
 
     if (pRtlGetNtGlobalFlags)
     {
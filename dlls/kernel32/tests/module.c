@@ -230,6 +230,73 @@ static void testGetProcAddress_Wrong(void)
         "Expected ERROR_MOD_NOT_FOUND or ERROR_INVALID_HANDLE(win9x), got %d\n", GetLastError());
 }
 
+static void testGetProcAddress_exports(const char *dll)
+{
+    const IMAGE_DOS_HEADER *dos;
+    const IMAGE_NT_HEADERS *nt;
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    const DWORD *names;
+    const WORD *ordinals;
+    HMODULE mod;
+    FARPROC by_name, by_ord;
+    DWORD i, rva, start, ticks, missing = 0;
+    char buffer[256];
+    size_t len;
+    int pass;
+
+    mod = LoadLibraryA(dll);
+    ok(mod != NULL, "failed to load %s, error %u\n", dll, GetLastError());
+    if (!mod) return;
+
+    dos = (const IMAGE_DOS_HEADER *)mod;
+    nt = (const IMAGE_NT_HEADERS *)((const char *)mod + dos->e_lfanew);
+    rva = nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress;
+    ok(rva != 0, "%s has no export directory\n", dll);
+    if (!rva)
+    {
+        FreeLibrary(mod);
+        return;
+    }
+    exports = (const IMAGE_EXPORT_DIRECTORY *)((const char *)mod + rva);
+    names = (const DWORD *)((const char *)mod + exports->AddressOfNames);
+    ordinals = (const WORD *)((const char *)mod + exports->AddressOfNameOrdinals);
+
+    /* every named export must resolve to the same address as its ordinal */
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        const char *name = (const char *)mod + names[i];
+
+        by_name = GetProcAddress(mod, name);
+        by_ord = GetProcAddress(mod, MAKEINTRESOURCEA(ordinals[i] + exports->Base));
+        ok(by_name == by_ord, "%s: %s resolved to %p by name and %p by ordinal\n",
+           dll, name, by_name, by_ord);
+        if (!by_name) missing++;
+
+        /* lookups are case sensitive */
+        len = strlen(name);
+        if (by_name && len && len < sizeof(buffer) &&
+            ((name[len - 1] >= 'a' && name[len - 1] <= 'z') ||
+             (name[len - 1] >= 'A' && name[len - 1] <= 'Z')))
+        {
+            strcpy(buffer, name);
+            buffer[len - 1] ^= 0x20;
+            ok(GetProcAddress(mod, buffer) != by_name, "%s: %s found as %s\n", dll, name, buffer);
+        }
+    }
+    /* forwards to missing modules may not resolve, but most exports must */
+    ok(missing < exports->NumberOfNames / 10 + 1, "%s: %u of %u exports couldn't be resolved\n",
+       dll, missing, exports->NumberOfNames);
+
+    start = GetTickCount();
+    for (pass = 0; pass < 10; pass++)
+        for (i = 0; i < exports->NumberOfNames; i++)
+            GetProcAddress(mod, (const char *)mod + names[i]);
+    ticks = GetTickCount() - start;
+    trace("%s: resolved %u exports 10 times in %u ms\n", dll, exports->NumberOfNames, ticks);
+
+    FreeLibrary(mod);
+}
+
 static void testLoadLibraryEx(void)
 {
     CHAR path[MAX_PATH];
@@ -696,6 +763,71 @@ static void testGetModuleHandleEx(void)
     FreeLibrary( mod_kernel32 );
 }
 
+static BOOL module_churn_stop;
+
+static DWORD WINAPI module_churn_thread(void *arg)
+{
+    LONG *loads = arg;
+    HMODULE mod;
+
+    while (!module_churn_stop)
+    {
+        mod = LoadLibraryA("version.dll");
+        ok(mod != NULL, "failed to load version.dll, error %u\n", GetLastError());
+        if (!mod) break;
+        InterlockedIncrement(loads);
+        FreeLibrary(mod);
+    }
+    return 0;
+}
+
+static void testModuleLookupConcurrency(void)
+{
+    HMODULE kernel32 = GetModuleHandleA("kernel32.dll"), mod;
+    void *proc = GetProcAddress(kernel32, "GetModuleHandleA");
+    DWORD start, lookups = 0;
+    LONG loads = 0;
+    HANDLE thread;
+    BOOL ret;
+
+    if (!pGetModuleHandleExA)
+    {
+        win_skip("GetModuleHandleExA is not available\n");
+        return;
+    }
+
+    module_churn_stop = FALSE;
+    thread = CreateThread(NULL, 0, module_churn_thread, &loads, 0, NULL);
+    ok(thread != NULL, "CreateThread failed, error %u\n", GetLastError());
+
+    /* lookups of other modules must not be affected by the concurrent loads and unloads */
+    start = GetTickCount();
+    while (GetTickCount() - start < 500)
+    {
+        mod = GetModuleHandleA("kernel32.dll");
+        ok(mod == kernel32, "got %p, expected %p\n", mod, kernel32);
+        mod = GetModuleHandleA("KERNEL32");
+        ok(mod == kernel32, "got %p, expected %p\n", mod, kernel32);
+
+        mod = NULL;
+        ret = pGetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                                  GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, proc, &mod);
+        ok(ret, "GetModuleHandleExA failed, error %u\n", GetLastError());
+        ok(mod == kernel32, "got %p, expected %p\n", mod, kernel32);
+
+        mod = GetModuleHandleA("nosuchmod.dll");
+        ok(!mod, "got %p\n", mod);
+        lookups++;
+    }
+
+    module_churn_stop = TRUE;
+    ok(!WaitForSingleObject(thread, 5000), "thread didn't terminate\n");
+    CloseHandle(thread);
+
+    ok(loads > 0, "version.dll was never loaded\n");
+    trace("%u lookups during %d loads of version.dll\n", lookups, loads);
+}
+
 START_TEST(module)
 {
     WCHAR filenameW[MAX_PATH];
@@ -722,6 +854,9 @@ START_TEST(module)
     testNestedLoadLibraryA();
     testLoadLibraryA_Wrong();
     testGetProcAddress_Wrong();
+    testGetProcAddress_exports("kernel32.dll");
+    testGetProcAddress_exports("user32.dll");
     testLoadLibraryEx();
     testGetModuleHandleEx();
+    testModuleLookupConcurrency();
 }
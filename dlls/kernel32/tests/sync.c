@@ -453,6 +453,195 @@ static void test_event(void)
     CloseHandle( handle );
 }
 
+static void test_many_named_events(void)
+{
+    static HANDLE events[5000];
+    char name[64];
+    HANDLE handle;
+    DWORD i;
+
+    for (i = 0; i < sizeof(events)/sizeof(events[0]); i++)
+    {
+        sprintf( name, "winetest_many_events_%u", i );
+        events[i] = CreateEventA( NULL, TRUE, FALSE, name );
+        ok( events[i] != NULL, "CreateEvent %u failed with %u\n", i, GetLastError() );
+        if (!events[i]) break;
+    }
+
+    /* all the names must still be found after the namespace has been grown */
+    while (i--)
+    {
+        sprintf( name, "winetest_many_events_%u", i );
+        handle = OpenEventA( EVENT_ALL_ACCESS, FALSE, name );
+        ok( handle != NULL, "OpenEvent %u failed with %u\n", i, GetLastError() );
+        if (i % 2) SetEvent( handle );
+        ok( WaitForSingleObject( events[i], 0 ) == (i % 2 ? WAIT_OBJECT_0 : WAIT_TIMEOUT),
+            "event %u not shared\n", i );
+        CloseHandle( handle );
+        CloseHandle( events[i] );
+    }
+
+    SetLastError( 0xdeadbeef );
+    handle = OpenEventA( EVENT_ALL_ACCESS, FALSE, "winetest_many_events_0" );
+    ok( !handle, "event still exists\n" );
+    ok( GetLastError() == ERROR_FILE_NOT_FOUND, "wrong error %u\n", GetLastError() );
+}
+
+static void test_event_state(void)
+{
+    HANDLE handle, handle2;
+    DWORD ret;
+
+    /* manual reset events stay signaled */
+    handle = CreateEventA( NULL, TRUE, FALSE, NULL );
+    ok( handle != NULL, "CreateEvent failed with %u\n", GetLastError() );
+    ret = WaitForSingleObject( handle, 0 );
+    ok( ret == WAIT_TIMEOUT, "got %u\n", ret );
+    ret = ResetEvent( handle );
+    ok( ret, "ResetEvent failed with %u\n", GetLastError() );
+    ret = PulseEvent( handle );
+    ok( ret, "PulseEvent failed with %u\n", GetLastError() );
+    ret = WaitForSingleObject( handle, 0 );
+    ok( ret == WAIT_TIMEOUT, "got %u\n", ret );
+    ret = SetEvent( handle );
+    ok( ret, "SetEvent failed with %u\n", GetLastError() );
+    ret = SetEvent( handle );
+    ok( ret, "SetEvent failed with %u\n", GetLastError() );
+    ret = WaitForSingleObject( handle, 0 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    ret = WaitForSingleObject( handle, 0 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    ret = ResetEvent( handle );
+    ok( ret, "ResetEvent failed with %u\n", GetLastError() );
+    ret = WaitForSingleObject( handle, 0 );
+    ok( ret == WAIT_TIMEOUT, "got %u\n", ret );
+
+    /* setting and waiting still require the access rights */
+    SetEvent( handle );
+    ret = DuplicateHandle( GetCurrentProcess(), handle, GetCurrentProcess(), &handle2,
+                           SYNCHRONIZE, FALSE, 0 );
+    ok( ret, "DuplicateHandle failed with %u\n", GetLastError() );
+    SetLastError( 0xdeadbeef );
+    ret = SetEvent( handle2 );
+    ok( !ret, "SetEvent succeeded\n" );
+    ok( GetLastError() == ERROR_ACCESS_DENIED, "wrong error %u\n", GetLastError() );
+    ret = WaitForSingleObject( handle2, 0 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    CloseHandle( handle2 );
+    ret = DuplicateHandle( GetCurrentProcess(), handle, GetCurrentProcess(), &handle2,
+                           EVENT_MODIFY_STATE, FALSE, 0 );
+    ok( ret, "DuplicateHandle failed with %u\n", GetLastError() );
+    SetLastError( 0xdeadbeef );
+    ret = WaitForSingleObject( handle2, 0 );
+    ok( ret == WAIT_FAILED, "got %u\n", ret );
+    ok( GetLastError() == ERROR_ACCESS_DENIED, "wrong error %u\n", GetLastError() );
+    CloseHandle( handle2 );
+    CloseHandle( handle );
+
+    /* auto reset events are reset by a successful wait */
+    handle = CreateEventA( NULL, FALSE, TRUE, NULL );
+    ok( handle != NULL, "CreateEvent failed with %u\n", GetLastError() );
+    ret = WaitForSingleObject( handle, 0 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    ret = WaitForSingleObject( handle, 0 );
+    ok( ret == WAIT_TIMEOUT, "got %u\n", ret );
+    SetEvent( handle );
+    SetEvent( handle );
+    ret = WaitForSingleObject( handle, 0 );
+    ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+    ret = WaitForSingleObject( handle, 0 );
+    ok( ret == WAIT_TIMEOUT, "got %u\n", ret );
+    SetEvent( handle );
+    ret = PulseEvent( handle );
+    ok( ret, "PulseEvent failed with %u\n", GetLastError() );
+    ret = WaitForSingleObject( handle, 0 );
+    ok( ret == WAIT_TIMEOUT, "got %u\n", ret );
+    CloseHandle( handle );
+}
+
+static void close_remote_handle_child( const char *pid_str, const char *handle_str )
+{
+    HANDLE process, handle;
+    BOOL ret;
+
+    process = OpenProcess( PROCESS_DUP_HANDLE, FALSE, strtoul( pid_str, NULL, 16 ));
+    ok( process != NULL, "OpenProcess failed with %u\n", GetLastError() );
+    handle = (HANDLE)(ULONG_PTR)strtoul( handle_str, NULL, 16 );
+    ret = DuplicateHandle( process, handle, NULL, NULL, 0, FALSE, DUPLICATE_CLOSE_SOURCE );
+    ok( ret, "DuplicateHandle failed with %u\n", GetLastError() );
+    CloseHandle( process );
+}
+
+static void close_remote_handle( HANDLE handle )
+{
+    PROCESS_INFORMATION info;
+    STARTUPINFOA startup;
+    char cmdline[MAX_PATH + 64], **argv;
+    BOOL ret;
+
+    winetest_get_mainargs( &argv );
+    /* handle values always fit in 32 bits */
+    sprintf( cmdline, "\"%s\" sync closehandle %x %x", argv[0], GetCurrentProcessId(),
+             (DWORD)(ULONG_PTR)handle );
+    memset( &startup, 0, sizeof(startup) );
+    startup.cb = sizeof(startup);
+    ret = CreateProcessA( NULL, cmdline, NULL, NULL, FALSE, 0, NULL, NULL, &startup, &info );
+    ok( ret, "CreateProcess failed with %u\n", GetLastError() );
+    winetest_wait_child_process( info.hProcess );
+    CloseHandle( info.hProcess );
+    CloseHandle( info.hThread );
+}
+
+/* a handle closed by another process may be reused for an unrelated event */
+static void test_event_handle_reuse(void)
+{
+    HANDLE handle, handle2, other;
+    DWORD ret;
+    int i;
+
+    for (i = 0; i < 3; i++)
+    {
+        handle = CreateEventA( NULL, TRUE, TRUE, NULL );
+        ok( handle != NULL, "CreateEvent failed with %u\n", GetLastError() );
+        ret = WaitForSingleObject( handle, 0 );
+        ok( ret == WAIT_OBJECT_0, "%d: got %u\n", i, ret );
+
+        /* keep the first event alive through another handle in one case */
+        if (i == 1) DuplicateHandle( GetCurrentProcess(), handle, GetCurrentProcess(), &other,
+                                     0, FALSE, DUPLICATE_SAME_ACCESS );
+        else other = NULL;
+
+        if (i == 2) CloseHandle( handle );
+        else close_remote_handle( handle );
+
+        handle2 = CreateEventA( NULL, TRUE, FALSE, NULL );
+        ok( handle2 != NULL, "CreateEvent failed with %u\n", GetLastError() );
+        if (handle2 != handle) trace( "%d: handle %p not reused, got %p\n", i, handle, handle2 );
+        ret = WaitForSingleObject( handle2, 0 );
+        ok( ret == WAIT_TIMEOUT, "%d: got %u\n", i, ret );
+        ret = SetEvent( handle2 );
+        ok( ret, "%d: SetEvent failed with %u\n", i, GetLastError() );
+        ret = WaitForSingleObject( handle2, 0 );
+        ok( ret == WAIT_OBJECT_0, "%d: got %u\n", i, ret );
+
+        if (other)
+        {
+            ret = ResetEvent( other );
+            ok( ret, "ResetEvent failed with %u\n", GetLastError() );
+            ret = WaitForSingleObject( handle2, 0 );
+            ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+            ret = SetEvent( other );
+            ok( ret, "SetEvent failed with %u\n", GetLastError() );
+            ret = ResetEvent( handle2 );
+            ok( ret, "ResetEvent failed with %u\n", GetLastError() );
+            ret = WaitForSingleObject( other, 0 );
+            ok( ret == WAIT_OBJECT_0, "got %u\n", ret );
+            CloseHandle( other );
+        }
+        CloseHandle( handle2 );
+    }
+}
+
 static void test_semaphore(void)
 {
     HANDLE handle, handle2;
@@ -2284,9 +2473,122 @@ static void test_srwlock_example(void)
     trace("number of total exclusive accesses is %d\n", srwlock_protected_value);
 }
 
+static SRWLOCK srwlock_contention;
+static LONG srwlock_contention_inside_excl, srwlock_contention_inside_shared;
+static LONG srwlock_contention_errors;
+static LONG srwlock_contention_value;
+static BOOL srwlock_contention_stop;
+
+struct srwlock_contention_params
+{
+    unsigned int write_ratio;  /* one exclusive acquisition every write_ratio iterations */
+    DWORD shared, exclusive;
+};
+
+static DWORD WINAPI srwlock_contention_thread(LPVOID arg)
+{
+    struct srwlock_contention_params *params = arg;
+    unsigned int i = GetCurrentThreadId();
+    LONG old;
+
+    while (!srwlock_contention_stop)
+    {
+        if (++i % params->write_ratio == 0)
+        {
+            pAcquireSRWLockExclusive(&srwlock_contention);
+            if (InterlockedIncrement(&srwlock_contention_inside_excl) != 1 || srwlock_contention_inside_shared)
+                InterlockedIncrement(&srwlock_contention_errors);
+            srwlock_contention_value++;
+            if (InterlockedDecrement(&srwlock_contention_inside_excl) != 0)
+                InterlockedIncrement(&srwlock_contention_errors);
+            pReleaseSRWLockExclusive(&srwlock_contention);
+            params->exclusive++;
+        }
+        else
+        {
+            pAcquireSRWLockShared(&srwlock_contention);
+            InterlockedIncrement(&srwlock_contention_inside_shared);
+            old = srwlock_contention_value;
+            if (srwlock_contention_inside_excl || old != srwlock_contention_value)
+                InterlockedIncrement(&srwlock_contention_errors);
+            InterlockedDecrement(&srwlock_contention_inside_shared);
+            pReleaseSRWLockShared(&srwlock_contention);
+            params->shared++;
+        }
+    }
+
+    return 0;
+}
+
+static void run_srwlock_contention(unsigned int write_ratio, const char *name)
+{
+    struct srwlock_contention_params params[4];
+    HANDLE threads[4];
+    DWORD shared = 0, exclusive = 0, start, ticks, ret;
+    unsigned int i;
+
+    pInitializeSRWLock(&srwlock_contention);
+    srwlock_contention_inside_excl = srwlock_contention_inside_shared = 0;
+    srwlock_contention_errors = srwlock_contention_value = 0;
+    srwlock_contention_stop = FALSE;
+
+    start = GetTickCount();
+    for (i = 0; i < 4; i++)
+    {
+        params[i].write_ratio = write_ratio;
+        params[i].shared = params[i].exclusive = 0;
+        threads[i] = CreateThread(NULL, 0, srwlock_contention_thread, &params[i], 0, NULL);
+        ok(threads[i] != NULL, "CreateThread failed, error %u\n", GetLastError());
+    }
+
+    Sleep(500);
+    srwlock_contention_stop = TRUE;
+
+    ret = WaitForMultipleObjects(4, threads, TRUE, 5000);
+    ok(ret == WAIT_OBJECT_0, "threads didn't terminate, ret %u\n", ret);
+    ticks = GetTickCount() - start;
+
+    for (i = 0; i < 4; i++)
+    {
+        shared += params[i].shared;
+        exclusive += params[i].exclusive;
+        CloseHandle(threads[i]);
+    }
+
+    ok(!srwlock_contention_errors, "%s: lock invariants were broken %d times\n",
+       name, srwlock_contention_errors);
+    ok(srwlock_contention_value == exclusive, "%s: got %d exclusive updates, expected %u\n",
+       name, srwlock_contention_value, exclusive);
+    ok(shared + exclusive > 0, "%s: no thread made progress\n", name);
+
+    trace("%s: %u shared and %u exclusive acquisitions in %u ms\n", name, shared, exclusive, ticks);
+}
+
+static void test_srwlock_contention(void)
+{
+    if (!pInitializeSRWLock)
+    {
+        win_skip("no srw lock support.\n");
+        return;
+    }
+
+    run_srwlock_contention(50, "reader-heavy");
+    run_srwlock_contention(2, "writer-heavy");
+}
+
 START_TEST(sync)
 {
     HMODULE hdll = GetModuleHandleA("kernel32.dll");
+    char **argv;
+    int argc;
+
+    argc = winetest_get_mainargs( &argv );
+    if (argc >= 5 && !strcmp( argv[2], "closehandle" ))
+    {
+        close_remote_handle_child( argv[3], argv[4] );
+        return;
+    }
+
     pChangeTimerQueueTimer = (void*)GetProcAddress(hdll, "ChangeTimerQueueTimer");
     pCreateTimerQueue = (void*)GetProcAddress(hdll, "CreateTimerQueue");
     pCreateTimerQueueTimer = (void*)GetProcAddress(hdll, "CreateTimerQueueTimer");
@@ -2317,6 +2619,9 @@ START_TEST(sync)
     test_mutex();
     test_slist();
     test_event();
+    test_many_named_events();
+    test_event_state();
+    test_event_handle_reuse();
     test_semaphore();
     test_waitable_timer();
     test_iocp_callback();
@@ -2328,4 +2633,5 @@ START_TEST(sync)
     test_condvars_consumer_producer();
     test_srwlock_base();
     test_srwlock_example();
+    test_srwlock_contention();
 }
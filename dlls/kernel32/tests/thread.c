@@ -87,6 +87,17 @@ static PTP_WORK (WINAPI *pCreateThreadpoolWork)(PTP_WORK_CALLBACK,PVOID,PTP_CALL
 static void (WINAPI *pSubmitThreadpoolWork)(PTP_WORK);
 static void (WINAPI *pWaitForThreadpoolWorkCallbacks)(PTP_WORK,BOOL);
 static void (WINAPI *pCloseThreadpoolWork)(PTP_WORK);
+static void (WINAPI *pCloseThreadpool)(PTP_POOL);
+static PTP_TIMER (WINAPI *pCreateThreadpoolTimer)(PTP_TIMER_CALLBACK,PVOID,PTP_CALLBACK_ENVIRON);
+static void (WINAPI *pSetThreadpoolTimer)(PTP_TIMER,FILETIME*,DWORD,DWORD);
+static BOOL (WINAPI *pIsThreadpoolTimerSet)(PTP_TIMER);
+static void (WINAPI *pWaitForThreadpoolTimerCallbacks)(PTP_TIMER,BOOL);
+static void (WINAPI *pCloseThreadpoolTimer)(PTP_TIMER);
+static PTP_WAIT (WINAPI *pCreateThreadpoolWait)(PTP_WAIT_CALLBACK,PVOID,PTP_CALLBACK_ENVIRON);
+static void (WINAPI *pSetThreadpoolWait)(PTP_WAIT,HANDLE,FILETIME*);
+static void (WINAPI *pWaitForThreadpoolWaitCallbacks)(PTP_WAIT,BOOL);
+static void (WINAPI *pCloseThreadpoolWait)(PTP_WAIT);
+static BOOL (WINAPI *pTrySubmitThreadpoolCallback)(PTP_SIMPLE_CALLBACK,PVOID,PTP_CALLBACK_ENVIRON);
 
 static HANDLE create_target_process(const char *arg)
 {
@@ -1606,17 +1617,44 @@ static void test_thread_actctx(void)
 
 
 static void WINAPI threadpool_workcallback(PTP_CALLBACK_INSTANCE instance, void *context, PTP_WORK work) {
-    int *foo = (int*)context;
+    LONG *foo = context;
 
-    (*foo)++;
+    InterlockedIncrement(foo);
+}
+
+static void WINAPI threadpool_simplecallback(PTP_CALLBACK_INSTANCE instance, void *context) {
+    SetEvent(context);
+}
+
+static void WINAPI threadpool_timercallback(PTP_CALLBACK_INSTANCE instance, void *context, PTP_TIMER timer) {
+    LONG *foo = context;
+
+    InterlockedIncrement(foo);
+}
+
+static TP_WAIT_RESULT wait_result;
+
+static void WINAPI threadpool_waitcallback(PTP_CALLBACK_INSTANCE instance, void *context, PTP_WAIT wait,
+                                           TP_WAIT_RESULT result) {
+    LONG *foo = context;
+
+    wait_result = result;
+    InterlockedIncrement(foo);
 }
 
 
 static void test_threadpool(void)
 {
+    TP_CALLBACK_ENVIRON environment;
     PTP_POOL pool;
     PTP_WORK work;
-    int workcalled = 0;
+    PTP_TIMER timer;
+    PTP_WAIT wait, wait2;
+    LARGE_INTEGER due;
+    HANDLE event, event2, dup;
+    LONG workcalled = 0, timercalled = 0, waitcalled = 0, waitcalled2 = 0;
+    DWORD ret;
+    int i;
 
     if (!pCreateThreadpool) {
         todo_wine win_skip("thread pool apis not supported.\n");
@@ -1632,7 +1670,193 @@ static void test_threadpool(void)
     ok (workcalled == 1, "expected work to be called once, got %d\n", workcalled);
 
     pool = pCreateThreadpool(NULL);
-    todo_wine ok (pool != NULL, "CreateThreadpool failed\n");
+    ok (pool != NULL, "CreateThreadpool failed\n");
+    if (!pool) return;
+
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+
+    /* many submissions of the same work object on a private pool */
+    workcalled = 0;
+    work = pCreateThreadpoolWork(threadpool_workcallback, &workcalled, &environment);
+    ok (work != NULL, "Error %d in CreateThreadpoolWork\n", GetLastError());
+    for (i = 0; i < 1000; i++) pSubmitThreadpoolWork(work);
+    pWaitForThreadpoolWorkCallbacks(work, FALSE);
+    ok (workcalled == 1000, "expected work to be called 1000 times, got %d\n", workcalled);
+
+    /* cancelled callbacks are never run */
+    for (i = 0; i < 1000; i++) pSubmitThreadpoolWork(work);
+    pWaitForThreadpoolWorkCallbacks(work, TRUE);
+    ok (workcalled >= 1000 && workcalled <= 2000, "got %d\n", workcalled);
+    ret = workcalled;
+    Sleep(50);
+    ok (workcalled == ret, "callbacks ran after being cancelled, %d -> %d\n", ret, workcalled);
+    pCloseThreadpoolWork(work);
+
+    event = CreateEventA(NULL, FALSE, FALSE, NULL);
+    ok(pTrySubmitThreadpoolCallback(threadpool_simplecallback, event, &environment),
+       "TrySubmitThreadpoolCallback failed, error %u\n", GetLastError());
+    ret = WaitForSingleObject(event, 1000);
+    ok(ret == WAIT_OBJECT_0, "simple callback not called, got %u\n", ret);
+
+    /* one-shot timer */
+    timer = pCreateThreadpoolTimer(threadpool_timercallback, &timercalled, &environment);
+    ok (timer != NULL, "Error %d in CreateThreadpoolTimer\n", GetLastError());
+    ok (!pIsThreadpoolTimerSet(timer), "timer should not be set\n");
+    due.QuadPart = -100 * 10000;
+    pSetThreadpoolTimer(timer, (FILETIME *)&due, 0, 0);
+    ok (pIsThreadpoolTimerSet(timer), "timer should be set\n");
+    Sleep(500);
+    pWaitForThreadpoolTimerCallbacks(timer, FALSE);
+    ok (timercalled == 1, "expected timer to be called once, got %d\n", timercalled);
+    ok (!pIsThreadpoolTimerSet(timer), "timer should not be set after expiring\n");
+
+    /* periodic timer */
+    timercalled = 0;
+    due.QuadPart = -10 * 10000;
+    pSetThreadpoolTimer(timer, (FILETIME *)&due, 50, 0);
+    Sleep(500);
+    pSetThreadpoolTimer(timer, NULL, 0, 0);
+    pWaitForThreadpoolTimerCallbacks(timer, FALSE);
+    ok (timercalled > 2, "expected timer to be called several times, got %d\n", timercalled);
+    ok (!pIsThreadpoolTimerSet(timer), "timer should not be set\n");
+    pCloseThreadpoolTimer(timer);
+
+    /* wait signaled, then timed out */
+    wait = pCreateThreadpoolWait(threadpool_waitcallback, &waitcalled, &environment);
+    ok (wait != NULL, "Error %d in CreateThreadpoolWait\n", GetLastError());
+    wait_result = 0xdeadbeef;
+    pSetThreadpoolWait(wait, event, NULL);
+    SetEvent(event);
+    for (i = 0; i < 50 && !waitcalled; i++) Sleep(10);
+    pWaitForThreadpoolWaitCallbacks(wait, FALSE);
+    ok (waitcalled == 1, "expected wait to be called once, got %d\n", waitcalled);
+    ok (wait_result == WAIT_OBJECT_0, "got wait result %u\n", wait_result);
+
+    due.QuadPart = -50 * 10000;
+    pSetThreadpoolWait(wait, event, (FILETIME *)&due);
+    for (i = 0; i < 50 && waitcalled < 2; i++) Sleep(10);
+    pWaitForThreadpoolWaitCallbacks(wait, FALSE);
+    ok (waitcalled == 2, "expected wait to be called twice, got %d\n", waitcalled);
+    ok (wait_result == WAIT_TIMEOUT, "got wait result %u\n", wait_result);
+
+    /* only one of two waits sharing a wait thread is signaled */
+    event2 = CreateEventA(NULL, FALSE, FALSE, NULL);
+    wait2 = pCreateThreadpoolWait(threadpool_waitcallback, &waitcalled2, &environment);
+    ok (wait2 != NULL, "Error %d in CreateThreadpoolWait\n", GetLastError());
+    waitcalled = 0;
+    wait_result = 0xdeadbeef;
+    pSetThreadpoolWait(wait, event, NULL);
+    pSetThreadpoolWait(wait2, event2, NULL);
+    SetEvent(event2);
+    for (i = 0; i < 50 && !waitcalled2; i++) Sleep(10);
+    pWaitForThreadpoolWaitCallbacks(wait2, FALSE);
+    ok (waitcalled2 == 1, "expected second wait to be called once, got %d\n", waitcalled2);
+    ok (!waitcalled, "expected first wait not to be called, got %d\n", waitcalled);
+    ok (wait_result == WAIT_OBJECT_0, "got wait result %u\n", wait_result);
+
+    SetEvent(event);
+    for (i = 0; i < 50 && !waitcalled; i++) Sleep(10);
+    pWaitForThreadpoolWaitCallbacks(wait, FALSE);
+    ok (waitcalled == 1, "expected first wait to be called once, got %d\n", waitcalled);
+    ok (waitcalled2 == 1, "expected second wait to be called once, got %d\n", waitcalled2);
+
+    /* closing a handle being waited on doesn't stop the other waits */
+    DuplicateHandle(GetCurrentProcess(), event, GetCurrentProcess(), &dup, 0, FALSE, DUPLICATE_SAME_ACCESS);
+    waitcalled = waitcalled2 = 0;
+    pSetThreadpoolWait(wait, dup, NULL);
+    pSetThreadpoolWait(wait2, event2, NULL);
+    Sleep(50);
+    CloseHandle(dup);
+    Sleep(50);
+    SetEvent(event2);
+    for (i = 0; i < 50 && !waitcalled2; i++) Sleep(10);
+    pWaitForThreadpoolWaitCallbacks(wait2, FALSE);
+    ok (waitcalled2 == 1, "expected second wait to be called once, got %d\n", waitcalled2);
+    pSetThreadpoolWait(wait, NULL, NULL);
+    pWaitForThreadpoolWaitCallbacks(wait, TRUE);
+    pCloseThreadpoolWait(wait2);
+    pCloseThreadpoolWait(wait);
+
+    CloseHandle(event2);
+    CloseHandle(event);
+    pCloseThreadpool(pool);
+}
+
+#define SCALING_ITEMS 20000
+
+struct scaling_submitter
+{
+    PTP_WORK work;
+    HANDLE   start;
+};
+
+static DWORD WINAPI scaling_submit_thread(void *arg)
+{
+    struct scaling_submitter *submitter = arg;
+    int i;
+
+    WaitForSingleObject(submitter->start, INFINITE);
+    for (i = 0; i < SCALING_ITEMS; i++) pSubmitThreadpoolWork(submitter->work);
+    return 0;
+}
+
+/* time the same number of submissions per thread with a growing number of submitting threads */
+static void test_threadpool_scaling(void)
+{
+    struct scaling_submitter submitters[8];
+    HANDLE threads[8], start;
+    TP_CALLBACK_ENVIRON environment;
+    PTP_POOL pool;
+    LONG workcalled;
+    DWORD ticks;
+    unsigned int count, i;
+
+    if (!pCreateThreadpool) {
+        win_skip("thread pool apis not supported.\n");
+        return;
+    }
+
+    pool = pCreateThreadpool(NULL);
+    ok (pool != NULL, "CreateThreadpool failed\n");
+    if (!pool) return;
+    memset(&environment, 0, sizeof(environment));
+    environment.Version = 1;
+    environment.Pool = pool;
+    start = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+    for (count = 1; count <= 8; count *= 2)
+    {
+        workcalled = 0;
+        ResetEvent(start);
+        for (i = 0; i < count; i++)
+        {
+            submitters[i].work = pCreateThreadpoolWork(threadpool_workcallback, &workcalled, &environment);
+            ok (submitters[i].work != NULL, "Error %d in CreateThreadpoolWork\n", GetLastError());
+            submitters[i].start = start;
+            threads[i] = CreateThread(NULL, 0, scaling_submit_thread, &submitters[i], 0, NULL);
+        }
+
+        ticks = GetTickCount();
+        SetEvent(start);
+        WaitForMultipleObjects(count, threads, TRUE, INFINITE);
+        for (i = 0; i < count; i++) pWaitForThreadpoolWorkCallbacks(submitters[i].work, FALSE);
+        ticks = GetTickCount() - ticks;
+
+        ok (workcalled == count * SCALING_ITEMS, "expected %u callbacks, got %d\n",
+            count * SCALING_ITEMS, workcalled);
+        trace("%u submitting threads: %u callbacks in %u ms\n", count, count * SCALING_ITEMS, ticks);
+
+        for (i = 0; i < count; i++)
+        {
+            pCloseThreadpoolWork(submitters[i].work);
+            CloseHandle(threads[i]);
+        }
+    }
+
+    CloseHandle(start);
+    pCloseThreadpool(pool);
 }
 
 static void init_funcs(void)
@@ -1664,6 +1888,17 @@ static void init_funcs(void)
     X(SubmitThreadpoolWork);
     X(WaitForThreadpoolWorkCallbacks);
     X(CloseThreadpoolWork);
+    X(CloseThreadpool);
+    X(CreateThreadpoolTimer);
+    X(SetThreadpoolTimer);
+    X(IsThreadpoolTimerSet);
+    X(WaitForThreadpoolTimerCallbacks);
+    X(CloseThreadpoolTimer);
+    X(CreateThreadpoolWait);
+    X(SetThreadpoolWait);
+    X(WaitForThreadpoolWaitCallbacks);
+    X(CloseThreadpoolWait);
+    X(TrySubmitThreadpoolCallback);
 #undef X
 }
 
@@ -1731,4 +1966,5 @@ START_TEST(thread)
    test_thread_actctx();
 
    test_threadpool();
+   test_threadpool_scaling();
 }
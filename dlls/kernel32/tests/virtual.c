@@ -2447,6 +2447,81 @@ todo_wine
     DeleteFileA(file_name);
 }
 
+static void test_many_views(void)
+{
+    static const int count = 4096;
+    MEMORY_BASIC_INFORMATION info;
+    char *base, *ptr;
+    DWORD old_prot;
+    SIZE_T ret;
+    BOOL res;
+    int i;
+
+    /* reserve a range and carve it into many adjacent views */
+    base = VirtualAlloc( NULL, count * 0x10000, MEM_RESERVE, PAGE_NOACCESS );
+    if (!base)
+    {
+        skip( "can't reserve enough address space\n" );
+        return;
+    }
+    res = VirtualFree( base, 0, MEM_RELEASE );
+    ok( res, "VirtualFree failed %u\n", GetLastError() );
+
+    for (i = 0; i < count; i++)
+    {
+        ptr = VirtualAlloc( base + i * 0x10000, 0x10000, MEM_RESERVE, PAGE_NOACCESS );
+        ok( ptr == base + i * 0x10000, "%d: VirtualAlloc returned %p, expected %p\n",
+            i, ptr, base + i * 0x10000 );
+        if (!ptr) break;
+    }
+    if (i < count)
+    {
+        while (i--) VirtualFree( base + i * 0x10000, 0, MEM_RELEASE );
+        return;
+    }
+
+    /* punch holes in every other view */
+    for (i = 0; i < count; i += 2)
+    {
+        res = VirtualFree( base + i * 0x10000, 0, MEM_RELEASE );
+        ok( res, "%d: VirtualFree failed %u\n", i, GetLastError() );
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        ptr = base + i * 0x10000;
+        ret = VirtualQuery( ptr + 0x1000, &info, sizeof(info) );
+        ok( ret == sizeof(info), "%d: VirtualQuery failed %u\n", i, GetLastError() );
+        ok( info.BaseAddress == ptr + 0x1000, "%d: got base %p, expected %p\n",
+            i, info.BaseAddress, ptr + 0x1000 );
+        if (i & 1)
+        {
+            ok( info.AllocationBase == ptr, "%d: got allocation base %p, expected %p\n",
+                i, info.AllocationBase, ptr );
+            ok( info.RegionSize == 0xf000, "%d: got size %lx\n", i, info.RegionSize );
+            ok( info.State == MEM_RESERVE, "%d: got state %x\n", i, info.State );
+
+            ptr = VirtualAlloc( ptr, 0x1000, MEM_COMMIT, PAGE_READWRITE );
+            ok( ptr == base + i * 0x10000, "%d: VirtualAlloc failed %u\n", i, GetLastError() );
+            res = VirtualProtect( ptr, 0x1000, PAGE_READONLY, &old_prot );
+            ok( res, "%d: VirtualProtect failed %u\n", i, GetLastError() );
+            ok( old_prot == PAGE_READWRITE, "%d: got old protection %x\n", i, old_prot );
+        }
+        else
+        {
+            ok( info.RegionSize == 0xf000, "%d: got size %lx\n", i, info.RegionSize );
+            res = VirtualProtect( ptr, 0x1000, PAGE_READONLY, &old_prot );
+            ok( !res, "%d: VirtualProtect succeeded on free memory\n", i );
+        }
+    }
+
+    for (i = 1; i < count; i += 2)
+    {
+        res = VirtualFree( base + i * 0x10000, 0, MEM_RELEASE );
+        ok( res, "%d: VirtualFree failed %u\n", i, GetLastError() );
+    }
+}
+
 static void test_shared_memory(int is_child)
 {
     HANDLE mapping;
@@ -2547,4 +2622,5 @@ START_TEST(virtual)
     test_IsBadWritePtr();
     test_IsBadCodePtr();
     test_write_watch();
+    test_many_views();
 }
@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #ifdef HAVE_SYS_SYSCALL_H
 #include <sys/syscall.h>
@@ -52,13 +53,143 @@ static inline LONG interlocked_dec( PLONG dest )
 
 static inline void small_pause(void)
 {
-#ifdef __i386__
+#if defined(__i386__) || defined(__x86_64__)
     __asm__ __volatile__( "rep;nop" : : : "memory" );
 #else
     __asm__ __volatile__( "" : : : "memory" );
 #endif
 }
 
+/* Sections without an explicit spin count spin adaptively: the low bits of
+ * SpinCount hold a running estimate of how many iterations it took to get
+ * the section after the owner released it, and RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN
+ * marks it as such.  The upper bound depends on the number of CPUs. */
+static ULONG max_adaptive_spin;
+
+static inline BOOL is_adaptive_spin( const RTL_CRITICAL_SECTION *crit )
+{
+    return !crit->SpinCount || (crit->SpinCount & RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN);
+}
+
+/* contention profiler, enabled with the WINELOCKPROFILE environment variable */
+
+#define LOCK_PROFILE_SIZE 1024  /* must be a power of two */
+
+struct lock_profile_entry
+{
+    const char *name;          /* section name from the debug info */
+    LONG        acquisitions;  /* number of enter calls */
+    LONG        spins;         /* number of contended enters resolved by spinning */
+    LONG        contentions;   /* number of times a thread had to block */
+    LONGLONG    wait_time;     /* total blocking time in performance counter ticks */
+};
+
+static const char unnamed_lock[] = "(unnamed)";
+static const char *lock_profile_file;
+BOOL lock_profile_enabled = FALSE;
+static struct lock_profile_entry lock_profile[LOCK_PROFILE_SIZE];
+
+static struct lock_profile_entry *get_lock_profile( const RTL_CRITICAL_SECTION *crit )
+{
+    const char *name = NULL;
+    unsigned int i, hash;
+
+    if (crit->DebugInfo) name = (const char *)crit->DebugInfo->Spare[0];
+    if (!name) name = unnamed_lock;
+
+    /* names are static strings, so hash the pointer */
+    hash = ((ULONG_PTR)name >> 2) * 0x9e3779b1;
+    for (i = 0; i < LOCK_PROFILE_SIZE; i++)
+    {
+        struct lock_profile_entry *entry = &lock_profile[(hash + i) & (LOCK_PROFILE_SIZE - 1)];
+
+        if (entry->name == name) return entry;
+        if (!entry->name && !interlocked_cmpxchg_ptr( (void **)&entry->name, (void *)name, NULL ))
+            return entry;
+        if (entry->name == name) return entry;
+    }
+    return NULL;
+}
+
+static void profile_acquire( const RTL_CRITICAL_SECTION *crit )
+{
+    struct lock_profile_entry *entry = get_lock_profile( crit );
+
+    if (entry) interlocked_inc( &entry->acquisitions );
+}
+
+static void profile_spin( const RTL_CRITICAL_SECTION *crit )
+{
+    struct lock_profile_entry *entry = get_lock_profile( crit );
+
+    if (entry) interlocked_inc( &entry->spins );
+}
+
+static void profile_wait( const RTL_CRITICAL_SECTION *crit, LONGLONG time )
+{
+    struct lock_profile_entry *entry = get_lock_profile( crit );
+    LONGLONG old;
+
+    if (!entry) return;
+    interlocked_inc( &entry->contentions );
+    do old = entry->wait_time;
+    while (interlocked_cmpxchg64( &entry->wait_time, old + time, old ) != old);
+}
+
+static int compare_lock_profile( const void *a, const void *b )
+{
+    const struct lock_profile_entry *entry1 = *(const struct lock_profile_entry * const *)a;
+    const struct lock_profile_entry *entry2 = *(const struct lock_profile_entry * const *)b;
+
+    if (entry1->wait_time != entry2->wait_time) return entry1->wait_time < entry2->wait_time ? 1 : -1;
+    return entry2->acquisitions - entry1->acquisitions;
+}
+
+/***********************************************************************
+ *           critsection_init
+ */
+void critsection_init(void)
+{
+    ULONG cpus = NtCurrentTeb()->Peb->NumberOfProcessors;
+
+    if (cpus > 1) max_adaptive_spin = min( 250 * (cpus - 1), 1000 );
+    lock_profile_file = getenv( "WINELOCKPROFILE" );
+    lock_profile_enabled = (lock_profile_file != NULL);
+}
+
+/***********************************************************************
+ *           critsection_dump_profile
+ *
+ * Write the contention profile at process exit, sorted by total wait time.
+ */
+void critsection_dump_profile(void)
+{
+    static struct lock_profile_entry *entries[LOCK_PROFILE_SIZE];
+    unsigned int i, count = 0, hits, misses, uncached;
+    LARGE_INTEGER counter, freq;
+    FILE *file = stderr;
+
+    if (!lock_profile_file) return;
+
+    for (i = 0; i < LOCK_PROFILE_SIZE; i++)
+        if (lock_profile[i].name) entries[count++] = &lock_profile[i];
+    qsort( entries, count, sizeof(entries[0]), compare_lock_profile );
+
+    if (*lock_profile_file && !(file = fopen( lock_profile_file, "a" ))) return;
+
+    NtQueryPerformanceCounter( &counter, &freq );
+    fprintf( file, "# lock profile for process %04x\n", HandleToULong( NtCurrentTeb()->ClientId.UniqueProcess ));
+    fprintf( file, "# acquisitions spins contentions wait_ms name\n" );
+    for (i = 0; i < count; i++)
+        fprintf( file, "lock %u %u %u %.3f %s\n", entries[i]->acquisitions, entries[i]->spins,
+                 entries[i]->contentions, entries[i]->wait_time * 1000.0 / freq.QuadPart, entries[i]->name );
+    server_get_fd_cache_stats( &hits, &misses, &uncached );
+    fprintf( file, "# fd cache hits misses uncached\n" );
+    fprintf( file, "fdcache %u %u %u\n", hits, misses, uncached );
+    if (file != stderr) fclose( file );
+    else fflush( file );
+}
+
 #ifdef __linux__
 
 static int wait_op = 128; /*FUTEX_WAIT|FUTEX_PRIVATE_FLAG*/
@@ -311,7 +442,7 @@ NTSTATUS WINAPI RtlInitializeCriticalSectionAndSpinCount( RTL_CRITICAL_SECTION *
  */
 NTSTATUS WINAPI RtlInitializeCriticalSectionEx( RTL_CRITICAL_SECTION *crit, ULONG spincount, ULONG flags )
 {
-    if (flags & (RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN|RTL_CRITICAL_SECTION_FLAG_STATIC_INIT))
+    if (flags & RTL_CRITICAL_SECTION_FLAG_STATIC_INIT)
         FIXME("(%p,%u,0x%08x) semi-stub\n", crit, spincount, flags);
 
     /* FIXME: if RTL_CRITICAL_SECTION_FLAG_STATIC_INIT is given, we should use
@@ -342,6 +473,9 @@ NTSTATUS WINAPI RtlInitializeCriticalSectionEx( RTL_CRITICAL_SECTION *crit, ULON
     crit->LockSemaphore  = 0;
     if (NtCurrentTeb()->Peb->NumberOfProcessors <= 1) spincount = 0;
     crit->SpinCount = spincount & ~0x80000000;
+    if (flags & RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN)
+        crit->SpinCount = RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN |
+                          min( spincount & ~RTL_CRITICAL_SECTION_ALL_FLAG_BITS, max_adaptive_spin );
     return STATUS_SUCCESS;
 }
 
@@ -359,6 +493,7 @@ NTSTATUS WINAPI RtlInitializeCriticalSectionEx( RTL_CRITICAL_SECTION *crit, ULON
  *
  * NOTES
  *  If the system is not SMP, spincount is ignored and set to 0.
+ *  A spin count of 0 makes the section spin adaptively.
  *
  * SEE
  *  RtlInitializeCriticalSectionEx(),
@@ -369,6 +504,8 @@ NTSTATUS WINAPI RtlInitializeCriticalSectionEx( RTL_CRITICAL_SECTION *crit, ULON
 ULONG WINAPI RtlSetCriticalSectionSpinCount( RTL_CRITICAL_SECTION *crit, ULONG spincount )
 {
     ULONG oldspincount = crit->SpinCount;
+    if (crit->SpinCount & RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN)
+        oldspincount &= ~RTL_CRITICAL_SECTION_ALL_FLAG_BITS;
     if (NtCurrentTeb()->Peb->NumberOfProcessors <= 1) spincount = 0;
     crit->SpinCount = spincount;
     return oldspincount;
@@ -435,6 +572,9 @@ NTSTATUS WINAPI RtlDeleteCriticalSection( RTL_CRITICAL_SECTION *crit )
  */
 NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
 {
+    LARGE_INTEGER start, end;
+
+    if (lock_profile_file) NtQueryPerformanceCounter( &start, NULL );
     for (;;)
     {
         EXCEPTION_RECORD rec;
@@ -469,6 +609,11 @@ NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
         RtlRaiseException( &rec );
     }
     if (crit->DebugInfo) crit->DebugInfo->ContentionCount++;
+    if (lock_profile_file)
+    {
+        NtQueryPerformanceCounter( &end, NULL );
+        profile_wait( crit, end.QuadPart - start.QuadPart );
+    }
     return STATUS_SUCCESS;
 }
 
@@ -511,6 +656,34 @@ NTSTATUS WINAPI RtlpUnWaitCriticalSection( RTL_CRITICAL_SECTION *crit )
 }
 
 
+/***********************************************************************
+ *           spin_adaptive
+ *
+ * Spin for up to twice the current estimate, and update it with the number
+ * of iterations it took to get the section, or shrink it if the owner held
+ * on to the section for too long.
+ */
+static BOOL spin_adaptive( RTL_CRITICAL_SECTION *crit )
+{
+    ULONG estimate = crit->SpinCount & ~RTL_CRITICAL_SECTION_ALL_FLAG_BITS;
+    ULONG count, max_count = min( 2 * estimate + 16, max_adaptive_spin );
+
+    for (count = 0; count < max_count; count++)
+    {
+        if (crit->LockCount > 0) return FALSE;  /* more than one waiter, don't bother spinning */
+        if (crit->LockCount == -1 && interlocked_cmpxchg( &crit->LockCount, 0, -1 ) == -1)
+        {
+            estimate += ((LONG)count - (LONG)estimate) / 8;
+            crit->SpinCount = RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN | estimate;
+            return TRUE;
+        }
+        small_pause();
+    }
+    crit->SpinCount = RTL_CRITICAL_SECTION_FLAG_DYNAMIC_SPIN | (estimate - estimate / 4);
+    return FALSE;
+}
+
+
 /***********************************************************************
  *           RtlEnterCriticalSection   (NTDLL.@)
  *
@@ -530,7 +703,15 @@ NTSTATUS WINAPI RtlpUnWaitCriticalSection( RTL_CRITICAL_SECTION *crit )
  */
 NTSTATUS WINAPI RtlEnterCriticalSection( RTL_CRITICAL_SECTION *crit )
 {
-    if (crit->SpinCount)
+    if (lock_profile_file) profile_acquire( crit );
+
+    if (is_adaptive_spin( crit ))
+    {
+        if (max_adaptive_spin && crit->LockCount >= 0 &&
+            crit->OwningThread != ULongToHandle(GetCurrentThreadId()) && spin_adaptive( crit ))
+            goto spun;
+    }
+    else
     {
         ULONG count;
 
@@ -540,7 +721,7 @@ NTSTATUS WINAPI RtlEnterCriticalSection( RTL_CRITICAL_SECTION *crit )
             if (crit->LockCount > 0) break;  /* more than one waiter, don't bother spinning */
             if (crit->LockCount == -1)       /* try again */
             {
-                if (interlocked_cmpxchg( &crit->LockCount, 0, -1 ) == -1) goto done;
+                if (interlocked_cmpxchg( &crit->LockCount, 0, -1 ) == -1) goto spun;
             }
             small_pause();
         }
@@ -557,7 +738,12 @@ NTSTATUS WINAPI RtlEnterCriticalSection( RTL_CRITICAL_SECTION *crit )
         /* Now wait for it */
         RtlpWaitForCriticalSection( crit );
     }
-done:
+    crit->OwningThread   = ULongToHandle(GetCurrentThreadId());
+    crit->RecursionCount = 1;
+    return STATUS_SUCCESS;
+
+spun:
+    if (lock_profile_file) profile_spin( crit );
     crit->OwningThread   = ULongToHandle(GetCurrentThreadId());
     crit->RecursionCount = 1;
     return STATUS_SUCCESS;
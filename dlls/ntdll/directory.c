@@ -177,6 +177,46 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
 };
 static RTL_CRITICAL_SECTION dir_section = { &critsect_debug, -1, 0, 0, 0, 0 };
 
+/* cache of the names of large directories, for case-insensitive lookups */
+
+struct dir_cache_name
+{
+    struct dir_cache_name *next;       /* next name in the same hash bucket */
+    BOOL                   is_short;   /* generated 8.3 name of a long name */
+    int                    length;     /* length of the Unicode name */
+    const char            *unix_name;  /* name of the Unix file */
+    WCHAR                  name[1];    /* Unicode name, followed by the Unix name for long names */
+};
+
+struct dir_cache
+{
+    struct list             entry;      /* entry in the list of cached directories, most recent first */
+    dev_t                   dev;        /* device of the directory */
+    ino_t                   ino;        /* inode of the directory */
+    time_t                  mtime;      /* modification time of the directory when it was read */
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    long                    mtime_nsec;
+#endif
+    unsigned int            count;      /* number of names */
+    unsigned int            hash_size;  /* size of the hash table */
+    struct dir_cache_name **hash_table; /* hash table of the names */
+};
+
+#define DIR_CACHE_MIN_NAMES 64  /* min. number of names to keep a directory in the cache */
+#define DIR_CACHE_MAX_DIRS  16  /* max. number of cached directories */
+
+static struct list dir_cache_list = LIST_INIT( dir_cache_list );
+static unsigned int dir_cache_count;
+
+static RTL_CRITICAL_SECTION dir_cache_section;
+static RTL_CRITICAL_SECTION_DEBUG dir_cache_critsect_debug =
+{
+    0, 0, &dir_cache_section,
+    { &dir_cache_critsect_debug.ProcessLocksList, &dir_cache_critsect_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": dir_cache_section") }
+};
+static RTL_CRITICAL_SECTION dir_cache_section = { &dir_cache_critsect_debug, -1, 0, 0, 0, 0 };
+
 
 /* check if a given Unicode char is OK in a DOS short name */
 static inline BOOL is_invalid_dos_char( WCHAR ch )
@@ -2092,6 +2132,328 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
 }
 
 
+/***********************************************************************
+ *           hash_dir_cache_name
+ */
+static unsigned int hash_dir_cache_name( const WCHAR *name, int length )
+{
+    unsigned int hash = 0;
+
+    while (length--) hash = hash * 31 + tolowerW( *name++ );
+    return hash;
+}
+
+
+/***********************************************************************
+ *           free_dir_cache
+ */
+static void free_dir_cache( struct dir_cache *cache )
+{
+    struct dir_cache_name *entry, *next;
+    unsigned int i;
+
+    for (i = 0; i < cache->hash_size; i++)
+    {
+        for (entry = cache->hash_table[i]; entry; entry = next)
+        {
+            next = entry->next;
+            RtlFreeHeap( GetProcessHeap(), 0, entry );
+        }
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, cache->hash_table );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+}
+
+
+/***********************************************************************
+ *           is_dir_cache_valid
+ *
+ * Check if a cached directory is the one described by st and hasn't changed.
+ */
+static BOOL is_dir_cache_valid( const struct dir_cache *cache, const struct stat *st )
+{
+    if (cache->dev != st->st_dev || cache->ino != st->st_ino) return FALSE;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    if (cache->mtime_nsec != st->st_mtim.tv_nsec) return FALSE;
+#endif
+    return cache->mtime == st->st_mtime;
+}
+
+
+/***********************************************************************
+ *           read_dir_cache
+ *
+ * Read all the names of a directory, including the generated 8.3 names.
+ */
+static NTSTATUS read_dir_cache( const char *unix_name, const struct stat *st, struct dir_cache **ret )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dir_cache_name *entry, *short_entry, *list = NULL;
+    struct dir_cache *cache;
+    UNICODE_STRING str;
+    BOOLEAN spaces;
+    struct dirent *de;
+    DIR *dir;
+    unsigned int hash;
+    int len, unix_len;
+
+    if (!(dir = opendir( unix_name )))
+    {
+        if (errno == ENOENT) return STATUS_OBJECT_PATH_NOT_FOUND;
+        else return FILE_GetNtStatus();
+    }
+    if (!(cache = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*cache) )))
+    {
+        closedir( dir );
+        return STATUS_NO_MEMORY;
+    }
+    cache->dev   = st->st_dev;
+    cache->ino   = st->st_ino;
+    cache->mtime = st->st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    cache->mtime_nsec = st->st_mtim.tv_nsec;
+#endif
+
+    str.Buffer = buffer;
+    str.MaximumLength = sizeof(buffer);
+    while ((de = readdir( dir )))
+    {
+        len = ntdll_umbstowcs( 0, de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
+        if (len <= 0) continue;
+        unix_len = strlen( de->d_name ) + 1;
+        if (!(entry = RtlAllocateHeap( GetProcessHeap(), 0,
+                                       FIELD_OFFSET( struct dir_cache_name, name[len] ) + unix_len )))
+            goto failed;
+        entry->is_short  = FALSE;
+        entry->length    = len;
+        entry->unix_name = (char *)&entry->name[len];
+        memcpy( entry->name, buffer, len * sizeof(WCHAR) );
+        memcpy( (char *)&entry->name[len], de->d_name, unix_len );
+        entry->next = list;
+        list = entry;
+        cache->count++;
+
+        str.Length = len * sizeof(WCHAR);
+        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
+        {
+            WCHAR short_nameW[12];
+
+            len = hash_short_file_name( &str, short_nameW );
+            if (!(short_entry = RtlAllocateHeap( GetProcessHeap(), 0,
+                                                 FIELD_OFFSET( struct dir_cache_name, name[len] ))))
+                goto failed;
+            short_entry->is_short  = TRUE;
+            short_entry->length    = len;
+            short_entry->unix_name = entry->unix_name;
+            memcpy( short_entry->name, short_nameW, len * sizeof(WCHAR) );
+            short_entry->next = list;
+            list = short_entry;
+            cache->count++;
+        }
+    }
+    closedir( dir );
+    dir = NULL;
+
+    cache->hash_size = cache->count | 1;
+    if (!(cache->hash_table = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                               cache->hash_size * sizeof(*cache->hash_table) )))
+        goto failed;
+    while ((entry = list))
+    {
+        list = entry->next;
+        hash = hash_dir_cache_name( entry->name, entry->length ) % cache->hash_size;
+        entry->next = cache->hash_table[hash];
+        cache->hash_table[hash] = entry;
+    }
+    *ret = cache;
+    return STATUS_SUCCESS;
+
+failed:
+    if (dir) closedir( dir );
+    while ((entry = list))
+    {
+        list = entry->next;
+        RtlFreeHeap( GetProcessHeap(), 0, entry );
+    }
+    cache->hash_size = 0;
+    free_dir_cache( cache );
+    return STATUS_NO_MEMORY;
+}
+
+
+/***********************************************************************
+ *           lookup_dir_cache
+ *
+ * Find a name in a cached directory; 8.3 names are only matched if short_names is set.
+ */
+static const char *lookup_dir_cache( const struct dir_cache *cache, const WCHAR *name, int length,
+                                     BOOLEAN short_names )
+{
+    const struct dir_cache_name *entry;
+    const char *ret = NULL;
+
+    entry = cache->hash_table[hash_dir_cache_name( name, length ) % cache->hash_size];
+    for ( ; entry; entry = entry->next)
+    {
+        if (entry->length != length || memicmpW( entry->name, name, length )) continue;
+        if (!entry->is_short) return entry->unix_name;
+        if (short_names && !ret) ret = entry->unix_name;
+    }
+    return ret;
+}
+
+
+/***********************************************************************
+ *           scan_dir_for_file
+ *
+ * Look for a file by reading the directory, stopping at the first match.
+ * Gives up with STATUS_MORE_ENTRIES once max_names names have been checked.
+ * The file found is appended to unix_name at pos.
+ */
+static NTSTATUS scan_dir_for_file( char *unix_name, int pos, const WCHAR *name, int length,
+                                   BOOLEAN short_names, unsigned int max_names )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    UNICODE_STRING str;
+    BOOLEAN spaces;
+    unsigned int count = 0;
+    struct dirent *de;
+    DIR *dir;
+    int ret;
+
+    if (!(dir = opendir( unix_name )))
+    {
+        if (errno == ENOENT) return STATUS_OBJECT_PATH_NOT_FOUND;
+        else return FILE_GetNtStatus();
+    }
+    str.Buffer = buffer;
+    str.MaximumLength = sizeof(buffer);
+    while ((de = readdir( dir )))
+    {
+        if (count++ == max_names)
+        {
+            closedir( dir );
+            return STATUS_MORE_ENTRIES;
+        }
+
+        ret = ntdll_umbstowcs( 0, de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
+        if (ret == length && !memicmpW( buffer, name, length )) goto found;
+
+        if (!short_names) continue;
+
+        str.Length = ret * sizeof(WCHAR);
+        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
+        {
+            WCHAR short_nameW[12];
+            ret = hash_short_file_name( &str, short_nameW );
+            if (ret == length && !memicmpW( short_nameW, name, length )) goto found;
+        }
+    }
+    closedir( dir );
+    return STATUS_OBJECT_PATH_NOT_FOUND;
+
+found:
+    unix_name[pos - 1] = '/';
+    strcpy( unix_name + pos, de->d_name );
+    closedir( dir );
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *           find_file_in_dir_cache
+ *
+ * Look for a file in the cache of large directories, reading the directory
+ * if it isn't cached yet. The file found is appended to unix_name at pos.
+ */
+static NTSTATUS find_file_in_dir_cache( char *unix_name, int pos, const WCHAR *name, int length,
+                                        BOOLEAN short_names )
+{
+    struct dir_cache *cache = NULL, *iter;
+    const char *found;
+    struct stat st;
+    NTSTATUS status;
+
+    if (stat( unix_name, &st ) == -1)
+    {
+        if (errno == ENOENT) return STATUS_OBJECT_PATH_NOT_FOUND;
+        else return FILE_GetNtStatus();
+    }
+
+    RtlEnterCriticalSection( &dir_cache_section );
+    LIST_FOR_EACH_ENTRY( iter, &dir_cache_list, struct dir_cache, entry )
+    {
+        if (iter->dev != st.st_dev || iter->ino != st.st_ino) continue;
+        list_remove( &iter->entry );
+        if (is_dir_cache_valid( iter, &st ))
+        {
+            list_add_head( &dir_cache_list, &iter->entry );
+            cache = iter;
+        }
+        else
+        {
+            dir_cache_count--;
+            free_dir_cache( iter );
+        }
+        break;
+    }
+    if (cache)
+    {
+        if ((found = lookup_dir_cache( cache, name, length, short_names )))
+        {
+            unix_name[pos - 1] = '/';
+            strcpy( unix_name + pos, found );
+        }
+        RtlLeaveCriticalSection( &dir_cache_section );
+        return found ? STATUS_SUCCESS : STATUS_OBJECT_PATH_NOT_FOUND;
+    }
+    RtlLeaveCriticalSection( &dir_cache_section );
+
+    /* only build the cache for large directories, and not if they changed too
+     * recently for a later change to be detected with the modification time */
+    status = scan_dir_for_file( unix_name, pos, name, length, short_names,
+                                st.st_mtime < time( NULL ) ? DIR_CACHE_MIN_NAMES : ~0u );
+    if (status != STATUS_MORE_ENTRIES) return status;
+
+    if ((status = read_dir_cache( unix_name, &st, &cache ))) return status;
+
+    if ((found = lookup_dir_cache( cache, name, length, short_names )))
+    {
+        unix_name[pos - 1] = '/';
+        strcpy( unix_name + pos, found );
+    }
+
+    /* the directory may have shrunk since it was scanned */
+    if (cache->count < DIR_CACHE_MIN_NAMES)
+    {
+        free_dir_cache( cache );
+        return found ? STATUS_SUCCESS : STATUS_OBJECT_PATH_NOT_FOUND;
+    }
+
+    RtlEnterCriticalSection( &dir_cache_section );
+    LIST_FOR_EACH_ENTRY( iter, &dir_cache_list, struct dir_cache, entry )
+    {
+        if (iter->dev != st.st_dev || iter->ino != st.st_ino) continue;
+        /* cached by another thread in the meantime */
+        list_remove( &iter->entry );
+        dir_cache_count--;
+        free_dir_cache( iter );
+        break;
+    }
+    if (dir_cache_count == DIR_CACHE_MAX_DIRS)
+    {
+        iter = LIST_ENTRY( list_tail( &dir_cache_list ), struct dir_cache, entry );
+        list_remove( &iter->entry );
+        dir_cache_count--;
+        free_dir_cache( iter );
+    }
+    list_add_head( &dir_cache_list, &cache->entry );
+    dir_cache_count++;
+    RtlLeaveCriticalSection( &dir_cache_section );
+    return found ? STATUS_SUCCESS : STATUS_OBJECT_PATH_NOT_FOUND;
+}
+
+
 /***********************************************************************
  *           find_file_in_dir
  *
@@ -2102,11 +2464,9 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
 static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, int length,
                                   BOOLEAN check_case, BOOLEAN *is_win_dir )
 {
-    WCHAR buffer[MAX_DIR_ENTRY_LEN];
     UNICODE_STRING str;
     BOOLEAN spaces, is_name_8_dot_3;
-    DIR *dir;
-    struct dirent *de;
+    NTSTATUS status;
     struct stat st;
     int ret, used_default;
 
@@ -2148,6 +2508,7 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
         int fd = open( unix_name, O_RDONLY | O_DIRECTORY );
         if (fd != -1)
         {
+            WCHAR buffer[MAX_DIR_ENTRY_LEN];
             KERNEL_DIRENT *kde;
 
             RtlEnterCriticalSection( &dir_section );
@@ -2199,40 +2560,12 @@ static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, i
     }
 #endif /* VFAT_IOCTL_READDIR_BOTH */
 
-    if (!(dir = opendir( unix_name )))
+    if ((status = find_file_in_dir_cache( unix_name, pos, name, length, is_name_8_dot_3 )))
     {
-        if (errno == ENOENT) return STATUS_OBJECT_PATH_NOT_FOUND;
-        else return FILE_GetNtStatus();
+        if (status == STATUS_OBJECT_PATH_NOT_FOUND) goto not_found;
+        return status;
     }
-    unix_name[pos - 1] = '/';
-    str.Buffer = buffer;
-    str.MaximumLength = sizeof(buffer);
-    while ((de = readdir( dir )))
-    {
-        ret = ntdll_umbstowcs( 0, de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
-        if (ret == length && !memicmpW( buffer, name, length ))
-        {
-            strcpy( unix_name + pos, de->d_name );
-            closedir( dir );
-            goto success;
-        }
-
-        if (!is_name_8_dot_3) continue;
-
-        str.Length = ret * sizeof(WCHAR);
-        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
-        {
-            WCHAR short_nameW[12];
-            ret = hash_short_file_name( &str, short_nameW );
-            if (ret == length && !memicmpW( short_nameW, name, length ))
-            {
-                strcpy( unix_name + pos, de->d_name );
-                closedir( dir );
-                goto success;
-            }
-        }
-    }
-    closedir( dir );
+    goto success;
 
 not_found:
     unix_name[pos - 1] = 0;
@@ -42,6 +42,9 @@
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #endif
@@ -426,6 +429,209 @@ static NTSTATUS FILE_AsyncReadService(void *user, PIO_STATUS_BLOCK iosb, NTSTATU
     return status;
 }
 
+/***********************************************************************
+ *                  Offloaded reads of regular files
+ *
+ * Overlapped reads of regular files are done inline when the data is in
+ * the page cache. Otherwise the read is handed to a worker thread, so that
+ * the caller isn't stalled by the disk, and the worker completes the I/O
+ * status block, the event and the completion port.
+ */
+
+struct offload_read
+{
+    int              fd;        /* private copy of the unix fd */
+    HANDLE           handle;    /* private copy of the file handle, for the completion port */
+    HANDLE           event;     /* private copy of the event handle */
+    IO_STATUS_BLOCK *iosb;
+    char            *buffer;    /* destination buffer, NULL for a scatter read */
+    ULONG            already;   /* bytes already read */
+    ULONG            count;     /* total bytes to read */
+    ULONGLONG        offset;    /* file offset of the start of the read */
+    ULONG_PTR        cvalue;    /* completion port value */
+    FILE_SEGMENT_ELEMENT segments[1];  /* destination pages for a scatter read */
+};
+
+/* max number of pages transferred by a single preadv/pwritev call */
+#define MAX_SEGMENT_IOV 256
+
+#if defined(HAVE_PREADV) || defined(HAVE_PWRITEV)
+/* fill an iovec array with the part of the segment pages that remains to be transferred */
+static int get_segments_iov( struct iovec *iov, const FILE_SEGMENT_ELEMENT *segments,
+                             ULONG done, ULONG length )
+{
+    const FILE_SEGMENT_ELEMENT *segment = segments + done / page_size;
+    ULONG pos = done % page_size;
+    int count = 0;
+
+    while (length && count < MAX_SEGMENT_IOV)
+    {
+        iov[count].iov_base = (char *)segment->Buffer + pos;
+        iov[count].iov_len  = min( page_size - pos, length );
+        length -= iov[count].iov_len;
+        pos = 0;
+        segment++;
+        count++;
+    }
+    return count;
+}
+#endif
+
+#if defined(__linux__) && defined(__NR_preadv2) && defined(HAVE_PREADV)
+
+#define HAVE_PREADV_NOWAIT
+
+#ifndef RWF_NOWAIT
+#define RWF_NOWAIT 0x00000008
+#endif
+
+static BOOL use_rwf_nowait = TRUE;
+
+/* read from a regular file, failing with EAGAIN if the data is not cached */
+static ssize_t preadv_nowait( int fd, const struct iovec *iov, int count, off_t offset )
+{
+    ssize_t ret;
+
+    if (use_rwf_nowait)
+    {
+        ret = syscall( __NR_preadv2, fd, iov, count, (unsigned long)offset,
+                       (unsigned long)((ULONGLONG)offset >> 32), RWF_NOWAIT );
+        if (ret != -1 || (errno != ENOSYS && errno != EOPNOTSUPP && errno != EINVAL)) return ret;
+        TRACE( "RWF_NOWAIT not supported, reads won't be offloaded\n" );
+        use_rwf_nowait = FALSE;
+    }
+    return preadv( fd, iov, count, offset );
+}
+
+static ssize_t pread_nowait( int fd, void *buffer, size_t count, off_t offset )
+{
+    struct iovec iov;
+
+    iov.iov_base = buffer;
+    iov.iov_len  = count;
+    return preadv_nowait( fd, &iov, 1, offset );
+}
+
+#else
+
+static inline ssize_t pread_nowait( int fd, void *buffer, size_t count, off_t offset )
+{
+    return pread( fd, buffer, count, offset );
+}
+
+#endif
+
+static DWORD CALLBACK offload_read_proc( void *arg )
+{
+    struct offload_read *read_op = arg;
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG total = read_op->already;
+    ssize_t result;
+
+    while (total < read_op->count)
+    {
+#ifdef HAVE_PREADV
+        if (!read_op->buffer)
+        {
+            struct iovec iov[MAX_SEGMENT_IOV];
+            int count = get_segments_iov( iov, read_op->segments, total, read_op->count - total );
+            result = preadv( read_op->fd, iov, count, read_op->offset + total );
+        }
+        else
+#endif
+        result = pread( read_op->fd, read_op->buffer + total, read_op->count - total,
+                        read_op->offset + total );
+        if (result > 0)
+        {
+            total += result;
+            continue;
+        }
+        if (result == -1)
+        {
+            if (errno == EINTR) continue;
+            if (!total) status = FILE_GetNtStatus();
+        }
+        break;
+    }
+    /* scatter reads fail if the whole length can't be read */
+    if (!status && total < read_op->count && (!total || !read_op->buffer)) status = STATUS_END_OF_FILE;
+    close( read_op->fd );
+
+    TRACE( "%p: read %u bytes at %s, status %08x\n", read_op, total,
+           wine_dbgstr_longlong(read_op->offset), status );
+
+    read_op->iosb->Information = total;
+    interlocked_xchg( (int *)&read_op->iosb->u.Status, status );
+    NtSetEvent( read_op->event, NULL );
+    NtClose( read_op->event );
+    if (read_op->cvalue)
+    {
+        NTDLL_AddCompletion( read_op->handle, read_op->cvalue, status, total );
+        NtClose( read_op->handle );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, read_op );
+    return 0;
+}
+
+/* queue the rest of a read to a worker thread; returns STATUS_PENDING on success */
+static NTSTATUS offload_read( HANDLE handle, int fd, HANDLE event, IO_STATUS_BLOCK *iosb, char *buffer,
+                              const FILE_SEGMENT_ELEMENT *segments, ULONG already, ULONG count,
+                              ULONGLONG offset, ULONG_PTR cvalue )
+{
+    struct offload_read *read_op;
+    ULONG nb_segments = buffer ? 0 : count / page_size;
+    NTSTATUS status;
+
+    if (!(read_op = RtlAllocateHeap( GetProcessHeap(), 0,
+                                     offsetof( struct offload_read, segments[nb_segments] ))))
+        return STATUS_NO_MEMORY;
+    if ((read_op->fd = dup( fd )) == -1)
+    {
+        status = FILE_GetNtStatus();
+        goto failed;
+    }
+    if ((status = NtDuplicateObject( NtCurrentProcess(), event, NtCurrentProcess(), &read_op->event,
+                                     0, 0, DUPLICATE_SAME_ACCESS )))
+    {
+        close( read_op->fd );
+        goto failed;
+    }
+    /* the application may close its handles before the read completes */
+    read_op->handle = 0;
+    if (cvalue && (status = NtDuplicateObject( NtCurrentProcess(), handle, NtCurrentProcess(),
+                                               &read_op->handle, 0, 0, DUPLICATE_SAME_ACCESS )))
+    {
+        NtClose( read_op->event );
+        close( read_op->fd );
+        goto failed;
+    }
+    read_op->iosb    = iosb;
+    read_op->buffer  = buffer;
+    read_op->already = already;
+    read_op->count   = count;
+    read_op->offset  = offset;
+    read_op->cvalue  = cvalue;
+    /* the segment array doesn't need to remain valid once the call returns */
+    if (segments) memcpy( read_op->segments, segments, nb_segments * sizeof(*segments) );
+
+    NtResetEvent( event, NULL );
+    iosb->u.Status = STATUS_PENDING;
+    iosb->Information = 0;
+    /* the worker blocks on the disk, don't let it hold up short work items */
+    if ((status = RtlQueueWorkItem( offload_read_proc, read_op, WT_EXECUTELONGFUNCTION )))
+    {
+        if (read_op->handle) NtClose( read_op->handle );
+        NtClose( read_op->event );
+        close( read_op->fd );
+        goto failed;
+    }
+    return STATUS_PENDING;
+
+failed:
+    RtlFreeHeap( GetProcessHeap(), 0, read_op );
+    return status;
+}
+
 struct io_timeouts
 {
     int interval;   /* max interval between two bytes */
@@ -622,6 +828,59 @@ NTSTATUS WINAPI NtReadFile(HANDLE hFile, HANDLE hEvent,
 
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
         {
+            if (async_read && hEvent && !apc)
+            {
+                struct stat st;
+
+                /* unbuffered reads are expected to go to the disk, don't look at the cache first */
+                if ((options & FILE_NO_INTERMEDIATE_BUFFERING) && length &&
+                    !fstat( unix_handle, &st ) && offset->QuadPart < st.st_size)
+                {
+                    status = offload_read( hFile, unix_handle, hEvent, io_status, buffer, NULL,
+                                           0, length, offset->QuadPart, cvalue );
+                    if (status == STATUS_PENDING) goto err;
+                    WARN( "failed to offload read, status %08x\n", status );
+                }
+
+                /* read what is cached, and let a worker thread wait for the disk */
+                while (total < length)
+                {
+                    result = pread_nowait( unix_handle, (char *)buffer + total, length - total,
+                                           offset->QuadPart + total );
+                    if (result > 0)
+                    {
+                        total += result;
+                        continue;
+                    }
+                    if (!result) break;
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN)
+                    {
+                        status = offload_read( hFile, unix_handle, hEvent, io_status, buffer, NULL,
+                                               total, length, offset->QuadPart, cvalue );
+                        if (status == STATUS_PENDING) goto err;
+                        WARN( "failed to offload read, status %08x\n", status );
+                        /* fall back to a blocking read */
+                        while ((result = pread( unix_handle, (char *)buffer + total, length - total,
+                                                offset->QuadPart + total )) == -1 && errno == EINTR) ;
+                        if (result > 0)
+                        {
+                            total += result;
+                            continue;
+                        }
+                        if (!result) break;
+                    }
+                    if (!total)
+                    {
+                        status = FILE_GetNtStatus();
+                        goto done;
+                    }
+                    break;
+                }
+                status = (total || !length) ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+                goto done;
+            }
+
             /* async I/O doesn't make sense on regular files */
             while ((result = pread( unix_handle, buffer, length, offset->QuadPart )) == -1)
             {
@@ -797,10 +1056,16 @@ NTSTATUS WINAPI NtReadFileScatter( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
     int result, unix_handle, needs_close;
     unsigned int options;
     NTSTATUS status;
-    ULONG pos = 0, total = 0;
+    ULONG total = 0;
     enum server_fd_type type;
     ULONG_PTR cvalue = apc ? 0 : (ULONG_PTR)apc_user;
     BOOL send_completion = FALSE;
+#ifdef HAVE_PREADV
+    struct iovec iov[MAX_SEGMENT_IOV];
+    int count;
+#else
+    ULONG pos = 0;
+#endif
 
     TRACE( "(%p,%p,%p,%p,%p,%p,0x%08x,%p,%p),partial stub!\n",
            file, event, apc, apc_user, io_status, segments, length, offset, key);
@@ -820,13 +1085,41 @@ NTSTATUS WINAPI NtReadFileScatter( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
         goto error;
     }
 
-    while (length)
+    while (total < length)
     {
+#ifdef HAVE_PREADV
+        /* transfer as many pages as possible with each call */
+        count = get_segments_iov( iov, segments, total, length - total );
+        if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
+        {
+#ifdef HAVE_PREADV_NOWAIT
+            if (event && !apc)
+            {
+                /* let a worker thread wait for the disk if the data isn't cached */
+                result = preadv_nowait( unix_handle, iov, count, offset->QuadPart + total );
+                if (result == -1 && errno == EAGAIN)
+                {
+                    status = offload_read( file, unix_handle, event, io_status, NULL, segments,
+                                           total, length, offset->QuadPart, cvalue );
+                    if (status == STATUS_PENDING) goto error;
+                    WARN( "failed to offload read, status %08x\n", status );
+                    status = STATUS_SUCCESS;
+                    result = preadv( unix_handle, iov, count, offset->QuadPart + total );
+                }
+            }
+            else
+#endif
+            result = preadv( unix_handle, iov, count, offset->QuadPart + total );
+        }
+        else
+            result = readv( unix_handle, iov, count );
+#else
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
             result = pread( unix_handle, (char *)segments->Buffer + pos,
                             page_size - pos, offset->QuadPart + total );
         else
             result = read( unix_handle, (char *)segments->Buffer + pos, page_size - pos );
+#endif
 
         if (result == -1)
         {
@@ -840,12 +1133,13 @@ NTSTATUS WINAPI NtReadFileScatter( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
             break;
         }
         total += result;
-        length -= result;
+#ifndef HAVE_PREADV
         if ((pos += result) == page_size)
         {
             pos = 0;
             segments++;
         }
+#endif
     }
 
     send_completion = cvalue != 0;
@@ -1199,10 +1493,16 @@ NTSTATUS WINAPI NtWriteFileGather( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
     int result, unix_handle, needs_close;
     unsigned int options;
     NTSTATUS status;
-    ULONG pos = 0, total = 0;
+    ULONG total = 0;
     enum server_fd_type type;
     ULONG_PTR cvalue = apc ? 0 : (ULONG_PTR)apc_user;
     BOOL send_completion = FALSE;
+#ifdef HAVE_PWRITEV
+    struct iovec iov[MAX_SEGMENT_IOV];
+    int count;
+#else
+    ULONG pos = 0;
+#endif
 
     TRACE( "(%p,%p,%p,%p,%p,%p,0x%08x,%p,%p),partial stub!\n",
            file, event, apc, apc_user, io_status, segments, length, offset, key);
@@ -1222,13 +1522,22 @@ NTSTATUS WINAPI NtWriteFileGather( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
         goto error;
     }
 
-    while (length)
+    while (total < length)
     {
+#ifdef HAVE_PWRITEV
+        /* transfer as many pages as possible with each call */
+        count = get_segments_iov( iov, segments, total, length - total );
+        if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
+            result = pwritev( unix_handle, iov, count, offset->QuadPart + total );
+        else
+            result = writev( unix_handle, iov, count );
+#else
         if (offset && offset->QuadPart != FILE_USE_FILE_POINTER_POSITION)
             result = pwrite( unix_handle, (char *)segments->Buffer + pos,
                              page_size - pos, offset->QuadPart + total );
         else
             result = write( unix_handle, (char *)segments->Buffer + pos, page_size - pos );
+#endif
 
         if (result == -1)
         {
@@ -1247,12 +1556,13 @@ NTSTATUS WINAPI NtWriteFileGather( HANDLE file, HANDLE event, PIO_APC_ROUTINE ap
             break;
         }
         total += result;
-        length -= result;
+#ifndef HAVE_PWRITEV
         if ((pos += result) == page_size)
         {
             pos = 0;
             segments++;
         }
+#endif
     }
 
     send_completion = cvalue != 0;
@@ -3057,6 +3367,20 @@ NTSTATUS WINAPI NtDeleteFile( POBJECT_ATTRIBUTES ObjectAttributes )
     return status;
 }
 
+typedef BOOL (CDECL *wine_cancel_io_handler)( HANDLE handle, IO_STATUS_BLOCK *iosb, BOOL only_thread );
+static wine_cancel_io_handler cancel_io_handler;
+
+/******************************************************************
+ *		__wine_set_cancel_io_handler    (NTDLL.@)
+ *
+ * Set a handler cancelling the requests that a dll services without the
+ * server. It returns TRUE if it cancelled some requests.
+ */
+void CDECL __wine_set_cancel_io_handler( wine_cancel_io_handler handler )
+{
+    cancel_io_handler = handler;
+}
+
 /******************************************************************
  *		NtCancelIoFileEx    (NTDLL.@)
  *
@@ -3065,9 +3389,12 @@ NTSTATUS WINAPI NtDeleteFile( POBJECT_ATTRIBUTES ObjectAttributes )
 NTSTATUS WINAPI NtCancelIoFileEx( HANDLE hFile, PIO_STATUS_BLOCK iosb, PIO_STATUS_BLOCK io_status )
 {
     LARGE_INTEGER timeout;
+    BOOL cancelled;
 
     TRACE("%p %p %p\n", hFile, iosb, io_status );
 
+    cancelled = cancel_io_handler && cancel_io_handler( hFile, iosb, FALSE );
+
     SERVER_START_REQ( cancel_async )
     {
         req->handle      = wine_server_obj_handle( hFile );
@@ -3076,6 +3403,8 @@ NTSTATUS WINAPI NtCancelIoFileEx( HANDLE hFile, PIO_STATUS_BLOCK iosb, PIO_STATU
         io_status->u.Status = wine_server_call( req );
     }
     SERVER_END_REQ;
+    if (io_status->u.Status == STATUS_NOT_FOUND && cancelled)
+        io_status->u.Status = STATUS_SUCCESS;
     if (io_status->u.Status)
         return io_status->u.Status;
 
@@ -3097,9 +3426,12 @@ NTSTATUS WINAPI NtCancelIoFileEx( HANDLE hFile, PIO_STATUS_BLOCK iosb, PIO_STATU
 NTSTATUS WINAPI NtCancelIoFile( HANDLE hFile, PIO_STATUS_BLOCK io_status )
 {
     LARGE_INTEGER timeout;
+    BOOL cancelled;
 
     TRACE("%p %p\n", hFile, io_status );
 
+    cancelled = cancel_io_handler && cancel_io_handler( hFile, NULL, TRUE );
+
     SERVER_START_REQ( cancel_async )
     {
         req->handle      = wine_server_obj_handle( hFile );
@@ -3108,6 +3440,8 @@ NTSTATUS WINAPI NtCancelIoFile( HANDLE hFile, PIO_STATUS_BLOCK io_status )
         io_status->u.Status = wine_server_call( req );
     }
     SERVER_END_REQ;
+    if (io_status->u.Status == STATUS_NOT_FOUND && cancelled)
+        io_status->u.Status = STATUS_SUCCESS;
     if (io_status->u.Status)
         return io_status->u.Status;
 
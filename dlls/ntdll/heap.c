@@ -84,6 +84,7 @@ typedef struct
 /* Value for arena 'magic' field */
 #define ARENA_INUSE_MAGIC      0x455355
 #define ARENA_PENDING_MAGIC    0xbedead
+#define ARENA_LFH_MAGIC        0x48464c
 #define ARENA_FREE_MAGIC       0x45455246
 #define ARENA_LARGE_MAGIC      0x6752614c
 
@@ -121,6 +122,14 @@ static const SIZE_T HEAP_freeListSizes[] =
 };
 #define HEAP_NB_FREE_LISTS  (sizeof(HEAP_freeListSizes)/sizeof(HEAP_freeListSizes[0]))
 
+/* Low-fragmentation front end: freed small blocks are cached on lock-free
+ * per-size lists and handed out again without entering the heap lock.
+ * Once it is enabled, sub-heaps are no longer released when they become
+ * empty, so that the front end can look them up without the lock. */
+#define HEAP_LFH_MAX_SIZE   0x400   /* max block size handled by the front end */
+#define HEAP_LFH_NB_LISTS   (HEAP_LFH_MAX_SIZE / ALIGNMENT + 1)
+#define HEAP_LFH_MAX_DEPTH  256     /* max number of cached blocks per size */
+
 typedef union
 {
     ARENA_FREE  arena;
@@ -159,6 +168,7 @@ typedef struct tagHEAP
     ARENA_INUSE    **pending_free;  /* Ring buffer for pending free requests */
     RTL_CRITICAL_SECTION critSection; /* Critical section for serialization */
     FREE_LIST_ENTRY *freeList;      /* Free lists */
+    SLIST_HEADER    *lfh_lists;     /* Low-fragmentation front end lists, if enabled */
 } HEAP;
 
 #define HEAP_MAGIC       ((DWORD)('H' | ('E'<<8) | ('A'<<16) | ('P'<<24)))
@@ -505,6 +515,111 @@ static SUBHEAP *HEAP_FindSubHeap(
 }
 
 
+/***********************************************************************
+ *           get_lfh_index
+ *
+ * Index of the front end list for a given block size. Block sizes always
+ * differ by a multiple of ALIGNMENT, so each list holds a single size.
+ */
+static inline unsigned int get_lfh_index( SIZE_T size )
+{
+    return (size - ARENA_OFFSET) / ALIGNMENT;
+}
+
+
+/***********************************************************************
+ *           lfh_alloc_block
+ *
+ * Take a cached block from the low-fragmentation front end. No locking needed.
+ */
+static ARENA_INUSE *lfh_alloc_block( HEAP *heap, SIZE_T rounded_size )
+{
+    SLIST_ENTRY *entry;
+    ARENA_INUSE *arena;
+
+    if (rounded_size > HEAP_LFH_MAX_SIZE) return NULL;
+    if (!(entry = RtlInterlockedPopEntrySList( &heap->lfh_lists[get_lfh_index( rounded_size )] )))
+        return NULL;
+    arena = (ARENA_INUSE *)entry - 1;
+    arena->magic = ARENA_INUSE_MAGIC;
+    return arena;
+}
+
+
+/***********************************************************************
+ *           lfh_free_block
+ *
+ * Cache a freed block in the low-fragmentation front end, without the heap
+ * lock. Cached blocks remain in use for the back end; they get their own
+ * magic since their first bytes hold the list entry, and the validation
+ * code skips their contents. Blocks that don't pass the checks are left to
+ * the back end, which reports the error.
+ */
+static BOOL lfh_free_block( HEAP *heap, ARENA_INUSE *arena )
+{
+    const SUBHEAP *subheap;
+    SLIST_HEADER *list;
+    ARENA_INUSE old, new;
+    DWORD size;
+
+    if ((ULONG_PTR)arena % ALIGNMENT != ARENA_OFFSET) return FALSE;
+    if (!(subheap = HEAP_FindSubHeap( heap, arena ))) return FALSE;
+    if ((const char *)arena < (const char *)subheap->base + subheap->headerSize) return FALSE;
+
+    /* only the ARENA_FLAG_PREV_FREE bit of the size can change under us */
+    old = *(volatile ARENA_INUSE *)arena;
+    size = old.size & ARENA_SIZE_MASK;
+    if (old.magic != ARENA_INUSE_MAGIC || (old.size & ARENA_FLAG_FREE)) return FALSE;
+    if (size > HEAP_LFH_MAX_SIZE) return FALSE;
+
+    list = &heap->lfh_lists[get_lfh_index( size )];
+    if (RtlQueryDepthSList( list ) >= HEAP_LFH_MAX_DEPTH) return FALSE;
+
+    /* switch the magic atomically, so that a concurrent double free fails */
+    new = old;
+    new.magic = ARENA_LFH_MAGIC;
+    if (interlocked_cmpxchg( (int *)&arena->size + 1, ((int *)&new)[1], ((int *)&old)[1] ) != ((int *)&old)[1])
+        return FALSE;
+    RtlInterlockedPushEntrySList( list, (SLIST_ENTRY *)(arena + 1) );
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           enable_lfh
+ *
+ * Enable the low-fragmentation front end on a heap.
+ */
+static NTSTATUS enable_lfh( HEAP *heap )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    SLIST_HEADER *lists = NULL;
+    SIZE_T size = HEAP_LFH_NB_LISTS * sizeof(*lists);
+    unsigned int i;
+
+    if (heap->lfh_lists) return STATUS_SUCCESS;
+
+    /* the front end bypasses serialization and all debugging checks */
+    if (heap->flags & (HEAP_NO_SERIALIZE | HEAP_VALIDATE | HEAP_TAIL_CHECKING_ENABLED |
+                       HEAP_FREE_CHECKING_ENABLED | HEAP_PAGE_ALLOCS))
+        return STATUS_UNSUCCESSFUL;
+
+    RtlEnterCriticalSection( &heap->critSection );
+    if (!heap->lfh_lists)
+    {
+        if (!(status = NtAllocateVirtualMemory( NtCurrentProcess(), (void **)&lists, 4, &size,
+                                                MEM_COMMIT, PAGE_READWRITE )))
+        {
+            for (i = 0; i < HEAP_LFH_NB_LISTS; i++) RtlInitializeSListHead( &lists[i] );
+            interlocked_xchg_ptr( (void **)&heap->lfh_lists, lists );
+            TRACE( "heap %p: enabled low-fragmentation front end\n", heap );
+        }
+    }
+    RtlLeaveCriticalSection( &heap->critSection );
+    return status;
+}
+
+
 /***********************************************************************
  *           HEAP_Commit
  *
@@ -661,7 +776,7 @@ static void HEAP_MakeInUseBlockFree( SUBHEAP *subheap, ARENA_INUSE *pArena )
     /* Free the whole sub-heap if it's empty and not the original one */
 
     if (((char *)pFree == (char *)subheap->base + subheap->headerSize) &&
-        (subheap != &subheap->heap->subheap))
+        (subheap != &subheap->heap->subheap) && !subheap->heap->lfh_lists)
     {
         void *addr = subheap->base;
 
@@ -905,7 +1020,11 @@ static SUBHEAP *HEAP_CreateSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         subheap->commitSize = commitSize;
         subheap->magic      = SUBHEAP_MAGIC;
         subheap->headerSize = ROUND_SIZE( sizeof(SUBHEAP) );
-        list_add_head( &heap->subheap_list, &subheap->entry );
+        /* the front end walks the list without the lock, publish the entry last */
+        subheap->entry.next = heap->subheap_list.next;
+        subheap->entry.prev = &heap->subheap_list;
+        heap->subheap_list.next->prev = &subheap->entry;
+        interlocked_xchg_ptr( (void **)&heap->subheap_list.next, &subheap->entry );
     }
     else
     {
@@ -1204,7 +1323,8 @@ static BOOL HEAP_ValidateInUseArena( const SUBHEAP *subheap, const ARENA_INUSE *
     }
 
     /* Check magic number */
-    if (pArena->magic != ARENA_INUSE_MAGIC && pArena->magic != ARENA_PENDING_MAGIC)
+    if (pArena->magic != ARENA_INUSE_MAGIC && pArena->magic != ARENA_PENDING_MAGIC &&
+        pArena->magic != ARENA_LFH_MAGIC)
     {
         if (quiet == NOISY) {
             ERR("Heap %p: invalid in-use arena magic %08x for %p\n", subheap->heap, pArena->magic, pArena );
@@ -1291,6 +1411,10 @@ static BOOL HEAP_ValidateInUseArena( const SUBHEAP *subheap, const ARENA_INUSE *
             ptr++;
         }
     }
+    else if (pArena->magic == ARENA_LFH_MAGIC)
+    {
+        /* cached in the low-fragmentation front end, contents are undefined */
+    }
     else if (flags & HEAP_TAIL_CHECKING_ENABLED)
     {
         const unsigned char *data = (const unsigned char *)(pArena + 1) + size - pArena->unused_bytes;
@@ -1419,7 +1543,7 @@ static BOOL validate_block_pointer( HEAP *heap, SUBHEAP **ret_subheap, const ARE
         ret = HEAP_ValidateInUseArena( subheap, arena, QUIET );
     else if ((ULONG_PTR)arena % ALIGNMENT != ARENA_OFFSET)
         WARN( "Heap %p: unaligned arena pointer %p\n", subheap->heap, arena );
-    else if (arena->magic == ARENA_PENDING_MAGIC)
+    else if (arena->magic == ARENA_PENDING_MAGIC || arena->magic == ARENA_LFH_MAGIC)
         WARN( "Heap %p: block %p used after free\n", subheap->heap, arena + 1 );
     else if (arena->magic != ARENA_INUSE_MAGIC)
         WARN( "Heap %p: invalid in-use arena magic %08x for %p\n", subheap->heap, arena->magic, arena );
@@ -1628,6 +1752,12 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
         addr = heapPtr->pending_free;
         NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
     }
+    if (heapPtr->lfh_lists)
+    {
+        size = 0;
+        addr = heapPtr->lfh_lists;
+        NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+    }
     size = 0;
     addr = heapPtr->subheap.base;
     NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
@@ -1673,6 +1803,15 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
+    if (heapPtr->lfh_lists && (pInUse = lfh_alloc_block( heapPtr, rounded_size )))
+    {
+        pInUse->unused_bytes = (pInUse->size & ARENA_SIZE_MASK) - size;
+        notify_alloc( pInUse + 1, size, flags & HEAP_ZERO_MEMORY );
+        initialize_block( pInUse + 1, size, pInUse->unused_bytes, flags );
+        TRACE("(%p,%08x,%08lx): returning %p\n", heap, flags, size, pInUse + 1 );
+        return pInUse + 1;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     if (rounded_size >= HEAP_MIN_LARGE_BLOCK_SIZE && (flags & HEAP_GROWABLE))
@@ -1756,13 +1895,22 @@ BOOLEAN WINAPI RtlFreeHeap( HANDLE heap, ULONG flags, PVOID ptr )
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
+    pInUse  = (ARENA_INUSE *)ptr - 1;
+
+    /* small blocks are cached by the front end without taking the lock */
+    if (heapPtr->lfh_lists && lfh_free_block( heapPtr, pInUse ))
+    {
+        notify_free( ptr );
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     /* Inform valgrind we are trying to free memory, so it can throw up an error message */
     notify_free( ptr );
 
     /* Some sanity checks */
-    pInUse  = (ARENA_INUSE *)ptr - 1;
     if (!validate_block_pointer( heapPtr, &subheap, pInUse )) goto error;
 
     if (!subheap)
@@ -2123,7 +2271,8 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         }
 
         if (((ARENA_INUSE *)ptr - 1)->magic == ARENA_INUSE_MAGIC ||
-            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC)
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_PENDING_MAGIC ||
+            ((ARENA_INUSE *)ptr - 1)->magic == ARENA_LFH_MAGIC)
         {
             ARENA_INUSE *pArena = (ARENA_INUSE *)ptr - 1;
             ptr += pArena->size & ARENA_SIZE_MASK;
@@ -2171,7 +2320,7 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         entry->lpData = pArena + 1;
         entry->cbData = pArena->size & ARENA_SIZE_MASK;
         entry->cbOverhead = sizeof(ARENA_INUSE);
-        entry->wFlags = (pArena->magic == ARENA_PENDING_MAGIC) ?
+        entry->wFlags = (pArena->magic == ARENA_PENDING_MAGIC || pArena->magic == ARENA_LFH_MAGIC) ?
                         PROCESS_HEAP_UNCOMMITTED_RANGE : PROCESS_HEAP_ENTRY_BUSY;
         /* FIXME: can't handle PROCESS_HEAP_ENTRY_MOVEABLE
         and PROCESS_HEAP_ENTRY_DDESHARE yet */
@@ -2236,6 +2385,8 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
 NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
                                          PVOID info, SIZE_T size_in, PSIZE_T size_out)
 {
+    HEAP *heapPtr;
+
     switch (info_class)
     {
     case HeapCompatibilityInformation:
@@ -2244,7 +2395,48 @@ NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS inf
         if (size_in < sizeof(ULONG))
             return STATUS_BUFFER_TOO_SMALL;
 
-        *(ULONG *)info = 0; /* standard heap */
+        if (!info) return STATUS_ACCESS_VIOLATION;
+
+        heapPtr = HEAP_GetPtr( heap );
+        *(ULONG *)info = (heapPtr && heapPtr->lfh_lists) ? 2 /* low-fragmentation heap */
+                                                          : 0 /* standard heap */;
+        return STATUS_SUCCESS;
+
+    default:
+        FIXME("Unknown heap information class %u\n", info_class);
+        return STATUS_INVALID_INFO_CLASS;
+    }
+}
+
+/***********************************************************************
+ *           RtlSetHeapInformation    (NTDLL.@)
+ */
+NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
+                                       PVOID info, SIZE_T size )
+{
+    HEAP *heapPtr;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG))
+            return STATUS_BUFFER_TOO_SMALL;
+        if (!info) return STATUS_ACCESS_VIOLATION;
+
+        if (!(heapPtr = HEAP_GetPtr( heap ))) return STATUS_INVALID_HANDLE;
+
+        switch (*(ULONG *)info)
+        {
+        case 0:  /* standard heap, the front end cannot be disabled once enabled */
+            return heapPtr->lfh_lists ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+        case 2:  /* low-fragmentation heap */
+            return enable_lfh( heapPtr );
+        default:
+            return STATUS_UNSUCCESSFUL;
+        }
+
+    case HeapEnableTerminationOnCorruption:
+        FIXME("HeapEnableTerminationOnCorruption not supported, ignoring\n");
         return STATUS_SUCCESS;
 
     default:
@@ -73,12 +73,27 @@ static const char * const reason_names[] =
 
 static const WCHAR dllW[] = {'.','d','l','l',0};
 
+/* hash index of the export names of a module */
+struct export_index
+{
+    DWORD mask;              /* size of the table minus one */
+    struct
+    {
+        DWORD hash;          /* hash of the name */
+        DWORD pos;           /* position in AddressOfNames plus one, 0 if empty */
+    } entries[1];
+};
+
+/* modules with fewer names than this are searched with a binary search only */
+#define EXPORT_INDEX_MIN_NAMES 32
+
 /* internal representation of 32bit modules. per process. */
 typedef struct _wine_modref
 {
     LDR_MODULE            ldr;
     int                   nDeps;
     struct _wine_modref **deps;
+    struct export_index  *export_index;
 } WINE_MODREF;
 
 /* info about the current builtin dll load */
@@ -112,6 +127,27 @@ static WINE_MODREF *cached_modref;
 static WINE_MODREF *current_modref;
 static WINE_MODREF *last_failed_modref;
 
+/* snapshot of the module list, used for lookups without the loader_section */
+struct module_index
+{
+    struct module_index *next;      /* next retired snapshot */
+    unsigned int         count;     /* number of modules */
+    unsigned int         mask;      /* size of the name hash table minus one */
+    struct module_range
+    {
+        const char      *base;      /* start of the image */
+        const char      *end;       /* end of the image */
+        WINE_MODREF     *wm;
+        const WCHAR     *name;      /* upper-case copy of the base name, NULL if not attached yet */
+        DWORD            hash;      /* hash of the name */
+    }                   *ranges;    /* sorted by base address */
+    unsigned int        *names;     /* name hash table of range index plus one, 0 if empty */
+};
+
+static struct module_index *module_index;   /* current snapshot */
+static struct module_index *retired_module_index;  /* snapshots that may still be in use */
+static LONG module_index_readers;           /* number of threads reading a snapshot */
+
 static NTSTATUS load_dll( LPCWSTR load_path, LPCWSTR libname, DWORD flags, WINE_MODREF** pwm );
 static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved );
 static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports,
@@ -318,6 +354,161 @@ static inline ULONG_PTR allocate_stub( const char *dll, const char *name ) { ret
 #endif  /* __i386__ */
 
 
+/* hash of an upper-case module name */
+static DWORD hash_module_name( const WCHAR *name )
+{
+    DWORD hash = 0;
+
+    while (*name) hash = hash * 31 + *name++;
+    return hash;
+}
+
+
+/**********************************************************************
+ *	    update_module_index
+ *
+ * Publish a new snapshot of the module list. Snapshots are immutable, and
+ * replaced ones are freed once no thread is reading them anymore.
+ * The loader_section must be locked while calling this function.
+ */
+static void update_module_index(void)
+{
+    PLIST_ENTRY mark, entry;
+    struct module_index *index, *old;
+    unsigned int i, count = 0, size;
+    SIZE_T len = 0;
+    WCHAR *name;
+    char *ptr;
+
+    mark = &NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList;
+    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+    {
+        LDR_MODULE *mod = CONTAINING_RECORD(entry, LDR_MODULE, InMemoryOrderModuleList);
+        count++;
+        if (mod->Flags & LDR_PROCESS_ATTACHED) len += strlenW( mod->BaseDllName.Buffer ) + 1;
+    }
+    for (size = 16; size < 2 * count; size *= 2) ;
+
+    index = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*index) + count * sizeof(index->ranges[0]) +
+                             size * sizeof(index->names[0]) + len * sizeof(WCHAR) );
+    if (index)
+    {
+        ptr = (char *)(index + 1);
+        index->ranges = (struct module_range *)ptr;
+        ptr += count * sizeof(index->ranges[0]);
+        index->names = (unsigned int *)ptr;
+        ptr += size * sizeof(index->names[0]);
+        name = (WCHAR *)ptr;
+        memset( index->names, 0, size * sizeof(index->names[0]) );
+        index->count = count;
+        index->mask = size - 1;
+
+        for (i = 0, entry = mark->Flink; entry != mark; entry = entry->Flink, i++)
+        {
+            LDR_MODULE *mod = CONTAINING_RECORD(entry, LDR_MODULE, InMemoryOrderModuleList);
+            struct module_range *range = &index->ranges[i];
+            unsigned int pos;
+
+            range->base = mod->BaseAddress;
+            range->end  = range->base + mod->SizeOfImage;
+            range->wm   = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
+            range->name = NULL;
+            range->hash = 0;
+            /* only fully initialized modules can be found by name */
+            if (!(mod->Flags & LDR_PROCESS_ATTACHED)) continue;
+
+            strcpyW( name, mod->BaseDllName.Buffer );
+            struprW( name );
+            range->name = name;
+            range->hash = hash_module_name( name );
+            name += strlenW( name ) + 1;
+            for (pos = range->hash & index->mask; index->names[pos]; pos = (pos + 1) & index->mask) ;
+            index->names[pos] = i + 1;
+        }
+    }
+
+    old = interlocked_xchg_ptr( (void **)&module_index, index );
+    if (old)
+    {
+        old->next = retired_module_index;
+        retired_module_index = old;
+    }
+    /* readers that start from now on can only see the new snapshot */
+    if (!module_index_readers)
+    {
+        while ((old = retired_module_index))
+        {
+            retired_module_index = old->next;
+            RtlFreeHeap( GetProcessHeap(), 0, old );
+        }
+    }
+}
+
+
+/**********************************************************************
+ *	    grab_module_index
+ *
+ * Get the current module snapshot; it must be released with release_module_index.
+ */
+static const struct module_index *grab_module_index(void)
+{
+    interlocked_xchg_add( &module_index_readers, 1 );
+    return module_index;
+}
+
+static inline void release_module_index(void)
+{
+    interlocked_xchg_add( &module_index_readers, -1 );
+}
+
+
+/**********************************************************************
+ *	    find_module_range
+ *
+ * Find the module containing a given address in a snapshot.
+ */
+static const struct module_range *find_module_range( const struct module_index *index, const void *addr )
+{
+    int min = 0, max = index->count - 1;
+
+    while (min <= max)
+    {
+        int pos = (min + max) / 2;
+        const struct module_range *range = &index->ranges[pos];
+
+        if ((const char *)addr < range->base) max = pos - 1;
+        else if ((const char *)addr >= range->end) min = pos + 1;
+        else return range;
+    }
+    return NULL;
+}
+
+
+/**********************************************************************
+ *	    find_module_name
+ *
+ * Find an initialized module by base name in a snapshot.
+ */
+static const struct module_range *find_module_name( const struct module_index *index, const WCHAR *name )
+{
+    WCHAR upper[MAX_PATH];
+    unsigned int pos;
+    DWORD hash;
+
+    if (strlenW( name ) >= MAX_PATH) return NULL;
+    strcpyW( upper, name );
+    struprW( upper );
+    hash = hash_module_name( upper );
+
+    for (pos = hash & index->mask; index->names[pos]; pos = (pos + 1) & index->mask)
+    {
+        const struct module_range *range = &index->ranges[index->names[pos] - 1];
+        if (range->hash == hash && !strcmpW( range->name, upper )) return range;
+    }
+    return NULL;
+}
+
+
 /*************************************************************************
  *		get_modref
  *
@@ -331,6 +522,14 @@ static WINE_MODREF *get_modref( HMODULE hmod )
 
     if (cached_modref && cached_modref->ldr.BaseAddress == hmod) return cached_modref;
 
+    if (module_index)
+    {
+        const struct module_range *range = find_module_range( module_index, hmod );
+
+        if (range && range->base == (const char *)hmod) return cached_modref = range->wm;
+        return NULL;
+    }
+
     mark = &NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList;
     for (entry = mark->Flink; entry != mark; entry = entry->Flink)
     {
@@ -504,6 +703,54 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
 }
 
 
+/* FNV-1a hash of an export name */
+static inline DWORD hash_export_name( const char *name )
+{
+    DWORD hash = 2166136261u;
+
+    while (*name) hash = (hash ^ (unsigned char)*name++) * 16777619;
+    return hash;
+}
+
+
+/*************************************************************************
+ *		get_export_index
+ *
+ * Get the export name index of a module, building it on first use.
+ * Once published the index is never modified until the module is freed,
+ * so it can be read without holding the loader_section.
+ */
+static const struct export_index *get_export_index( WINE_MODREF *wm, const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    const DWORD *names = get_rva( wm->ldr.BaseAddress, exports->AddressOfNames );
+    struct export_index *index;
+    DWORD i, size, pos;
+
+    if (wm->export_index) return wm->export_index;
+    if (exports->NumberOfNames < EXPORT_INDEX_MIN_NAMES) return NULL;
+
+    /* keep the load factor below one half */
+    for (size = 64; size < 2 * exports->NumberOfNames; size *= 2) ;
+    if (!(index = RtlAllocateHeap( GetProcessHeap(), 0,
+                                   offsetof( struct export_index, entries[size] ) ))) return NULL;
+    memset( index->entries, 0, size * sizeof(index->entries[0]) );
+    index->mask = size - 1;
+
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        DWORD hash = hash_export_name( get_rva( wm->ldr.BaseAddress, names[i] ));
+
+        for (pos = hash & index->mask; index->entries[pos].pos; pos = (pos + 1) & index->mask) ;
+        index->entries[pos].hash = hash;
+        index->entries[pos].pos  = i + 1;
+    }
+
+    if (interlocked_cmpxchg_ptr( (void **)&wm->export_index, index, NULL ))
+        RtlFreeHeap( GetProcessHeap(), 0, index );
+    return wm->export_index;
+}
+
+
 /*************************************************************************
  *		find_named_export
  *
@@ -515,6 +762,8 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 {
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
+    const struct export_index *index;
+    WINE_MODREF *wm;
     int min = 0, max = exports->NumberOfNames - 1;
 
     /* first check the hint */
@@ -525,6 +774,22 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
+    /* then look it up in the hash index */
+    if ((wm = get_modref( module )) && (index = get_export_index( wm, exports )))
+    {
+        DWORD hash = hash_export_name( name ), pos;
+
+        for (pos = hash & index->mask; index->entries[pos].pos; pos = (pos + 1) & index->mask)
+        {
+            DWORD i = index->entries[pos].pos - 1;
+
+            if (index->entries[pos].hash != hash) continue;
+            if (!strcmp( get_rva( module, names[i] ), name ))
+                return find_ordinal_export( module, exports, exp_size, ordinals[i], load_path );
+        }
+        return NULL;
+    }
+
     /* then do a binary search */
     while (min <= max)
     {
@@ -902,6 +1167,7 @@ static WINE_MODREF *alloc_module( HMODULE hModule, LPCWSTR filename )
 
     wm->nDeps    = 0;
     wm->deps     = NULL;
+    wm->export_index = NULL;
 
     wm->ldr.BaseAddress   = hModule;
     wm->ldr.EntryPoint    = NULL;
@@ -939,6 +1205,7 @@ static WINE_MODREF *alloc_module( HMODULE hModule, LPCWSTR filename )
     wm->ldr.InMemoryOrderModuleList.Blink = entry->Blink;
     wm->ldr.InMemoryOrderModuleList.Flink = entry;
     entry->Blink = &wm->ldr.InMemoryOrderModuleList;
+    update_module_index();
 
     /* wait until init is called for inserting into this list */
     wm->ldr.InInitializationOrderModuleList.Flink = NULL;
@@ -1155,7 +1422,10 @@ static NTSTATUS process_attach( WINE_MODREF *wm, LPVOID lpReserved )
         current_modref = wm;
         status = MODULE_InitDLL( wm, DLL_PROCESS_ATTACH, lpReserved );
         if (status == STATUS_SUCCESS)
+        {
             wm->ldr.Flags |= LDR_PROCESS_ATTACHED;
+            update_module_index();
+        }
         else
         {
             MODULE_InitDLL( wm, DLL_PROCESS_DETACH, lpReserved );
@@ -1233,6 +1503,7 @@ static void process_detach(void)
 
             /* Call detach notification */
             mod->Flags &= ~LDR_PROCESS_ATTACHED;
+            update_module_index();
             MODULE_InitDLL( CONTAINING_RECORD(mod, WINE_MODREF, ldr), 
                             DLL_PROCESS_DETACH, ULongToPtr(process_detaching) );
 
@@ -1315,9 +1586,19 @@ NTSTATUS WINAPI LdrDisableThreadCalloutsForDll(HMODULE hModule)
  */
 NTSTATUS WINAPI LdrFindEntryForAddress(const void* addr, PLDR_MODULE* pmod)
 {
+    const struct module_index *index;
+    const struct module_range *range;
     PLIST_ENTRY mark, entry;
     PLDR_MODULE mod;
 
+    if ((index = grab_module_index()))
+    {
+        if ((range = find_module_range( index, addr ))) *pmod = &range->wm->ldr;
+        release_module_index();
+        return range ? STATUS_SUCCESS : STATUS_NO_MORE_ENTRIES;
+    }
+    release_module_index();
+
     mark = &NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList;
     for (entry = mark->Flink; entry != mark; entry = entry->Flink)
     {
@@ -1526,6 +1807,7 @@ static void load_builtin_callback( void *module, const char *filename )
             /* the module has only be inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
             RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+            update_module_index();
             /* FIXME: free the modref */
             builtin_load_info->status = STATUS_DLL_NOT_FOUND;
             return;
@@ -1598,6 +1880,7 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, LPCWSTR name, HANDLE file,
             /* the module has only be inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
             RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+            update_module_index();
 
             /* FIXME: there are several more dangling references
              * left. Including dlls loaded by this dll before the
@@ -2137,6 +2420,29 @@ NTSTATUS WINAPI LdrGetDllHandle( LPCWSTR load_path, ULONG flags, const UNICODE_S
     ULONG size;
     WINE_MODREF *wm;
 
+    /* first look for an initialized module with that base name, without taking the lock */
+    if (name->Length < sizeof(buffer) - sizeof(dllW))
+    {
+        const struct module_index *index;
+        const struct module_range *range = NULL;
+
+        memcpy( buffer, name->Buffer, name->Length );
+        buffer[name->Length / sizeof(WCHAR)] = 0;
+        if (!strrchrW( buffer, '.' )) strcatW( buffer, dllW );
+
+        if (!contains_path( buffer ))
+        {
+            if ((index = grab_module_index()) && (range = find_module_name( index, buffer )))
+                *base = (HMODULE)range->base;
+            release_module_index();
+        }
+        if (range)
+        {
+            TRACE( "%s -> %p (cached)\n", debugstr_us(name), *base );
+            return STATUS_SUCCESS;
+        }
+    }
+
     RtlEnterCriticalSection( &loader_section );
 
     if (!load_path) load_path = NtCurrentTeb()->Peb->ProcessParameters->DllPath.Buffer;
@@ -2509,6 +2815,7 @@ void WINAPI LdrShutdownProcess(void)
     TRACE("()\n");
     process_detaching = TRUE;
     process_detach();
+    critsection_dump_profile();
 }
 
 
@@ -2580,6 +2887,7 @@ static void free_modref( WINE_MODREF *wm )
 {
     RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
     RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+    update_module_index();
     if (wm->ldr.InInitializationOrderModuleList.Flink)
         RemoveEntryList(&wm->ldr.InInitializationOrderModuleList);
 
@@ -2603,6 +2911,7 @@ static void free_modref( WINE_MODREF *wm )
     if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
     RtlFreeHeap( GetProcessHeap(), 0, wm->deps );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_index );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
 }
 
@@ -2971,12 +3280,24 @@ PVOID WINAPI RtlImageRvaToVa( const IMAGE_NT_HEADERS *nt, HMODULE module,
  */
 PVOID WINAPI RtlPcToFileHeader( PVOID pc, PVOID *address )
 {
+    const struct module_index *index;
+    const struct module_range *range;
     LDR_MODULE *module;
     PVOID ret = NULL;
 
-    RtlEnterCriticalSection( &loader_section );
-    if (!LdrFindEntryForAddress( pc, &module )) ret = module->BaseAddress;
-    RtlLeaveCriticalSection( &loader_section );
+    if ((index = grab_module_index()))
+    {
+        /* the module may be unloaded once the snapshot is released */
+        if ((range = find_module_range( index, pc ))) ret = (void *)range->base;
+        release_module_index();
+    }
+    else
+    {
+        release_module_index();
+        RtlEnterCriticalSection( &loader_section );
+        if (!LdrFindEntryForAddress( pc, &module )) ret = module->BaseAddress;
+        RtlLeaveCriticalSection( &loader_section );
+    }
     *address = ret;
     return ret;
 }
@@ -3061,6 +3382,7 @@ void __wine_process_init(void)
     void (* DECLSPEC_NORETURN CDECL init_func)(void);
 
     main_exe_file = thread_init();
+    critsection_init();
 
     /* retrieve current umask */
     FILE_umask = umask(0777);
@@ -311,6 +311,9 @@ NtQuerySecurityObject(
 }
 
 
+typedef void (CDECL *wine_close_handle_handler)( HANDLE handle );
+static wine_close_handle_handler close_handle_handler;
+
 /******************************************************************************
  *  NtDuplicateObject		[NTDLL.@]
  *  ZwDuplicateObject		[NTDLL.@]
@@ -336,6 +339,8 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source,
             {
                 int fd = server_remove_fd_from_cache( source );
                 if (fd != -1) close( fd );
+                remove_shared_event_from_cache( source );
+                if (close_handle_handler) close_handle_handler( source );
             }
         }
     }
@@ -343,12 +348,25 @@ NTSTATUS WINAPI NtDuplicateObject( HANDLE source_process, HANDLE source,
     return ret;
 }
 
+/******************************************************************
+ *		__wine_set_close_handle_handler    (NTDLL.@)
+ *
+ * Set a handler notified when the process closes one of its handles, for
+ * dlls that keep their own per-handle state.
+ */
+void CDECL __wine_set_close_handle_handler( wine_close_handle_handler handler )
+{
+    close_handle_handler = handler;
+}
+
 /* Everquest 2 / Pirates of the Burning Sea hooks NtClose, so we need a wrapper */
 NTSTATUS close_handle( HANDLE handle )
 {
     NTSTATUS ret;
     int fd = server_remove_fd_from_cache( handle );
 
+    remove_shared_event_from_cache( handle );
+    if (close_handle_handler) close_handle_handler( handle );
     SERVER_START_REQ( close_handle )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -47,6 +47,10 @@ WINE_DEFAULT_DEBUG_CHANNEL(reg);
 /* maximum length of a value name in bytes (without terminating null) */
 #define MAX_VALUE_LENGTH (16383 * sizeof(WCHAR))
 
+/* number of values fetched at once when enumerating */
+#define ENUM_VALUES_BATCH 16
+#define ENUM_VALUES_SLOT_SIZE 512
+
 /******************************************************************************
  * NtCreateKey [NTDLL.@]
  * ZwCreateKey [NTDLL.@]
@@ -466,6 +470,49 @@ NTSTATUS WINAPI NtEnumerateValueKey( HANDLE handle, ULONG index,
 }
 
 
+/* fetch the full information of consecutive values with a single server call */
+static void enumerate_values_batch( HANDLE handle, ULONG index, ULONG count, char *buffer,
+                                    DWORD slot_size, NTSTATUS *status, DWORD *result_len )
+{
+    struct __server_request_info reqs[ENUM_VALUES_BATCH];
+    const size_t fixed_size = FIELD_OFFSET( KEY_VALUE_FULL_INFORMATION, Name );
+    NTSTATUS ret;
+    ULONG i;
+
+    for (i = 0; i < count; i++)
+    {
+        struct enum_key_value_request *req = &reqs[i].u.req.enum_key_value_request;
+
+        memset( &reqs[i].u.req, 0, sizeof(reqs[i].u.req) );
+        reqs[i].u.req.request_header.req = REQ_enum_key_value;
+        reqs[i].data_count = 0;
+        reqs[i].reply_data = NULL;
+        req->hkey       = wine_server_obj_handle( handle );
+        req->index      = index + i;
+        req->info_class = KeyValueFullInformation;
+        if (slot_size > fixed_size)
+            wine_server_set_reply( req, buffer + i * slot_size + fixed_size, slot_size - fixed_size );
+    }
+
+    if ((ret = server_call_batch( reqs, count )))
+    {
+        for (i = 0; i < count; i++) status[i] = ret;
+        return;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        const struct enum_key_value_reply *reply = &reqs[i].u.reply.enum_key_value_reply;
+
+        if ((status[i] = reply->__header.error)) continue;
+        copy_key_value_info( KeyValueFullInformation, buffer + i * slot_size, slot_size, reply->type,
+                             reply->namelen, wine_server_reply_size(reply) - reply->namelen );
+        result_len[i] = fixed_size + reply->total;
+        if (slot_size < result_len[i]) status[i] = STATUS_BUFFER_OVERFLOW;
+    }
+}
+
+
 /******************************************************************************
  * NtQueryValueKey [NTDLL.@]
  * ZwQueryValueKey [NTDLL.@]
@@ -1142,10 +1189,13 @@ NTSTATUS WINAPI RtlQueryRegistryValues(IN ULONG RelativeTo, IN PCWSTR Path,
 {
     UNICODE_STRING Value;
     HANDLE handle, topkey;
-    PKEY_VALUE_FULL_INFORMATION pInfo = NULL;
+    PKEY_VALUE_FULL_INFORMATION pInfo = NULL, info;
     ULONG len, buflen = 0;
     NTSTATUS status=STATUS_SUCCESS, ret = STATUS_SUCCESS;
-    INT i;
+    NTSTATUS batch_status[ENUM_VALUES_BATCH];
+    DWORD batch_len[ENUM_VALUES_BATCH];
+    char *batch = NULL;
+    INT i, batch_start, batch_count;
 
     TRACE("(%d, %s, %p, %p, %p)\n", RelativeTo, debugstr_w(Path), QueryTable, Context, Environment);
 
@@ -1212,11 +1262,32 @@ NTSTATUS WINAPI RtlQueryRegistryValues(IN ULONG RelativeTo, IN PCWSTR Path,
                 goto out;
             }
 
+            /* values are fetched in batches, unless deleting them shifts the indices */
+            if (!(QueryTable->Flags & RTL_QUERY_REGISTRY_DELETE) && !batch)
+                batch = RtlAllocateHeap(GetProcessHeap(), 0, ENUM_VALUES_BATCH * ENUM_VALUES_SLOT_SIZE);
+            batch_start = batch_count = 0;
+
             /* Report all subkeys */
             for (i = 0;; ++i)
             {
-                status = NtEnumerateValueKey(handle, i,
-                    KeyValueFullInformation, pInfo, buflen, &len);
+                info = pInfo;
+                if (batch && !(QueryTable->Flags & RTL_QUERY_REGISTRY_DELETE))
+                {
+                    if (i >= batch_start + batch_count)
+                    {
+                        batch_start = i;
+                        batch_count = ENUM_VALUES_BATCH;
+                        enumerate_values_batch(handle, i, batch_count, batch,
+                            ENUM_VALUES_SLOT_SIZE, batch_status, batch_len);
+                    }
+                    status = batch_status[i - batch_start];
+                    len = batch_len[i - batch_start];
+                    if (status == STATUS_SUCCESS)
+                        info = (PKEY_VALUE_FULL_INFORMATION)(batch + (i - batch_start) * ENUM_VALUES_SLOT_SIZE);
+                }
+                else
+                    status = NtEnumerateValueKey(handle, i,
+                        KeyValueFullInformation, pInfo, buflen, &len);
                 if (status == STATUS_NO_MORE_ENTRIES)
                     break;
                 if (status == STATUS_BUFFER_OVERFLOW ||
@@ -1224,12 +1295,12 @@ NTSTATUS WINAPI RtlQueryRegistryValues(IN ULONG RelativeTo, IN PCWSTR Path,
                 {
                     buflen = len;
                     RtlFreeHeap(GetProcessHeap(), 0, pInfo);
-                    pInfo = RtlAllocateHeap(GetProcessHeap(), 0, buflen);
+                    info = pInfo = RtlAllocateHeap(GetProcessHeap(), 0, buflen);
                     NtEnumerateValueKey(handle, i, KeyValueFullInformation,
                         pInfo, buflen, &len);
                 }
 
-                status = RTL_ReportRegistryValue(pInfo, QueryTable, Context, Environment);
+                status = RTL_ReportRegistryValue(info, QueryTable, Context, Environment);
                 if(status != STATUS_SUCCESS && status != STATUS_BUFFER_TOO_SMALL)
                 {
                     ret = status;
@@ -1237,7 +1308,7 @@ NTSTATUS WINAPI RtlQueryRegistryValues(IN ULONG RelativeTo, IN PCWSTR Path,
                 }
                 if (QueryTable->Flags & RTL_QUERY_REGISTRY_DELETE)
                 {
-                    RtlInitUnicodeString(&Value, pInfo->Name);
+                    RtlInitUnicodeString(&Value, info->Name);
                     NtDeleteValueKey(handle, &Value);
                 }
             }
@@ -1292,6 +1363,7 @@ NTSTATUS WINAPI RtlQueryRegistryValues(IN ULONG RelativeTo, IN PCWSTR Path,
 
 out:
     RtlFreeHeap(GetProcessHeap(), 0, pInfo);
+    RtlFreeHeap(GetProcessHeap(), 0, batch);
     if (handle != topkey)
         NtClose(handle);
     NtClose(topkey);
@@ -298,6 +298,67 @@ unsigned int wine_server_call( void *req_ptr )
 }
 
 
+/***********************************************************************
+ *           server_call_batch
+ *
+ * Perform several independent server calls in a single round trip.
+ * The requests are set up as for wine_server_call; the status of each
+ * of them is returned in its reply header. The return value is the
+ * status of the batch itself.
+ */
+unsigned int server_call_batch( struct __server_request_info *reqs, unsigned int count )
+{
+    data_size_t req_size = 0, reply_size = 0, size;
+    unsigned int i, j, ret;
+    char *buffer, *ptr;
+
+    for (i = 0; i < count; i++)
+    {
+        req_size += sizeof(reqs[i].u.req) + BATCH_ALIGN( reqs[i].u.req.request_header.request_size );
+        reply_size += sizeof(reqs[i].u.reply) + BATCH_ALIGN( reqs[i].u.req.request_header.reply_size );
+    }
+    if (!(buffer = RtlAllocateHeap( GetProcessHeap(), 0, req_size + reply_size )))
+        return STATUS_NO_MEMORY;
+
+    for (i = 0, ptr = buffer; i < count; i++)
+    {
+        memcpy( ptr, &reqs[i].u.req, sizeof(reqs[i].u.req) );
+        ptr += sizeof(reqs[i].u.req);
+        for (j = 0; j < reqs[i].data_count; j++)
+        {
+            memcpy( ptr, reqs[i].data[j].ptr, reqs[i].data[j].size );
+            ptr += reqs[i].data[j].size;
+        }
+        size = reqs[i].u.req.request_header.request_size;
+        memset( ptr, 0, BATCH_ALIGN( size ) - size );
+        ptr += BATCH_ALIGN( size ) - size;
+    }
+
+    SERVER_START_REQ( batch_requests )
+    {
+        req->count = count;
+        wine_server_add_data( req, buffer, req_size );
+        wine_server_set_reply( req, buffer + req_size, reply_size );
+        ret = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+
+    if (!ret)
+    {
+        for (i = 0, ptr = buffer + req_size; i < count; i++)
+        {
+            memcpy( &reqs[i].u.reply, ptr, sizeof(reqs[i].u.reply) );
+            ptr += sizeof(reqs[i].u.reply);
+            if ((size = reqs[i].u.reply.reply_header.reply_size))
+                memcpy( reqs[i].reply_data, ptr, size );
+            ptr += BATCH_ALIGN( size );
+        }
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, buffer );
+    return ret;
+}
+
+
 /***********************************************************************
  *           server_enter_uninterrupted_section
  */
@@ -787,19 +848,31 @@ static int receive_fd( obj_handle_t *handle )
 /***********************************************************************/
 /* fd cache support */
 
-struct fd_cache_entry
+union fd_cache_entry
 {
-    int fd;
-    enum server_fd_type type : 5;
-    unsigned int        access : 3;
-    unsigned int        options : 24;
+    LONG64 data;
+    struct
+    {
+        int fd;
+        enum server_fd_type type : 5;
+        unsigned int        access : 3;
+        unsigned int        options : 24;
+    } s;
 };
 
-#define FD_CACHE_BLOCK_SIZE  (65536 / sizeof(struct fd_cache_entry))
-#define FD_CACHE_ENTRIES     128
+C_ASSERT( sizeof(union fd_cache_entry) == sizeof(LONG64) );
+
+#define FD_CACHE_BLOCK_SIZE  (65536 / sizeof(union fd_cache_entry))
+/* enough blocks to cover all the handles the server can allocate */
+#define FD_CACHE_ENTRIES     ((0x01000000 + FD_CACHE_BLOCK_SIZE - 1) / FD_CACHE_BLOCK_SIZE)
+
+static union fd_cache_entry *fd_cache[FD_CACHE_ENTRIES];
+static union fd_cache_entry fd_cache_initial_block[FD_CACHE_BLOCK_SIZE];
 
-static struct fd_cache_entry *fd_cache[FD_CACHE_ENTRIES];
-static struct fd_cache_entry fd_cache_initial_block[FD_CACHE_BLOCK_SIZE];
+/* cache statistics, only maintained when lock profiling is enabled */
+static int fd_cache_hits;      /* lookups satisfied from the cache */
+static int fd_cache_misses;    /* lookups that required a get_handle_fd call */
+static int fd_cache_uncached;  /* fds that couldn't be cached and have to be requested again */
 
 static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
 {
@@ -808,6 +881,11 @@ static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
     return idx % FD_CACHE_BLOCK_SIZE;
 }
 
+static inline void fd_cache_count( int *counter )
+{
+    if (lock_profile_enabled) interlocked_xchg_add( counter, 1 );
+}
+
 
 /***********************************************************************
  *           add_fd_to_cache
@@ -818,31 +896,34 @@ static BOOL add_fd_to_cache( HANDLE handle, int fd, enum server_fd_type type,
                             unsigned int access, unsigned int options )
 {
     unsigned int entry, idx = handle_to_index( handle, &entry );
-    int prev_fd;
+    union fd_cache_entry cache, old;
 
-    if (entry >= FD_CACHE_ENTRIES)
-    {
-        FIXME( "too many allocated handles, not caching %p\n", handle );
-        return FALSE;
-    }
+    if (entry >= FD_CACHE_ENTRIES) return FALSE;  /* pseudo-handle */
 
     if (!fd_cache[entry])  /* do we need to allocate a new block of entries? */
     {
         if (!entry) fd_cache[0] = fd_cache_initial_block;
         else
         {
-            void *ptr = wine_anon_mmap( NULL, FD_CACHE_BLOCK_SIZE * sizeof(struct fd_cache_entry),
+            void *ptr = wine_anon_mmap( NULL, FD_CACHE_BLOCK_SIZE * sizeof(union fd_cache_entry),
                                         PROT_READ | PROT_WRITE, 0 );
-            if (ptr == MAP_FAILED) return FALSE;
+            if (ptr == MAP_FAILED)
+            {
+                WARN( "failed to allocate fd cache block, not caching %p\n", handle );
+                return FALSE;
+            }
             fd_cache[entry] = ptr;
         }
     }
     /* store fd+1 so that 0 can be used as the unset value */
-    prev_fd = interlocked_xchg( &fd_cache[entry][idx].fd, fd + 1 ) - 1;
-    fd_cache[entry][idx].type = type;
-    fd_cache[entry][idx].access = access;
-    fd_cache[entry][idx].options = options;
-    if (prev_fd != -1) close( prev_fd );
+    cache.s.fd = fd + 1;
+    cache.s.type = type;
+    cache.s.access = access;
+    cache.s.options = options;
+    /* replace the whole entry at once so that lookups never see a partial update */
+    do old.data = fd_cache[entry][idx].data;
+    while (interlocked_cmpxchg64( &fd_cache[entry][idx].data, cache.data, old.data ) != old.data);
+    if (old.s.fd) close( old.s.fd - 1 );
     return TRUE;
 }
 
@@ -850,22 +931,26 @@ static BOOL add_fd_to_cache( HANDLE handle, int fd, enum server_fd_type type,
 /***********************************************************************
  *           get_cached_fd
  *
- * Caller must hold fd_cache_section.
+ * Can be called without holding fd_cache_section.
  */
 static inline int get_cached_fd( HANDLE handle, enum server_fd_type *type,
                                  unsigned int *access, unsigned int *options )
 {
     unsigned int entry, idx = handle_to_index( handle, &entry );
-    int fd = -1;
+    union fd_cache_entry cache;
 
-    if (entry < FD_CACHE_ENTRIES && fd_cache[entry])
-    {
-        fd = fd_cache[entry][idx].fd - 1;
-        if (type) *type = fd_cache[entry][idx].type;
-        if (access) *access = fd_cache[entry][idx].access;
-        if (options) *options = fd_cache[entry][idx].options;
-    }
-    return fd;
+    if (entry >= FD_CACHE_ENTRIES || !fd_cache[entry]) return -1;
+
+#ifdef _WIN64
+    cache.data = *(volatile LONG64 *)&fd_cache[entry][idx].data;
+#else
+    cache.data = interlocked_cmpxchg64( &fd_cache[entry][idx].data, 0, 0 );
+#endif
+    if (!cache.s.fd) return -1;
+    if (type) *type = cache.s.type;
+    if (access) *access = cache.s.access;
+    if (options) *options = cache.s.options;
+    return cache.s.fd - 1;
 }
 
 
@@ -878,12 +963,23 @@ int server_remove_fd_from_cache( HANDLE handle )
     int fd = -1;
 
     if (entry < FD_CACHE_ENTRIES && fd_cache[entry])
-        fd = interlocked_xchg( &fd_cache[entry][idx].fd, 0 ) - 1;
+        fd = interlocked_xchg( &fd_cache[entry][idx].s.fd, 0 ) - 1;
 
     return fd;
 }
 
 
+/***********************************************************************
+ *           server_get_fd_cache_stats
+ */
+void server_get_fd_cache_stats( unsigned int *hits, unsigned int *misses, unsigned int *uncached )
+{
+    *hits = fd_cache_hits;
+    *misses = fd_cache_misses;
+    *uncached = fd_cache_uncached;
+}
+
+
 /***********************************************************************
  *           server_get_unix_fd
  *
@@ -901,33 +997,45 @@ int server_get_unix_fd( HANDLE handle, unsigned int wanted_access, int *unix_fd,
     *needs_close = 0;
     wanted_access &= FILE_READ_DATA | FILE_WRITE_DATA | FILE_APPEND_DATA;
 
+    if ((fd = get_cached_fd( handle, type, &access, options )) != -1)
+    {
+        fd_cache_count( &fd_cache_hits );
+        goto done;
+    }
+
     server_enter_uninterrupted_section( &fd_cache_section, &sigset );
 
+    /* another thread may have cached it in the meantime */
     fd = get_cached_fd( handle, type, &access, options );
-    if (fd != -1) goto done;
-
-    SERVER_START_REQ( get_handle_fd )
+    if (fd == -1)
     {
-        req->handle = wine_server_obj_handle( handle );
-        if (!(ret = wine_server_call( req )))
+        fd_cache_count( &fd_cache_misses );
+        SERVER_START_REQ( get_handle_fd )
         {
-            if (type) *type = reply->type;
-            if (options) *options = reply->options;
-            access = reply->access;
-            if ((fd = receive_fd( &fd_handle )) != -1)
+            req->handle = wine_server_obj_handle( handle );
+            if (!(ret = wine_server_call( req )))
             {
-                assert( wine_server_ptr_handle(fd_handle) == handle );
-                *needs_close = (!reply->cacheable ||
-                                !add_fd_to_cache( handle, fd, reply->type,
-                                                  reply->access, reply->options ));
+                if (type) *type = reply->type;
+                if (options) *options = reply->options;
+                access = reply->access;
+                if ((fd = receive_fd( &fd_handle )) != -1)
+                {
+                    assert( wine_server_ptr_handle(fd_handle) == handle );
+                    *needs_close = (!reply->cacheable ||
+                                    !add_fd_to_cache( handle, fd, reply->type,
+                                                      reply->access, reply->options ));
+                    if (*needs_close) fd_cache_count( &fd_cache_uncached );
+                }
+                else ret = STATUS_TOO_MANY_OPENED_FILES;
             }
-            else ret = STATUS_TOO_MANY_OPENED_FILES;
         }
+        SERVER_END_REQ;
     }
-    SERVER_END_REQ;
+    else fd_cache_count( &fd_cache_hits );
 
-done:
     server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+
+done:
     if (!ret && ((access & wanted_access) != wanted_access))
     {
         ret = STATUS_ACCESS_DENIED;
@@ -938,6 +1046,40 @@ done:
 }
 
 
+/***********************************************************************
+ *           server_map_sync_area
+ *
+ * Map the shared memory area holding the state of shared events.
+ * The area is only written by the server, so it is mapped read-only.
+ */
+void *server_map_sync_area( data_size_t *size, int *epoch )
+{
+    sigset_t sigset;
+    obj_handle_t fd_handle;
+    void *ptr;
+    int fd = -1;
+
+    /* the fd cache section serializes fd transfers from the server */
+    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
+    SERVER_START_REQ( get_shared_sync_area )
+    {
+        if (!wine_server_call( req ))
+        {
+            *size  = reply->size;
+            *epoch = reply->epoch;
+            fd = receive_fd( &fd_handle );
+        }
+    }
+    SERVER_END_REQ;
+    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
+
+    if (fd == -1) return NULL;
+    ptr = mmap( NULL, *size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    return ptr != MAP_FAILED ? ptr : NULL;
+}
+
+
 /***********************************************************************
  *           wine_server_fd_to_handle   (NTDLL.@)
  *
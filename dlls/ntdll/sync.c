@@ -42,6 +42,13 @@
 #ifdef HAVE_SCHED_H
 # include <sched.h>
 #endif
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+# include <sys/syscall.h>
+#endif
+#include <limits.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -55,6 +62,7 @@
 #define WIN32_NO_STATUS
 #include "windef.h"
 #include "winternl.h"
+#include "wine/library.h"
 #include "wine/server.h"
 #include "wine/debug.h"
 #include "ntdll_misc.h"
@@ -74,6 +82,142 @@ static inline int interlocked_dec_if_nonzero( int *dest )
     return val;
 }
 
+/* Shared events support: when enabled with WINESHAREDSYNC=1, the server
+ * publishes the state of events in a read-only shared memory area, and
+ * operations that wouldn't change the state of an event, or wake anybody,
+ * can complete without a server call. */
+
+#define SHARED_CACHE_BLOCK_SIZE  (65536 / sizeof(int))
+#define SHARED_CACHE_ENTRIES     128
+#define SHARED_INDEX_BITS        14  /* the area holds 65536 / sizeof(int) slots */
+#define SHARED_INDEX_MASK        ((1 << SHARED_INDEX_BITS) - 1)
+
+static const volatile int *sync_area;   /* shared memory area holding the event states */
+static int sync_epoch;                  /* index of the counter of our handles closed by others */
+static BOOL sync_area_init;
+static int shared_cache_epoch;          /* value of the counter the cache is valid for */
+/* (generation << SHARED_INDEX_BITS | index) + 1 of the event state for each handle,
+ * -1 if not shared, 0 if unknown */
+static int *shared_cache[SHARED_CACHE_ENTRIES];
+
+static const volatile int *get_sync_area(void)
+{
+    if (!sync_area_init)
+    {
+        const char *env = getenv( "WINESHAREDSYNC" );
+        data_size_t size;
+        int *area, epoch;
+
+        if (env && atoi( env ) && (area = server_map_sync_area( &size, &epoch )))
+        {
+            /* the server returns the same counter to all threads */
+            sync_epoch = epoch;
+            shared_cache_epoch = area[epoch];
+            if (interlocked_cmpxchg_ptr( (void **)&sync_area, area, NULL ))
+                munmap( area, size );  /* another thread beat us to it */
+        }
+        sync_area_init = TRUE;
+    }
+    return sync_area;
+}
+
+static inline unsigned int shared_handle_to_index( HANDLE handle, unsigned int *entry )
+{
+    unsigned int idx = (wine_server_obj_handle(handle) >> 2) - 1;
+    *entry = idx / SHARED_CACHE_BLOCK_SIZE;
+    return idx % SHARED_CACHE_BLOCK_SIZE;
+}
+
+/* forget everything once another process closed one of our handles, its value may have been reused */
+static void flush_shared_cache( int epoch )
+{
+    unsigned int i;
+
+    for (i = 0; i < SHARED_CACHE_ENTRIES; i++)
+        if (shared_cache[i]) memset( shared_cache[i], 0, SHARED_CACHE_BLOCK_SIZE * sizeof(int) );
+    shared_cache_epoch = epoch;
+}
+
+/***********************************************************************
+ *           get_shared_event_state
+ *
+ * Retrieve the current state of an event handle, return FALSE if the server has to be used.
+ */
+static BOOL get_shared_event_state( HANDLE handle, int *state )
+{
+    unsigned int entry, idx = shared_handle_to_index( handle, &entry );
+    const volatile int *area;
+    int *block, epoch, value;
+
+    if (!(area = get_sync_area())) return FALSE;
+    if (entry >= SHARED_CACHE_ENTRIES) return FALSE;
+
+    if ((epoch = area[sync_epoch]) != shared_cache_epoch) flush_shared_cache( epoch );
+
+    if (!(block = shared_cache[entry]))
+    {
+        void *ptr = wine_anon_mmap( NULL, SHARED_CACHE_BLOCK_SIZE * sizeof(int), PROT_READ | PROT_WRITE, 0 );
+        if (ptr == MAP_FAILED) return FALSE;
+        if ((block = interlocked_cmpxchg_ptr( (void **)&shared_cache[entry], ptr, NULL )))
+            munmap( ptr, SHARED_CACHE_BLOCK_SIZE * sizeof(int) );
+        else
+            block = ptr;
+    }
+
+    if (!(value = block[idx]))
+    {
+        int index = -1, gen = 0;
+
+        SERVER_START_REQ( share_event_state )
+        {
+            req->handle = wine_server_obj_handle( handle );
+            if (!wine_server_call( req ))
+            {
+                index = reply->index;
+                gen   = reply->gen;
+            }
+        }
+        SERVER_END_REQ;
+
+        if (index != -1) value = ((gen / SHARED_EVENT_GEN_INC) << SHARED_INDEX_BITS | index) + 1;
+        else value = -1;
+        block[idx] = value;
+        /* don't keep the entry if the cache was flushed before we stored it */
+        if (area[sync_epoch] != epoch) block[idx] = 0;
+    }
+    if (value < 0) return FALSE;
+
+    value--;
+    *state = area[value & SHARED_INDEX_MASK];
+    if ((*state & SHARED_EVENT_GEN_MASK) / SHARED_EVENT_GEN_INC != value >> SHARED_INDEX_BITS)
+    {
+        /* the event is gone and its slot was released */
+        block[idx] = 0;
+        return FALSE;
+    }
+    /* the handle may have been closed and reused while we were looking */
+    return area[sync_epoch] == epoch;
+}
+
+/***********************************************************************
+ *           remove_shared_event_from_cache
+ */
+void remove_shared_event_from_cache( HANDLE handle )
+{
+    unsigned int entry, idx = shared_handle_to_index( handle, &entry );
+
+    if (entry < SHARED_CACHE_ENTRIES && shared_cache[entry]) shared_cache[entry][idx] = 0;
+}
+
+/* try to satisfy a wait on a shared event, return STATUS_PENDING if the server is needed */
+static NTSTATUS wait_shared_event( int state, const LARGE_INTEGER *timeout )
+{
+    if (!(state & SHARED_EVENT_SIGNALED))
+        return (timeout && !timeout->QuadPart) ? STATUS_TIMEOUT : STATUS_PENDING;
+    /* consuming the signal of an auto-reset event needs the server */
+    return (state & SHARED_EVENT_MANUAL) ? STATUS_WAIT_0 : STATUS_PENDING;
+}
+
 /* creates a struct security_descriptor and contained information in one contiguous piece of memory */
 NTSTATUS NTDLL_create_struct_sd(PSECURITY_DESCRIPTOR nt_sd, struct security_descriptor **server_sd,
                                 data_size_t *server_sd_len)
@@ -351,9 +495,15 @@ NTSTATUS WINAPI NtOpenEvent(
 NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
     NTSTATUS ret;
+    int state;
 
     /* FIXME: set NumberOfThreadsReleased */
 
+    /* nothing to do if the event is already signaled */
+    if (get_shared_event_state( handle, &state ) &&
+        (state & (SHARED_EVENT_SIGNALED | SHARED_EVENT_WAITERS)) == SHARED_EVENT_SIGNALED)
+        return STATUS_SUCCESS;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -370,10 +520,16 @@ NTSTATUS WINAPI NtSetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 NTSTATUS WINAPI NtResetEvent( HANDLE handle, PULONG NumberOfThreadsReleased )
 {
     NTSTATUS ret;
+    int state;
 
     /* resetting an event can't release any thread... */
     if (NumberOfThreadsReleased) *NumberOfThreadsReleased = 0;
 
+    /* nothing to do if the event is already reset */
+    if (get_shared_event_state( handle, &state ) &&
+        !(state & (SHARED_EVENT_SIGNALED | SHARED_EVENT_WAITERS)))
+        return STATUS_SUCCESS;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -404,10 +560,16 @@ NTSTATUS WINAPI NtClearEvent ( HANDLE handle )
 NTSTATUS WINAPI NtPulseEvent( HANDLE handle, PULONG PulseCount )
 {
     NTSTATUS ret;
+    int state;
 
     if (PulseCount)
       FIXME("(%p,%d)\n", handle, *PulseCount);
 
+    /* without waiters, pulsing a reset event doesn't do anything */
+    if (get_shared_event_state( handle, &state ) &&
+        !(state & (SHARED_EVENT_SIGNALED | SHARED_EVENT_WAITERS)))
+        return STATUS_SUCCESS;
+
     SERVER_START_REQ( event_op )
     {
         req->handle = wine_server_obj_handle( handle );
@@ -857,6 +1019,15 @@ NTSTATUS WINAPI NtWaitForMultipleObjects( DWORD count, const HANDLE *handles,
 
     if (!count || count > MAXIMUM_WAIT_OBJECTS) return STATUS_INVALID_PARAMETER_1;
 
+    if (count == 1 && !alertable)
+    {
+        NTSTATUS ret;
+        int state;
+
+        if (get_shared_event_state( handles[0], &state ) &&
+            (ret = wait_shared_event( state, timeout )) != STATUS_PENDING) return ret;
+    }
+
     if (alertable) flags |= SELECT_ALERTABLE;
     select_op.wait.op = wait_all ? SELECT_WAIT_ALL : SELECT_WAIT;
     for (i = 0; i < count; i++) select_op.wait.handles[i] = wine_server_obj_handle( handles[i] );
@@ -1267,6 +1438,351 @@ NTSTATUS NTDLL_AddCompletion( HANDLE hFile, ULONG_PTR CompletionValue,
     return status;
 }
 
+/* Futex support for SRW locks, condition variables and run-once objects.
+ *
+ * When futexes are available, threads block directly on the lock word
+ * instead of going through the keyed event in the server. The fast_*
+ * helpers return STATUS_NOT_IMPLEMENTED when they cannot be used, and the
+ * callers then fall back to the keyed event implementation. The choice
+ * is made once per process, so a given object only ever sees one of the
+ * two layouts.
+ */
+
+#ifdef __linux__
+
+static int futex_private = 128;  /* FUTEX_PRIVATE_FLAG */
+
+static inline int futex_wait( int *addr, int val, struct timespec *timeout )
+{
+    return syscall( __NR_futex, addr, 0 /* FUTEX_WAIT */ | futex_private, val, timeout, 0, 0 );
+}
+
+static inline int futex_wake( int *addr, int val )
+{
+    return syscall( __NR_futex, addr, 1 /* FUTEX_WAKE */ | futex_private, val, NULL, 0, 0 );
+}
+
+static inline int futex_wait_bitset( int *addr, int val, int mask )
+{
+    return syscall( __NR_futex, addr, 9 /* FUTEX_WAIT_BITSET */ | futex_private, val, NULL, 0, mask );
+}
+
+static inline int futex_wake_bitset( int *addr, int val, int mask )
+{
+    return syscall( __NR_futex, addr, 10 /* FUTEX_WAKE_BITSET */ | futex_private, val, NULL, 0, mask );
+}
+
+static inline int use_futexes(void)
+{
+    static int supported = -1;
+
+    if (supported == -1)
+    {
+        futex_wait( &supported, 10, NULL );
+        if (errno == ENOSYS)
+        {
+            futex_private = 0;
+            futex_wait( &supported, 10, NULL );
+        }
+        /* SRW locks need bitsets to wake exclusive and shared waiters separately */
+        if (errno != ENOSYS) futex_wait_bitset( &supported, 10, ~0 );
+        supported = (errno != ENOSYS);
+    }
+    return supported;
+}
+
+static struct timespec *get_futex_timeout( struct timespec *timespec, const LARGE_INTEGER *timeout )
+{
+    LONGLONG diff;
+
+    if (!timeout) return NULL;
+    if (timeout->QuadPart > 0)
+    {
+        LARGE_INTEGER now;
+        NtQuerySystemTime( &now );
+        diff = timeout->QuadPart - now.QuadPart;
+    }
+    else diff = -timeout->QuadPart;
+    if (diff < 0) diff = 0;
+
+    timespec->tv_sec  = diff / 10000000;
+    timespec->tv_nsec = (diff % 10000000) * 100;
+    return timespec;
+}
+
+/* Condition variables store a sequence number that is bumped by every
+ * wake-up, in steps of 2 so that bit 0 can flag the presence of waiters. */
+#define CONDVAR_FUTEX_WAITERS   1
+#define CONDVAR_FUTEX_SEQ_INC   2
+
+static NTSTATUS fast_wait_cv( RTL_CONDITION_VARIABLE *variable, int val, const LARGE_INTEGER *timeout )
+{
+    struct timespec timespec;
+
+    if (futex_wait( (int *)&variable->Ptr, val, get_futex_timeout( &timespec, timeout )) == -1 &&
+        errno == ETIMEDOUT)
+        return STATUS_TIMEOUT;
+    return STATUS_SUCCESS;
+}
+
+/* flag the presence of a waiter and return the value to wait on */
+static int fast_prepare_wait_cv( RTL_CONDITION_VARIABLE *variable )
+{
+    int old, new;
+
+    do
+    {
+        old = *(int *)&variable->Ptr;
+        new = old | CONDVAR_FUTEX_WAITERS;
+    } while (old != new && interlocked_cmpxchg( (int *)&variable->Ptr, new, old ) != old);
+    return new;
+}
+
+static NTSTATUS fast_wake_cv( RTL_CONDITION_VARIABLE *variable, int count )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *(int *)&variable->Ptr;
+        new = old + CONDVAR_FUTEX_SEQ_INC;
+        /* the flag can only be cleared when all the waiters are woken */
+        if (count == INT_MAX) new &= ~CONDVAR_FUTEX_WAITERS;
+    } while (interlocked_cmpxchg( (int *)&variable->Ptr, new, old ) != old);
+
+    if (old & CONDVAR_FUTEX_WAITERS) futex_wake( (int *)&variable->Ptr, count );
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_wait_once( RTL_RUN_ONCE *once, ULONG_PTR val )
+{
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    /* the state bits live in the low 32 bits of the pointer */
+    futex_wait( (int *)&once->Ptr, (int)val, NULL );
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_wake_once( RTL_RUN_ONCE *once )
+{
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    futex_wake( (int *)&once->Ptr, INT_MAX );
+    return STATUS_SUCCESS;
+}
+
+/* SRW lock layout with futexes:
+ *
+ *  bit 31      lock is owned exclusively
+ *  bits 16-30  number of threads waiting for exclusive access
+ *  bit 15      some threads are waiting for shared access
+ *  bits 0-14   number of threads owning the lock in shared mode
+ *
+ * Exclusive waiters have priority over new shared owners, and are woken
+ * one at a time; shared waiters are all woken together once no exclusive
+ * waiter is left.
+ */
+#define SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT     0x80000000
+#define SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK 0x7fff0000
+#define SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC  0x00010000
+#define SRWLOCK_FUTEX_SHARED_WAITERS_BIT     0x00008000
+#define SRWLOCK_FUTEX_SHARED_OWNERS_MASK     0x00007fff
+#define SRWLOCK_FUTEX_SHARED_OWNERS_INC      0x00000001
+
+/* futex bitsets, independent from the bits in the lock itself */
+#define SRWLOCK_FUTEX_BITSET_EXCLUSIVE  1
+#define SRWLOCK_FUTEX_BITSET_SHARED     2
+
+static NTSTATUS fast_try_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int old;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *(int *)&lock->Ptr;
+        if ((old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) || (old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK))
+            return STATUS_TIMEOUT;
+    } while (interlocked_cmpxchg( (int *)&lock->Ptr, old | SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT, old ) != old);
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    if (!interlocked_cmpxchg( (int *)&lock->Ptr, SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT, 0 ))
+        return STATUS_SUCCESS;
+
+    interlocked_xchg_add( (int *)&lock->Ptr, SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC );
+    for (;;)
+    {
+        old = *(int *)&lock->Ptr;
+        if (!(old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) && !(old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK))
+        {
+            new = (old | SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) - SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_INC;
+            if (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) == old) return STATUS_SUCCESS;
+        }
+        else futex_wait_bitset( (int *)&lock->Ptr, old, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    }
+}
+
+static NTSTATUS fast_try_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    int old;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *(int *)&lock->Ptr;
+        if ((old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) || (old & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
+            return STATUS_TIMEOUT;
+        assert( (old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK) != SRWLOCK_FUTEX_SHARED_OWNERS_MASK );
+    } while (interlocked_cmpxchg( (int *)&lock->Ptr, old + SRWLOCK_FUTEX_SHARED_OWNERS_INC, old ) != old);
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    for (;;)
+    {
+        old = *(int *)&lock->Ptr;
+        if (!(old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) && !(old & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
+        {
+            assert( (old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK) != SRWLOCK_FUTEX_SHARED_OWNERS_MASK );
+            new = old + SRWLOCK_FUTEX_SHARED_OWNERS_INC;
+            if (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) == old) return STATUS_SUCCESS;
+        }
+        else
+        {
+            new = old | SRWLOCK_FUTEX_SHARED_WAITERS_BIT;
+            if (new == old || interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) == old)
+                futex_wait_bitset( (int *)&lock->Ptr, new, SRWLOCK_FUTEX_BITSET_SHARED );
+        }
+    }
+}
+
+static NTSTATUS fast_release_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *(int *)&lock->Ptr;
+        if (!(old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT))
+        {
+            ERR( "lock %p is not owned exclusively (%#x)\n", lock, old );
+            return STATUS_RESOURCE_NOT_OWNED;
+        }
+        new = old & ~SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT;
+        if (!(new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)) new &= ~SRWLOCK_FUTEX_SHARED_WAITERS_BIT;
+    } while (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old);
+
+    if (new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK)
+        futex_wake_bitset( (int *)&lock->Ptr, 1, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    else if (old & SRWLOCK_FUTEX_SHARED_WAITERS_BIT)
+        futex_wake_bitset( (int *)&lock->Ptr, INT_MAX, SRWLOCK_FUTEX_BITSET_SHARED );
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS fast_release_srw_shared( RTL_SRWLOCK *lock )
+{
+    int old, new;
+
+    if (!use_futexes()) return STATUS_NOT_IMPLEMENTED;
+
+    do
+    {
+        old = *(int *)&lock->Ptr;
+        if ((old & SRWLOCK_FUTEX_EXCLUSIVE_LOCK_BIT) || !(old & SRWLOCK_FUTEX_SHARED_OWNERS_MASK))
+        {
+            ERR( "lock %p is not owned shared (%#x)\n", lock, old );
+            return STATUS_RESOURCE_NOT_OWNED;
+        }
+        new = old - SRWLOCK_FUTEX_SHARED_OWNERS_INC;
+    } while (interlocked_cmpxchg( (int *)&lock->Ptr, new, old ) != old);
+
+    if (!(new & SRWLOCK_FUTEX_SHARED_OWNERS_MASK) && (new & SRWLOCK_FUTEX_EXCLUSIVE_WAITERS_MASK))
+        futex_wake_bitset( (int *)&lock->Ptr, 1, SRWLOCK_FUTEX_BITSET_EXCLUSIVE );
+    return STATUS_SUCCESS;
+}
+
+#else  /* __linux__ */
+
+static inline int use_futexes(void)
+{
+    return 0;
+}
+
+static NTSTATUS fast_wait_cv( RTL_CONDITION_VARIABLE *variable, int val, const LARGE_INTEGER *timeout )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static int fast_prepare_wait_cv( RTL_CONDITION_VARIABLE *variable )
+{
+    return 0;
+}
+
+static NTSTATUS fast_wake_cv( RTL_CONDITION_VARIABLE *variable, int count )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_wait_once( RTL_RUN_ONCE *once, ULONG_PTR val )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_wake_once( RTL_RUN_ONCE *once )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_try_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_acquire_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_try_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_acquire_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_release_srw_exclusive( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+static NTSTATUS fast_release_srw_shared( RTL_SRWLOCK *lock )
+{
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+#endif  /* __linux__ */
+
 /******************************************************************
  *              RtlRunOnceInitialize (NTDLL.@)
  */
@@ -1304,6 +1820,7 @@ DWORD WINAPI RtlRunOnceBeginInitialize( RTL_RUN_ONCE *once, ULONG flags, void **
 
         case 1:  /* in progress, wait */
             if (flags & RTL_RUN_ONCE_ASYNC) return STATUS_INVALID_PARAMETER;
+            if (fast_wait_once( once, val ) != STATUS_NOT_IMPLEMENTED) break;
             next = val & ~3;
             if (interlocked_cmpxchg_ptr( &once->Ptr, (void *)((ULONG_PTR)&next | 1),
                                          (void *)val ) == (void *)val)
@@ -1343,6 +1860,7 @@ DWORD WINAPI RtlRunOnceComplete( RTL_RUN_ONCE *once, ULONG flags, void *context
         {
         case 1:  /* in progress */
             if (interlocked_cmpxchg_ptr( &once->Ptr, context, (void *)val ) != (void *)val) break;
+            if (fast_wake_once( once ) != STATUS_NOT_IMPLEMENTED) return STATUS_SUCCESS;
             val &= ~3;
             while (val)
             {
@@ -1529,6 +2047,9 @@ void WINAPI RtlInitializeSRWLock( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    if (fast_acquire_srw_exclusive( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     if (srwlock_lock_exclusive( (unsigned int *)&lock->Ptr, SRWLOCK_RES_EXCLUSIVE ))
         NtWaitForKeyedEvent( keyed_event, srwlock_key_exclusive(lock), FALSE, NULL );
 }
@@ -1543,6 +2064,10 @@ void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
 {
     unsigned int val, tmp;
+
+    if (fast_acquire_srw_shared( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     /* Acquires a shared lock. If it's currently not possible to add elements to
      * the shared queue, then request exclusive access instead. */
     for (val = *(unsigned int *)&lock->Ptr;; val = tmp)
@@ -1573,6 +2098,9 @@ void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlReleaseSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    if (fast_release_srw_exclusive( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     srwlock_leave_exclusive( lock, srwlock_unlock_exclusive( (unsigned int *)&lock->Ptr,
                              - SRWLOCK_RES_EXCLUSIVE ) - SRWLOCK_RES_EXCLUSIVE );
 }
@@ -1582,6 +2110,9 @@ void WINAPI RtlReleaseSRWLockExclusive( RTL_SRWLOCK *lock )
  */
 void WINAPI RtlReleaseSRWLockShared( RTL_SRWLOCK *lock )
 {
+    if (fast_release_srw_shared( lock ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     srwlock_leave_shared( lock, srwlock_lock_exclusive( (unsigned int *)&lock->Ptr,
                           - SRWLOCK_RES_SHARED ) - SRWLOCK_RES_SHARED );
 }
@@ -1595,6 +2126,11 @@ void WINAPI RtlReleaseSRWLockShared( RTL_SRWLOCK *lock )
  */
 BOOLEAN WINAPI RtlTryAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 {
+    NTSTATUS ret;
+
+    if ((ret = fast_try_acquire_srw_exclusive( lock )) != STATUS_NOT_IMPLEMENTED)
+        return ret == STATUS_SUCCESS;
+
     return interlocked_cmpxchg( (int *)&lock->Ptr, SRWLOCK_MASK_IN_EXCLUSIVE |
                                 SRWLOCK_RES_EXCLUSIVE, 0 ) == 0;
 }
@@ -1605,6 +2141,11 @@ BOOLEAN WINAPI RtlTryAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 BOOLEAN WINAPI RtlTryAcquireSRWLockShared( RTL_SRWLOCK *lock )
 {
     unsigned int val, tmp;
+    NTSTATUS ret;
+
+    if ((ret = fast_try_acquire_srw_shared( lock )) != STATUS_NOT_IMPLEMENTED)
+        return ret == STATUS_SUCCESS;
+
     for (val = *(unsigned int *)&lock->Ptr;; val = tmp)
     {
         if (val & SRWLOCK_MASK_EXCLUSIVE_QUEUE)
@@ -1648,6 +2189,9 @@ void WINAPI RtlInitializeConditionVariable( RTL_CONDITION_VARIABLE *variable )
  */
 void WINAPI RtlWakeConditionVariable( RTL_CONDITION_VARIABLE *variable )
 {
+    if (fast_wake_cv( variable, 1 ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
     if (interlocked_dec_if_nonzero( (int *)&variable->Ptr ))
         NtReleaseKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
 }
@@ -1659,7 +2203,12 @@ void WINAPI RtlWakeConditionVariable( RTL_CONDITION_VARIABLE *variable )
  */
 void WINAPI RtlWakeAllConditionVariable( RTL_CONDITION_VARIABLE *variable )
 {
-    int val = interlocked_xchg( (int *)&variable->Ptr, 0 );
+    int val;
+
+    if (fast_wake_cv( variable, INT_MAX ) != STATUS_NOT_IMPLEMENTED)
+        return;
+
+    val = interlocked_xchg( (int *)&variable->Ptr, 0 );
     while (val-- > 0)
         NtReleaseKeyedEvent( keyed_event, &variable->Ptr, FALSE, NULL );
 }
@@ -1683,6 +2232,16 @@ NTSTATUS WINAPI RtlSleepConditionVariableCS( RTL_CONDITION_VARIABLE *variable, R
                                              const LARGE_INTEGER *timeout )
 {
     NTSTATUS status;
+
+    if (use_futexes())
+    {
+        int val = fast_prepare_wait_cv( variable );
+        RtlLeaveCriticalSection( crit );
+        status = fast_wait_cv( variable, val, timeout );
+        RtlEnterCriticalSection( crit );
+        return status;
+    }
+
     interlocked_xchg_add( (int *)&variable->Ptr, 1 );
     RtlLeaveCriticalSection( crit );
 
@@ -1720,6 +2279,25 @@ NTSTATUS WINAPI RtlSleepConditionVariableSRW( RTL_CONDITION_VARIABLE *variable,
                                               const LARGE_INTEGER *timeout, ULONG flags )
 {
     NTSTATUS status;
+
+    if (use_futexes())
+    {
+        int val = fast_prepare_wait_cv( variable );
+
+        if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
+            RtlReleaseSRWLockShared( lock );
+        else
+            RtlReleaseSRWLockExclusive( lock );
+
+        status = fast_wait_cv( variable, val, timeout );
+
+        if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
+            RtlAcquireSRWLockShared( lock );
+        else
+            RtlAcquireSRWLockExclusive( lock );
+        return status;
+    }
+
     interlocked_xchg_add( (int *)&variable->Ptr, 1 );
 
     if (flags & RTL_CONDITION_VARIABLE_LOCKMODE_SHARED)
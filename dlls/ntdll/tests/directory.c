@@ -276,6 +276,58 @@ done:
     pRtlFreeUnicodeString(&ntdirname);
 }
 
+static void test_case_insensitive_lookup(void)
+{
+    char dirA[MAX_PATH], nameA[MAX_PATH];
+    HANDLE handle;
+    DWORD attrs;
+    int i;
+
+    GetTempPathA(MAX_PATH, dirA);
+    strcat(dirA, "CaseLookup.tmp");
+    CreateDirectoryA(dirA, NULL);
+    for (i = 0; i < 200; i++)
+    {
+        sprintf(nameA, "%s\\File%03u.Txt", dirA, i);
+        handle = CreateFileA(nameA, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0);
+        ok(handle != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", nameA, GetLastError());
+        CloseHandle(handle);
+    }
+
+    for (i = 0; i < 200; i += 7)
+    {
+        sprintf(nameA, "%s\\fILE%03u.tXT", dirA, i);
+        attrs = GetFileAttributesA(nameA);
+        ok(attrs != INVALID_FILE_ATTRIBUTES, "%s not found, error %u\n", nameA, GetLastError());
+    }
+    sprintf(nameA, "%s\\file200.txt", dirA);
+    attrs = GetFileAttributesA(nameA);
+    ok(attrs == INVALID_FILE_ATTRIBUTES, "%s found\n", nameA);
+
+    /* changes to the directory must be visible right away */
+    sprintf(nameA, "%s\\File007.Txt", dirA);
+    ok(DeleteFileA(nameA), "failed to delete %s, error %u\n", nameA, GetLastError());
+    sprintf(nameA, "%s\\FILE007.TXT", dirA);
+    attrs = GetFileAttributesA(nameA);
+    ok(attrs == INVALID_FILE_ATTRIBUTES, "%s found\n", nameA);
+
+    sprintf(nameA, "%s\\NewFile.Txt", dirA);
+    handle = CreateFileA(nameA, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0);
+    ok(handle != INVALID_HANDLE_VALUE, "failed to create %s, error %u\n", nameA, GetLastError());
+    CloseHandle(handle);
+    sprintf(nameA, "%s\\newfile.txt", dirA);
+    attrs = GetFileAttributesA(nameA);
+    ok(attrs != INVALID_FILE_ATTRIBUTES, "%s not found, error %u\n", nameA, GetLastError());
+    ok(DeleteFileA(nameA), "failed to delete %s, error %u\n", nameA, GetLastError());
+
+    for (i = 0; i < 200; i++)
+    {
+        sprintf(nameA, "%s\\File%03u.Txt", dirA, i);
+        DeleteFileA(nameA);
+    }
+    ok(RemoveDirectoryA(dirA), "failed to remove %s, error %u\n", dirA, GetLastError());
+}
+
 static void test_redirection(void)
 {
     ULONG old, cur;
@@ -345,5 +397,6 @@ START_TEST(directory)
     pRtlWow64EnableFsRedirectionEx = (void *)GetProcAddress(hntdll,"RtlWow64EnableFsRedirectionEx");
 
     test_NtQueryDirectoryFile();
+    test_case_insensitive_lookup();
     test_redirection();
 }
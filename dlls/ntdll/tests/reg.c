@@ -333,6 +333,74 @@ static void test_RtlQueryRegistryValues(void)
     pRtlFreeHeap(GetProcessHeap(), 0, QueryTable);
 }
 
+static NTSTATUS WINAPI count_values_routine( PCWSTR name, ULONG type, PVOID data, ULONG length,
+                                             PVOID context, PVOID entry_context )
+{
+    DWORD *seen = context;
+    int index;
+
+    if (name[0] != 'v' || !name[1] || !name[2] || name[3] || type != REG_BINARY) return STATUS_SUCCESS;
+    index = (name[1] - '0') * 10 + name[2] - '0';
+    ok( index >= 0 && index < 40, "unexpected value %s\n", wine_dbgstr_w(name) );
+    if (index < 0 || index >= 40) return STATUS_SUCCESS;
+    ok( length == (index == 20 ? 2000 : index + 1), "%d: wrong length %u\n", index, length );
+    ok( ((BYTE *)data)[length - 1] == (BYTE)index, "%d: wrong data\n", index );
+    seen[index]++;
+    return STATUS_SUCCESS;
+}
+
+static void test_RtlQueryRegistryValues_many(void)
+{
+    RTL_QUERY_REGISTRY_TABLE table[2];
+    OBJECT_ATTRIBUTES attr;
+    UNICODE_STRING name;
+    WCHAR nameW[4];
+    BYTE data[2000];
+    DWORD seen[40];
+    HANDLE key;
+    NTSTATUS status;
+    int i;
+
+    InitializeObjectAttributes( &attr, &winetestpath, 0, 0, 0 );
+    status = pNtOpenKey( &key, KEY_WRITE|KEY_READ, &attr );
+    ok( status == STATUS_SUCCESS, "NtOpenKey failed: 0x%08x\n", status );
+
+    /* more values than fit in a single batch, one of them larger than a batch slot */
+    for (i = 0; i < 40; i++)
+    {
+        DWORD len = (i == 20) ? sizeof(data) : i + 1;
+
+        nameW[0] = 'v';
+        nameW[1] = '0' + i / 10;
+        nameW[2] = '0' + i % 10;
+        nameW[3] = 0;
+        pRtlCreateUnicodeString( &name, nameW );
+        memset( data, i, sizeof(data) );
+        status = pNtSetValueKey( key, &name, 0, REG_BINARY, data, len );
+        ok( status == STATUS_SUCCESS, "NtSetValueKey failed: 0x%08x\n", status );
+        pRtlFreeUnicodeString( &name );
+    }
+
+    memset( table, 0, sizeof(table) );
+    table[0].QueryRoutine = count_values_routine;
+    memset( seen, 0, sizeof(seen) );
+    status = pRtlQueryRegistryValues( RTL_REGISTRY_ABSOLUTE, winetestpath.Buffer, table, seen, NULL );
+    ok( status == STATUS_SUCCESS, "RtlQueryRegistryValues failed: 0x%08x\n", status );
+    for (i = 0; i < 40; i++) ok( seen[i] == 1, "value %d seen %u times\n", i, seen[i] );
+
+    for (i = 0; i < 40; i++)
+    {
+        nameW[0] = 'v';
+        nameW[1] = '0' + i / 10;
+        nameW[2] = '0' + i % 10;
+        nameW[3] = 0;
+        pRtlCreateUnicodeString( &name, nameW );
+        pNtDeleteValueKey( key, &name );
+        pRtlFreeUnicodeString( &name );
+    }
+    pNtClose( key );
+}
+
 static void test_NtOpenKey(void)
 {
     HANDLE key;
@@ -1295,6 +1363,7 @@ START_TEST(reg)
     test_RtlCheckRegistryKey();
     test_RtlOpenCurrentUser();
     test_RtlQueryRegistryValues();
+    test_RtlQueryRegistryValues_many();
     test_RtlpNtQueryValueKey();
     test_NtFlushKey();
     test_NtQueryValueKey();
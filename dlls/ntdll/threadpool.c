@@ -37,23 +37,128 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(threadpool);
 
-#define WORKER_TIMEOUT 30000 /* 30 seconds */
+#define THREADPOOL_WORKER_TIMEOUT   30000  /* idle workers above the minimum exit after 30 seconds */
+#define THREADPOOL_MONITOR_INTERVAL 100    /* ms without progress before another worker is started */
+#define THREADPOOL_MAX_WORKERS      500
+#define THREADPOOL_MAX_DEQUES       64
 
-static LONG num_workers;
-static LONG num_work_items;
-static LONG num_busy_workers;
+#define EXPIRE_NEVER (~(ULONGLONG) 0)
+
+/*
+ * Every pool has one deque per CPU.  Submissions are spread over the deques
+ * round-robin, and each worker drains its home deque first before stealing
+ * from the others, so that submitting and running threads rarely contend on
+ * the same lock.  Empty deques are skipped without taking their lock.
+ */
+struct threadpool_deque
+{
+    RTL_CRITICAL_SECTION       cs;
+    LONG                       count;   /* number of queued entries, may be read without the lock */
+    unsigned int               head;    /* index of the oldest entry */
+    unsigned int               size;    /* size of the ring buffer, a power of two */
+    struct threadpool_object **items;
+};
+
+/* generic timer, expired from the pool timer thread with timer_cs held */
+struct timer_entry
+{
+    struct list  entry;
+    ULONGLONG    timeout;   /* absolute expiration time in queue_current_time() units */
+    BOOL         queued;
+    void       (*expire)( struct timer_entry *timer );
+};
+
+struct threadpool
+{
+    LONG                    refcount;
+    LONG                    objcount;       /* number of objects bound to the pool */
+    BOOL                    shutdown;       /* pool has been released by its owner */
+    RTL_CRITICAL_SECTION    cs;             /* protects the worker counts */
+    HANDLE                  sem;            /* wakes up idle workers */
+    LONG                    max_workers;
+    LONG                    min_workers;
+    LONG                    num_workers;
+    LONG                    num_idle;       /* workers waiting on the semaphore */
+    LONG                    queued;         /* entries in all the deques */
+    LONG                    completed;      /* callbacks run so far, used to detect starvation */
+    LONG                    last_completed; /* value of completed at the last monitor check */
+    LONG                    monitor_armed;
+    LONG                    next_deque;     /* round-robin counter for submissions */
+    LONG                    next_home;      /* round-robin counter for worker home deques */
+    struct timer_entry      monitor;
+    unsigned int            num_deques;
+    struct threadpool_deque deques[1];
+};
+
+enum threadpool_objtype
+{
+    TP_OBJECT_TYPE_SIMPLE,
+    TP_OBJECT_TYPE_WORK_ITEM,
+    TP_OBJECT_TYPE_WORK,
+    TP_OBJECT_TYPE_TIMER,
+    TP_OBJECT_TYPE_WAIT
+};
+
+struct waitqueue_bucket;
 
-static struct list work_item_list = LIST_INIT(work_item_list);
-static HANDLE work_item_event;
+struct threadpool_object
+{
+    LONG                    refcount;
+    enum threadpool_objtype type;
+    struct threadpool      *pool;
+    PVOID                   userdata;
+    BOOL                    may_run_long;
+    LONG                    num_pending;    /* submitted callbacks not started yet */
+    LONG                    num_active;     /* pending and running callbacks */
+    LONG                    num_waiters;    /* threads waiting for num_active to drop to zero */
+    RTL_CONDITION_VARIABLE  finished;
+    union
+    {
+        struct
+        {
+            PTP_SIMPLE_CALLBACK callback;
+        } simple;
+        struct
+        {
+            PRTL_WORK_ITEM_ROUTINE function;
+        } work_item;
+        struct
+        {
+            PTP_WORK_CALLBACK callback;
+        } work;
+        struct
+        {
+            PTP_TIMER_CALLBACK callback;
+            struct timer_entry entry;
+            LONG               period;
+            BOOL               set;
+        } timer;
+        struct
+        {
+            PTP_WAIT_CALLBACK        callback;
+            struct waitqueue_bucket *bucket;
+            struct list              entry;     /* entry in the bucket waiting list */
+            HANDLE                   handle;
+            ULONGLONG                timeout;
+            TP_WAIT_RESULT           result;
+        } wait;
+    } u;
+};
 
-static RTL_CRITICAL_SECTION threadpool_cs;
-static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
+static struct threadpool *default_threadpool;
+
+static struct list timer_list = LIST_INIT( timer_list );
+static RTL_CONDITION_VARIABLE timer_cond;
+static BOOL timer_thread_running;
+
+static RTL_CRITICAL_SECTION timer_cs;
+static RTL_CRITICAL_SECTION_DEBUG timer_cs_debug =
 {
-    0, 0, &threadpool_cs,
-    { &critsect_debug.ProcessLocksList, &critsect_debug.ProcessLocksList },
-    0, 0, { (DWORD_PTR)(__FILE__ ": threadpool_cs") }
+    0, 0, &timer_cs,
+    { &timer_cs_debug.ProcessLocksList, &timer_cs_debug.ProcessLocksList },
+    0, 0, { (DWORD_PTR)(__FILE__ ": timer_cs") }
 };
-static RTL_CRITICAL_SECTION threadpool_cs = { &critsect_debug, -1, 0, 0, 0, 0 };
+static RTL_CRITICAL_SECTION timer_cs = { &timer_cs_debug, -1, 0, 0, 0, 0 };
 
 static HANDLE compl_port = NULL;
 static RTL_CRITICAL_SECTION threadpool_compl_cs;
@@ -65,13 +170,6 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_compl_debug =
 };
 static RTL_CRITICAL_SECTION threadpool_compl_cs = { &critsect_compl_debug, -1, 0, 0, 0, 0 };
 
-struct work_item
-{
-    struct list entry;
-    PRTL_WORK_ITEM_ROUTINE function;
-    PVOID context;
-};
-
 static inline LONG interlocked_inc( PLONG dest )
 {
     return interlocked_xchg_add( dest, 1 ) + 1;
@@ -82,82 +180,523 @@ static inline LONG interlocked_dec( PLONG dest )
     return interlocked_xchg_add( dest, -1 ) - 1;
 }
 
-static void WINAPI worker_thread_proc(void * param)
+static inline int interlocked_dec_if_nonzero( int *dest )
+{
+    int val, tmp;
+    for (val = *dest;; val = tmp)
+    {
+        if (!val || (tmp = interlocked_cmpxchg( dest, val - 1, val )) == val)
+            break;
+    }
+    return val;
+}
+
+static inline ULONGLONG queue_current_time(void)
 {
-    interlocked_inc(&num_workers);
+    LARGE_INTEGER now, freq;
+    NtQueryPerformanceCounter(&now, &freq);
+    return now.QuadPart * 1000 / freq.QuadPart;
+}
 
-    /* free the work item memory sooner to reduce memory usage */
-    while (TRUE)
+static void tp_pool_release( struct threadpool *pool );
+static NTSTATUS tp_pool_start_worker( struct threadpool *pool );
+
+/***********************************************************************
+ *           timer_thread_proc
+ *
+ * Expires the pool timers; the expire callbacks run with timer_cs held.
+ */
+static void CALLBACK timer_thread_proc( void *param )
+{
+    RtlEnterCriticalSection( &timer_cs );
+    for (;;)
     {
-        if (num_work_items > 0)
+        ULONGLONG now = queue_current_time();
+        struct timer_entry *timer = NULL;
+        LARGE_INTEGER timeout;
+        struct list *ptr;
+
+        while ((ptr = list_head( &timer_list )))
         {
-            struct list *item;
-            RtlEnterCriticalSection(&threadpool_cs);
-            item = list_head(&work_item_list);
-            if (item)
-            {
-                struct work_item *work_item_ptr = LIST_ENTRY(item, struct work_item, entry);
-                struct work_item work_item;
-                list_remove(&work_item_ptr->entry);
-                interlocked_dec(&num_work_items);
+            timer = LIST_ENTRY( ptr, struct timer_entry, entry );
+            if (timer->timeout > now) break;
+            list_remove( &timer->entry );
+            timer->queued = FALSE;
+            timer->expire( timer );
+            timer = NULL;
+        }
+
+        if (timer)
+        {
+            timeout.QuadPart = (timer->timeout - now) * -10000;
+            RtlSleepConditionVariableCS( &timer_cond, &timer_cs, &timeout );
+        }
+        else RtlSleepConditionVariableCS( &timer_cond, &timer_cs, NULL );
+    }
+}
+
+/* add a timer to the sorted list; timer_cs must be held */
+static void timer_add( struct timer_entry *timer )
+{
+    struct timer_entry *other;
+    struct list *ptr = &timer_list;
 
-                RtlLeaveCriticalSection(&threadpool_cs);
+    assert( !timer->queued );
 
-                work_item = *work_item_ptr;
-                RtlFreeHeap(GetProcessHeap(), 0, work_item_ptr);
+    if (!timer_thread_running)
+    {
+        HANDLE thread;
+        NTSTATUS status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                               timer_thread_proc, NULL, &thread, NULL );
+        if (status)
+        {
+            ERR( "failed to start timer thread: %08x\n", status );
+            return;
+        }
+        NtClose( thread );
+        timer_thread_running = TRUE;
+    }
 
-                TRACE("executing %p(%p)\n", work_item.function, work_item.context);
+    LIST_FOR_EACH_ENTRY( other, &timer_list, struct timer_entry, entry )
+    {
+        if (timer->timeout < other->timeout)
+        {
+            ptr = &other->entry;
+            break;
+        }
+    }
+    list_add_before( ptr, &timer->entry );
+    timer->queued = TRUE;
+    if (list_head( &timer_list ) == &timer->entry) RtlWakeAllConditionVariable( &timer_cond );
+}
 
-                interlocked_inc(&num_busy_workers);
+/* remove a timer from the list; timer_cs must be held */
+static void timer_remove( struct timer_entry *timer )
+{
+    if (!timer->queued) return;
+    list_remove( &timer->entry );
+    timer->queued = FALSE;
+}
 
-                /* do the work */
-                work_item.function(work_item.context);
+/***********************************************************************
+ *           tp_pool_monitor_expire
+ *
+ * Starts another worker when the queue made no progress since the last
+ * check, because all the workers are blocked in long callbacks.
+ */
+static void tp_pool_monitor_expire( struct timer_entry *timer )
+{
+    struct threadpool *pool = CONTAINING_RECORD( timer, struct threadpool, monitor );
+    LONG completed = pool->completed;
 
-                interlocked_dec(&num_busy_workers);
-            }
-            else
-                RtlLeaveCriticalSection(&threadpool_cs);
+    if (pool->queued && !pool->num_idle && completed == pool->last_completed)
+    {
+        RtlEnterCriticalSection( &pool->cs );
+        if (pool->num_workers < pool->max_workers)
+        {
+            TRACE( "pool %p starved, starting worker %u\n", pool, pool->num_workers + 1 );
+            tp_pool_start_worker( pool );
         }
-        else
+        RtlLeaveCriticalSection( &pool->cs );
+    }
+    pool->last_completed = completed;
+
+    pool->monitor_armed = 0;
+    if (pool->queued && !interlocked_cmpxchg( &pool->monitor_armed, 1, 0 ))
+    {
+        pool->monitor.timeout = queue_current_time() + THREADPOOL_MONITOR_INTERVAL;
+        timer_add( &pool->monitor );
+        if (pool->monitor.queued) return;  /* keep the reference */
+        pool->monitor_armed = 0;
+    }
+    tp_pool_release( pool );
+}
+
+static void tp_pool_arm_monitor( struct threadpool *pool )
+{
+    if (interlocked_cmpxchg( &pool->monitor_armed, 1, 0 )) return;
+
+    interlocked_inc( &pool->refcount );
+    pool->last_completed = pool->completed;
+    RtlEnterCriticalSection( &timer_cs );
+    pool->monitor.timeout = queue_current_time() + THREADPOOL_MONITOR_INTERVAL;
+    timer_add( &pool->monitor );
+    if (!pool->monitor.queued)
+    {
+        pool->monitor_armed = 0;
+        interlocked_dec( &pool->refcount );
+    }
+    RtlLeaveCriticalSection( &timer_cs );
+}
+
+/***********************************************************************
+ *           tp_pool_alloc
+ */
+static NTSTATUS tp_pool_alloc( struct threadpool **out )
+{
+    struct threadpool *pool;
+    unsigned int i, num_deques = NtCurrentTeb()->Peb->NumberOfProcessors;
+    NTSTATUS status;
+
+    if (!num_deques) num_deques = 1;
+    if (num_deques > THREADPOOL_MAX_DEQUES) num_deques = THREADPOOL_MAX_DEQUES;
+
+    if (!(pool = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                  FIELD_OFFSET( struct threadpool, deques[num_deques] ))))
+        return STATUS_NO_MEMORY;
+
+    if ((status = NtCreateSemaphore( &pool->sem, SEMAPHORE_ALL_ACCESS, NULL, 0, INT_MAX )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, pool );
+        return status;
+    }
+
+    pool->refcount       = 1;
+    pool->max_workers    = THREADPOOL_MAX_WORKERS;
+    pool->monitor.expire = tp_pool_monitor_expire;
+    pool->num_deques     = num_deques;
+    RtlInitializeCriticalSection( &pool->cs );
+    pool->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": threadpool.cs");
+    for (i = 0; i < num_deques; i++) RtlInitializeCriticalSection( &pool->deques[i].cs );
+
+    TRACE( "allocated pool %p with %u deques\n", pool, num_deques );
+    *out = pool;
+    return STATUS_SUCCESS;
+}
+
+static void tp_pool_release( struct threadpool *pool )
+{
+    unsigned int i;
+
+    if (interlocked_dec( &pool->refcount )) return;
+
+    TRACE( "destroying pool %p\n", pool );
+    assert( !pool->num_workers && !pool->objcount && !pool->queued );
+
+    for (i = 0; i < pool->num_deques; i++)
+    {
+        RtlDeleteCriticalSection( &pool->deques[i].cs );
+        RtlFreeHeap( GetProcessHeap(), 0, pool->deques[i].items );
+    }
+    pool->cs.DebugInfo->Spare[0] = 0;
+    RtlDeleteCriticalSection( &pool->cs );
+    NtClose( pool->sem );
+    RtlFreeHeap( GetProcessHeap(), 0, pool );
+}
+
+static NTSTATUS tp_pool_get_default( struct threadpool **out )
+{
+    struct threadpool *pool;
+    NTSTATUS status;
+
+    if (!default_threadpool)
+    {
+        if ((status = tp_pool_alloc( &pool ))) return status;
+        if (interlocked_cmpxchg_ptr( (void **)&default_threadpool, pool, NULL ))
+            tp_pool_release( pool );  /* somebody beat us to it */
+    }
+    *out = default_threadpool;
+    return STATUS_SUCCESS;
+}
+
+/* wake up the workers of a pool that has been shut down once it has no objects left */
+static void tp_pool_unbind( struct threadpool *pool )
+{
+    if (!interlocked_dec( &pool->objcount ) && pool->shutdown && pool->num_workers)
+        NtReleaseSemaphore( pool->sem, pool->num_workers, NULL );
+    tp_pool_release( pool );
+}
+
+static NTSTATUS tp_pool_push( struct threadpool *pool, struct threadpool_object *object )
+{
+    struct threadpool_deque *deque;
+
+    deque = &pool->deques[(unsigned int)interlocked_inc( &pool->next_deque ) % pool->num_deques];
+
+    RtlEnterCriticalSection( &deque->cs );
+    if (deque->count == deque->size)
+    {
+        unsigned int i, new_size = deque->size ? deque->size * 2 : 16;
+        struct threadpool_object **items;
+
+        if (!(items = RtlAllocateHeap( GetProcessHeap(), 0, new_size * sizeof(*items) )))
         {
-            NTSTATUS status;
-            LARGE_INTEGER timeout;
-            timeout.QuadPart = -(WORKER_TIMEOUT * (ULONGLONG)10000);
-            status = NtWaitForSingleObject(work_item_event, FALSE, &timeout);
-            if (status != STATUS_WAIT_0)
-                break;
+            RtlLeaveCriticalSection( &deque->cs );
+            return STATUS_NO_MEMORY;
+        }
+        for (i = 0; i < deque->count; i++)
+            items[i] = deque->items[(deque->head + i) & (deque->size - 1)];
+        RtlFreeHeap( GetProcessHeap(), 0, deque->items );
+        deque->items = items;
+        deque->size  = new_size;
+        deque->head  = 0;
+    }
+    deque->items[(deque->head + deque->count) & (deque->size - 1)] = object;
+    deque->count++;
+    RtlLeaveCriticalSection( &deque->cs );
+
+    interlocked_inc( &pool->queued );
+    return STATUS_SUCCESS;
+}
+
+static struct threadpool_object *tp_pool_pop( struct threadpool *pool, unsigned int home )
+{
+    unsigned int i;
+
+    for (i = 0; i < pool->num_deques; i++)
+    {
+        struct threadpool_deque *deque = &pool->deques[(home + i) % pool->num_deques];
+        struct threadpool_object *object = NULL;
+
+        if (!deque->count) continue;
+
+        RtlEnterCriticalSection( &deque->cs );
+        if (deque->count)
+        {
+            object = deque->items[deque->head];
+            deque->head = (deque->head + 1) & (deque->size - 1);
+            deque->count--;
+        }
+        RtlLeaveCriticalSection( &deque->cs );
+
+        if (object)
+        {
+            interlocked_dec( &pool->queued );
+            return object;
         }
     }
+    return NULL;
+}
+
+static void tp_object_release( struct threadpool_object *object )
+{
+    struct threadpool *pool = object->pool;
+
+    if (interlocked_dec( &object->refcount )) return;
+
+    TRACE( "destroying object %p of type %u\n", object, object->type );
+    assert( !object->num_active );
+    RtlFreeHeap( GetProcessHeap(), 0, object );
+    tp_pool_unbind( pool );
+}
+
+/* called when a pending or running callback is done or cancelled */
+static void tp_object_finished( struct threadpool_object *object, LONG count )
+{
+    if (interlocked_xchg_add( &object->num_active, -count ) != count) return;
+    if (!object->num_waiters) return;
 
-    interlocked_dec(&num_workers);
+    RtlEnterCriticalSection( &object->pool->cs );
+    RtlWakeAllConditionVariable( &object->finished );
+    RtlLeaveCriticalSection( &object->pool->cs );
+}
 
-    RtlExitUserThread(0);
+static void tp_object_execute( struct threadpool_object *object )
+{
+    PTP_CALLBACK_INSTANCE instance = (PTP_CALLBACK_INSTANCE)object;
 
-    /* never reached */
+    if (interlocked_dec_if_nonzero( &object->num_pending ))
+    {
+        switch (object->type)
+        {
+        case TP_OBJECT_TYPE_SIMPLE:
+            TRACE( "executing simple callback %p(%p, %p)\n",
+                   object->u.simple.callback, instance, object->userdata );
+            object->u.simple.callback( instance, object->userdata );
+            break;
+        case TP_OBJECT_TYPE_WORK_ITEM:
+            TRACE( "executing %p(%p)\n", object->u.work_item.function, object->userdata );
+            object->u.work_item.function( object->userdata );
+            break;
+        case TP_OBJECT_TYPE_WORK:
+            TRACE( "executing work callback %p(%p, %p, %p)\n",
+                   object->u.work.callback, instance, object->userdata, object );
+            object->u.work.callback( instance, object->userdata, (TP_WORK *)object );
+            break;
+        case TP_OBJECT_TYPE_TIMER:
+            TRACE( "executing timer callback %p(%p, %p, %p)\n",
+                   object->u.timer.callback, instance, object->userdata, object );
+            object->u.timer.callback( instance, object->userdata, (TP_TIMER *)object );
+            break;
+        case TP_OBJECT_TYPE_WAIT:
+            TRACE( "executing wait callback %p(%p, %p, %p, %u)\n",
+                   object->u.wait.callback, instance, object->userdata, object, object->u.wait.result );
+            object->u.wait.callback( instance, object->userdata, (TP_WAIT *)object, object->u.wait.result );
+            break;
+        }
+        interlocked_inc( &object->pool->completed );
+        tp_object_finished( object, 1 );
+    }
+    tp_object_release( object );
 }
 
-static NTSTATUS add_work_item_to_queue(struct work_item *work_item)
+/***********************************************************************
+ *           threadpool_worker_proc
+ */
+static void CALLBACK threadpool_worker_proc( void *param )
 {
+    struct threadpool *pool = param;
+    unsigned int home = (unsigned int)interlocked_inc( &pool->next_home ) % pool->num_deques;
+    struct threadpool_object *object;
+    LARGE_INTEGER timeout;
     NTSTATUS status;
 
-    RtlEnterCriticalSection(&threadpool_cs);
-    list_add_tail(&work_item_list, &work_item->entry);
-    num_work_items++;
-    RtlLeaveCriticalSection(&threadpool_cs);
+    for (;;)
+    {
+        if ((object = tp_pool_pop( pool, home )))
+        {
+            tp_object_execute( object );
+            continue;
+        }
+
+        interlocked_inc( &pool->num_idle );
+        if (pool->queued)
+        {
+            interlocked_dec( &pool->num_idle );
+            continue;
+        }
+        timeout.QuadPart = (ULONGLONG)THREADPOOL_WORKER_TIMEOUT * -10000;
+        status = NtWaitForSingleObject( pool->sem, FALSE, &timeout );
+        interlocked_dec( &pool->num_idle );
+
+        if (status != STATUS_TIMEOUT && !pool->shutdown) continue;
+
+        RtlEnterCriticalSection( &pool->cs );
+        if (!pool->queued && ((pool->shutdown && !pool->objcount) ||
+                              (status == STATUS_TIMEOUT && pool->num_workers > pool->min_workers)))
+        {
+            pool->num_workers--;
+            RtlLeaveCriticalSection( &pool->cs );
+            break;
+        }
+        RtlLeaveCriticalSection( &pool->cs );
+    }
+
+    TRACE( "worker of pool %p exiting\n", pool );
+    tp_pool_release( pool );
+    RtlExitUserThread( 0 );
+}
+
+/* start a new worker thread; pool->cs must be held */
+static NTSTATUS tp_pool_start_worker( struct threadpool *pool )
+{
+    HANDLE thread;
+    NTSTATUS status;
 
-    if (!work_item_event)
+    interlocked_inc( &pool->refcount );
+    status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                  threadpool_worker_proc, pool, &thread, NULL );
+    if (status)
     {
-        HANDLE sem;
-        status = NtCreateSemaphore(&sem, SEMAPHORE_ALL_ACCESS, NULL, 1, INT_MAX);
-        if (interlocked_cmpxchg_ptr( &work_item_event, sem, 0 ))
-            NtClose(sem);  /* somebody beat us to it */
+        interlocked_dec( &pool->refcount );
+        return status;
     }
-    else
-        status = NtReleaseSemaphore(work_item_event, 1, NULL);
+    pool->num_workers++;
+    NtClose( thread );
+    return STATUS_SUCCESS;
+}
 
+/***********************************************************************
+ *           tp_pool_wake
+ *
+ * Makes sure somebody picks up a newly queued entry: an idle worker if
+ * there is one, otherwise a new worker as long as there are fewer workers
+ * than CPUs (or the callback may block for a long time), otherwise the
+ * starvation monitor.
+ */
+static NTSTATUS tp_pool_wake( struct threadpool *pool, BOOL may_run_long )
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    BOOL monitor = FALSE;
+
+    if (pool->num_idle > 0) return NtReleaseSemaphore( pool->sem, 1, NULL );
+
+    RtlEnterCriticalSection( &pool->cs );
+    if (pool->num_workers < pool->max_workers &&
+        (!pool->num_workers || may_run_long ||
+         pool->num_workers < NtCurrentTeb()->Peb->NumberOfProcessors))
+    {
+        status = tp_pool_start_worker( pool );
+        /* we don't care if the thread creation failed as long as there is a worker */
+        if (status && pool->num_workers) status = STATUS_SUCCESS;
+    }
+    else monitor = TRUE;
+    RtlLeaveCriticalSection( &pool->cs );
+
+    if (monitor) tp_pool_arm_monitor( pool );
     return status;
 }
 
+static NTSTATUS tp_object_submit( struct threadpool_object *object )
+{
+    NTSTATUS status;
+
+    interlocked_inc( &object->refcount );
+    interlocked_inc( &object->num_active );
+    interlocked_inc( &object->num_pending );
+
+    if ((status = tp_pool_push( object->pool, object )))
+    {
+        interlocked_dec( &object->num_pending );
+        tp_object_finished( object, 1 );
+        tp_object_release( object );
+        return status;
+    }
+    return tp_pool_wake( object->pool, object->may_run_long );
+}
+
+/* cancel the callbacks that have not started yet */
+static void tp_object_cancel( struct threadpool_object *object )
+{
+    LONG pending = interlocked_xchg( &object->num_pending, 0 );
+    if (pending) tp_object_finished( object, pending );
+}
+
+/* wait for the running and pending callbacks to complete */
+static void tp_object_wait( struct threadpool_object *object )
+{
+    struct threadpool *pool = object->pool;
+
+    RtlEnterCriticalSection( &pool->cs );
+    interlocked_inc( &object->num_waiters );
+    while (object->num_active)
+        RtlSleepConditionVariableCS( &object->finished, &pool->cs, NULL );
+    interlocked_dec( &object->num_waiters );
+    RtlLeaveCriticalSection( &pool->cs );
+}
+
+static NTSTATUS tp_object_alloc( struct threadpool_object **out, enum threadpool_objtype type,
+                                 PVOID userdata, TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    struct threadpool *pool;
+    NTSTATUS status;
+
+    if (environment && environment->Pool) pool = (struct threadpool *)environment->Pool;
+    else if ((status = tp_pool_get_default( &pool ))) return status;
+
+    if (!(object = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*object) )))
+        return STATUS_NO_MEMORY;
+
+    if (environment)
+    {
+        if (environment->CleanupGroup || environment->FinalizationCallback)
+            FIXME( "cleanup groups and finalization callbacks not supported\n" );
+        object->may_run_long = environment->u.s.LongFunction;
+    }
+
+    object->refcount = 1;
+    object->type     = type;
+    object->pool     = pool;
+    object->userdata = userdata;
+    RtlInitializeConditionVariable( &object->finished );
+    interlocked_inc( &pool->refcount );
+    interlocked_inc( &pool->objcount );
+
+    *out = object;
+    return STATUS_SUCCESS;
+}
+
 /***********************************************************************
  *              RtlQueueWorkItem   (NTDLL.@)
  *
@@ -182,52 +721,21 @@ static NTSTATUS add_work_item_to_queue(struct work_item *work_item)
  */
 NTSTATUS WINAPI RtlQueueWorkItem(PRTL_WORK_ITEM_ROUTINE Function, PVOID Context, ULONG Flags)
 {
-    HANDLE thread;
+    struct threadpool_object *object;
     NTSTATUS status;
-    struct work_item *work_item = RtlAllocateHeap(GetProcessHeap(), 0, sizeof(struct work_item));
-
-    if (!work_item)
-        return STATUS_NO_MEMORY;
-
-    work_item->function = Function;
-    work_item->context = Context;
 
     if (Flags & ~WT_EXECUTELONGFUNCTION)
         FIXME("Flags 0x%x not supported\n", Flags);
 
-    status = add_work_item_to_queue(work_item);
-
-    /* FIXME: tune this algorithm to not be as aggressive with creating threads
-     * if WT_EXECUTELONGFUNCTION isn't specified */
-    if ((status == STATUS_SUCCESS) &&
-        ((num_workers == 0) || (num_workers == num_busy_workers)))
-    {
-        status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE,
-                                    NULL, 0, 0,
-                                    worker_thread_proc, NULL, &thread, NULL );
-        if (status == STATUS_SUCCESS)
-            NtClose( thread );
-
-        /* NOTE: we don't care if we couldn't create the thread if there is at
-         * least one other available to process the request */
-        if ((num_workers > 0) && (status != STATUS_SUCCESS))
-            status = STATUS_SUCCESS;
-    }
-
-    if (status != STATUS_SUCCESS)
-    {
-        RtlEnterCriticalSection(&threadpool_cs);
-
-        interlocked_dec(&num_work_items);
-        list_remove(&work_item->entry);
-        RtlFreeHeap(GetProcessHeap(), 0, work_item);
+    status = tp_object_alloc( &object, TP_OBJECT_TYPE_WORK_ITEM, Context, NULL );
+    if (status) return status;
 
-        RtlLeaveCriticalSection(&threadpool_cs);
+    object->u.work_item.function = Function;
+    object->may_run_long = (Flags & WT_EXECUTELONGFUNCTION) != 0;
 
-        return status;
-    }
-
-    return STATUS_SUCCESS;
+    if ((status = tp_object_submit( object ))) tp_object_cancel( object );
+    tp_object_release( object );
+    return status;
 }
 
 /***********************************************************************
@@ -297,7 +805,7 @@ NTSTATUS WINAPI RtlSetIoCompletionCallback(HANDLE FileHandle, PRTL_OVERLAPPED_CO
             if (!res)
             {
                 /* FIXME native can start additional threads in case of e.g. hung callback function. */
-                res = RtlQueueWorkItem( iocp_poller, NULL, WT_EXECUTEDEFAULT );
+                res = RtlQueueWorkItem( iocp_poller, NULL, WT_EXECUTELONGFUNCTION );
                 if (!res)
                     compl_port = cport;
                 else
@@ -561,7 +1069,6 @@ struct timer_queue
     HANDLE thread;
 };
 
-#define EXPIRE_NEVER (~(ULONGLONG) 0)
 #define TIMER_QUEUE_MAGIC 0x516d6954  /* TimQ */
 
 static void queue_remove_timer(struct queue_timer *t)
@@ -605,15 +1112,8 @@ static DWORD WINAPI timer_callback_wrapper(LPVOID p)
     return 0;
 }
 
-static inline ULONGLONG queue_current_time(void)
-{
-    LARGE_INTEGER now, freq;
-    NtQueryPerformanceCounter(&now, &freq);
-    return now.QuadPart * 1000 / freq.QuadPart;
-}
-
-static void queue_add_timer(struct queue_timer *t, ULONGLONG time,
-                            BOOL set_event)
+static void queue_add_timer(struct queue_timer *t, ULONGLONG time,
+                            BOOL set_event)
 {
     /* We MUST hold the queue cs while calling this function.  */
     struct timer_queue *q = t->q;
@@ -1055,3 +1555,561 @@ NTSTATUS WINAPI RtlDeleteTimer(HANDLE TimerQueue, HANDLE Timer,
 
     return status;
 }
+
+
+/************************** Thread pool API **************************/
+
+#define MAXIMUM_WAITQUEUE_OBJECTS (MAXIMUM_WAIT_OBJECTS - 1)
+#define WAITQUEUE_IDLE_TIMEOUT    10000  /* wait threads without waits exit after 10 seconds */
+
+/* a thread waiting on behalf of up to MAXIMUM_WAITQUEUE_OBJECTS wait objects */
+struct waitqueue_bucket
+{
+    struct list entry;          /* entry in waitqueue_buckets */
+    LONG        objcount;       /* number of waits in the bucket */
+    struct list waiting;        /* waits this thread is blocked on */
+    HANDLE      update_event;   /* signaled when the waiting list changes */
+};
+
+static struct list waitqueue_buckets = LIST_INIT( waitqueue_buckets );
+
+static RTL_CRITICAL_SECTION waitqueue_cs;
+static RTL_CRITICAL_SECTION_DEBUG waitqueue_cs_debug =
+{
+    0, 0, &waitqueue_cs,
+    { &waitqueue_cs_debug.ProcessLocksList, &waitqueue_cs_debug.ProcessLocksList },
+    0, 0, { (DWORD_PTR)(__FILE__ ": waitqueue_cs") }
+};
+static RTL_CRITICAL_SECTION waitqueue_cs = { &waitqueue_cs_debug, -1, 0, 0, 0, 0 };
+
+static inline struct threadpool *impl_from_TP_POOL( TP_POOL *pool )
+{
+    return (struct threadpool *)pool;
+}
+
+static inline struct threadpool_object *impl_from_TP_WORK( TP_WORK *work )
+{
+    struct threadpool_object *object = (struct threadpool_object *)work;
+    assert( object->type == TP_OBJECT_TYPE_WORK );
+    return object;
+}
+
+static inline struct threadpool_object *impl_from_TP_TIMER( TP_TIMER *timer )
+{
+    struct threadpool_object *object = (struct threadpool_object *)timer;
+    assert( object->type == TP_OBJECT_TYPE_TIMER );
+    return object;
+}
+
+static inline struct threadpool_object *impl_from_TP_WAIT( TP_WAIT *wait )
+{
+    struct threadpool_object *object = (struct threadpool_object *)wait;
+    assert( object->type == TP_OBJECT_TYPE_WAIT );
+    return object;
+}
+
+/* convert an NT timeout (relative if negative, absolute otherwise) to queue_current_time() units */
+static ULONGLONG tp_get_expire( const LARGE_INTEGER *timeout )
+{
+    ULONGLONG now = queue_current_time();
+    LARGE_INTEGER system_time;
+
+    if (!timeout) return EXPIRE_NEVER;
+    if (timeout->QuadPart < 0) return now + (-timeout->QuadPart + 9999) / 10000;
+
+    NtQuerySystemTime( &system_time );
+    if (timeout->QuadPart <= system_time.QuadPart) return now;
+    return now + (timeout->QuadPart - system_time.QuadPart + 9999) / 10000;
+}
+
+static void tp_timer_expire( struct timer_entry *timer )
+{
+    struct threadpool_object *object = CONTAINING_RECORD( timer, struct threadpool_object, u.timer.entry );
+
+    if (object->u.timer.period)
+    {
+        ULONGLONG now = queue_current_time();
+        timer->timeout += object->u.timer.period;
+        if (timer->timeout < now) timer->timeout = now + object->u.timer.period;
+        timer_add( timer );
+    }
+    else object->u.timer.set = FALSE;  /* one-shot timers are no longer set once expired */
+    tp_object_submit( object );
+}
+
+/* remove a wait from its bucket; waitqueue_cs must be held */
+static void tp_wait_remove( struct threadpool_object *wait )
+{
+    struct waitqueue_bucket *bucket = wait->u.wait.bucket;
+
+    if (!bucket) return;
+    list_remove( &wait->u.wait.entry );
+    bucket->objcount--;
+    wait->u.wait.bucket = NULL;
+}
+
+static void tp_wait_signal( struct threadpool_object *wait, TP_WAIT_RESULT result )
+{
+    tp_wait_remove( wait );
+    wait->u.wait.result = result;
+    tp_object_submit( wait );
+}
+
+/* check that a wait is still queued in the bucket on the same handle; waitqueue_cs must be held */
+static BOOL tp_wait_is_current( struct waitqueue_bucket *bucket, struct threadpool_object *object,
+                                HANDLE handle )
+{
+    struct threadpool_object *wait;
+
+    LIST_FOR_EACH_ENTRY( wait, &bucket->waiting, struct threadpool_object, u.wait.entry )
+        if (wait == object) return wait->u.wait.handle == handle;
+    return FALSE;
+}
+
+/* a multiple wait failed, poll the handles one at a time to find the ones that can't be
+ * waited on, e.g. because they were closed; waitqueue_cs must be held */
+static void tp_wait_check_handles( struct waitqueue_bucket *bucket, struct threadpool_object **objects,
+                                   const HANDLE *handles, unsigned int count )
+{
+    LARGE_INTEGER zero;
+    NTSTATUS status;
+    unsigned int i;
+
+    zero.QuadPart = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (!tp_wait_is_current( bucket, objects[i], handles[i] )) continue;
+        status = NtWaitForMultipleObjects( 1, &handles[i], FALSE, FALSE, &zero );
+        if (status == STATUS_TIMEOUT) continue;
+        if (status == STATUS_WAIT_0) tp_wait_signal( objects[i], WAIT_OBJECT_0 );
+        else if (status == STATUS_ABANDONED_WAIT_0) tp_wait_signal( objects[i], WAIT_ABANDONED );
+        else
+        {
+            /* the wait can never be satisfied, stop waiting on it */
+            WARN( "can't wait on %p for %p: %08x\n", handles[i], objects[i], status );
+            tp_wait_remove( objects[i] );
+        }
+    }
+}
+
+/***********************************************************************
+ *           waitqueue_thread_proc
+ */
+static void CALLBACK waitqueue_thread_proc( void *param )
+{
+    struct waitqueue_bucket *bucket = param;
+    struct threadpool_object *objects[MAXIMUM_WAITQUEUE_OBJECTS];
+    HANDLE handles[MAXIMUM_WAITQUEUE_OBJECTS + 1];
+    struct threadpool_object *wait, *next;
+    NTSTATUS status = STATUS_SUCCESS;
+    LARGE_INTEGER timeout;
+    ULONGLONG now, expire;
+    unsigned int count;
+
+    RtlEnterCriticalSection( &waitqueue_cs );
+    for (;;)
+    {
+        now = queue_current_time();
+        expire = EXPIRE_NEVER;
+        count = 0;
+
+        LIST_FOR_EACH_ENTRY_SAFE( wait, next, &bucket->waiting, struct threadpool_object, u.wait.entry )
+        {
+            if (wait->u.wait.timeout <= now)
+            {
+                tp_wait_signal( wait, WAIT_TIMEOUT );
+                continue;
+            }
+            if (wait->u.wait.timeout < expire) expire = wait->u.wait.timeout;
+            objects[count] = wait;
+            handles[count++] = wait->u.wait.handle;
+        }
+
+        if (!bucket->objcount)
+        {
+            if (status == STATUS_TIMEOUT) break;
+            expire = now + WAITQUEUE_IDLE_TIMEOUT;
+        }
+        handles[count] = bucket->update_event;
+        timeout.QuadPart = (expire - now) * -10000;
+
+        RtlLeaveCriticalSection( &waitqueue_cs );
+        status = NtWaitForMultipleObjects( count + 1, handles, FALSE, FALSE,
+                                           expire != EXPIRE_NEVER ? &timeout : NULL );
+        RtlEnterCriticalSection( &waitqueue_cs );
+
+        if ((status >= STATUS_WAIT_0 && status < STATUS_WAIT_0 + count) ||
+            (status >= STATUS_ABANDONED_WAIT_0 && status < STATUS_ABANDONED_WAIT_0 + count))
+        {
+            unsigned int index = status >= STATUS_ABANDONED_WAIT_0 ? status - STATUS_ABANDONED_WAIT_0
+                                                                   : status - STATUS_WAIT_0;
+
+            /* make sure the wait hasn't been removed or changed in the meantime */
+            if (tp_wait_is_current( bucket, objects[index], handles[index] ))
+                tp_wait_signal( objects[index], status >= STATUS_ABANDONED_WAIT_0 ? WAIT_ABANDONED
+                                                                                  : WAIT_OBJECT_0 );
+        }
+        else if (status == STATUS_TIMEOUT && count) status = STATUS_SUCCESS;
+        else if (status != STATUS_WAIT_0 + count && status != STATUS_TIMEOUT)
+        {
+            WARN( "wait failed: %08x\n", status );
+            tp_wait_check_handles( bucket, objects, handles, count );
+            status = STATUS_SUCCESS;
+        }
+    }
+
+    list_remove( &bucket->entry );
+    RtlLeaveCriticalSection( &waitqueue_cs );
+
+    TRACE( "wait bucket %p exiting\n", bucket );
+    NtClose( bucket->update_event );
+    RtlFreeHeap( GetProcessHeap(), 0, bucket );
+    RtlExitUserThread( 0 );
+}
+
+/* add a wait to a bucket with some room left; waitqueue_cs must be held */
+static NTSTATUS tp_wait_add( struct threadpool_object *wait )
+{
+    struct waitqueue_bucket *bucket;
+    HANDLE thread;
+    NTSTATUS status;
+
+    LIST_FOR_EACH_ENTRY( bucket, &waitqueue_buckets, struct waitqueue_bucket, entry )
+        if (bucket->objcount < MAXIMUM_WAITQUEUE_OBJECTS) goto found;
+
+    if (!(bucket = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*bucket) )))
+        return STATUS_NO_MEMORY;
+
+    bucket->objcount = 0;
+    list_init( &bucket->waiting );
+    if ((status = NtCreateEvent( &bucket->update_event, EVENT_ALL_ACCESS, NULL,
+                                 SynchronizationEvent, FALSE )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+        return status;
+    }
+    if ((status = RtlCreateUserThread( GetCurrentProcess(), NULL, FALSE, NULL, 0, 0,
+                                       waitqueue_thread_proc, bucket, &thread, NULL )))
+    {
+        NtClose( bucket->update_event );
+        RtlFreeHeap( GetProcessHeap(), 0, bucket );
+        return status;
+    }
+    NtClose( thread );
+    list_add_tail( &waitqueue_buckets, &bucket->entry );
+
+found:
+    list_add_tail( &bucket->waiting, &wait->u.wait.entry );
+    bucket->objcount++;
+    wait->u.wait.bucket = bucket;
+    NtSetEvent( bucket->update_event, NULL );
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpAllocPool    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocPool( TP_POOL **out, PVOID reserved )
+{
+    TRACE( "%p %p\n", out, reserved );
+
+    if (reserved) FIXME( "reserved argument is nonzero (%p)\n", reserved );
+    return tp_pool_alloc( (struct threadpool **)out );
+}
+
+/***********************************************************************
+ *           TpReleasePool    (NTDLL.@)
+ */
+VOID WINAPI TpReleasePool( TP_POOL *pool )
+{
+    struct threadpool *this = impl_from_TP_POOL( pool );
+
+    TRACE( "%p\n", pool );
+
+    RtlEnterCriticalSection( &this->cs );
+    this->shutdown = TRUE;
+    if (!this->objcount && this->num_workers)
+        NtReleaseSemaphore( this->sem, this->num_workers, NULL );
+    RtlLeaveCriticalSection( &this->cs );
+
+    tp_pool_release( this );
+}
+
+/***********************************************************************
+ *           TpSetPoolMaxThreads    (NTDLL.@)
+ */
+VOID WINAPI TpSetPoolMaxThreads( TP_POOL *pool, DWORD maximum )
+{
+    struct threadpool *this = impl_from_TP_POOL( pool );
+
+    TRACE( "%p %u\n", pool, maximum );
+
+    RtlEnterCriticalSection( &this->cs );
+    this->max_workers = max( maximum, 1 );
+    this->min_workers = min( this->min_workers, this->max_workers );
+    RtlLeaveCriticalSection( &this->cs );
+}
+
+/***********************************************************************
+ *           TpSetPoolMinThreads    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpSetPoolMinThreads( TP_POOL *pool, DWORD minimum )
+{
+    struct threadpool *this = impl_from_TP_POOL( pool );
+    NTSTATUS status = STATUS_SUCCESS;
+
+    TRACE( "%p %u\n", pool, minimum );
+
+    RtlEnterCriticalSection( &this->cs );
+    while (this->num_workers < (LONG)minimum)
+        if ((status = tp_pool_start_worker( this ))) break;
+    if (!status)
+    {
+        this->min_workers = minimum;
+        this->max_workers = max( this->min_workers, this->max_workers );
+    }
+    RtlLeaveCriticalSection( &this->cs );
+    return status;
+}
+
+/***********************************************************************
+ *           TpSimpleTryPost    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpSimpleTryPost( PTP_SIMPLE_CALLBACK callback, PVOID userdata,
+                                 TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p\n", callback, userdata, environment );
+
+    if ((status = tp_object_alloc( &object, TP_OBJECT_TYPE_SIMPLE, userdata, environment )))
+        return status;
+
+    object->u.simple.callback = callback;
+    if ((status = tp_object_submit( object ))) tp_object_cancel( object );
+    tp_object_release( object );
+    return status;
+}
+
+/***********************************************************************
+ *           TpAllocWork    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocWork( TP_WORK **out, PTP_WORK_CALLBACK callback, PVOID userdata,
+                             TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p %p\n", out, callback, userdata, environment );
+
+    if ((status = tp_object_alloc( &object, TP_OBJECT_TYPE_WORK, userdata, environment )))
+        return status;
+
+    object->u.work.callback = callback;
+    *out = (TP_WORK *)object;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpPostWork    (NTDLL.@)
+ */
+VOID WINAPI TpPostWork( TP_WORK *work )
+{
+    struct threadpool_object *this = impl_from_TP_WORK( work );
+    NTSTATUS status;
+
+    TRACE( "%p\n", work );
+
+    if ((status = tp_object_submit( this ))) ERR( "failed to submit %p: %08x\n", work, status );
+}
+
+/***********************************************************************
+ *           TpWaitForWork    (NTDLL.@)
+ */
+VOID WINAPI TpWaitForWork( TP_WORK *work, BOOL cancel_pending )
+{
+    struct threadpool_object *this = impl_from_TP_WORK( work );
+
+    TRACE( "%p %d\n", work, cancel_pending );
+
+    if (cancel_pending) tp_object_cancel( this );
+    tp_object_wait( this );
+}
+
+/***********************************************************************
+ *           TpReleaseWork    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseWork( TP_WORK *work )
+{
+    struct threadpool_object *this = impl_from_TP_WORK( work );
+
+    TRACE( "%p\n", work );
+
+    tp_object_release( this );
+}
+
+/***********************************************************************
+ *           TpAllocTimer    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocTimer( TP_TIMER **out, PTP_TIMER_CALLBACK callback, PVOID userdata,
+                              TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p %p\n", out, callback, userdata, environment );
+
+    if ((status = tp_object_alloc( &object, TP_OBJECT_TYPE_TIMER, userdata, environment )))
+        return status;
+
+    object->u.timer.callback = callback;
+    object->u.timer.entry.expire = tp_timer_expire;
+    *out = (TP_TIMER *)object;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpSetTimer    (NTDLL.@)
+ */
+VOID WINAPI TpSetTimer( TP_TIMER *timer, LARGE_INTEGER *timeout, LONG period, LONG window_length )
+{
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
+
+    TRACE( "%p %p %d %d\n", timer, timeout, period, window_length );
+
+    RtlEnterCriticalSection( &timer_cs );
+    timer_remove( &this->u.timer.entry );
+    this->u.timer.set = timeout != NULL;
+    this->u.timer.period = period;
+    if (timeout)
+    {
+        this->u.timer.entry.timeout = tp_get_expire( timeout );
+        timer_add( &this->u.timer.entry );
+    }
+    RtlLeaveCriticalSection( &timer_cs );
+}
+
+/***********************************************************************
+ *           TpIsTimerSet    (NTDLL.@)
+ */
+BOOL WINAPI TpIsTimerSet( TP_TIMER *timer )
+{
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
+
+    TRACE( "%p\n", timer );
+
+    return this->u.timer.set;
+}
+
+/***********************************************************************
+ *           TpWaitForTimer    (NTDLL.@)
+ */
+VOID WINAPI TpWaitForTimer( TP_TIMER *timer, BOOL cancel_pending )
+{
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
+
+    TRACE( "%p %d\n", timer, cancel_pending );
+
+    if (cancel_pending) tp_object_cancel( this );
+    tp_object_wait( this );
+}
+
+/***********************************************************************
+ *           TpReleaseTimer    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseTimer( TP_TIMER *timer )
+{
+    struct threadpool_object *this = impl_from_TP_TIMER( timer );
+
+    TRACE( "%p\n", timer );
+
+    RtlEnterCriticalSection( &timer_cs );
+    timer_remove( &this->u.timer.entry );
+    this->u.timer.set = FALSE;
+    RtlLeaveCriticalSection( &timer_cs );
+
+    tp_object_release( this );
+}
+
+/***********************************************************************
+ *           TpAllocWait    (NTDLL.@)
+ */
+NTSTATUS WINAPI TpAllocWait( TP_WAIT **out, PTP_WAIT_CALLBACK callback, PVOID userdata,
+                             TP_CALLBACK_ENVIRON *environment )
+{
+    struct threadpool_object *object;
+    NTSTATUS status;
+
+    TRACE( "%p %p %p %p\n", out, callback, userdata, environment );
+
+    if ((status = tp_object_alloc( &object, TP_OBJECT_TYPE_WAIT, userdata, environment )))
+        return status;
+
+    object->u.wait.callback = callback;
+    *out = (TP_WAIT *)object;
+    return STATUS_SUCCESS;
+}
+
+/***********************************************************************
+ *           TpSetWait    (NTDLL.@)
+ */
+VOID WINAPI TpSetWait( TP_WAIT *wait, HANDLE handle, LARGE_INTEGER *timeout )
+{
+    struct threadpool_object *this = impl_from_TP_WAIT( wait );
+    NTSTATUS status = STATUS_SUCCESS;
+
+    TRACE( "%p %p %p\n", wait, handle, timeout );
+
+    RtlEnterCriticalSection( &waitqueue_cs );
+    if (this->u.wait.bucket)
+    {
+        NtSetEvent( this->u.wait.bucket->update_event, NULL );
+        tp_wait_remove( this );
+    }
+    if (handle)
+    {
+        this->u.wait.handle  = handle;
+        this->u.wait.timeout = tp_get_expire( timeout );
+        if (timeout && this->u.wait.timeout <= queue_current_time())
+            tp_wait_signal( this, WAIT_TIMEOUT );
+        else
+            status = tp_wait_add( this );
+    }
+    RtlLeaveCriticalSection( &waitqueue_cs );
+
+    if (status) ERR( "failed to set wait %p: %08x\n", wait, status );
+}
+
+/***********************************************************************
+ *           TpWaitForWait    (NTDLL.@)
+ */
+VOID WINAPI TpWaitForWait( TP_WAIT *wait, BOOL cancel_pending )
+{
+    struct threadpool_object *this = impl_from_TP_WAIT( wait );
+
+    TRACE( "%p %d\n", wait, cancel_pending );
+
+    if (cancel_pending) tp_object_cancel( this );
+    tp_object_wait( this );
+}
+
+/***********************************************************************
+ *           TpReleaseWait    (NTDLL.@)
+ */
+VOID WINAPI TpReleaseWait( TP_WAIT *wait )
+{
+    struct threadpool_object *this = impl_from_TP_WAIT( wait );
+
+    TRACE( "%p\n", wait );
+
+    RtlEnterCriticalSection( &waitqueue_cs );
+    if (this->u.wait.bucket)
+    {
+        NtSetEvent( this->u.wait.bucket->update_event, NULL );
+        tp_wait_remove( this );
+    }
+    RtlLeaveCriticalSection( &waitqueue_cs );
+
+    tp_object_release( this );
+}
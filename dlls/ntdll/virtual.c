@@ -52,6 +52,7 @@
 #include "wine/server.h"
 #include "wine/exception.h"
 #include "wine/list.h"
+#include "wine/rbtree.h"
 #include "wine/debug.h"
 #include "ntdll_misc.h"
 
@@ -70,6 +71,7 @@ WINE_DECLARE_DEBUG_CHANNEL(module);
 struct file_view
 {
     struct list   entry;       /* Entry in global view list */
+    struct wine_rb_entry tree_entry; /* Entry in global view tree */
     void         *base;        /* Base address */
     size_t        size;        /* Size in bytes */
     HANDLE        mapping;     /* Handle to the file mapping */
@@ -100,7 +102,9 @@ static const BYTE VIRTUAL_Win32Flags[16] =
     PAGE_EXECUTE_WRITECOPY      /* READ | WRITE | EXEC | WRITECOPY */
 };
 
+/* the list is sorted by address and used for iterating; the tree is used for lookups */
 static struct list views_list = LIST_INIT(views_list);
+static struct wine_rb_tree views_tree;
 
 static RTL_CRITICAL_SECTION csVirtual;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -246,6 +250,73 @@ static void VIRTUAL_Dump(void)
 #endif
 
 
+/***********************************************************************
+ *           views_tree_alloc etc.
+ *
+ * Memory management for the view tree. The csVirtual section must be held by caller.
+ */
+static void *views_tree_alloc( size_t size )
+{
+    return RtlAllocateHeap( virtual_heap, 0, size );
+}
+
+static void *views_tree_realloc( void *ptr, size_t size )
+{
+    return RtlReAllocateHeap( virtual_heap, 0, ptr, size );
+}
+
+static void views_tree_free( void *ptr )
+{
+    RtlFreeHeap( virtual_heap, 0, ptr );
+}
+
+/* views never overlap, so a view matches all the addresses it contains */
+static int views_tree_compare( const void *key, const struct wine_rb_entry *entry )
+{
+    const struct file_view *view = WINE_RB_ENTRY_VALUE( entry, const struct file_view, tree_entry );
+    const char *addr = key;
+
+    if (addr < (const char *)view->base) return -1;
+    if (addr >= (const char *)view->base + view->size) return 1;
+    return 0;
+}
+
+static const struct wine_rb_functions views_tree_functions =
+{
+    views_tree_alloc,
+    views_tree_realloc,
+    views_tree_free,
+    views_tree_compare
+};
+
+
+/***********************************************************************
+ *           find_view_after
+ *
+ * Find the first view that ends above the given address, i.e. either the view
+ * containing it or the next one. The csVirtual section must be held by caller.
+ */
+static struct file_view *find_view_after( const void *addr )
+{
+    struct wine_rb_entry *ptr = views_tree.root;
+    struct file_view *ret = NULL;
+
+    while (ptr)
+    {
+        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, tree_entry );
+
+        if ((const char *)view->base + view->size > (const char *)addr)
+        {
+            ret = view;
+            if (view->base <= addr) break;
+            ptr = ptr->left;
+        }
+        else ptr = ptr->right;
+    }
+    return ret;
+}
+
+
 /***********************************************************************
  *           VIRTUAL_FindView
  *
@@ -260,17 +331,14 @@ static void VIRTUAL_Dump(void)
  */
 static struct file_view *VIRTUAL_FindView( const void *addr, size_t size )
 {
+    struct wine_rb_entry *ptr = wine_rb_get( &views_tree, addr );
     struct file_view *view;
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
-    {
-        if (view->base > addr) break;  /* no matching view */
-        if ((const char *)view->base + view->size <= (const char *)addr) continue;
-        if ((const char *)view->base + view->size < (const char *)addr + size) break;  /* size too large */
-        if ((const char *)addr + size < (const char *)addr) break; /* overflow */
-        return view;
-    }
-    return NULL;
+    if (!ptr) return NULL;  /* no matching view */
+    view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, tree_entry );
+    if ((const char *)view->base + view->size < (const char *)addr + size) return NULL;  /* size too large */
+    if ((const char *)addr + size < (const char *)addr) return NULL; /* overflow */
+    return view;
 }
 
 
@@ -293,13 +361,9 @@ static inline UINT_PTR get_mask( ULONG zero_bits )
  */
 static struct file_view *find_view_range( const void *addr, size_t size )
 {
-    struct file_view *view;
+    struct file_view *view = find_view_after( addr );
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
-    {
-        if ((const char *)view->base >= (const char *)addr + size) break;
-        if ((const char *)view->base + view->size > (const char *)addr) return view;
-    }
+    if (view && (const char *)view->base < (const char *)addr + size) return view;
     return NULL;
 }
 
@@ -317,10 +381,17 @@ static void *find_free_area( void *base, void *end, size_t size, size_t mask, in
 
     if (top_down)
     {
+        struct file_view *first;
+
         start = ROUND_ADDR( (char *)end - size, mask );
         if (start >= end || start < base) return NULL;
 
-        for (ptr = views_list.prev; ptr != &views_list; ptr = ptr->prev)
+        /* skip the views that are entirely above the start area */
+        if (!(first = find_view_after( (char *)start + size ))) ptr = views_list.prev;
+        else if ((char *)first->base < (char *)start + size) ptr = &first->entry;
+        else ptr = first->entry.prev;
+
+        for ( ; ptr != &views_list; ptr = ptr->prev)
         {
             struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
 
@@ -333,10 +404,15 @@ static void *find_free_area( void *base, void *end, size_t size, size_t mask, in
     }
     else
     {
+        struct file_view *first;
+
         start = ROUND_ADDR( (char *)base + mask, mask );
         if (start >= end || (char *)end - (char *)start < size) return NULL;
 
-        for (ptr = views_list.next; ptr != &views_list; ptr = ptr->next)
+        /* skip the views that are entirely below the start area */
+        if (!(first = find_view_after( start ))) return start;
+
+        for (ptr = &first->entry; ptr != &views_list; ptr = ptr->next)
         {
             struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
 
@@ -351,6 +427,19 @@ static void *find_free_area( void *base, void *end, size_t size, size_t mask, in
 }
 
 
+/***********************************************************************
+ *           next_view
+ *
+ * Return the view following a given one in address order.
+ * The csVirtual section must be held by caller.
+ */
+static inline struct file_view *next_view( struct file_view *view )
+{
+    struct list *ptr = list_next( &views_list, &view->entry );
+    return ptr ? LIST_ENTRY( ptr, struct file_view, entry ) : NULL;
+}
+
+
 /***********************************************************************
  *           add_reserved_area
  *
@@ -389,7 +478,7 @@ static void remove_reserved_area( void *addr, size_t size )
     wine_mmap_remove_reserved_area( addr, size, 0 );
 
     /* unmap areas not covered by an existing view */
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+    for (view = find_view_after( addr ); view; view = next_view( view ))
     {
         if ((char *)view->base >= (char *)addr + size)
         {
@@ -441,6 +530,7 @@ static inline void unmap_area( void *addr, size_t size )
 static void delete_view( struct file_view *view ) /* [in] View */
 {
     if (!(view->protect & VPROT_SYSTEM)) unmap_area( view->base, view->size );
+    wine_rb_remove( &views_tree, view->base );
     list_remove( &view->entry );
     if (view->mapping) close_handle( view->mapping );
     RtlFreeHeap( virtual_heap, 0, view );
@@ -454,13 +544,24 @@ static void delete_view( struct file_view *view ) /* [in] View */
  */
 static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t size, unsigned int vprot )
 {
-    struct file_view *view;
-    struct list *ptr;
+    struct file_view *view, *next;
     int unix_prot = VIRTUAL_GetUnixProt( vprot );
 
     assert( !((UINT_PTR)base & page_mask) );
     assert( !(size & page_mask) );
 
+    /* Check for overlapping views. This can happen if the previous view
+     * was a system view that got unmapped behind our back. In that case
+     * we recover by simply deleting it. */
+
+    while ((next = find_view_range( base, size )))
+    {
+        TRACE( "overlapping view %p-%p for %p-%p\n",
+               next->base, (char *)next->base + next->size, base, (char *)base + size );
+        assert( next->protect & VPROT_SYSTEM );
+        delete_view( next );
+    }
+
     /* Create the view structure */
 
     if (!(view = RtlAllocateHeap( virtual_heap, 0, sizeof(*view) + (size >> page_shift) - 1 )))
@@ -476,43 +577,16 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
     view->protect = vprot;
     memset( view->prot, vprot, size >> page_shift );
 
-    /* Insert it in the linked list */
-
-    LIST_FOR_EACH( ptr, &views_list )
-    {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
-        if (next->base > base) break;
-    }
-    list_add_before( ptr, &view->entry );
-
-    /* Check for overlapping views. This can happen if the previous view
-     * was a system view that got unmapped behind our back. In that case
-     * we recover by simply deleting it. */
+    /* Insert it in the tree and in the sorted list */
 
-    if ((ptr = list_prev( &views_list, &view->entry )) != NULL)
+    if (wine_rb_put( &views_tree, base, &view->tree_entry ) == -1)
     {
-        struct file_view *prev = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)prev->base + prev->size > (char *)base)
-        {
-            TRACE( "overlapping prev view %p-%p for %p-%p\n",
-                   prev->base, (char *)prev->base + prev->size,
-                   base, (char *)base + view->size );
-            assert( prev->protect & VPROT_SYSTEM );
-            delete_view( prev );
-        }
-    }
-    if ((ptr = list_next( &views_list, &view->entry )) != NULL)
-    {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)base + view->size > (char *)next->base)
-        {
-            TRACE( "overlapping next view %p-%p for %p-%p\n",
-                   next->base, (char *)next->base + next->size,
-                   base, (char *)base + view->size );
-            assert( next->protect & VPROT_SYSTEM );
-            delete_view( next );
-        }
+        FIXME( "out of memory in virtual heap for %p-%p\n", base, (char *)base + size );
+        RtlFreeHeap( virtual_heap, 0, view );
+        return STATUS_NO_MEMORY;
     }
+    next = find_view_after( (char *)base + size );
+    list_add_before( next ? &next->entry : &views_list, &view->entry );
 
     *view_ret = view;
     VIRTUAL_DEBUG_DUMP_VIEW( view );
@@ -1375,6 +1449,11 @@ void virtual_init(void)
     assert( heap_base != (void *)-1 );
     virtual_heap = RtlCreateHeap( HEAP_NO_SERIALIZE, heap_base, VIRTUAL_HEAP_SIZE,
                                   VIRTUAL_HEAP_SIZE, NULL, NULL );
+    if (wine_rb_init( &views_tree, &views_tree_functions ) == -1)
+    {
+        ERR( "failed to initialize the view tree\n" );
+        exit(1);
+    }
     create_view( &heap_view, heap_base, VIRTUAL_HEAP_SIZE, VPROT_COMMITTED | VPROT_READ | VPROT_WRITE );
 
     /* make the DOS area accessible (except the low 64K) to hide bugs in broken apps like Excel 2003 */
@@ -2239,30 +2318,24 @@ NTSTATUS WINAPI NtQueryVirtualMemory( HANDLE process, LPCVOID addr,
     /* Find the view containing the address */
 
     server_enter_uninterrupted_section( &csVirtual, &sigset );
-    ptr = list_head( &views_list );
-    for (;;)
+    view = find_view_after( base );
+    ptr = view ? list_prev( &views_list, &view->entry ) : list_tail( &views_list );
+    if (ptr)
     {
-        if (!ptr)
-        {
-            size = (char *)working_set_limit - alloc_base;
-            view = NULL;
-            break;
-        }
-        view = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)view->base > base)
-        {
-            size = (char *)view->base - alloc_base;
-            view = NULL;
-            break;
-        }
-        if ((char *)view->base + view->size > base)
-        {
-            alloc_base = view->base;
-            size = view->size;
-            break;
-        }
-        alloc_base = (char *)view->base + view->size;
-        ptr = list_next( &views_list, ptr );
+        struct file_view *prev = LIST_ENTRY( ptr, struct file_view, entry );
+        alloc_base = (char *)prev->base + prev->size;
+    }
+    if (!view)
+        size = (char *)working_set_limit - alloc_base;
+    else if ((char *)view->base > base)
+    {
+        size = (char *)view->base - alloc_base;
+        view = NULL;
+    }
+    else
+    {
+        alloc_base = view->base;
+        size = view->size;
     }
 
     /* Fill the info structure */
@@ -129,6 +129,12 @@
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
 
 #define NONAMELESSUNION
 #define NONAMELESSSTRUCT
@@ -155,6 +161,7 @@
 #include "wine/debug.h"
 #include "wine/exception.h"
 #include "wine/unicode.h"
+#include "wine/list.h"
 
 #ifdef HAS_IPX
 # include "wsnwlink.h"
@@ -844,9 +851,122 @@ static inline void release_sock_fd( SOCKET s, int fd )
     wine_server_release_fd( SOCKET2HANDLE(s), fd );
 }
 
+/* Client-side copy of the socket state needed by the send and receive paths.
+ * The held events only matter to the server once an event mask has been set
+ * with WSAEventSelect or WSAAsyncSelect, so they don't need to be re-enabled
+ * on sockets without one. The state is fetched from the server on first use
+ * and then kept up to date by the functions of this process that change it.
+ * It is forgotten when ntdll closes the handle, like the unix fd cache. */
+
+#define SOCK_STATE_VALID        0x01  /* the state below is known */
+#define SOCK_STATE_NONBLOCKING  0x02  /* socket is in non-blocking mode */
+#define SOCK_STATE_SELECT       0x04  /* socket has an event mask */
+
+#define SOCK_STATE_BLOCK_SIZE   4096
+#define SOCK_STATE_BLOCKS       (0x01000000 / SOCK_STATE_BLOCK_SIZE)
+
+static LONG *sock_state[SOCK_STATE_BLOCKS];
+
+static LONG *get_sock_state_ptr( SOCKET s, BOOL alloc )
+{
+    unsigned int idx = ((ULONG_PTR)s >> 2) - 1;
+    unsigned int block = idx / SOCK_STATE_BLOCK_SIZE;
+    LONG *ptr;
+
+    if (block >= SOCK_STATE_BLOCKS) return NULL;
+    if (!(ptr = sock_state[block]))
+    {
+        if (!alloc) return NULL;
+        if (!(ptr = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, SOCK_STATE_BLOCK_SIZE * sizeof(LONG) )))
+            return NULL;
+        if (InterlockedCompareExchangePointer( (void **)&sock_state[block], ptr, NULL ))
+        {
+            HeapFree( GetProcessHeap(), 0, ptr );
+            ptr = sock_state[block];
+        }
+    }
+    return &ptr[idx % SOCK_STATE_BLOCK_SIZE];
+}
+
+static LONG get_sock_state( SOCKET s )
+{
+    LONG *ptr = get_sock_state_ptr( s, FALSE );
+    return ptr ? *ptr : 0;
+}
+
+static void set_sock_state( SOCKET s, LONG state )
+{
+    LONG *ptr = get_sock_state_ptr( s, state != 0 );
+    if (ptr) *ptr = state;
+}
+
+static void update_sock_state( SOCKET s, LONG set, LONG clear )
+{
+    LONG *ptr = get_sock_state_ptr( s, FALSE );
+    LONG old;
+
+    if (!ptr) return;
+    do
+    {
+        old = *ptr;
+        if (!(old & SOCK_STATE_VALID)) return;
+    } while (InterlockedCompareExchange( ptr, (old | set) & ~clear, old ) != old);
+}
+
+extern void CDECL __wine_set_close_handle_handler( void (CDECL *)(HANDLE) );
+
+/* called by ntdll when a handle is closed, the value may be reused for another object */
+static void CDECL sock_state_close_handler( HANDLE handle )
+{
+    LONG *ptr = get_sock_state_ptr( HANDLE2SOCKET(handle), FALSE );
+    if (ptr) *ptr = 0;
+}
+
+static NTSTATUS query_sock_state( SOCKET s, LONG *ret )
+{
+    NTSTATUS status;
+    LONG state;
+
+    if ((state = get_sock_state( s )) & SOCK_STATE_VALID)
+    {
+        *ret = state;
+        return STATUS_SUCCESS;
+    }
+    SERVER_START_REQ( get_socket_event )
+    {
+        req->handle  = wine_server_obj_handle( SOCKET2HANDLE(s) );
+        req->service = FALSE;
+        req->c_event = 0;
+        if (!(status = wine_server_call( req )))
+        {
+            state = SOCK_STATE_VALID;
+            if (reply->state & FD_WINE_NONBLOCKING) state |= SOCK_STATE_NONBLOCKING;
+            if (reply->mask) state |= SOCK_STATE_SELECT;
+        }
+    }
+    SERVER_END_REQ;
+    if (status) return status;
+    set_sock_state( s, state );
+    *ret = state;
+    return STATUS_SUCCESS;
+}
+
 static void _enable_event( HANDLE s, unsigned int event,
                            unsigned int sstate, unsigned int cstate )
 {
+    LONG state;
+
+    if (!sstate && !cstate)
+    {
+        /* nothing to do if no event mask is set, the server will clear the
+         * held events when one is */
+        if (!query_sock_state( HANDLE2SOCKET(s), &state ) && !(state & SOCK_STATE_SELECT))
+            return;
+    }
+    else if ((sstate | cstate) & FD_WINE_NONBLOCKING)
+        update_sock_state( HANDLE2SOCKET(s), (sstate & FD_WINE_NONBLOCKING) ? SOCK_STATE_NONBLOCKING : 0,
+                           (cstate & FD_WINE_NONBLOCKING) ? SOCK_STATE_NONBLOCKING : 0 );
+
     SERVER_START_REQ( enable_socket_event )
     {
         req->handle = wine_server_obj_handle( s );
@@ -861,39 +981,31 @@ static void _enable_event( HANDLE s, unsigned int event,
 static NTSTATUS _is_blocking(SOCKET s, BOOL *ret)
 {
     NTSTATUS status;
-    SERVER_START_REQ( get_socket_event )
-    {
-        req->handle  = wine_server_obj_handle( SOCKET2HANDLE(s) );
-        req->service = FALSE;
-        req->c_event = 0;
-        status = wine_server_call( req );
-        *ret = (reply->state & FD_WINE_NONBLOCKING) == 0;
-    }
-    SERVER_END_REQ;
+    LONG state;
+
+    if (!(status = query_sock_state( s, &state ))) *ret = !(state & SOCK_STATE_NONBLOCKING);
     return status;
 }
 
-static unsigned int _get_sock_mask(SOCKET s)
+static BOOL _has_sock_mask(SOCKET s)
+{
+    LONG state;
+
+    return !query_sock_state( s, &state ) && (state & SOCK_STATE_SELECT);
+}
+
+static void _sync_sock_state(SOCKET s)
 {
-    unsigned int ret;
+    /* do a dummy wineserver request in order to let
+       the wineserver run through its select loop once */
     SERVER_START_REQ( get_socket_event )
     {
         req->handle  = wine_server_obj_handle( SOCKET2HANDLE(s) );
         req->service = FALSE;
         req->c_event = 0;
         wine_server_call( req );
-        ret = reply->mask;
     }
     SERVER_END_REQ;
-    return ret;
-}
-
-static void _sync_sock_state(SOCKET s)
-{
-    BOOL dummy;
-    /* do a dummy wineserver request in order to let
-       the wineserver run through its select loop once */
-    (void)_is_blocking(s, &dummy);
 }
 
 static int _get_sock_error(SOCKET s, unsigned int bit)
@@ -950,8 +1062,10 @@ BOOL WINAPI DllMain(HINSTANCE hInstDLL, DWORD fdwReason, LPVOID fImpLoad)
     TRACE("%p 0x%x %p\n", hInstDLL, fdwReason, fImpLoad);
     switch (fdwReason) {
     case DLL_PROCESS_ATTACH:
+        __wine_set_close_handle_handler( sock_state_close_handler );
         break;
     case DLL_PROCESS_DETACH:
+        __wine_set_close_handle_handler( NULL );
         if (fImpLoad) break;
         free_per_thread_data();
         DeleteCriticalSection(&csWSgetXXXbyYYY);
@@ -2237,6 +2351,657 @@ static NTSTATUS WS2_async_send(void* user, IO_STATUS_BLOCK* iosb, NTSTATUS statu
     return status;
 }
 
+/* state of a TransmitFile or TransmitPackets request */
+struct transmit_request
+{
+    HANDLE                   socket;    /* socket handle, for the server async */
+    DWORD                    flags;
+    DWORD                    count;     /* number of elements */
+    DWORD                    current;   /* element being sent */
+    ULONG                    offset;    /* bytes of the current element already sent */
+    int                      file_fd;   /* unix fd of the current file element, or -1 */
+    TRANSMIT_PACKETS_ELEMENT elements[1];
+};
+
+static struct transmit_request *alloc_transmit_request( const TRANSMIT_PACKETS_ELEMENT *elements,
+                                                        DWORD count, DWORD flags )
+{
+    struct transmit_request *req;
+
+    if (!(req = HeapAlloc( GetProcessHeap(), 0, FIELD_OFFSET( struct transmit_request, elements[count] ))))
+        return NULL;
+    req->socket  = 0;
+    req->flags   = flags;
+    req->count   = count;
+    req->current = 0;
+    req->offset  = 0;
+    req->file_fd = -1;
+    memcpy( req->elements, elements, count * sizeof(*elements) );
+    return req;
+}
+
+static void free_transmit_request( struct transmit_request *req )
+{
+    if (!req) return;
+    if (req->file_fd != -1) close( req->file_fd );
+    HeapFree( GetProcessHeap(), 0, req );
+}
+
+/* get the unix fd of a file element, resolving its offset and length */
+static NTSTATUS open_transmit_file( TRANSMIT_PACKETS_ELEMENT *elem, int *fd )
+{
+    LARGE_INTEGER size;
+    NTSTATUS status;
+
+    if ((status = wine_server_handle_to_fd( elem->u.s.hFile, FILE_READ_DATA, fd, NULL ))) return status;
+    if (elem->u.s.nFileOffset.QuadPart == -1)  /* start at the current file pointer */
+    {
+        LARGE_INTEGER zero;
+
+        zero.QuadPart = 0;
+        if (!SetFilePointerEx( elem->u.s.hFile, zero, &elem->u.s.nFileOffset, FILE_CURRENT ))
+            elem->u.s.nFileOffset.QuadPart = 0;
+    }
+    if (!elem->cLength)  /* send up to the end of the file */
+    {
+        if (!GetFileSizeEx( elem->u.s.hFile, &size ))
+        {
+            close( *fd );
+            *fd = -1;
+            return STATUS_INVALID_HANDLE;
+        }
+        if (size.QuadPart > elem->u.s.nFileOffset.QuadPart)
+            elem->cLength = min( size.QuadPart - elem->u.s.nFileOffset.QuadPart, ~0u );
+    }
+    return STATUS_SUCCESS;
+}
+
+/* send a part of a file without copying it through user memory when possible */
+static ssize_t send_file_data( int sock_fd, int file_fd, ULONGLONG offset, size_t len )
+{
+    char buffer[32768];
+    ssize_t n;
+
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+    off_t off = offset;
+
+    if ((n = sendfile( sock_fd, file_fd, &off, len )) != -1) return n;
+    if (errno != EINVAL && errno != ENOSYS) return -1;
+    /* the file doesn't support it, fall back to read and send */
+#endif
+    if ((n = pread( file_fd, buffer, min( len, sizeof(buffer) ), offset )) <= 0) return n;
+    return send( sock_fd, buffer, n, 0 );
+}
+
+/***********************************************************************
+ *              transmit_packets          (INTERNAL)
+ *
+ * Send as much of a transmit request as the socket accepts. Returns
+ * STATUS_PENDING if the socket buffer is full.
+ */
+static NTSTATUS transmit_packets( int fd, struct transmit_request *req, ULONG *sent )
+{
+    NTSTATUS status;
+    ssize_t n;
+
+    while (req->current < req->count)
+    {
+        TRANSMIT_PACKETS_ELEMENT *elem = &req->elements[req->current];
+
+        if ((elem->dwElFlags & TP_ELEMENT_FILE) && req->file_fd == -1)
+        {
+            if ((status = open_transmit_file( elem, &req->file_fd ))) return status;
+        }
+        if (req->offset >= elem->cLength)
+        {
+            if (req->file_fd != -1) close( req->file_fd );
+            req->file_fd = -1;
+            req->offset = 0;
+            req->current++;
+            continue;
+        }
+
+        if (elem->dwElFlags & TP_ELEMENT_FILE)
+            n = send_file_data( fd, req->file_fd, elem->u.s.nFileOffset.QuadPart + req->offset,
+                                elem->cLength - req->offset );
+        else
+            n = send( fd, (char *)elem->u.pBuffer + req->offset, elem->cLength - req->offset, 0 );
+
+        if (n == -1)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return STATUS_PENDING;
+            return wsaErrStatus();
+        }
+        if (!n) elem->cLength = req->offset;  /* end of file reached early */
+        req->offset += n;
+        *sent += n;
+    }
+
+    if ((req->flags & TF_DISCONNECT) && shutdown( fd, 1 ) == -1) return wsaErrStatus();
+    return STATUS_SUCCESS;
+}
+
+static void WINAPI ws2_transmit_apc( void *arg, IO_STATUS_BLOCK *iosb, ULONG reserved )
+{
+    free_transmit_request( arg );
+}
+
+/***********************************************************************
+ *              WS2_async_transmit      (INTERNAL)
+ *
+ * Handler for overlapped TransmitFile and TransmitPackets operations
+ * queued to the server.
+ */
+static NTSTATUS WS2_async_transmit( void *user, IO_STATUS_BLOCK *iosb, NTSTATUS status, void **apc )
+{
+    struct transmit_request *req = user;
+    ULONG sent = iosb->Information;
+    int fd;
+
+    if (status == STATUS_ALERTED)
+    {
+        if (!(status = wine_server_handle_to_fd( req->socket, FILE_WRITE_DATA, &fd, NULL )))
+        {
+            status = transmit_packets( fd, req, &sent );
+            wine_server_release_fd( req->socket, fd );
+            iosb->Information = sent;
+        }
+    }
+    if (status != STATUS_PENDING)
+    {
+        iosb->u.Status = status;
+        *apc = ws2_transmit_apc;
+    }
+    return status;
+}
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE)
+
+/* Overlapped recv and send requests that can't complete immediately are
+ * serviced by a pool of threads waiting on the sockets with epoll, instead
+ * of being queued to the server. Requests with a completion routine still
+ * go through the server since the APC has to run in the calling thread.
+ * Pending requests are aborted by closesocket, and by CancelIo through a
+ * handler called by ntdll. */
+
+#define SOCK_IO_READ       0
+#define SOCK_IO_WRITE      1
+#define SOCK_IO_MAX_THREADS 8
+
+extern void CDECL __wine_set_cancel_io_handler( BOOL (CDECL *)(HANDLE, IO_STATUS_BLOCK *, BOOL) );
+
+struct sock_io_op
+{
+    struct list        entry;
+    struct ws2_async  *wsa;
+    struct transmit_request *transmit;  /* TransmitFile/TransmitPackets request instead of wsa */
+    IO_STATUS_BLOCK   *iosb;
+    HANDLE             event;        /* private copy of the event handle */
+    ULONG_PTR          cvalue;
+    ULONG              information;  /* bytes transferred so far */
+    DWORD              thread;       /* thread that issued the request, for CancelIo */
+    BOOL               cancelled;    /* cancelled while being performed */
+};
+
+struct sock_io_queue
+{
+    SOCKET             socket;
+    unsigned int       serial;    /* identifies the queue in epoll events */
+    int                fd;        /* private copy of the unix fd */
+    unsigned int       events;    /* epoll events the queue is armed for */
+    BOOL               busy;      /* a worker thread is processing the queue */
+    BOOL               closed;    /* socket was closed while busy */
+    HANDLE             idle;      /* signaled when the worker is done with a closed queue */
+    struct sock_io_op *current;   /* request being performed by the worker */
+    int                current_type;  /* direction of the current request */
+    struct list        ops[2];    /* pending reads and writes */
+};
+
+static CRITICAL_SECTION sock_io_section;
+static CRITICAL_SECTION_DEBUG sock_io_section_debug =
+{
+    0, 0, &sock_io_section,
+    { &sock_io_section_debug.ProcessLocksList, &sock_io_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": sock_io_section") }
+};
+static CRITICAL_SECTION sock_io_section = { &sock_io_section_debug, -1, 0, 0, 0, 0 };
+
+static int sock_io_epoll = -1;
+static BOOL sock_io_disabled;
+static unsigned int sock_io_serial;
+static struct sock_io_queue **sock_io_queues[SOCK_STATE_BLOCKS];
+
+/* get the queue slot of a socket; sock_io_section must be held */
+static struct sock_io_queue **get_sock_io_slot( SOCKET s, BOOL alloc )
+{
+    unsigned int idx = ((ULONG_PTR)s >> 2) - 1;
+    unsigned int block = idx / SOCK_STATE_BLOCK_SIZE;
+
+    if (block >= SOCK_STATE_BLOCKS) return NULL;
+    if (!sock_io_queues[block])
+    {
+        if (!alloc) return NULL;
+        if (!(sock_io_queues[block] = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                                 SOCK_STATE_BLOCK_SIZE * sizeof(struct sock_io_queue *) )))
+            return NULL;
+    }
+    return &sock_io_queues[block][idx % SOCK_STATE_BLOCK_SIZE];
+}
+
+static struct sock_io_queue *get_sock_io_queue( SOCKET s )
+{
+    struct sock_io_queue **slot = get_sock_io_slot( s, FALSE );
+    return slot ? *slot : NULL;
+}
+
+/* wait for the events needed by the pending requests; sock_io_section must be held */
+static void arm_sock_io_queue( struct sock_io_queue *queue )
+{
+    struct epoll_event ev;
+
+    ev.events = 0;
+    if (!list_empty( &queue->ops[SOCK_IO_READ] )) ev.events |= EPOLLIN;
+    if (!list_empty( &queue->ops[SOCK_IO_WRITE] )) ev.events |= EPOLLOUT;
+    if (!ev.events || ev.events == queue->events) return;
+
+    ev.events |= EPOLLONESHOT;
+    ev.data.u64 = ((ULONGLONG)queue->serial << 32) | (ULONG)queue->socket;
+    if (epoll_ctl( sock_io_epoll, EPOLL_CTL_MOD, queue->fd, &ev ) == -1)
+        ERR( "epoll_ctl failed for socket %04lx: %s\n", queue->socket, strerror(errno) );
+    else
+        queue->events = ev.events & ~EPOLLONESHOT;
+}
+
+static void free_sock_io_queue( struct sock_io_queue *queue )
+{
+    epoll_ctl( sock_io_epoll, EPOLL_CTL_DEL, queue->fd, NULL );
+    close( queue->fd );
+    CloseHandle( queue->idle );
+    HeapFree( GetProcessHeap(), 0, queue );
+}
+
+static void complete_sock_io_op( SOCKET s, struct sock_io_op *op, int type, NTSTATUS status )
+{
+    TRACE( "socket %04lx %s completed, status %08x, %u bytes\n", s,
+           type == SOCK_IO_READ ? "recv" : "send", status, op->information );
+
+    op->iosb->Information = op->information;
+    op->iosb->u.Status = status;
+    if (op->event)
+    {
+        NtSetEvent( op->event, NULL );
+        NtClose( op->event );
+    }
+    if (op->cvalue) WS_AddCompletion( s, op->cvalue, status, op->information );
+    if (status != STATUS_CANCELLED) _enable_event( SOCKET2HANDLE(s), type == SOCK_IO_READ ? FD_READ : FD_WRITE, 0, 0 );
+    HeapFree( GetProcessHeap(), 0, op->wsa );
+    free_transmit_request( op->transmit );
+    HeapFree( GetProcessHeap(), 0, op );
+}
+
+/* try to perform a request, returns STATUS_PENDING if the socket isn't ready */
+static NTSTATUS perform_sock_io_op( int fd, struct sock_io_op *op, int type )
+{
+    struct ws2_async *wsa = op->wsa;
+    int n;
+
+    if (op->transmit) return transmit_packets( fd, op->transmit, &op->information );
+
+    if (type == SOCK_IO_READ)
+    {
+        do n = WS2_recv( fd, wsa ); while (n == -1 && errno == EINTR);
+        if (n >= 0)
+        {
+            op->information = n;
+            return STATUS_SUCCESS;
+        }
+    }
+    else
+    {
+        while (wsa->first_iovec < wsa->n_iovecs)
+        {
+            if ((n = WS2_send( fd, wsa )) >= 0) op->information += n;
+            else if (errno != EINTR) break;
+        }
+        if (wsa->first_iovec >= wsa->n_iovecs) return STATUS_SUCCESS;
+    }
+    if (errno == EAGAIN) return STATUS_PENDING;
+    return wsaErrStatus();
+}
+
+static void process_sock_io_queue( SOCKET s, unsigned int serial )
+{
+    struct sock_io_queue *queue;
+    struct sock_io_op *op;
+    struct list *ptr;
+    NTSTATUS status;
+    int type;
+
+    EnterCriticalSection( &sock_io_section );
+    queue = get_sock_io_queue( s );
+    if (!queue || queue->serial != serial)  /* stale event for a closed socket */
+    {
+        LeaveCriticalSection( &sock_io_section );
+        return;
+    }
+    queue->events = 0;  /* the event disarmed it */
+    if (queue->busy)  /* another thread will re-arm it when it's done */
+    {
+        LeaveCriticalSection( &sock_io_section );
+        return;
+    }
+    queue->busy = TRUE;
+
+    for (type = SOCK_IO_READ; type <= SOCK_IO_WRITE; type++)
+    {
+        while (!queue->closed && (ptr = list_head( &queue->ops[type] )))
+        {
+            op = LIST_ENTRY( ptr, struct sock_io_op, entry );
+            list_remove( &op->entry );
+            queue->current = op;
+            queue->current_type = type;
+            LeaveCriticalSection( &sock_io_section );
+
+            status = perform_sock_io_op( queue->fd, op, type );
+
+            EnterCriticalSection( &sock_io_section );
+            queue->current = NULL;
+            if (status == STATUS_PENDING)
+            {
+                if (!queue->closed && !op->cancelled)
+                {
+                    list_add_head( &queue->ops[type], &op->entry );
+                    break;
+                }
+                status = STATUS_CANCELLED;
+            }
+            LeaveCriticalSection( &sock_io_section );
+            complete_sock_io_op( s, op, type, status );
+            EnterCriticalSection( &sock_io_section );
+        }
+    }
+
+    queue->busy = FALSE;
+    if (queue->closed) SetEvent( queue->idle );  /* close_sock_io frees it */
+    else arm_sock_io_queue( queue );
+    LeaveCriticalSection( &sock_io_section );
+}
+
+/* called by ntdll for CancelIo and CancelIoEx, returns TRUE if requests were cancelled */
+static BOOL CDECL cancel_sock_io( HANDLE handle, IO_STATUS_BLOCK *iosb, BOOL only_thread )
+{
+    SOCKET s = HANDLE2SOCKET( handle );
+    struct sock_io_queue *queue;
+    struct sock_io_op *op, *next;
+    struct list ops[2];
+    DWORD thread = GetCurrentThreadId();
+    BOOL ret = FALSE;
+    int type;
+
+    EnterCriticalSection( &sock_io_section );
+    if (!(queue = get_sock_io_queue( s )))
+    {
+        LeaveCriticalSection( &sock_io_section );
+        return FALSE;
+    }
+    for (type = SOCK_IO_READ; type <= SOCK_IO_WRITE; type++)
+    {
+        list_init( &ops[type] );
+        LIST_FOR_EACH_ENTRY_SAFE( op, next, &queue->ops[type], struct sock_io_op, entry )
+        {
+            if (iosb && op->iosb != iosb) continue;
+            if (only_thread && op->thread != thread) continue;
+            list_remove( &op->entry );
+            list_add_tail( &ops[type], &op->entry );
+            ret = TRUE;
+        }
+    }
+    /* the worker completes it if it can't be finished right away */
+    if ((op = queue->current) && (!iosb || op->iosb == iosb) && (!only_thread || op->thread == thread))
+    {
+        op->cancelled = TRUE;
+        ret = TRUE;
+    }
+    LeaveCriticalSection( &sock_io_section );
+
+    for (type = SOCK_IO_READ; type <= SOCK_IO_WRITE; type++)
+        LIST_FOR_EACH_ENTRY_SAFE( op, next, &ops[type], struct sock_io_op, entry )
+            complete_sock_io_op( s, op, type, STATUS_CANCELLED );
+    return ret;
+}
+
+static DWORD WINAPI sock_io_thread( void *arg )
+{
+    struct epoll_event events[64];
+    int i, count;
+
+    for (;;)
+    {
+        if ((count = epoll_wait( sock_io_epoll, events, sizeof(events)/sizeof(events[0]), -1 )) == -1)
+        {
+            if (errno == EINTR) continue;
+            ERR( "epoll_wait failed: %s\n", strerror(errno) );
+            return 1;
+        }
+        for (i = 0; i < count; i++)
+            process_sock_io_queue( (ULONG)events[i].data.u64, events[i].data.u64 >> 32 );
+    }
+}
+
+/* start the worker threads; sock_io_section must be held */
+static BOOL init_sock_io(void)
+{
+    SYSTEM_INFO si;
+    HANDLE thread;
+    DWORD i, count;
+
+    if (sock_io_epoll != -1) return TRUE;
+    if (sock_io_disabled) return FALSE;
+
+    if ((sock_io_epoll = epoll_create( 64 )) == -1)
+    {
+        WARN( "epoll_create failed: %s\n", strerror(errno) );
+        sock_io_disabled = TRUE;
+        return FALSE;
+    }
+    fcntl( sock_io_epoll, F_SETFD, FD_CLOEXEC );
+
+    GetSystemInfo( &si );
+    count = min( max( si.dwNumberOfProcessors, 1 ), SOCK_IO_MAX_THREADS );
+    for (i = 0; i < count; i++)
+    {
+        if (!(thread = CreateThread( NULL, 0, sock_io_thread, NULL, 0, NULL ))) break;
+        CloseHandle( thread );
+    }
+    if (!i)
+    {
+        close( sock_io_epoll );
+        sock_io_epoll = -1;
+        sock_io_disabled = TRUE;
+        return FALSE;
+    }
+    __wine_set_cancel_io_handler( cancel_sock_io );
+    TRACE( "started %u threads\n", i );
+    return TRUE;
+}
+
+/***********************************************************************
+ *              queue_sock_io          (INTERNAL)
+ *
+ * Queue an overlapped request to the worker threads. Returns STATUS_PENDING
+ * on success; on failure the caller has to go through the server instead.
+ */
+static NTSTATUS queue_sock_io( SOCKET s, int type, struct ws2_async *wsa, struct transmit_request *transmit,
+                               IO_STATUS_BLOCK *iosb, HANDLE event, ULONG_PTR cvalue, ULONG information )
+{
+    struct sock_io_queue **slot, *queue;
+    struct sock_io_op *op;
+    struct epoll_event ev;
+    NTSTATUS status = STATUS_PENDING;
+    int fd;
+
+    if (sock_io_disabled) return STATUS_NOT_SUPPORTED;
+    if (!(op = HeapAlloc( GetProcessHeap(), 0, sizeof(*op) ))) return STATUS_NO_MEMORY;
+    /* the application may close the event before the request completes */
+    op->event = 0;
+    if (event && (status = NtDuplicateObject( GetCurrentProcess(), event, GetCurrentProcess(),
+                                              &op->event, 0, 0, DUPLICATE_SAME_ACCESS )))
+    {
+        HeapFree( GetProcessHeap(), 0, op );
+        return status;
+    }
+    status = STATUS_PENDING;
+    op->wsa         = wsa;
+    op->transmit    = transmit;
+    op->iosb        = iosb;
+    op->cvalue      = cvalue;
+    op->information = information;
+    op->thread      = GetCurrentThreadId();
+    op->cancelled   = FALSE;
+
+    EnterCriticalSection( &sock_io_section );
+    if (!init_sock_io())
+    {
+        status = STATUS_NOT_SUPPORTED;
+        goto done;
+    }
+    if (!(slot = get_sock_io_slot( s, TRUE )))
+    {
+        status = STATUS_NO_MEMORY;
+        goto done;
+    }
+    if (!(queue = *slot))
+    {
+        if ((status = wine_server_handle_to_fd( SOCKET2HANDLE(s), 0, &fd, NULL ))) goto done;
+        if (!(queue = HeapAlloc( GetProcessHeap(), 0, sizeof(*queue) )))
+        {
+            close( fd );
+            status = STATUS_NO_MEMORY;
+            goto done;
+        }
+        if (!(queue->idle = CreateEventW( NULL, TRUE, FALSE, NULL )))
+        {
+            close( fd );
+            HeapFree( GetProcessHeap(), 0, queue );
+            status = STATUS_NO_MEMORY;
+            goto done;
+        }
+        queue->socket  = s;
+        queue->serial  = ++sock_io_serial;
+        queue->fd      = fd;
+        queue->events  = 0;
+        queue->busy    = FALSE;
+        queue->closed  = FALSE;
+        queue->current = NULL;
+        queue->current_type = SOCK_IO_READ;
+        list_init( &queue->ops[SOCK_IO_READ] );
+        list_init( &queue->ops[SOCK_IO_WRITE] );
+        ev.events = 0;
+        ev.data.u64 = ((ULONGLONG)queue->serial << 32) | (ULONG)s;
+        if (epoll_ctl( sock_io_epoll, EPOLL_CTL_ADD, fd, &ev ) == -1)
+        {
+            WARN( "epoll_ctl failed for socket %04lx: %s\n", s, strerror(errno) );
+            close( fd );
+            CloseHandle( queue->idle );
+            HeapFree( GetProcessHeap(), 0, queue );
+            status = STATUS_NOT_SUPPORTED;
+            goto done;
+        }
+        *slot = queue;
+    }
+
+    /* the server resets the event when it starts an async request */
+    if (event) NtResetEvent( event, NULL );
+    iosb->u.Status = STATUS_PENDING;
+    iosb->Information = information;
+    list_add_tail( &queue->ops[type], &op->entry );
+    if (!queue->busy) arm_sock_io_queue( queue );
+
+done:
+    LeaveCriticalSection( &sock_io_section );
+    if (status != STATUS_PENDING)
+    {
+        if (op->event) NtClose( op->event );
+        HeapFree( GetProcessHeap(), 0, op );
+    }
+    return status;
+}
+
+/* check if requests of a given type are pending, new ones must be queued behind them */
+static BOOL sock_io_pending( SOCKET s, int type )
+{
+    struct sock_io_queue *queue;
+    BOOL ret;
+
+    if (sock_io_epoll == -1) return FALSE;
+    EnterCriticalSection( &sock_io_section );
+    queue = get_sock_io_queue( s );
+    ret = queue && (!list_empty( &queue->ops[type] ) ||
+                    (queue->current && queue->current_type == type));
+    LeaveCriticalSection( &sock_io_section );
+    return ret;
+}
+
+/* abort the pending requests of a socket that is being closed */
+static void close_sock_io( SOCKET s )
+{
+    struct sock_io_queue **slot, *queue;
+    struct sock_io_op *op, *next;
+    struct list ops[2];
+    BOOL busy;
+    int type;
+
+    if (sock_io_epoll == -1) return;
+
+    EnterCriticalSection( &sock_io_section );
+    if (!(slot = get_sock_io_slot( s, FALSE )) || !(queue = *slot))
+    {
+        LeaveCriticalSection( &sock_io_section );
+        return;
+    }
+    *slot = NULL;
+    for (type = SOCK_IO_READ; type <= SOCK_IO_WRITE; type++)
+    {
+        list_init( &ops[type] );
+        list_move_tail( &ops[type], &queue->ops[type] );
+    }
+    queue->closed = TRUE;
+    busy = queue->busy;
+    LeaveCriticalSection( &sock_io_section );
+
+    /* let the worker complete the request it is performing while the handle is still valid */
+    if (busy) WaitForSingleObject( queue->idle, INFINITE );
+    free_sock_io_queue( queue );
+
+    for (type = SOCK_IO_READ; type <= SOCK_IO_WRITE; type++)
+        LIST_FOR_EACH_ENTRY_SAFE( op, next, &ops[type], struct sock_io_op, entry )
+            complete_sock_io_op( s, op, type, STATUS_CANCELLED );
+}
+
+#else  /* HAVE_SYS_EPOLL_H */
+
+#define SOCK_IO_READ  0
+#define SOCK_IO_WRITE 1
+
+static inline NTSTATUS queue_sock_io( SOCKET s, int type, struct ws2_async *wsa,
+                                      struct transmit_request *transmit, IO_STATUS_BLOCK *iosb,
+                                      HANDLE event, ULONG_PTR cvalue, ULONG information )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+static inline BOOL sock_io_pending( SOCKET s, int type )
+{
+    return FALSE;
+}
+
+static inline void close_sock_io( SOCKET s )
+{
+}
+
+#endif  /* HAVE_SYS_EPOLL_H */
+
 /***********************************************************************
  *              WS2_async_shutdown      (INTERNAL)
  *
@@ -2338,6 +3103,10 @@ SOCKET WINAPI WS_accept(SOCKET s, struct WS_sockaddr *addr, int *addrlen32)
         SERVER_END_REQ;
         if (!status)
         {
+            /* the state is inherited from the listening socket or from a deferred one,
+             * let the server tell us */
+            set_sock_state( as, 0 );
+            close_sock_io( as );
             if (addr && WS_getpeername(as, addr, addrlen32))
             {
                 WS_closesocket(as);
@@ -2702,6 +3471,7 @@ int WINAPI WS_bind(SOCKET s, const struct WS_sockaddr* name, int namelen)
 int WINAPI WS_closesocket(SOCKET s)
 {
     TRACE("socket %04lx\n", s);
+    close_sock_io( s );
     if (CloseHandle(SOCKET2HANDLE(s))) return 0;
     return SOCKET_ERROR;
 }
@@ -2930,6 +3700,190 @@ connection_success:
     return TRUE;
 }
 
+/* common part of TransmitFile and TransmitPackets */
+static BOOL transmit( SOCKET s, const TRANSMIT_PACKETS_ELEMENT *elements, DWORD count,
+                      LPOVERLAPPED overlapped, DWORD flags )
+{
+    ULONG_PTR cvalue = (overlapped && ((ULONG_PTR)overlapped->hEvent & 1) == 0) ? (ULONG_PTR)overlapped : 0;
+    struct transmit_request *request;
+    struct pollfd pfd;
+    NTSTATUS status;
+    ULONG sent = 0;
+    unsigned int options;
+    int fd;
+
+    if ((fd = get_sock_fd( s, FILE_WRITE_DATA, &options )) == -1) return FALSE;
+    if (options & (FILE_SYNCHRONOUS_IO_ALERT | FILE_SYNCHRONOUS_IO_NONALERT)) overlapped = NULL;
+
+    if (!(request = alloc_transmit_request( elements, count, flags )))
+    {
+        release_sock_fd( s, fd );
+        SetLastError( WSAENOBUFS );
+        return FALSE;
+    }
+
+    if (overlapped && sock_io_pending( s, SOCK_IO_WRITE ))
+        status = STATUS_PENDING;  /* don't overtake the overlapped sends that are already pending */
+    else
+        status = transmit_packets( fd, request, &sent );
+
+    if (status == STATUS_PENDING && overlapped)
+    {
+        IO_STATUS_BLOCK *iosb = (IO_STATUS_BLOCK *)overlapped;
+
+        release_sock_fd( s, fd );
+        if (queue_sock_io( s, SOCK_IO_WRITE, NULL, request, iosb, overlapped->hEvent,
+                           cvalue, sent ) == STATUS_PENDING)
+        {
+            SetLastError( WSA_IO_PENDING );
+            return FALSE;
+        }
+
+        /* no worker threads to hand it to, let the server wait for the socket */
+        request->socket = SOCKET2HANDLE(s);
+        iosb->u.Status = STATUS_PENDING;
+        iosb->Information = sent;
+
+        SERVER_START_REQ( register_async )
+        {
+            req->type           = ASYNC_TYPE_WRITE;
+            req->async.handle   = wine_server_obj_handle( SOCKET2HANDLE(s) );
+            req->async.callback = wine_server_client_ptr( WS2_async_transmit );
+            req->async.iosb     = wine_server_client_ptr( iosb );
+            req->async.arg      = wine_server_client_ptr( request );
+            req->async.event    = wine_server_obj_handle( overlapped->hEvent );
+            req->async.cvalue   = cvalue;
+            status = wine_server_call( req );
+        }
+        SERVER_END_REQ;
+
+        /* Enable the event only after starting the async. The server will deliver it as soon as
+           the async is done. */
+        _enable_event( SOCKET2HANDLE(s), FD_WRITE, 0, 0 );
+
+        if (status != STATUS_PENDING)
+        {
+            iosb->u.Status = status;
+            free_transmit_request( request );
+        }
+        SetLastError( NtStatusToWSAError( status ) );
+        return FALSE;
+    }
+
+    /* synchronous request */
+    while (status == STATUS_PENDING)
+    {
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+        if (poll( &pfd, 1, -1 ) == -1 && errno != EINTR)
+            status = wsaErrStatus();
+        else
+            status = transmit_packets( fd, request, &sent );
+    }
+    release_sock_fd( s, fd );
+    free_transmit_request( request );
+    TRACE( "socket %04lx, status %08x, %u bytes\n", s, status, sent );
+
+    if (status)
+    {
+        if (overlapped) ((IO_STATUS_BLOCK *)overlapped)->u.Status = status;
+        SetLastError( NtStatusToWSAError( status ) );
+        return FALSE;
+    }
+    _enable_event( SOCKET2HANDLE(s), FD_WRITE, 0, 0 );
+    if (overlapped)
+    {
+        IO_STATUS_BLOCK *iosb = (IO_STATUS_BLOCK *)overlapped;
+
+        iosb->u.Status = STATUS_SUCCESS;
+        iosb->Information = sent;
+        if (cvalue) WS_AddCompletion( s, cvalue, STATUS_SUCCESS, sent );
+        if (overlapped->hEvent) SetEvent( overlapped->hEvent );
+    }
+    return TRUE;
+}
+
+/***********************************************************************
+ *             TransmitFile
+ *
+ * File data is sent with sendfile() when the platform supports it, so
+ * it doesn't have to be copied through user memory.
+ */
+static BOOL WINAPI WS2_TransmitFile( SOCKET s, HANDLE file, DWORD total_len, DWORD chunk_len,
+                                     LPOVERLAPPED overlapped, LPTRANSMIT_FILE_BUFFERS buffers, DWORD flags )
+{
+    TRANSMIT_PACKETS_ELEMENT elements[3];
+    DWORD count = 0;
+
+    TRACE( "socket %04lx, file %p, total %u, chunk %u, ov %p, buffers %p, flags %x\n",
+           s, file, total_len, chunk_len, overlapped, buffers, flags );
+
+    if (flags & ~(TF_DISCONNECT | TF_REUSE_SOCKET | TF_WRITE_BEHIND | TF_USE_SYSTEM_THREAD | TF_USE_KERNEL_APC))
+    {
+        SetLastError( WSAEINVAL );
+        return FALSE;
+    }
+    if (flags & TF_REUSE_SOCKET) FIXME( "TF_REUSE_SOCKET not supported\n" );
+
+    if (buffers && buffers->Head && buffers->HeadLength)
+    {
+        elements[count].dwElFlags = TP_ELEMENT_MEMORY;
+        elements[count].cLength   = buffers->HeadLength;
+        elements[count].u.pBuffer   = buffers->Head;
+        count++;
+    }
+    if (file)
+    {
+        elements[count].dwElFlags = TP_ELEMENT_FILE;
+        elements[count].cLength   = total_len;
+        elements[count].u.s.hFile     = file;
+        /* the offset comes from the overlapped structure, or else from the file pointer */
+        if (overlapped)
+        {
+            elements[count].u.s.nFileOffset.u.LowPart  = overlapped->u.s.Offset;
+            elements[count].u.s.nFileOffset.u.HighPart = overlapped->u.s.OffsetHigh;
+        }
+        else elements[count].u.s.nFileOffset.QuadPart = -1;
+        count++;
+    }
+    if (buffers && buffers->Tail && buffers->TailLength)
+    {
+        elements[count].dwElFlags = TP_ELEMENT_MEMORY;
+        elements[count].cLength   = buffers->TailLength;
+        elements[count].u.pBuffer   = buffers->Tail;
+        count++;
+    }
+    return transmit( s, elements, count, overlapped, flags );
+}
+
+/***********************************************************************
+ *             TransmitPackets
+ */
+static BOOL WINAPI WS2_TransmitPackets( SOCKET s, LPTRANSMIT_PACKETS_ELEMENT elements, DWORD count,
+                                        DWORD send_size, LPOVERLAPPED overlapped, DWORD flags )
+{
+    DWORD i;
+
+    TRACE( "socket %04lx, elements %p, count %u, size %u, ov %p, flags %x\n",
+           s, elements, count, send_size, overlapped, flags );
+
+    if (count && !elements)
+    {
+        SetLastError( WSAEFAULT );
+        return FALSE;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if ((elements[i].dwElFlags & (TP_ELEMENT_MEMORY | TP_ELEMENT_FILE)) == TP_ELEMENT_MEMORY ||
+            (elements[i].dwElFlags & (TP_ELEMENT_MEMORY | TP_ELEMENT_FILE)) == TP_ELEMENT_FILE)
+            continue;
+        SetLastError( WSAEINVAL );
+        return FALSE;
+    }
+    if (flags & TP_REUSE_SOCKET) FIXME( "TP_REUSE_SOCKET not supported\n" );
+    return transmit( s, elements, count, overlapped, flags );
+}
+
 
 /***********************************************************************
  *		getpeername		(WS2_32.5)
@@ -3691,7 +4645,7 @@ INT WINAPI WSAIoctl(SOCKET s, DWORD code, LPVOID in_buff, DWORD in_size, LPVOID
             WSASetLastError(WSAEFAULT);
             return SOCKET_ERROR;
         }
-        if (_get_sock_mask(s))
+        if (_has_sock_mask(s))
         {
             /* AsyncSelect()'ed sockets are always nonblocking */
             if (!*(WS_u_long *)in_buff) status = WSAEINVAL;
@@ -3974,11 +4928,13 @@ INT WINAPI WSAIoctl(SOCKET s, DWORD code, LPVOID in_buff, DWORD in_size, LPVOID
         }
         else if ( IsEqualGUID(&transmitfile_guid, in_buff) )
         {
-            FIXME("SIO_GET_EXTENSION_FUNCTION_POINTER: unimplemented TransmitFile\n");
+            *(LPFN_TRANSMITFILE *)out_buff = WS2_TransmitFile;
+            break;
         }
         else if ( IsEqualGUID(&transmitpackets_guid, in_buff) )
         {
-            FIXME("SIO_GET_EXTENSION_FUNCTION_POINTER: unimplemented TransmitPackets\n");
+            *(LPFN_TRANSMITPACKETS *)out_buff = WS2_TransmitPackets;
+            break;
         }
         else if ( IsEqualGUID(&wsarecvmsg_guid, in_buff) )
         {
@@ -4210,129 +5166,169 @@ int WINAPI WS_recvfrom(SOCKET s, char *buf, INT len, int flags,
         return n;
 }
 
-/* allocate a poll array for the corresponding fd sets */
-static struct pollfd *fd_sets_to_poll( const WS_fd_set *readfds, const WS_fd_set *writefds,
-                                       const WS_fd_set *exceptfds, int *count_ptr )
+/* poll array built from the fd sets of a select call */
+struct select_poll
 {
-    unsigned int i, j = 0, count = 0;
-    struct pollfd *fds;
+    struct pollfd *fds;      /* one entry per distinct socket */
+    SOCKET        *sockets;  /* socket corresponding to each poll entry */
+    unsigned int  *map;      /* poll entry of each fd set element, in read/write/except order */
+    unsigned int   count;    /* number of distinct sockets */
+};
 
-    if (readfds) count += readfds->fd_count;
-    if (writefds) count += writefds->fd_count;
-    if (exceptfds) count += exceptfds->fd_count;
-    *count_ptr = count;
-    if (!count)
+static inline unsigned int hash_socket( SOCKET s )
+{
+    return (unsigned int)((ULONG_PTR)s >> 2) * 0x9e3779b1;
+}
+
+/* allocate a poll array for the corresponding fd sets */
+/* a socket present in several sets only gets a single poll entry, so that
+ * its unix fd is only looked up once for the whole select call */
+static BOOL fd_sets_to_poll( const WS_fd_set *readfds, const WS_fd_set *writefds,
+                             const WS_fd_set *exceptfds, struct select_poll *sp )
+{
+    static const short events[3] = { POLLIN, POLLOUT, POLLHUP };
+    static const DWORD access[3] = { FILE_READ_DATA, FILE_WRITE_DATA, 0 };
+    const WS_fd_set *sets[3];
+    unsigned int i, j, h, k = 0, total = 0, hash_size;
+    int *hash;
+
+    sets[0] = readfds;
+    sets[1] = writefds;
+    sets[2] = exceptfds;
+    for (i = 0; i < 3; i++) if (sets[i]) total += sets[i]->fd_count;
+    if (!total)
     {
         SetLastError(WSAEINVAL);
-        return NULL;
+        return FALSE;
     }
-    if (!(fds = HeapAlloc( GetProcessHeap(), 0, count * sizeof(fds[0]))))
+    for (hash_size = 16; hash_size < 2 * total; hash_size *= 2) /* nothing */;
+
+    if (!(sp->fds = HeapAlloc( GetProcessHeap(), 0, total * (sizeof(sp->fds[0]) + sizeof(sp->sockets[0]) +
+                                                             sizeof(sp->map[0])) + hash_size * sizeof(int) )))
     {
         SetLastError( ERROR_NOT_ENOUGH_MEMORY );
-        return NULL;
+        return FALSE;
     }
-    if (readfds)
-        for (i = 0; i < readfds->fd_count; i++, j++)
-        {
-            fds[j].fd = get_sock_fd( readfds->fd_array[i], FILE_READ_DATA, NULL );
-            if (fds[j].fd == -1) goto failed;
-            fds[j].events = POLLIN;
-            fds[j].revents = 0;
-        }
-    if (writefds)
-        for (i = 0; i < writefds->fd_count; i++, j++)
-        {
-            fds[j].fd = get_sock_fd( writefds->fd_array[i], FILE_WRITE_DATA, NULL );
-            if (fds[j].fd == -1) goto failed;
-            fds[j].events = POLLOUT;
-            fds[j].revents = 0;
-        }
-    if (exceptfds)
-        for (i = 0; i < exceptfds->fd_count; i++, j++)
-        {
-            fds[j].fd = get_sock_fd( exceptfds->fd_array[i], 0, NULL );
-            if (fds[j].fd == -1) goto failed;
-            fds[j].events = POLLHUP;
-            fds[j].revents = 0;
-        }
-    return fds;
-
-failed:
-    count = j;
-    j = 0;
-    if (readfds)
-        for (i = 0; i < readfds->fd_count && j < count; i++, j++)
-            release_sock_fd( readfds->fd_array[i], fds[j].fd );
-    if (writefds)
-        for (i = 0; i < writefds->fd_count && j < count; i++, j++)
-            release_sock_fd( writefds->fd_array[i], fds[j].fd );
-    if (exceptfds)
-        for (i = 0; i < exceptfds->fd_count && j < count; i++, j++)
-            release_sock_fd( exceptfds->fd_array[i], fds[j].fd );
-    HeapFree( GetProcessHeap(), 0, fds );
-    return NULL;
-}
+    sp->sockets = (SOCKET *)(sp->fds + total);
+    sp->map = (unsigned int *)(sp->sockets + total);
+    hash = (int *)(sp->map + total);
+    memset( hash, 0xff, hash_size * sizeof(int) );
+    sp->count = 0;
 
-/* release the file descriptor obtained in fd_sets_to_poll */
-/* must be called with the original fd_set arrays, before calling get_poll_results */
-static void release_poll_fds( const WS_fd_set *readfds, const WS_fd_set *writefds,
-                              const WS_fd_set *exceptfds, struct pollfd *fds )
-{
-    unsigned int i, j = 0;
-
-    if (readfds)
-    {
-        for (i = 0; i < readfds->fd_count; i++, j++)
-            if (fds[j].fd != -1) release_sock_fd( readfds->fd_array[i], fds[j].fd );
-    }
-    if (writefds)
+    for (i = 0; i < 3; i++)
     {
-        for (i = 0; i < writefds->fd_count; i++, j++)
-            if (fds[j].fd != -1) release_sock_fd( writefds->fd_array[i], fds[j].fd );
-    }
-    if (exceptfds)
-    {
-        for (i = 0; i < exceptfds->fd_count; i++, j++)
-            if (fds[j].fd != -1)
+        if (!sets[i]) continue;
+        for (j = 0; j < sets[i]->fd_count; j++, k++)
+        {
+            SOCKET s = sets[i]->fd_array[j];
+
+            for (h = hash_socket( s ) & (hash_size - 1); hash[h] != -1; h = (h + 1) & (hash_size - 1))
+                if (sp->sockets[hash[h]] == s) break;
+            if (hash[h] == -1)
             {
-                /* make sure we have a real error before releasing the fd */
-                if (!sock_error_p( fds[j].fd )) fds[j].revents = 0;
-                release_sock_fd( exceptfds->fd_array[i], fds[j].fd );
+                struct pollfd *pfd = &sp->fds[sp->count];
+
+                if ((pfd->fd = get_sock_fd( s, access[i], NULL )) == -1) goto failed;
+                pfd->events = 0;
+                pfd->revents = 0;
+                sp->sockets[sp->count] = s;
+                hash[h] = sp->count++;
             }
+            sp->fds[hash[h]].events |= events[i];
+            sp->map[k] = hash[h];
+        }
     }
+    return TRUE;
+
+failed:
+    for (i = 0; i < sp->count; i++) release_sock_fd( sp->sockets[i], sp->fds[i].fd );
+    HeapFree( GetProcessHeap(), 0, sp->fds );
+    return FALSE;
+}
+
+/* release the file descriptors obtained in fd_sets_to_poll */
+static void release_poll_fds( struct select_poll *sp )
+{
+    unsigned int i;
+
+    for (i = 0; i < sp->count; i++) release_sock_fd( sp->sockets[i], sp->fds[i].fd );
+    HeapFree( GetProcessHeap(), 0, sp->fds );
 }
 
 /* map the poll results back into the Windows fd sets */
+/* must be called before release_poll_fds, the fds are needed for the error check */
 static int get_poll_results( WS_fd_set *readfds, WS_fd_set *writefds, WS_fd_set *exceptfds,
-                             const struct pollfd *fds )
+                             const struct select_poll *sp )
 {
-    unsigned int i, j = 0, k, total = 0;
+    unsigned int i, k, m = 0, total = 0;
 
     if (readfds)
     {
-        for (i = k = 0; i < readfds->fd_count; i++, j++)
-            if (fds[j].revents) readfds->fd_array[k++] = readfds->fd_array[i];
+        for (i = k = 0; i < readfds->fd_count; i++)
+        {
+            const struct pollfd *pfd = &sp->fds[sp->map[m++]];
+            if (pfd->revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL))
+                readfds->fd_array[k++] = readfds->fd_array[i];
+        }
         readfds->fd_count = k;
         total += k;
     }
     if (writefds)
     {
-        for (i = k = 0; i < writefds->fd_count; i++, j++)
-            if ((fds[j].revents & POLLOUT) && !(fds[j].revents & POLLHUP))
+        for (i = k = 0; i < writefds->fd_count; i++)
+        {
+            const struct pollfd *pfd = &sp->fds[sp->map[m++]];
+            if ((pfd->revents & POLLOUT) && !(pfd->revents & POLLHUP))
                 writefds->fd_array[k++] = writefds->fd_array[i];
+        }
         writefds->fd_count = k;
         total += k;
     }
     if (exceptfds)
     {
-        for (i = k = 0; i < exceptfds->fd_count; i++, j++)
-            if (fds[j].revents) exceptfds->fd_array[k++] = exceptfds->fd_array[i];
+        for (i = k = 0; i < exceptfds->fd_count; i++)
+        {
+            const struct pollfd *pfd = &sp->fds[sp->map[m++]];
+            /* make sure we have a real error */
+            if ((pfd->revents & (POLLERR | POLLHUP | POLLNVAL)) && sock_error_p( pfd->fd ))
+                exceptfds->fd_array[k++] = exceptfds->fd_array[i];
+        }
         exceptfds->fd_count = k;
         total += k;
     }
     return total;
 }
 
+/* poll the fds, restarting on EINTR while the timeout (in ms, -1 for infinite) has not expired */
+static int do_poll( struct pollfd *fds, unsigned int count, int timeout )
+{
+    struct timeval tv1, tv2;
+    int ret, torig = timeout;
+
+    if (timeout > 0) gettimeofday( &tv1, 0 );
+
+    while ((ret = poll( fds, count, timeout )) < 0)
+    {
+        if (errno == EINTR)
+        {
+            if (timeout < 0) continue;
+            gettimeofday( &tv2, 0 );
+
+            tv2.tv_sec  -= tv1.tv_sec;
+            tv2.tv_usec -= tv1.tv_usec;
+            if (tv2.tv_usec < 0)
+            {
+                tv2.tv_usec += 1000000;
+                tv2.tv_sec  -= 1;
+            }
+
+            timeout = torig - (tv2.tv_sec * 1000) - (tv2.tv_usec + 999) / 1000;
+            if (timeout <= 0) break;
+        } else break;
+    }
+    return ret;
+}
+
 
 /***********************************************************************
  *		select			(WS2_32.18)
@@ -4341,48 +5337,98 @@ int WINAPI WS_select(int nfds, WS_fd_set *ws_readfds,
                      WS_fd_set *ws_writefds, WS_fd_set *ws_exceptfds,
                      const struct WS_timeval* ws_timeout)
 {
-    struct pollfd *pollfds;
-    struct timeval tv1, tv2;
-    int torig = 0;
-    int count, ret, timeout = -1;
+    struct select_poll sp;
+    int ret, timeout = -1;
 
     TRACE("read %p, write %p, excp %p timeout %p\n",
           ws_readfds, ws_writefds, ws_exceptfds, ws_timeout);
 
-    if (!(pollfds = fd_sets_to_poll( ws_readfds, ws_writefds, ws_exceptfds, &count )))
+    if (!fd_sets_to_poll( ws_readfds, ws_writefds, ws_exceptfds, &sp ))
         return SOCKET_ERROR;
 
     if (ws_timeout)
+        timeout = (ws_timeout->tv_sec * 1000) + (ws_timeout->tv_usec + 999) / 1000;
+
+    if ((ret = do_poll( sp.fds, sp.count, timeout )) == -1) SetLastError(wsaErrno());
+    else ret = get_poll_results( ws_readfds, ws_writefds, ws_exceptfds, &sp );
+    release_poll_fds( &sp );
+    return ret;
+}
+
+/***********************************************************************
+ *		WSAPoll			(WS2_32.@)
+ */
+int WINAPI WSAPoll( WSAPOLLFD *wfds, ULONG count, int timeout )
+{
+    struct pollfd *fds;
+    ULONG i;
+    int ret, invalid = 0;
+
+    TRACE( "(%p, %u, %d)\n", wfds, count, timeout );
+
+    if (!count)
+    {
+        SetLastError( WSAEINVAL );
+        return SOCKET_ERROR;
+    }
+    if (!wfds)
     {
-        torig = (ws_timeout->tv_sec * 1000) + (ws_timeout->tv_usec + 999) / 1000;
-        timeout = torig;
-        gettimeofday( &tv1, 0 );
+        SetLastError( WSAEFAULT );
+        return SOCKET_ERROR;
+    }
+    if (!(fds = HeapAlloc( GetProcessHeap(), 0, count * sizeof(fds[0]) )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        return SOCKET_ERROR;
     }
 
-    while ((ret = poll( pollfds, count, timeout )) < 0)
+    for (i = 0; i < count; i++)
     {
-        if (errno == EINTR)
+        fds[i].fd = -1;
+        fds[i].events = 0;
+        fds[i].revents = 0;
+        wfds[i].revents = 0;
+        if (wfds[i].fd == INVALID_SOCKET) continue;  /* ignored, like a negative unix fd */
+        if ((fds[i].fd = get_sock_fd( wfds[i].fd, 0, NULL )) == -1)
         {
-            if (!ws_timeout) continue;
-            gettimeofday( &tv2, 0 );
+            wfds[i].revents = WS_POLLNVAL;
+            invalid++;
+            continue;
+        }
+        if (wfds[i].events & WS_POLLRDNORM) fds[i].events |= POLLIN;
+        if (wfds[i].events & (WS_POLLRDBAND | WS_POLLPRI)) fds[i].events |= POLLPRI;
+        if (wfds[i].events & (WS_POLLWRNORM | WS_POLLWRBAND)) fds[i].events |= POLLOUT;
+    }
 
-            tv2.tv_sec  -= tv1.tv_sec;
-            tv2.tv_usec -= tv1.tv_usec;
-            if (tv2.tv_usec < 0)
-            {
-                tv2.tv_usec += 1000000;
-                tv2.tv_sec  -= 1;
-            }
+    /* don't wait if some sockets are already known to be invalid */
+    ret = do_poll( fds, count, invalid ? 0 : timeout );
 
-            timeout = torig - (tv2.tv_sec * 1000) - (tv2.tv_usec + 999) / 1000;
-            if (timeout <= 0) break;
-        } else break;
+    for (i = 0; i < count; i++)
+    {
+        if (fds[i].fd == -1) continue;
+        if (ret > 0)
+        {
+            if (fds[i].revents & POLLIN) wfds[i].revents |= WS_POLLRDNORM;
+            /* urgent data satisfies whichever of RDBAND and PRI was asked for */
+            if (fds[i].revents & POLLPRI)
+                wfds[i].revents |= wfds[i].events & (WS_POLLRDBAND | WS_POLLPRI);
+            if (fds[i].revents & POLLOUT) wfds[i].revents |= WS_POLLWRNORM;
+            if (fds[i].revents & POLLERR) wfds[i].revents |= WS_POLLERR;
+            if (fds[i].revents & POLLHUP) wfds[i].revents |= WS_POLLHUP;
+            if (fds[i].revents & POLLNVAL) wfds[i].revents |= WS_POLLNVAL;
+            /* only report the requested events, errors are always reported */
+            wfds[i].revents &= wfds[i].events | WS_POLLERR | WS_POLLHUP | WS_POLLNVAL;
+        }
+        release_sock_fd( wfds[i].fd, fds[i].fd );
     }
-    release_poll_fds( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
+    HeapFree( GetProcessHeap(), 0, fds );
 
-    if (ret == -1) SetLastError(wsaErrno());
-    else ret = get_poll_results( ws_readfds, ws_writefds, ws_exceptfds, pollfds );
-    HeapFree( GetProcessHeap(), 0, pollfds );
+    if (ret == -1)
+    {
+        SetLastError( wsaErrno() );
+        return SOCKET_ERROR;
+    }
+    for (i = 0, ret = 0; i < count; i++) if (wfds[i].revents) ret++;
     return ret;
 }
 
@@ -4489,7 +5535,15 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
         totalLength += lpBuffers[i].len;
     }
 
-    for (;;)
+    if (lpOverlapped && !lpCompletionRoutine &&
+        !(options & (FILE_SYNCHRONOUS_IO_ALERT | FILE_SYNCHRONOUS_IO_NONALERT)) &&
+        sock_io_pending( s, SOCK_IO_WRITE ))
+    {
+        /* don't overtake the overlapped requests that are already pending */
+        n = -1;
+        errno = EAGAIN;
+    }
+    else for (;;)
     {
         n = WS2_send( fd, wsa );
         if (n != -1 || errno != EINTR) break;
@@ -4511,6 +5565,14 @@ static int WS2_sendto( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
 
         if (n == -1 || n < totalLength)
         {
+            if (!lpCompletionRoutine &&
+                queue_sock_io( s, SOCK_IO_WRITE, wsa, NULL, iosb, lpOverlapped->hEvent, cvalue,
+                               n == -1 ? 0 : n ) == STATUS_PENDING)
+            {
+                WSASetLastError( WSA_IO_PENDING );
+                return SOCKET_ERROR;
+            }
+
             iosb->u.Status = STATUS_PENDING;
             iosb->Information = n == -1 ? 0 : n;
 
@@ -5439,10 +6501,177 @@ static char *get_hostname(void)
     return ret;
 }
 
-/***********************************************************************
- *		getaddrinfo		(WS2_32.@)
- */
-int WINAPI WS_getaddrinfo(LPCSTR nodename, LPCSTR servname, const struct WS_addrinfo *hints, struct WS_addrinfo **res)
+/* Resolved names are cached for a while, since many applications look up
+ * the same host names over and over. getaddrinfo(3) doesn't return the
+ * record TTLs, so entries simply expire after a fixed time; failures are
+ * only cached for a short time. */
+
+#define ADDRINFO_CACHE_SIZE         64
+#define ADDRINFO_CACHE_TTL          30000  /* ms */
+#define ADDRINFO_CACHE_NEGATIVE_TTL 5000   /* ms */
+
+struct addrinfo_cache_entry
+{
+    struct list         entry;
+    DWORD               expire;   /* GetTickCount() value at which the entry expires */
+    int                 result;
+    int                 flags;    /* hints used for the lookup */
+    int                 family;
+    int                 socktype;
+    int                 protocol;
+    struct WS_addrinfo *res;
+    char               *servname;
+    char                nodename[1];
+};
+
+static struct list addrinfo_cache = LIST_INIT( addrinfo_cache );
+static unsigned int addrinfo_cache_count;
+
+static CRITICAL_SECTION addrinfo_cache_section;
+static CRITICAL_SECTION_DEBUG addrinfo_cache_section_debug =
+{
+    0, 0, &addrinfo_cache_section,
+    { &addrinfo_cache_section_debug.ProcessLocksList, &addrinfo_cache_section_debug.ProcessLocksList },
+      0, 0, { (DWORD_PTR)(__FILE__ ": addrinfo_cache_section") }
+};
+static CRITICAL_SECTION addrinfo_cache_section = { &addrinfo_cache_section_debug, -1, 0, 0, 0, 0 };
+
+static struct WS_addrinfo *addrinfo_list_dup( const struct WS_addrinfo *ai )
+{
+    struct WS_addrinfo *ret = NULL, **next = &ret;
+
+    for ( ; ai; ai = ai->ai_next)
+    {
+        struct WS_addrinfo *copy;
+
+        if (!(copy = HeapAlloc( GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*copy) ))) goto failed;
+        *next = copy;
+        next = &copy->ai_next;
+        copy->ai_flags    = ai->ai_flags;
+        copy->ai_family   = ai->ai_family;
+        copy->ai_socktype = ai->ai_socktype;
+        copy->ai_protocol = ai->ai_protocol;
+        if (ai->ai_canonname)
+        {
+            if (!(copy->ai_canonname = HeapAlloc( GetProcessHeap(), 0, strlen( ai->ai_canonname ) + 1 )))
+                goto failed;
+            strcpy( copy->ai_canonname, ai->ai_canonname );
+        }
+        if (ai->ai_addr)
+        {
+            if (!(copy->ai_addr = HeapAlloc( GetProcessHeap(), 0, ai->ai_addrlen ))) goto failed;
+            memcpy( copy->ai_addr, ai->ai_addr, ai->ai_addrlen );
+            copy->ai_addrlen = ai->ai_addrlen;
+        }
+    }
+    return ret;
+
+failed:
+    WS_freeaddrinfo( ret );
+    return NULL;
+}
+
+static void free_addrinfo_cache_entry( struct addrinfo_cache_entry *entry )
+{
+    list_remove( &entry->entry );
+    addrinfo_cache_count--;
+    WS_freeaddrinfo( entry->res );
+    HeapFree( GetProcessHeap(), 0, entry );
+}
+
+/* find a cache entry; addrinfo_cache_section must be held */
+static struct addrinfo_cache_entry *find_addrinfo_cache_entry( const char *nodename, const char *servname,
+                                                                const struct WS_addrinfo *hints )
+{
+    struct addrinfo_cache_entry *entry, *next;
+    DWORD now = GetTickCount();
+
+    LIST_FOR_EACH_ENTRY_SAFE( entry, next, &addrinfo_cache, struct addrinfo_cache_entry, entry )
+    {
+        if ((int)(entry->expire - now) <= 0)
+        {
+            free_addrinfo_cache_entry( entry );
+            continue;
+        }
+        if (strcmp( entry->nodename, nodename )) continue;
+        if (servname ? !entry->servname || strcmp( entry->servname, servname ) : entry->servname != NULL)
+            continue;
+        if (entry->flags != (hints ? hints->ai_flags : 0) ||
+            entry->family != (hints ? hints->ai_family : 0) ||
+            entry->socktype != (hints ? hints->ai_socktype : 0) ||
+            entry->protocol != (hints ? hints->ai_protocol : 0))
+            continue;
+        return entry;
+    }
+    return NULL;
+}
+
+/* returns -1 if the name isn't in the cache */
+static int get_cached_addrinfo( const char *nodename, const char *servname,
+                                const struct WS_addrinfo *hints, struct WS_addrinfo **res )
+{
+    struct addrinfo_cache_entry *entry;
+    int result = -1;
+
+    EnterCriticalSection( &addrinfo_cache_section );
+    if ((entry = find_addrinfo_cache_entry( nodename, servname, hints )))
+    {
+        /* keep the most recently used entries at the head */
+        list_remove( &entry->entry );
+        list_add_head( &addrinfo_cache, &entry->entry );
+        result = entry->result;
+        if (!result && !(*res = addrinfo_list_dup( entry->res ))) result = WSA_NOT_ENOUGH_MEMORY;
+    }
+    LeaveCriticalSection( &addrinfo_cache_section );
+    if (result != -1) TRACE( "%s, %s found in cache -> %d\n", debugstr_a(nodename), debugstr_a(servname), result );
+    return result;
+}
+
+static void cache_addrinfo( const char *nodename, const char *servname, const struct WS_addrinfo *hints,
+                            int result, const struct WS_addrinfo *res )
+{
+    struct addrinfo_cache_entry *entry;
+    size_t node_len = strlen( nodename ) + 1, serv_len = servname ? strlen( servname ) + 1 : 0;
+
+    if (result && result != WSAHOST_NOT_FOUND) return;  /* don't cache temporary failures */
+    if (!(entry = HeapAlloc( GetProcessHeap(), 0, FIELD_OFFSET( struct addrinfo_cache_entry, nodename[node_len + serv_len] ))))
+        return;
+    if (!result && !(entry->res = addrinfo_list_dup( res )))
+    {
+        HeapFree( GetProcessHeap(), 0, entry );
+        return;
+    }
+    if (result) entry->res = NULL;
+    entry->expire   = GetTickCount() + (result ? ADDRINFO_CACHE_NEGATIVE_TTL : ADDRINFO_CACHE_TTL);
+    entry->result   = result;
+    entry->flags    = hints ? hints->ai_flags : 0;
+    entry->family   = hints ? hints->ai_family : 0;
+    entry->socktype = hints ? hints->ai_socktype : 0;
+    entry->protocol = hints ? hints->ai_protocol : 0;
+    memcpy( entry->nodename, nodename, node_len );
+    entry->servname = NULL;
+    if (servname) entry->servname = memcpy( entry->nodename + node_len, servname, serv_len );
+
+    EnterCriticalSection( &addrinfo_cache_section );
+    if (!find_addrinfo_cache_entry( nodename, servname, hints ))  /* another thread may have added it */
+    {
+        if (addrinfo_cache_count >= ADDRINFO_CACHE_SIZE)
+            free_addrinfo_cache_entry( LIST_ENTRY( list_tail( &addrinfo_cache ), struct addrinfo_cache_entry, entry ));
+        list_add_head( &addrinfo_cache, &entry->entry );
+        addrinfo_cache_count++;
+        entry = NULL;
+    }
+    LeaveCriticalSection( &addrinfo_cache_section );
+
+    if (entry)
+    {
+        WS_freeaddrinfo( entry->res );
+        HeapFree( GetProcessHeap(), 0, entry );
+    }
+}
+
+static int lookup_addrinfo( const char *nodename, const char *servname, const struct WS_addrinfo *hints,
+                            struct WS_addrinfo **res )
 {
 #ifdef HAVE_GETADDRINFO
     struct addrinfo *unixaires = NULL;
@@ -5582,6 +6811,33 @@ outofmem:
 #endif
 }
 
+/* literal addresses are converted without a lookup, there is no point in caching them */
+static BOOL is_numeric_host( const char *nodename )
+{
+#ifdef HAVE_INET_PTON
+    char addr[16];
+
+    if (inet_pton( AF_INET, nodename, addr ) > 0 || inet_pton( AF_INET6, nodename, addr ) > 0)
+        return TRUE;
+#endif
+    return inet_addr( nodename ) != INADDR_NONE;
+}
+
+/***********************************************************************
+ *		getaddrinfo		(WS2_32.@)
+ */
+int WINAPI WS_getaddrinfo(LPCSTR nodename, LPCSTR servname, const struct WS_addrinfo *hints, struct WS_addrinfo **res)
+{
+    BOOL cache = nodename && !(hints && (hints->ai_flags & WS_AI_NUMERICHOST)) && !is_numeric_host( nodename );
+    int result;
+
+    *res = NULL;
+    if (cache && (result = get_cached_addrinfo( nodename, servname, hints, res )) != -1) return result;
+    result = lookup_addrinfo( nodename, servname, hints, res );
+    if (cache) cache_addrinfo( nodename, servname, hints, result, *res );
+    return result;
+}
+
 static struct WS_addrinfoW *addrinfo_AtoW(const struct WS_addrinfo *ai)
 {
     struct WS_addrinfoW *ret;
@@ -5598,7 +6854,7 @@ static struct WS_addrinfoW *addrinfo_AtoW(const struct WS_addrinfo *ai)
     if (ai->ai_canonname)
     {
         int len = MultiByteToWideChar(CP_ACP, 0, ai->ai_canonname, -1, NULL, 0);
-        if (!(ret->ai_canonname = HeapAlloc(GetProcessHeap(), 0, len)))
+        if (!(ret->ai_canonname = HeapAlloc(GetProcessHeap(), 0, len * sizeof(WCHAR))))
         {
             HeapFree(GetProcessHeap(), 0, ret);
             return NULL;
@@ -5607,13 +6863,13 @@ static struct WS_addrinfoW *addrinfo_AtoW(const struct WS_addrinfo *ai)
     }
     if (ai->ai_addr)
     {
-        if (!(ret->ai_addr = HeapAlloc(GetProcessHeap(), 0, sizeof(struct WS_sockaddr))))
+        if (!(ret->ai_addr = HeapAlloc(GetProcessHeap(), 0, ai->ai_addrlen)))
         {
             HeapFree(GetProcessHeap(), 0, ret->ai_canonname);
             HeapFree(GetProcessHeap(), 0, ret);
             return NULL;
         }
-        memcpy(ret->ai_addr, ai->ai_addr, sizeof(struct WS_sockaddr));
+        memcpy(ret->ai_addr, ai->ai_addr, ai->ai_addrlen);
     }
     return ret;
 }
@@ -5661,13 +6917,13 @@ static struct WS_addrinfo *addrinfo_WtoA(const struct WS_addrinfoW *ai)
     }
     if (ai->ai_addr)
     {
-        if (!(ret->ai_addr = HeapAlloc(GetProcessHeap(), 0, sizeof(struct WS_sockaddr))))
+        if (!(ret->ai_addr = HeapAlloc(GetProcessHeap(), 0, ai->ai_addrlen)))
         {
             HeapFree(GetProcessHeap(), 0, ret->ai_canonname);
             HeapFree(GetProcessHeap(), 0, ret);
             return NULL;
         }
-        memcpy(ret->ai_addr, ai->ai_addr, sizeof(struct WS_sockaddr));
+        memcpy(ret->ai_addr, ai->ai_addr, ai->ai_addrlen);
     }
     return ret;
 }
@@ -5730,6 +6986,171 @@ void WINAPI FreeAddrInfoW(PADDRINFOW ai)
     }
 }
 
+static struct WS_addrinfoexW *addrinfo_list_WtoEx(const struct WS_addrinfoW *info)
+{
+    struct WS_addrinfoexW *ret = NULL, **next = &ret, *ex;
+
+    for ( ; info; info = info->ai_next)
+    {
+        if (!(ex = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*ex)))) goto failed;
+        *next = ex;
+        next = &ex->ai_next;
+        ex->ai_flags    = info->ai_flags;
+        ex->ai_family   = info->ai_family;
+        ex->ai_socktype = info->ai_socktype;
+        ex->ai_protocol = info->ai_protocol;
+        if (info->ai_canonname)
+        {
+            if (!(ex->ai_canonname = HeapAlloc(GetProcessHeap(), 0, (strlenW(info->ai_canonname) + 1) * sizeof(WCHAR))))
+                goto failed;
+            strcpyW(ex->ai_canonname, info->ai_canonname);
+        }
+        if (info->ai_addr)
+        {
+            if (!(ex->ai_addr = HeapAlloc(GetProcessHeap(), 0, info->ai_addrlen))) goto failed;
+            memcpy(ex->ai_addr, info->ai_addr, info->ai_addrlen);
+            ex->ai_addrlen = info->ai_addrlen;
+        }
+    }
+    return ret;
+
+failed:
+    FreeAddrInfoExW(ret);
+    return NULL;
+}
+
+static int getaddrinfoex(const WCHAR *nodename, const WCHAR *servname, const ADDRINFOEXW *hints,
+                         ADDRINFOEXW **res)
+{
+    ADDRINFOW hintsW, *resW;
+    int ret;
+
+    if (hints)
+    {
+        memset(&hintsW, 0, sizeof(hintsW));
+        hintsW.ai_flags    = hints->ai_flags;
+        hintsW.ai_family   = hints->ai_family;
+        hintsW.ai_socktype = hints->ai_socktype;
+        hintsW.ai_protocol = hints->ai_protocol;
+    }
+    if (!(ret = GetAddrInfoW(nodename, servname, hints ? &hintsW : NULL, &resW)))
+    {
+        if (!(*res = addrinfo_list_WtoEx(resW))) ret = WSA_NOT_ENOUGH_MEMORY;
+        FreeAddrInfoW(resW);
+    }
+    return ret;
+}
+
+struct getaddrinfo_args
+{
+    OVERLAPPED                        *overlapped;
+    LPLOOKUPSERVICE_COMPLETION_ROUTINE completion_routine;
+    ADDRINFOEXW                      **result;
+    ADDRINFOEXW                        hints;
+    BOOL                               has_hints;
+    WCHAR                             *nodename;
+    WCHAR                             *servname;
+    WCHAR                              data[1];
+};
+
+static DWORD WINAPI getaddrinfo_callback(void *arg)
+{
+    struct getaddrinfo_args *args = arg;
+    OVERLAPPED *overlapped = args->overlapped;
+    LPLOOKUPSERVICE_COMPLETION_ROUTINE completion_routine = args->completion_routine;
+    ADDRINFOEXW *res = NULL;
+    int ret;
+
+    ret = getaddrinfoex(args->nodename, args->servname, args->has_hints ? &args->hints : NULL, &res);
+    TRACE("%s, %s -> %d\n", debugstr_w(args->nodename), debugstr_w(args->servname), ret);
+    *args->result = res;
+    HeapFree(GetProcessHeap(), 0, args);
+
+    overlapped->Internal = ret;
+    if (completion_routine) completion_routine(ret, 0, overlapped);
+    else if (overlapped->hEvent) SetEvent(overlapped->hEvent);
+    return 0;
+}
+
+/***********************************************************************
+ *      GetAddrInfoExW        (WS2_32.@)
+ *
+ * Asynchronous requests are resolved by a worker thread. The name space
+ * and timeout parameters are ignored.
+ */
+int WINAPI GetAddrInfoExW(const WCHAR *name, const WCHAR *servname, DWORD namespace, GUID *namespace_id,
+                          const ADDRINFOEXW *hints, ADDRINFOEXW **result, struct WS_timeval *timeout,
+                          OVERLAPPED *overlapped, LPLOOKUPSERVICE_COMPLETION_ROUTINE completion_routine,
+                          HANDLE *handle)
+{
+    struct getaddrinfo_args *args;
+    size_t name_len, serv_len;
+
+    TRACE("(%s, %s, %x, %s, %p, %p, %p, %p, %p, %p)\n", debugstr_w(name), debugstr_w(servname), namespace,
+          debugstr_guid(namespace_id), hints, result, timeout, overlapped, completion_routine, handle);
+
+    if (namespace != NS_ALL && namespace != NS_DNS)
+        FIXME("unsupported namespace %u\n", namespace);
+    if (namespace_id) FIXME("namespace_id not supported\n");
+    if (timeout) FIXME("timeout not supported\n");
+    if (!result) return WSAEFAULT;
+
+    *result = NULL;
+    if (handle) *handle = 0;
+    if (!overlapped)
+    {
+        if (completion_routine) return WSAEINVAL;
+        return getaddrinfoex(name, servname, hints, result);
+    }
+
+    name_len = name ? strlenW(name) + 1 : 0;
+    serv_len = servname ? strlenW(servname) + 1 : 0;
+    if (!(args = HeapAlloc(GetProcessHeap(), 0, FIELD_OFFSET(struct getaddrinfo_args, data[name_len + serv_len]))))
+        return WSA_NOT_ENOUGH_MEMORY;
+    args->overlapped         = overlapped;
+    args->completion_routine = completion_routine;
+    args->result             = result;
+    args->has_hints          = hints != NULL;
+    if (hints) args->hints   = *hints;
+    args->nodename           = name ? memcpy(args->data, name, name_len * sizeof(WCHAR)) : NULL;
+    args->servname           = servname ? memcpy(args->data + name_len, servname, serv_len * sizeof(WCHAR)) : NULL;
+
+    overlapped->Internal = WSAEINPROGRESS;
+    if (!QueueUserWorkItem(getaddrinfo_callback, args, WT_EXECUTELONGFUNCTION))
+    {
+        HeapFree(GetProcessHeap(), 0, args);
+        return GetLastError();
+    }
+    return WSA_IO_PENDING;
+}
+
+/***********************************************************************
+ *      GetAddrInfoExOverlappedResult        (WS2_32.@)
+ */
+int WINAPI GetAddrInfoExOverlappedResult(OVERLAPPED *overlapped)
+{
+    TRACE("(%p)\n", overlapped);
+
+    if (!overlapped) return WSAEINVAL;
+    return overlapped->Internal;
+}
+
+/***********************************************************************
+ *      FreeAddrInfoExW        (WS2_32.@)
+ */
+void WINAPI FreeAddrInfoExW(ADDRINFOEXW *ai)
+{
+    while (ai)
+    {
+        ADDRINFOEXW *next;
+        HeapFree(GetProcessHeap(), 0, ai->ai_canonname);
+        HeapFree(GetProcessHeap(), 0, ai->ai_addr);
+        next = ai->ai_next;
+        HeapFree(GetProcessHeap(), 0, ai);
+        ai = next;
+    }
+}
+
 int WINAPI WS_getnameinfo(const SOCKADDR *sa, WS_socklen_t salen, PCHAR host,
                           DWORD hostlen, PCHAR serv, DWORD servlen, INT flags)
 {
@@ -5878,7 +7299,12 @@ int WINAPI WSAEventSelect(SOCKET s, WSAEVENT hEvent, LONG lEvent)
         ret = wine_server_call( req );
     }
     SERVER_END_REQ;
-    if (!ret) return 0;
+    if (!ret)
+    {
+        /* the server also makes the socket non-blocking */
+        set_sock_state( s, SOCK_STATE_VALID | SOCK_STATE_NONBLOCKING | (lEvent ? SOCK_STATE_SELECT : 0) );
+        return 0;
+    }
     SetLastError(WSAEINVAL);
     return SOCKET_ERROR;
 }
@@ -5947,7 +7373,12 @@ INT WINAPI WSAAsyncSelect(SOCKET s, HWND hWnd, UINT uMsg, LONG lEvent)
         ret = wine_server_call( req );
     }
     SERVER_END_REQ;
-    if (!ret) return 0;
+    if (!ret)
+    {
+        /* the server also makes the socket non-blocking */
+        set_sock_state( s, SOCK_STATE_VALID | SOCK_STATE_NONBLOCKING | (lEvent ? SOCK_STATE_SELECT : 0) );
+        return 0;
+    }
     SetLastError(WSAEINVAL);
     return SOCKET_ERROR;
 }
@@ -6034,6 +7465,8 @@ SOCKET WINAPI WSASocketW(int af, int type, int protocol,
     if (lpProtocolInfo && lpProtocolInfo->dwServiceFlags4 == 0xff00ff00) {
       ret = lpProtocolInfo->dwServiceFlags3;
       TRACE("\tgot duplicate %04lx\n", ret);
+      /* the duplicate shares the state of the original socket, fetch it on first use */
+      set_sock_state( ret, 0 );
       return ret;
     }
 
@@ -6132,6 +7565,8 @@ SOCKET WINAPI WSASocketW(int af, int type, int protocol,
     if (ret)
     {
         TRACE("\tcreated %04lx\n", ret );
+        set_sock_state( ret, SOCK_STATE_VALID );
+        close_sock_io( ret );
         if (ipxptype > 0)
             set_ipx_packettype(ret, ipxptype);
        return ret;
@@ -6447,7 +7882,7 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
     unsigned int i, options;
     int n, fd, err;
     struct ws2_async *wsa;
-    BOOL is_blocking;
+    BOOL is_blocking, queue_behind;
     DWORD timeout_start = GetTickCount();
     ULONG_PTR cvalue = (lpOverlapped && ((ULONG_PTR)lpOverlapped->hEvent & 1) == 0) ? (ULONG_PTR)lpOverlapped : 0;
 
@@ -6487,9 +7922,19 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
         wsa->iovec[i].iov_len  = lpBuffers[i].len;
     }
 
+    /* don't overtake the overlapped requests that are already pending */
+    queue_behind = lpOverlapped && !lpCompletionRoutine &&
+                   !(options & (FILE_SYNCHRONOUS_IO_ALERT | FILE_SYNCHRONOUS_IO_NONALERT)) &&
+                   sock_io_pending( s, SOCK_IO_READ );
+
     for (;;)
     {
-        n = WS2_recv( fd, wsa );
+        if (queue_behind)
+        {
+            n = -1;
+            errno = EAGAIN;
+        }
+        else n = WS2_recv( fd, wsa );
         if (n == -1)
         {
             if (errno == EINTR) continue;
@@ -6514,6 +7959,13 @@ static int WS2_recv_base( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
 
             if (n == -1)
             {
+                if (!lpCompletionRoutine &&
+                    queue_sock_io( s, SOCK_IO_READ, wsa, NULL, iosb, lpOverlapped->hEvent, cvalue, 0 ) == STATUS_PENDING)
+                {
+                    WSASetLastError( WSA_IO_PENDING );
+                    return SOCKET_ERROR;
+                }
+
                 iosb->u.Status = STATUS_PENDING;
                 iosb->Information = 0;
 
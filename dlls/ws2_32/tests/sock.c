@@ -66,10 +66,16 @@ static void  (WINAPI *pfreeaddrinfo)(struct addrinfo *);
 static int   (WINAPI *pgetaddrinfo)(LPCSTR,LPCSTR,const struct addrinfo *,struct addrinfo **);
 static void  (WINAPI *pFreeAddrInfoW)(PADDRINFOW);
 static int   (WINAPI *pGetAddrInfoW)(LPCWSTR,LPCWSTR,const ADDRINFOW *,PADDRINFOW *);
+static void  (WINAPI *pFreeAddrInfoExW)(ADDRINFOEXW *);
+static int   (WINAPI *pGetAddrInfoExW)(const WCHAR *,const WCHAR *,DWORD,GUID *,const ADDRINFOEXW *,
+                                       ADDRINFOEXW **,struct timeval *,OVERLAPPED *,
+                                       LPLOOKUPSERVICE_COMPLETION_ROUTINE,HANDLE *);
+static int   (WINAPI *pGetAddrInfoExOverlappedResult)(OVERLAPPED *);
 static PCSTR (WINAPI *pInetNtop)(INT,LPVOID,LPSTR,ULONG);
 static int   (WINAPI *pWSALookupServiceBeginW)(LPWSAQUERYSETW,DWORD,LPHANDLE);
 static int   (WINAPI *pWSALookupServiceEnd)(HANDLE);
 static int   (WINAPI *pWSALookupServiceNextW)(HANDLE,DWORD,LPDWORD,LPWSAQUERYSETW);
+static int   (WINAPI *pWSAPoll)(WSAPOLLFD*,ULONG,int);
 
 /**************** Structs and typedefs ***************/
 
@@ -1079,10 +1085,14 @@ static void Init (void)
     pgetaddrinfo = (void *)GetProcAddress(hws2_32, "getaddrinfo");
     pFreeAddrInfoW = (void *)GetProcAddress(hws2_32, "FreeAddrInfoW");
     pGetAddrInfoW = (void *)GetProcAddress(hws2_32, "GetAddrInfoW");
+    pFreeAddrInfoExW = (void *)GetProcAddress(hws2_32, "FreeAddrInfoExW");
+    pGetAddrInfoExW = (void *)GetProcAddress(hws2_32, "GetAddrInfoExW");
+    pGetAddrInfoExOverlappedResult = (void *)GetProcAddress(hws2_32, "GetAddrInfoExOverlappedResult");
     pInetNtop = (void *)GetProcAddress(hws2_32, "inet_ntop");
     pWSALookupServiceBeginW = (void *)GetProcAddress(hws2_32, "WSALookupServiceBeginW");
     pWSALookupServiceEnd = (void *)GetProcAddress(hws2_32, "WSALookupServiceEnd");
     pWSALookupServiceNextW = (void *)GetProcAddress(hws2_32, "WSALookupServiceNextW");
+    pWSAPoll = (void *)GetProcAddress(hws2_32, "WSAPoll");
 
     ok ( WSAStartup ( ver, &data ) == 0, "WSAStartup failed\n" );
     tls = TlsAlloc();
@@ -3226,6 +3236,152 @@ static void test_select(void)
     ok ( !FD_ISSET(fdRead, &exceptfds), "FD should not be set\n");
 }
 
+#define SELECT_MANY_COUNT 1000
+
+struct big_fd_set
+{
+    u_int  fd_count;
+    SOCKET fd_array[SELECT_MANY_COUNT];
+};
+
+static void test_select_many(void)
+{
+    static struct big_fd_set readfds, writefds, sockets;
+    struct sockaddr_in addr;
+    struct timeval timeout = {0, 0};
+    unsigned int i, iter;
+    int len, ret;
+    SOCKET sender;
+    DWORD start;
+
+    sender = socket(AF_INET, SOCK_DGRAM, 0);
+    ok(sender != INVALID_SOCKET, "socket failed: %d\n", WSAGetLastError());
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    for (sockets.fd_count = 0; sockets.fd_count < SELECT_MANY_COUNT; sockets.fd_count++)
+    {
+        SOCKET s = socket(AF_INET, SOCK_DGRAM, 0);
+        if (s == INVALID_SOCKET) break;
+        addr.sin_port = 0;
+        if (bind(s, (struct sockaddr *)&addr, sizeof(addr)))
+        {
+            closesocket(s);
+            break;
+        }
+        sockets.fd_array[sockets.fd_count] = s;
+    }
+    if (sockets.fd_count < SELECT_MANY_COUNT / 10)
+    {
+        skip("could only create %u sockets\n", sockets.fd_count);
+        goto done;
+    }
+
+    /* make every tenth socket readable */
+    for (i = 0; i < sockets.fd_count; i += 10)
+    {
+        len = sizeof(addr);
+        ret = getsockname(sockets.fd_array[i], (struct sockaddr *)&addr, &len);
+        ok(!ret, "getsockname failed: %d\n", WSAGetLastError());
+        ret = sendto(sender, "x", 1, 0, (struct sockaddr *)&addr, sizeof(addr));
+        ok(ret == 1, "sendto failed: %d\n", WSAGetLastError());
+    }
+    Sleep(100);
+
+    start = GetTickCount();
+    for (iter = 0; iter < 100; iter++)
+    {
+        /* every socket is in both sets */
+        readfds = writefds = sockets;
+        ret = select(0, (fd_set *)&readfds, (fd_set *)&writefds, NULL, &timeout);
+        ok(ret == readfds.fd_count + writefds.fd_count, "select returned %d\n", ret);
+        ok(readfds.fd_count == (sockets.fd_count + 9) / 10, "got %u readable sockets\n", readfds.fd_count);
+        ok(writefds.fd_count == sockets.fd_count, "got %u writable sockets\n", writefds.fd_count);
+        if (readfds.fd_count) ok(readfds.fd_array[0] == sockets.fd_array[0], "wrong first readable socket\n");
+        if (ret == SOCKET_ERROR) break;
+    }
+    trace("100 select calls over %u sockets took %u ms\n", sockets.fd_count, GetTickCount() - start);
+
+done:
+    for (i = 0; i < sockets.fd_count; i++) closesocket(sockets.fd_array[i]);
+    closesocket(sender);
+}
+
+static void test_WSAPoll(void)
+{
+    WSAPOLLFD fds[3];
+    SOCKET src, dst;
+    char buffer;
+    int ret;
+
+    if (!pWSAPoll)
+    {
+        win_skip("WSAPoll is not available\n");
+        return;
+    }
+
+    SetLastError(0xdeadbeef);
+    ret = pWSAPoll(NULL, 0, 0);
+    ok(ret == SOCKET_ERROR && WSAGetLastError() == WSAEINVAL, "got %d, error %d\n", ret, WSAGetLastError());
+
+    if (tcp_socketpair(&src, &dst) != 0)
+    {
+        ok(0, "creating socket pair failed, skipping test\n");
+        return;
+    }
+
+    fds[0].fd = src;
+    fds[0].events = POLLRDNORM | POLLWRNORM;
+    fds[0].revents = 0xdead;
+    fds[1].fd = dst;
+    fds[1].events = POLLRDNORM;
+    fds[1].revents = 0xdead;
+    fds[2].fd = INVALID_SOCKET;
+    fds[2].events = POLLRDNORM;
+    fds[2].revents = 0xdead;
+    ret = pWSAPoll(fds, 3, 0);
+    ok(ret == 1, "got %d\n", ret);
+    ok(fds[0].revents == POLLWRNORM, "got revents %x\n", fds[0].revents);
+    ok(!fds[1].revents, "got revents %x\n", fds[1].revents);
+    ok(!fds[2].revents, "got revents %x\n", fds[2].revents);
+
+    ret = send(src, "x", 1, 0);
+    ok(ret == 1, "send failed: %d\n", WSAGetLastError());
+    ret = pWSAPoll(fds, 2, 1000);
+    ok(ret == 2, "got %d\n", ret);
+    ok(fds[0].revents == POLLWRNORM, "got revents %x\n", fds[0].revents);
+    ok(fds[1].revents == POLLRDNORM, "got revents %x\n", fds[1].revents);
+    ret = recv(dst, &buffer, 1, 0);
+    ok(ret == 1, "recv failed: %d\n", WSAGetLastError());
+
+    /* out-of-band data is reported as priority band data */
+    ret = send(src, "x", 1, MSG_OOB);
+    ok(ret == 1, "send failed: %d\n", WSAGetLastError());
+    fds[1].events = POLLRDBAND;
+    ret = pWSAPoll(fds + 1, 1, 1000);
+    ok(ret == 1, "got %d\n", ret);
+    ok(fds[1].revents == POLLRDBAND, "got revents %x\n", fds[1].revents);
+    ret = recv(dst, &buffer, 1, MSG_OOB);
+    ok(ret == 1, "recv failed: %d\n", WSAGetLastError());
+    fds[1].events = POLLRDNORM;
+
+    /* a closed peer is reported as hang up */
+    closesocket(src);
+    ret = pWSAPoll(fds + 1, 1, 1000);
+    ok(ret == 1, "got %d\n", ret);
+    ok(fds[1].revents & (POLLHUP | POLLRDNORM), "got revents %x\n", fds[1].revents);
+
+    /* a closed socket is reported as invalid */
+    fds[0].fd = src;
+    fds[0].events = POLLRDNORM;
+    ret = pWSAPoll(fds, 1, 1000);
+    ok(ret == 1, "got %d\n", ret);
+    ok(fds[0].revents == POLLNVAL, "got revents %x\n", fds[0].revents);
+
+    closesocket(dst);
+}
+
 static DWORD WINAPI AcceptKillThread(void *param)
 {
     select_thread_params *par = param;
@@ -4001,6 +4157,60 @@ static void test_ioctlsocket(void)
     closesocket(src);
 }
 
+static DWORD WINAPI recv_once_thread(LPVOID arg)
+{
+    SOCKET sock = *(SOCKET *)arg;
+    char buffer[8];
+
+    if (recv(sock, buffer, sizeof(buffer), 0) == SOCKET_ERROR) return WSAGetLastError();
+    return 0;
+}
+
+/* the blocking mode of a closed socket must not apply to a new handle with the same value */
+static void test_closed_socket_state(void)
+{
+    SOCKET src, dst, sock, dup;
+    HANDLE thread;
+    u_long arg = 1;
+    DWORD ret, code;
+
+    if (tcp_socketpair(&src, &dst))
+    {
+        skip("failed to create sockets\n");
+        return;
+    }
+    ret = ioctlsocket(dst, FIONBIO, &arg);
+    ok(!ret, "FIONBIO failed, error %d\n", WSAGetLastError());
+
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    ok(sock != INVALID_SOCKET, "socket failed, error %d\n", WSAGetLastError());
+    ret = CloseHandle((HANDLE)sock);
+    ok(ret, "CloseHandle failed, error %u\n", GetLastError());
+
+    ret = DuplicateHandle(GetCurrentProcess(), (HANDLE)dst, GetCurrentProcess(), (HANDLE *)&dup,
+                          0, FALSE, DUPLICATE_SAME_ACCESS);
+    ok(ret, "DuplicateHandle failed, error %u\n", GetLastError());
+    if (dup != sock) trace("handle %x not reused, got %x\n", (UINT)sock, (UINT)dup);
+
+    /* the duplicate shares the non-blocking mode of dst */
+    thread = CreateThread(NULL, 0, recv_once_thread, &dup, 0, NULL);
+    ret = WaitForSingleObject(thread, 1000);
+    ok(ret == WAIT_OBJECT_0, "recv blocked on a non-blocking socket\n");
+    if (ret != WAIT_OBJECT_0)
+    {
+        closesocket(src);
+        src = INVALID_SOCKET;
+        WaitForSingleObject(thread, INFINITE);
+    }
+    GetExitCodeThread(thread, &code);
+    ok(code == WSAEWOULDBLOCK, "got %u\n", code);
+    CloseHandle(thread);
+
+    closesocket(dup);
+    closesocket(dst);
+    if (src != INVALID_SOCKET) closesocket(src);
+}
+
 static BOOL drain_pause = FALSE;
 static DWORD WINAPI drain_socket_thread(LPVOID arg)
 {
@@ -5366,6 +5576,415 @@ end:
         WSACloseEvent(ov.hEvent);
 }
 
+static int recv_all(SOCKET s, char *buf, int len)
+{
+    int n, total = 0;
+
+    while (total < len)
+    {
+        if ((n = recv(s, buf + total, len - total, 0)) <= 0) return n;
+        total += n;
+    }
+    return total;
+}
+
+static void test_echo(void)
+{
+    enum { nb_messages = 10000 };
+    SOCKET src, dst;
+    char msg[64], buf[64];
+    WSANETWORKEVENTS net_events;
+    WSAOVERLAPPED ov;
+    WSABUF wsabuf;
+    WSAEVENT event;
+    DWORD start, ticks, ret, count, flags;
+    u_long nonblocking;
+    int i, n, errors = 0;
+
+    if (tcp_socketpair(&src, &dst) != 0)
+    {
+        ok(0, "creating socket pair failed, skipping test\n");
+        return;
+    }
+
+    memset(msg, 0, sizeof(msg));
+    start = GetTickCount();
+    for (i = 0; i < nb_messages; i++)
+    {
+        sprintf(msg, "message %d", i);
+        n = send(src, msg, sizeof(msg), 0);
+        ok(n == sizeof(msg), "send returned %d, error %d\n", n, WSAGetLastError());
+        n = recv_all(dst, buf, sizeof(buf));
+        ok(n == sizeof(buf), "recv returned %d, error %d\n", n, WSAGetLastError());
+        n = send(dst, buf, sizeof(buf), 0);
+        ok(n == sizeof(buf), "send returned %d, error %d\n", n, WSAGetLastError());
+        memset(buf, 0, sizeof(buf));
+        n = recv_all(src, buf, sizeof(buf));
+        ok(n == sizeof(buf), "recv returned %d, error %d\n", n, WSAGetLastError());
+        if (memcmp(buf, msg, sizeof(msg))) errors++;
+        if (n != sizeof(buf)) break;
+    }
+    ticks = GetTickCount() - start;
+    ok(!errors, "got %d wrong messages\n", errors);
+    trace("%d echoed messages in %u ms (%u/s)\n", i, ticks, ticks ? i * 1000 / ticks : 0);
+
+    /* events selected after many receives are still reported */
+    event = WSACreateEvent();
+    ret = WSAEventSelect(dst, event, FD_READ);
+    ok(!ret, "WSAEventSelect failed, error %d\n", WSAGetLastError());
+    ret = WaitForSingleObject(event, 0);
+    ok(ret == WAIT_TIMEOUT, "event signaled without data\n");
+
+    for (i = 0; i < 2; i++)
+    {
+        n = send(src, msg, sizeof(msg), 0);
+        ok(n == sizeof(msg), "send returned %d, error %d\n", n, WSAGetLastError());
+        ret = WaitForSingleObject(event, 1000);
+        ok(ret == WAIT_OBJECT_0, "%d: event not signaled\n", i);
+        ret = WSAEnumNetworkEvents(dst, event, &net_events);
+        ok(!ret, "WSAEnumNetworkEvents failed, error %d\n", WSAGetLastError());
+        ok(net_events.lNetworkEvents == FD_READ, "%d: got events %x\n", i, net_events.lNetworkEvents);
+        /* receiving re-enables FD_READ */
+        n = recv(dst, buf, sizeof(buf), 0);
+        ok(n == sizeof(buf), "recv returned %d, error %d\n", n, WSAGetLastError());
+    }
+
+    /* WSAEventSelect made the socket non-blocking */
+    n = recv(dst, buf, sizeof(buf), 0);
+    ok(n == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK, "recv returned %d, error %d\n",
+       n, WSAGetLastError());
+    nonblocking = 0;
+    ret = ioctlsocket(dst, FIONBIO, &nonblocking);
+    ok(ret == SOCKET_ERROR && WSAGetLastError() == WSAEINVAL, "ioctlsocket returned %d, error %d\n",
+       ret, WSAGetLastError());
+
+    /* it can be made blocking again once the event mask is cleared */
+    ret = WSAEventSelect(dst, NULL, 0);
+    ok(!ret, "WSAEventSelect failed, error %d\n", WSAGetLastError());
+    ret = ioctlsocket(dst, FIONBIO, &nonblocking);
+    ok(!ret, "ioctlsocket failed, error %d\n", WSAGetLastError());
+    n = send(src, msg, sizeof(msg), 0);
+    ok(n == sizeof(msg), "send returned %d, error %d\n", n, WSAGetLastError());
+    n = recv_all(dst, buf, sizeof(buf));
+    ok(n == sizeof(buf), "recv returned %d, error %d\n", n, WSAGetLastError());
+
+    /* pending overlapped receives are cancelled by CancelIo */
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = event;
+    wsabuf.len = sizeof(buf);
+    wsabuf.buf = buf;
+    flags = 0;
+    ResetEvent(event);
+    n = WSARecv(dst, &wsabuf, 1, NULL, &flags, &ov, NULL);
+    ok(n == SOCKET_ERROR && WSAGetLastError() == WSA_IO_PENDING, "WSARecv returned %d, error %d\n",
+       n, WSAGetLastError());
+    ret = CancelIo((HANDLE)dst);
+    ok(ret, "CancelIo failed, error %u\n", GetLastError());
+    ret = WaitForSingleObject(event, 1000);
+    ok(ret == WAIT_OBJECT_0, "receive not cancelled\n");
+    ret = GetOverlappedResult((HANDLE)dst, &ov, &count, FALSE);
+    ok(!ret && GetLastError() == ERROR_OPERATION_ABORTED, "GetOverlappedResult returned %u, error %u\n",
+       ret, GetLastError());
+
+    WSACloseEvent(event);
+    closesocket(src);
+    closesocket(dst);
+}
+
+struct iocp_conn
+{
+    SOCKET     server;
+    SOCKET     client;
+    OVERLAPPED recv_ov;
+    OVERLAPPED send_ov;
+    WSABUF     recv_buf;
+    WSABUF     send_buf;
+    char       data[64];
+    char       echo[64];
+};
+
+static void test_iocp_echo(void)
+{
+    enum { nb_conns = 8, nb_rounds = 500 };
+    GUID acceptex_guid = WSAID_ACCEPTEX;
+    LPFN_ACCEPTEX pAcceptEx = NULL;
+    struct iocp_conn conns[nb_conns], *conn;
+    OVERLAPPED accept_ov[nb_conns], *ov;
+    char accept_buf[nb_conns][2 * (sizeof(struct sockaddr_in) + 16)];
+    char msg[64], buf[64];
+    struct sockaddr_in addr;
+    SOCKET listener;
+    HANDLE port;
+    ULONG_PTR key;
+    DWORD count, flags, start, ticks, received, sent;
+    int i, j, len, ret, errors = 0;
+
+    listener = WSASocketA(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+    ok(listener != INVALID_SOCKET, "failed to create socket, error %d\n", WSAGetLastError());
+    ret = WSAIoctl(listener, SIO_GET_EXTENSION_FUNCTION_POINTER, &acceptex_guid, sizeof(acceptex_guid),
+                   &pAcceptEx, sizeof(pAcceptEx), &count, NULL, NULL);
+    if (ret)
+    {
+        skip("AcceptEx not supported\n");
+        closesocket(listener);
+        return;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    ret = bind(listener, (struct sockaddr *)&addr, sizeof(addr));
+    ok(!ret, "bind failed, error %d\n", WSAGetLastError());
+    len = sizeof(addr);
+    ret = getsockname(listener, (struct sockaddr *)&addr, &len);
+    ok(!ret, "getsockname failed, error %d\n", WSAGetLastError());
+    ret = listen(listener, nb_conns);
+    ok(!ret, "listen failed, error %d\n", WSAGetLastError());
+
+    port = CreateIoCompletionPort((HANDLE)listener, NULL, 0, 0);
+    ok(port != NULL, "CreateIoCompletionPort failed, error %u\n", GetLastError());
+
+    /* accept all the connections through the completion port */
+    memset(conns, 0, sizeof(conns));
+    memset(accept_ov, 0, sizeof(accept_ov));
+    for (i = 0; i < nb_conns; i++)
+    {
+        conns[i].server = WSASocketA(AF_INET, SOCK_STREAM, IPPROTO_TCP, NULL, 0, WSA_FLAG_OVERLAPPED);
+        ok(conns[i].server != INVALID_SOCKET, "failed to create socket, error %d\n", WSAGetLastError());
+        ret = pAcceptEx(listener, conns[i].server, accept_buf[i], 0, sizeof(struct sockaddr_in) + 16,
+                        sizeof(struct sockaddr_in) + 16, &count, &accept_ov[i]);
+        ok(!ret && WSAGetLastError() == ERROR_IO_PENDING, "AcceptEx returned %d, error %d\n",
+           ret, WSAGetLastError());
+    }
+    for (i = 0; i < nb_conns; i++)
+    {
+        conns[i].client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        ret = connect(conns[i].client, (struct sockaddr *)&addr, sizeof(addr));
+        ok(!ret, "connect failed, error %d\n", WSAGetLastError());
+    }
+    for (i = 0; i < nb_conns; i++)
+    {
+        ret = GetQueuedCompletionStatus(port, &count, &key, &ov, 1000);
+        ok(ret, "GetQueuedCompletionStatus failed, error %u\n", GetLastError());
+        if (!ret) goto done;
+        ok(key == 0, "got key %lx\n", key);
+        ok(ov >= accept_ov && ov < accept_ov + nb_conns, "got overlapped %p\n", ov);
+    }
+
+    /* post a receive on each connection */
+    for (i = 0; i < nb_conns; i++)
+    {
+        conn = &conns[i];
+        ok(CreateIoCompletionPort((HANDLE)conn->server, port, (ULONG_PTR)conn, 0) == port,
+           "CreateIoCompletionPort failed, error %u\n", GetLastError());
+        conn->recv_buf.buf = conn->data;
+        conn->recv_buf.len = sizeof(conn->data);
+        flags = 0;
+        ret = WSARecv(conn->server, &conn->recv_buf, 1, NULL, &flags, &conn->recv_ov, NULL);
+        ok(ret == SOCKET_ERROR && WSAGetLastError() == ERROR_IO_PENDING, "WSARecv returned %d, error %d\n",
+           ret, WSAGetLastError());
+    }
+
+    memset(msg, 0, sizeof(msg));
+    start = GetTickCount();
+    for (i = 0; i < nb_rounds; i++)
+    {
+        for (j = 0; j < nb_conns; j++)
+        {
+            sprintf(msg, "round %d conn %d", i, j);
+            ret = send(conns[j].client, msg, sizeof(msg), 0);
+            ok(ret == sizeof(msg), "send returned %d, error %d\n", ret, WSAGetLastError());
+        }
+
+        /* echo each message back and post the next receive */
+        for (received = sent = 0; received < nb_conns || sent < nb_conns; )
+        {
+            ret = GetQueuedCompletionStatus(port, &count, &key, &ov, 1000);
+            ok(ret, "GetQueuedCompletionStatus failed, error %u\n", GetLastError());
+            if (!ret) goto done;
+            conn = (struct iocp_conn *)key;
+            if (ov == &conn->recv_ov)
+            {
+                ok(count == sizeof(conn->data), "received %u bytes\n", count);
+                memcpy(conn->echo, conn->data, sizeof(conn->echo));
+                conn->send_buf.buf = conn->echo;
+                conn->send_buf.len = count;
+                ret = WSASend(conn->server, &conn->send_buf, 1, NULL, 0, &conn->send_ov, NULL);
+                ok(!ret || WSAGetLastError() == ERROR_IO_PENDING, "WSASend returned %d, error %d\n",
+                   ret, WSAGetLastError());
+                flags = 0;
+                ret = WSARecv(conn->server, &conn->recv_buf, 1, NULL, &flags, &conn->recv_ov, NULL);
+                ok(!ret || WSAGetLastError() == ERROR_IO_PENDING, "WSARecv returned %d, error %d\n",
+                   ret, WSAGetLastError());
+                received++;
+            }
+            else
+            {
+                ok(ov == &conn->send_ov, "got overlapped %p\n", ov);
+                ok(count == sizeof(conn->echo), "sent %u bytes\n", count);
+                sent++;
+            }
+        }
+
+        for (j = 0; j < nb_conns; j++)
+        {
+            sprintf(msg, "round %d conn %d", i, j);
+            ret = recv_all(conns[j].client, buf, sizeof(buf));
+            ok(ret == sizeof(buf), "recv returned %d, error %d\n", ret, WSAGetLastError());
+            if (memcmp(buf, msg, sizeof(msg))) errors++;
+        }
+    }
+    ticks = GetTickCount() - start;
+    ok(!errors, "got %d wrong messages\n", errors);
+    trace("%d messages echoed over %d connections in %u ms\n", nb_rounds * nb_conns, nb_conns, ticks);
+
+    /* closing the sockets aborts the pending receives */
+    for (i = 0; i < nb_conns; i++)
+    {
+        closesocket(conns[i].server);
+        conns[i].server = INVALID_SOCKET;
+    }
+    for (i = 0; i < nb_conns; i++)
+    {
+        SetLastError(0xdeadbeef);
+        ret = GetQueuedCompletionStatus(port, &count, &key, &ov, 1000);
+        ok(!ret && GetLastError() == ERROR_OPERATION_ABORTED,
+           "GetQueuedCompletionStatus returned %d, error %u\n", ret, GetLastError());
+        if (!ov) break;
+        conn = (struct iocp_conn *)key;
+        ok(ov == &conn->recv_ov, "got overlapped %p\n", ov);
+    }
+
+done:
+    for (i = 0; i < nb_conns; i++)
+    {
+        if (conns[i].server != INVALID_SOCKET) closesocket(conns[i].server);
+        if (conns[i].client != INVALID_SOCKET) closesocket(conns[i].client);
+    }
+    closesocket(listener);
+    CloseHandle(port);
+}
+
+static ULONGLONG filetime_to_ms(const FILETIME *ft)
+{
+    return (((ULONGLONG)ft->dwHighDateTime << 32) | ft->dwLowDateTime) / 10000;
+}
+
+static void test_TransmitFile(void)
+{
+    enum { file_size = 16 * 1024 * 1024 };
+    GUID transmitfile_guid = WSAID_TRANSMITFILE, transmitpackets_guid = WSAID_TRANSMITPACKETS;
+    LPFN_TRANSMITFILE pTransmitFile = NULL;
+    LPFN_TRANSMITPACKETS pTransmitPackets = NULL;
+    TRANSMIT_FILE_BUFFERS buffers;
+    TRANSMIT_PACKETS_ELEMENT elements[3];
+    FILETIME dummy, kernel_start, user_start, kernel_end, user_end;
+    char path[MAX_PATH], head[] = "head", tail[] = "tail", *data, *buf;
+    OVERLAPPED ov;
+    SOCKET src, dst;
+    HANDLE file;
+    DWORD count, flags, start, ticks, i;
+    ULONGLONG cpu;
+    BOOL ret;
+    int n;
+
+    if (tcp_socketpair(&src, &dst) != 0)
+    {
+        ok(0, "creating socket pair failed, skipping test\n");
+        return;
+    }
+    if (WSAIoctl(src, SIO_GET_EXTENSION_FUNCTION_POINTER, &transmitfile_guid, sizeof(transmitfile_guid),
+                 &pTransmitFile, sizeof(pTransmitFile), &count, NULL, NULL) ||
+        WSAIoctl(src, SIO_GET_EXTENSION_FUNCTION_POINTER, &transmitpackets_guid, sizeof(transmitpackets_guid),
+                 &pTransmitPackets, sizeof(pTransmitPackets), &count, NULL, NULL))
+    {
+        skip("TransmitFile not supported\n");
+        closesocket(src);
+        closesocket(dst);
+        return;
+    }
+
+    data = HeapAlloc(GetProcessHeap(), 0, file_size);
+    buf = HeapAlloc(GetProcessHeap(), 0, file_size);
+    for (i = 0; i < file_size; i++) data[i] = i % 251;
+
+    GetTempPathA(sizeof(path), path);
+    GetTempFileNameA(path, "wst", 0, path);
+    file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "CreateFile failed, error %u\n", GetLastError());
+    ret = WriteFile(file, data, file_size, &count, NULL);
+    ok(ret && count == file_size, "WriteFile failed, error %u\n", GetLastError());
+
+    /* synchronous, from the current file position, with head and tail buffers */
+    SetFilePointer(file, 1000, NULL, FILE_BEGIN);
+    buffers.Head = head;
+    buffers.HeadLength = 4;
+    buffers.Tail = tail;
+    buffers.TailLength = 4;
+    ret = pTransmitFile(src, file, 4000, 0, NULL, &buffers, 0);
+    ok(ret, "TransmitFile failed, error %d\n", WSAGetLastError());
+    n = recv_all(dst, buf, 4008);
+    ok(n == 4008, "received %d bytes\n", n);
+    ok(!memcmp(buf, "head", 4), "wrong head\n");
+    ok(!memcmp(buf + 4, data + 1000, 4000), "wrong file data\n");
+    ok(!memcmp(buf + 4004, "tail", 4), "wrong tail\n");
+
+    /* overlapped, the whole file from the offset in the overlapped structure */
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    GetProcessTimes(GetCurrentProcess(), &dummy, &dummy, &kernel_start, &user_start);
+    start = GetTickCount();
+    ret = pTransmitFile(src, file, 0, 0, &ov, NULL, 0);
+    ok(ret || WSAGetLastError() == ERROR_IO_PENDING, "TransmitFile failed, error %d\n", WSAGetLastError());
+    n = recv_all(dst, buf, file_size);
+    ok(n == file_size, "received %d bytes\n", n);
+    ok(!WaitForSingleObject(ov.hEvent, 10000), "TransmitFile didn't complete\n");
+    ticks = GetTickCount() - start;
+    GetProcessTimes(GetCurrentProcess(), &dummy, &dummy, &kernel_end, &user_end);
+    ret = WSAGetOverlappedResult(src, &ov, &count, FALSE, &flags);
+    ok(ret, "WSAGetOverlappedResult failed, error %d\n", WSAGetLastError());
+    ok(count == file_size, "sent %u bytes\n", count);
+    ok(!memcmp(buf, data, file_size), "wrong file data\n");
+    cpu = filetime_to_ms(&kernel_end) - filetime_to_ms(&kernel_start) +
+          filetime_to_ms(&user_end) - filetime_to_ms(&user_start);
+    trace("TransmitFile: %u MB in %u ms (%u MB/s), %u ms of cpu time\n", file_size >> 20, ticks,
+          ticks ? (file_size >> 10) / ticks * 1000 / 1024 : 0, (DWORD)cpu);
+    CloseHandle(ov.hEvent);
+
+    /* TransmitPackets with memory and file elements, then disconnect */
+    elements[0].dwElFlags = TP_ELEMENT_MEMORY;
+    elements[0].cLength = 4;
+    elements[0].pBuffer = head;
+    elements[1].dwElFlags = TP_ELEMENT_FILE;
+    elements[1].cLength = 200;
+    elements[1].nFileOffset.QuadPart = 100;
+    elements[1].hFile = file;
+    elements[2].dwElFlags = TP_ELEMENT_MEMORY | TP_ELEMENT_EOP;
+    elements[2].cLength = 4;
+    elements[2].pBuffer = tail;
+    ret = pTransmitPackets(src, elements, 3, 0, NULL, TP_DISCONNECT);
+    ok(ret, "TransmitPackets failed, error %d\n", WSAGetLastError());
+    n = recv_all(dst, buf, 208);
+    ok(n == 208, "received %d bytes\n", n);
+    ok(!memcmp(buf, "head", 4), "wrong head\n");
+    ok(!memcmp(buf + 4, data + 100, 200), "wrong file data\n");
+    ok(!memcmp(buf + 204, "tail", 4), "wrong tail\n");
+    n = recv(dst, buf, 1, 0);
+    ok(!n, "expected the connection to be shut down, got %d\n", n);
+
+    elements[0].dwElFlags = TP_ELEMENT_MEMORY | TP_ELEMENT_FILE;
+    WSASetLastError(0xdeadbeef);
+    ret = pTransmitPackets(dst, elements, 1, 0, NULL, 0);
+    ok(!ret && WSAGetLastError() == WSAEINVAL, "got %d, error %d\n", ret, WSAGetLastError());
+
+    CloseHandle(file);
+    HeapFree(GetProcessHeap(), 0, data);
+    HeapFree(GetProcessHeap(), 0, buf);
+    closesocket(src);
+    closesocket(dst);
+}
+
 static void test_GetAddrInfoW(void)
 {
     static const WCHAR port[] = {'8','0',0};
@@ -5499,6 +6118,160 @@ static void test_GetAddrInfoW(void)
     }
 }
 
+static HANDLE completion_event;
+static DWORD completion_error;
+static OVERLAPPED *completion_overlapped;
+
+static void CALLBACK getaddrinfo_completion(DWORD error, DWORD bytes, OVERLAPPED *overlapped)
+{
+    completion_error = error;
+    completion_overlapped = overlapped;
+    SetEvent(completion_event);
+}
+
+static void test_GetAddrInfoExW(void)
+{
+    static const WCHAR localhost[] = {'l','o','c','a','l','h','o','s','t',0};
+    static const WCHAR loopback[] = {'1','2','7','.','0','.','0','.','1',0};
+    static const WCHAR nxdomain[] =
+        {'n','x','d','o','m','a','i','n','.','c','o','d','e','w','e','a','v','e','r','s','.','c','o','m',0};
+    ADDRINFOEXW *result, *first, hints;
+    OVERLAPPED overlapped;
+    DWORD start, ticks;
+    HANDLE handle;
+    int i, ret, mismatches = 0;
+
+    if (!pGetAddrInfoExW || !pGetAddrInfoExOverlappedResult || !pFreeAddrInfoExW)
+    {
+        win_skip("GetAddrInfoExW not present\n");
+        return;
+    }
+
+    result = (ADDRINFOEXW *)0xdeadbeef;
+    ret = pGetAddrInfoExW(localhost, NULL, NS_DNS, NULL, NULL, &result, NULL, NULL, NULL, NULL);
+    ok(!ret, "GetAddrInfoExW failed with %d\n", ret);
+    ok(result != NULL && result != (ADDRINFOEXW *)0xdeadbeef, "got %p\n", result);
+    if (!ret)
+    {
+        ok(result->ai_family == AF_INET || result->ai_family == AF_INET6, "got family %d\n", result->ai_family);
+        ok(result->ai_addr != NULL, "no address\n");
+        pFreeAddrInfoExW(result);
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    result = NULL;
+    ret = pGetAddrInfoExW(localhost, NULL, NS_ALL, NULL, &hints, &result, NULL, NULL, NULL, NULL);
+    ok(!ret, "GetAddrInfoExW failed with %d\n", ret);
+    if (!ret)
+    {
+        ok(result->ai_family == AF_INET, "got family %d\n", result->ai_family);
+        ok(result->ai_addrlen == sizeof(struct sockaddr_in), "got length %u\n", (DWORD)result->ai_addrlen);
+        ok(((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr == htonl(INADDR_LOOPBACK),
+           "wrong address %08x\n", ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr);
+        pFreeAddrInfoExW(result);
+    }
+
+    result = NULL;
+    ret = pGetAddrInfoExW(nxdomain, NULL, NS_DNS, NULL, NULL, &result, NULL, NULL, NULL, NULL);
+    ok(ret == WSAHOST_NOT_FOUND, "got %d\n", ret);
+    ok(!result, "got %p\n", result);
+
+    /* overlapped with an event */
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    result = (ADDRINFOEXW *)0xdeadbeef;
+    ret = pGetAddrInfoExW(localhost, NULL, NS_DNS, NULL, NULL, &result, NULL, &overlapped, NULL, &handle);
+    if (ret == WSAEINVAL)
+    {
+        win_skip("asynchronous GetAddrInfoExW not supported\n");
+        CloseHandle(overlapped.hEvent);
+        return;
+    }
+    ok(ret == ERROR_IO_PENDING, "got %d\n", ret);
+    ok(!WaitForSingleObject(overlapped.hEvent, 5000), "request didn't complete\n");
+    ret = pGetAddrInfoExOverlappedResult(&overlapped);
+    ok(!ret, "got %d\n", ret);
+    ok(result != NULL && result != (ADDRINFOEXW *)0xdeadbeef, "got %p\n", result);
+    if (!ret) pFreeAddrInfoExW(result);
+    CloseHandle(overlapped.hEvent);
+
+    /* overlapped with a completion routine */
+    completion_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+    memset(&overlapped, 0, sizeof(overlapped));
+    result = (ADDRINFOEXW *)0xdeadbeef;
+    ret = pGetAddrInfoExW(localhost, NULL, NS_DNS, NULL, NULL, &result, NULL, &overlapped,
+                          getaddrinfo_completion, &handle);
+    ok(ret == ERROR_IO_PENDING, "got %d\n", ret);
+    ok(!WaitForSingleObject(completion_event, 5000), "completion routine wasn't called\n");
+    ok(!completion_error, "got error %u\n", completion_error);
+    ok(completion_overlapped == &overlapped, "got overlapped %p\n", completion_overlapped);
+    ok(!pGetAddrInfoExOverlappedResult(&overlapped), "got %d\n", pGetAddrInfoExOverlappedResult(&overlapped));
+    ok(result != NULL && result != (ADDRINFOEXW *)0xdeadbeef, "got %p\n", result);
+    if (!completion_error) pFreeAddrInfoExW(result);
+
+    memset(&overlapped, 0, sizeof(overlapped));
+    result = (ADDRINFOEXW *)0xdeadbeef;
+    ret = pGetAddrInfoExW(nxdomain, NULL, NS_DNS, NULL, NULL, &result, NULL, &overlapped,
+                          getaddrinfo_completion, &handle);
+    ok(ret == ERROR_IO_PENDING, "got %d\n", ret);
+    ok(!WaitForSingleObject(completion_event, 5000), "completion routine wasn't called\n");
+    ok(completion_error == WSAHOST_NOT_FOUND, "got error %u\n", completion_error);
+    ok(!result, "got %p\n", result);
+    CloseHandle(completion_event);
+
+    /* repeated lookups of the same name give the same answer, each in its own copy */
+    first = NULL;
+    ret = pGetAddrInfoExW(localhost, NULL, NS_DNS, NULL, &hints, &first, NULL, NULL, NULL, NULL);
+    ok(!ret, "GetAddrInfoExW failed with %d\n", ret);
+    if (ret) return;
+    start = GetTickCount();
+    for (i = 0; i < 1000; i++)
+    {
+        ret = pGetAddrInfoExW(localhost, NULL, NS_DNS, NULL, &hints, &result, NULL, NULL, NULL, NULL);
+        if (ret) break;
+        if (result == first || result->ai_family != first->ai_family ||
+            result->ai_addrlen != first->ai_addrlen || result->ai_addr == first->ai_addr ||
+            memcmp(result->ai_addr, first->ai_addr, first->ai_addrlen) ||
+            !result->ai_next != !first->ai_next)
+            mismatches++;
+        pFreeAddrInfoExW(result);
+    }
+    ticks = GetTickCount() - start;
+    ok(!ret, "GetAddrInfoExW failed with %d\n", ret);
+    ok(!mismatches, "got %d different results\n", mismatches);
+    trace("1000 lookups of localhost took %u ms\n", ticks);
+
+    /* freeing the other results didn't affect the first one */
+    ok(first->ai_family == AF_INET, "got family %d\n", first->ai_family);
+    ok(((struct sockaddr_in *)first->ai_addr)->sin_addr.s_addr == htonl(INADDR_LOOPBACK),
+       "wrong address %08x\n", ((struct sockaddr_in *)first->ai_addr)->sin_addr.s_addr);
+    pFreeAddrInfoExW(first);
+
+    /* failures are reported again on the next lookups */
+    for (i = 0; i < 2; i++)
+    {
+        result = (ADDRINFOEXW *)0xdeadbeef;
+        ret = pGetAddrInfoExW(nxdomain, NULL, NS_DNS, NULL, NULL, &result, NULL, NULL, NULL, NULL);
+        ok(ret == WSAHOST_NOT_FOUND, "%d: got %d\n", i, ret);
+        ok(!result, "%d: got %p\n", i, result);
+    }
+
+    /* numeric addresses don't need AI_NUMERICHOST to be resolved */
+    for (i = 0; i < 2; i++)
+    {
+        result = NULL;
+        ret = pGetAddrInfoExW(loopback, NULL, NS_DNS, NULL, &hints, &result, NULL, NULL, NULL, NULL);
+        ok(!ret, "%d: GetAddrInfoExW failed with %d\n", i, ret);
+        if (ret) continue;
+        ok(((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr == htonl(INADDR_LOOPBACK),
+           "%d: wrong address %08x\n", i, ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr);
+        pFreeAddrInfoExW(result);
+    }
+}
+
 static void test_getaddrinfo(void)
 {
     int i, ret;
@@ -7550,24 +8323,29 @@ START_TEST( sock )
     test_errors();
     test_listen();
     test_select();
+    test_select_many();
+    test_WSAPoll();
     test_accept();
     test_getpeername();
     test_getsockname();
     test_inet_addr();
     test_addr_to_print();
     test_ioctlsocket();
+    test_closed_socket_state();
     test_dns();
     test_gethostbyname_hack();
 
     test_WSASendMsg();
     test_WSASendTo();
     test_WSARecv();
+    test_echo();
 
     test_events(0);
     test_events(1);
 
     test_ipv6only();
     test_GetAddrInfoW();
+    test_GetAddrInfoExW();
     test_getaddrinfo();
     test_AcceptEx();
     test_ConnectEx();
@@ -7580,6 +8358,8 @@ START_TEST( sock )
     test_WSAAsyncGetServByName();
 
     test_completion_port();
+    test_iocp_echo();
+    test_TransmitFile();
 
     /* this is an io heavy test, do it at the end so the kernel doesn't start dropping packets */
     test_send();
@@ -1008,6 +1008,23 @@ struct close_handle_reply
 
 
 
+struct batch_requests_request
+{
+    struct request_header __header;
+    unsigned int count;
+    /* VARARG(requests,bytes); */
+};
+struct batch_requests_reply
+{
+    struct reply_header __header;
+    unsigned int count;
+    /* VARARG(replies,bytes); */
+    char __pad_12[4];
+};
+#define BATCH_ALIGN(size) (((size) + 7) & ~7)
+
+
+
 struct set_handle_info_request
 {
     struct request_header __header;
@@ -1136,6 +1153,37 @@ struct event_op_reply
 };
 enum event_op { PULSE_EVENT, SET_EVENT, RESET_EVENT };
 
+
+struct get_shared_sync_area_request
+{
+    struct request_header __header;
+    char __pad_12[4];
+};
+struct get_shared_sync_area_reply
+{
+    struct reply_header __header;
+    data_size_t  size;
+    int          epoch;
+};
+
+
+struct share_event_state_request
+{
+    struct request_header __header;
+    obj_handle_t handle;
+};
+struct share_event_state_reply
+{
+    struct reply_header __header;
+    int          index;
+    int          gen;
+};
+#define SHARED_EVENT_SIGNALED  0x01
+#define SHARED_EVENT_MANUAL    0x02
+#define SHARED_EVENT_WAITERS   0x04
+#define SHARED_EVENT_GEN_MASK  0xffff00
+#define SHARED_EVENT_GEN_INC   0x000100
+
 struct query_event_request
 {
     struct request_header __header;
@@ -5103,6 +5151,7 @@ enum request
     REQ_queue_apc,
     REQ_get_apc_result,
     REQ_close_handle,
+    REQ_batch_requests,
     REQ_set_handle_info,
     REQ_dup_handle,
     REQ_open_process,
@@ -5110,6 +5159,8 @@ enum request
     REQ_select,
     REQ_create_event,
     REQ_event_op,
+    REQ_get_shared_sync_area,
+    REQ_share_event_state,
     REQ_query_event,
     REQ_open_event,
     REQ_create_keyed_event,
@@ -5365,6 +5416,7 @@ union generic_request
     struct queue_apc_request queue_apc_request;
     struct get_apc_result_request get_apc_result_request;
     struct close_handle_request close_handle_request;
+    struct batch_requests_request batch_requests_request;
     struct set_handle_info_request set_handle_info_request;
     struct dup_handle_request dup_handle_request;
     struct open_process_request open_process_request;
@@ -5372,6 +5424,8 @@ union generic_request
     struct select_request select_request;
     struct create_event_request create_event_request;
     struct event_op_request event_op_request;
+    struct get_shared_sync_area_request get_shared_sync_area_request;
+    struct share_event_state_request share_event_state_request;
     struct query_event_request query_event_request;
     struct open_event_request open_event_request;
     struct create_keyed_event_request create_keyed_event_request;
@@ -5625,6 +5679,7 @@ union generic_reply
     struct queue_apc_reply queue_apc_reply;
     struct get_apc_result_reply get_apc_result_reply;
     struct close_handle_reply close_handle_reply;
+    struct batch_requests_reply batch_requests_reply;
     struct set_handle_info_reply set_handle_info_reply;
     struct dup_handle_reply dup_handle_reply;
     struct open_process_reply open_process_reply;
@@ -5632,6 +5687,8 @@ union generic_reply
     struct select_reply select_reply;
     struct create_event_reply create_event_reply;
     struct event_op_reply event_op_reply;
+    struct get_shared_sync_area_reply get_shared_sync_area_reply;
+    struct share_event_state_reply share_event_state_reply;
     struct query_event_reply query_event_reply;
     struct open_event_reply open_event_reply;
     struct create_keyed_event_reply create_keyed_event_reply;
@@ -5862,6 +5919,6 @@ union generic_reply
     struct set_suspend_context_reply set_suspend_context_reply;
 };
 
-#define SERVER_PROTOCOL_VERSION 454
+#define SERVER_PROTOCOL_VERSION 457
 
 #endif /* __WINE_WINE_SERVER_PROTOCOL_H */
@@ -54,6 +54,23 @@ typedef struct WS(addrinfoW)
     struct WS(addrinfoW)*   ai_next;
 } ADDRINFOW, *PADDRINFOW;
 
+typedef struct WS(addrinfoexW)
+{
+    int                ai_flags;
+    int                ai_family;
+    int                ai_socktype;
+    int                ai_protocol;
+    SIZE_T             ai_addrlen;
+    PWSTR              ai_canonname;
+    struct WS(sockaddr)*   ai_addr;
+    void *             ai_blob;
+    SIZE_T             ai_bufferlen;
+    GUID *             ai_provider;
+    struct WS(addrinfoexW)* ai_next;
+} ADDRINFOEXW, *PADDRINFOEXW, *LPADDRINFOEXW;
+
+typedef void (CALLBACK *LPLOOKUPSERVICE_COMPLETION_ROUTINE)(DWORD,DWORD,LPWSAOVERLAPPED);
+
 typedef int WS(socklen_t);
 
 typedef ADDRINFOA ADDRINFO, *LPADDRINFO;
@@ -163,6 +180,10 @@ void WINAPI WS(freeaddrinfo)(LPADDRINFO);
 #define     FreeAddrInfoA WS(freeaddrinfo)
 void WINAPI FreeAddrInfoW(PADDRINFOW);
 #define     FreeAddrInfo WINELIB_NAME_AW(FreeAddrInfo)
+void WINAPI FreeAddrInfoExW(ADDRINFOEXW*);
+int WINAPI  GetAddrInfoExOverlappedResult(LPOVERLAPPED);
+int WINAPI  GetAddrInfoExW(PCWSTR,PCWSTR,DWORD,GUID*,const ADDRINFOEXW*,ADDRINFOEXW**,struct WS(timeval)*,
+                           LPOVERLAPPED,LPLOOKUPSERVICE_COMPLETION_ROUTINE,HANDLE*);
 int WINAPI  WS(getaddrinfo)(const char*,const char*,const struct WS(addrinfo)*,struct WS(addrinfo)**);
 #define     GetAddrInfoA WS(getaddrinfo)
 int WINAPI  GetAddrInfoW(PCWSTR,PCWSTR,const ADDRINFOW*,PADDRINFOW*);
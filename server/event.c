@@ -25,6 +25,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -32,6 +36,8 @@
 #include "winternl.h"
 
 #include "handle.h"
+#include "process.h"
+#include "file.h"
 #include "thread.h"
 #include "request.h"
 #include "security.h"
@@ -41,6 +47,7 @@ struct event
     struct object  obj;             /* object header */
     int            manual_reset;    /* is it a manual reset event? */
     int            signaled;        /* event has been signaled */
+    int           *shared;          /* state in the shared sync area, if any */
 };
 
 static void event_dump( struct object *obj, int verbose );
@@ -49,14 +56,17 @@ static int event_signaled( struct object *obj, struct wait_queue_entry *entry );
 static void event_satisfied( struct object *obj, struct wait_queue_entry *entry );
 static unsigned int event_map_access( struct object *obj, unsigned int access );
 static int event_signal( struct object *obj, unsigned int access);
+static int event_add_queue( struct object *obj, struct wait_queue_entry *entry );
+static void event_remove_queue( struct object *obj, struct wait_queue_entry *entry );
+static void event_destroy( struct object *obj );
 
 static const struct object_ops event_ops =
 {
     sizeof(struct event),      /* size */
     event_dump,                /* dump */
     event_get_type,            /* get_type */
-    add_queue,                 /* add_queue */
-    remove_queue,              /* remove_queue */
+    event_add_queue,           /* add_queue */
+    event_remove_queue,        /* remove_queue */
     event_signaled,            /* signaled */
     event_satisfied,           /* satisfied */
     event_signal,              /* signal */
@@ -67,7 +77,7 @@ static const struct object_ops event_ops =
     no_lookup_name,            /* lookup_name */
     no_open_file,              /* open_file */
     no_close_handle,           /* close_handle */
-    no_destroy                 /* destroy */
+    event_destroy              /* destroy */
 };
 
 
@@ -102,6 +112,97 @@ static const struct object_ops keyed_event_ops =
 };
 
 
+/* Shared sync area: clients map it read-only and can skip the server for
+ * operations that don't change the state of an event nobody waits on.
+ * Event slots carry a generation number that changes when they are released,
+ * so that clients can detect that a cached slot was reused. The per-process
+ * remote close counters are kept apart so they never alias an event slot. */
+
+#define SYNC_AREA_SIZE  65536
+#define SYNC_AREA_SLOTS (SYNC_AREA_SIZE / sizeof(int))
+
+struct sync_slot_list
+{
+    unsigned int *free;                 /* indices of the released slots */
+    unsigned int  count;
+};
+
+static int sync_area_fd = -1;           /* fd of the shared area */
+static int *sync_area;                  /* server mapping of the shared area */
+static unsigned int sync_area_used;     /* number of slots that have been used */
+static struct sync_slot_list event_slots;
+static struct sync_slot_list epoch_slots;
+
+static int init_sync_area(void)
+{
+    void *ptr;
+    int fd;
+
+    if (sync_area) return 1;
+    if (!(event_slots.free = mem_alloc( SYNC_AREA_SLOTS * sizeof(*event_slots.free) ))) return 0;
+    if (!(epoch_slots.free = mem_alloc( SYNC_AREA_SLOTS * sizeof(*epoch_slots.free) ))) goto failed;
+    if ((fd = create_temp_file( SYNC_AREA_SIZE )) == -1) goto failed;
+    if ((ptr = mmap( NULL, SYNC_AREA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        goto failed;
+    }
+    sync_area_fd = fd;
+    sync_area = ptr;
+    return 1;
+
+failed:
+    free( event_slots.free );
+    free( epoch_slots.free );
+    event_slots.free = epoch_slots.free = NULL;
+    set_error( STATUS_NO_MEMORY );
+    return 0;
+}
+
+static int *alloc_sync_slot( struct sync_slot_list *list )
+{
+    if (list->count) return sync_area + list->free[--list->count];
+    if (sync_area_used < SYNC_AREA_SLOTS) return sync_area + sync_area_used++;
+    return NULL;
+}
+
+static void free_sync_slot( struct sync_slot_list *list, int *slot )
+{
+    list->free[list->count++] = slot - sync_area;
+}
+
+/* update a shared state; only the server writes to the area */
+static void update_shared_state( int *state, int set, int clear )
+{
+    *state = (*state & ~clear) | set;
+}
+
+/* tell a process that one of its handles was closed by someone else */
+void notify_remote_handle_close( struct process *process )
+{
+    if (process->sync_epoch) (*process->sync_epoch)++;
+}
+
+/* release the remote close counter of a process */
+void release_process_sync_epoch( struct process *process )
+{
+    if (process->sync_epoch) free_sync_slot( &epoch_slots, process->sync_epoch );
+    process->sync_epoch = NULL;
+}
+
+static inline int is_event_signaled( struct event *event )
+{
+    if (event->shared) return (*event->shared & SHARED_EVENT_SIGNALED) != 0;
+    return event->signaled;
+}
+
+static void set_event_state( struct event *event, int signaled )
+{
+    if (!event->shared) event->signaled = signaled;
+    else if (signaled) update_shared_state( event->shared, SHARED_EVENT_SIGNALED, 0 );
+    else update_shared_state( event->shared, 0, SHARED_EVENT_SIGNALED );
+}
+
 struct event *create_event( struct directory *root, const struct unicode_str *name,
                             unsigned int attr, int manual_reset, int initial_state,
                             const struct security_descriptor *sd )
@@ -115,6 +216,7 @@ struct event *create_event( struct directory *root, const struct unicode_str *na
             /* initialize it if it didn't already exist */
             event->manual_reset = manual_reset;
             event->signaled     = initial_state;
+            event->shared       = NULL;
             if (sd) default_set_sd( &event->obj, sd, OWNER_SECURITY_INFORMATION|
                                                      GROUP_SECURITY_INFORMATION|
                                                      DACL_SECURITY_INFORMATION|
@@ -131,30 +233,30 @@ struct event *get_event_obj( struct process *process, obj_handle_t handle, unsig
 
 void pulse_event( struct event *event )
 {
-    event->signaled = 1;
+    set_event_state( event, 1 );
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
-    event->signaled = 0;
+    set_event_state( event, 0 );
 }
 
 void set_event( struct event *event )
 {
-    event->signaled = 1;
+    set_event_state( event, 1 );
     /* wake up all waiters if manual reset, a single one otherwise */
     wake_up( &event->obj, !event->manual_reset );
 }
 
 void reset_event( struct event *event )
 {
-    event->signaled = 0;
+    set_event_state( event, 0 );
 }
 
 static void event_dump( struct object *obj, int verbose )
 {
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
-    fprintf( stderr, "Event manual=%d signaled=%d ",
-             event->manual_reset, event->signaled );
+    fprintf( stderr, "Event manual=%d signaled=%d%s ",
+             event->manual_reset, is_event_signaled( event ), event->shared ? " shared" : "" );
     dump_object_name( &event->obj );
     fputc( '\n', stderr );
 }
@@ -170,7 +272,7 @@ static int event_signaled( struct object *obj, struct wait_queue_entry *entry )
 {
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
-    return event->signaled;
+    return is_event_signaled( event );
 }
 
 static void event_satisfied( struct object *obj, struct wait_queue_entry *entry )
@@ -178,7 +280,7 @@ static void event_satisfied( struct object *obj, struct wait_queue_entry *entry
     struct event *event = (struct event *)obj;
     assert( obj->ops == &event_ops );
     /* Reset if it's an auto-reset event */
-    if (!event->manual_reset) event->signaled = 0;
+    if (!event->manual_reset) set_event_state( event, 0 );
 }
 
 static unsigned int event_map_access( struct object *obj, unsigned int access )
@@ -204,6 +306,38 @@ static int event_signal( struct object *obj, unsigned int access )
     return 1;
 }
 
+static int event_add_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+
+    /* clients must go through the server while there are waiters */
+    if (event->shared) update_shared_state( event->shared, SHARED_EVENT_WAITERS, 0 );
+    return add_queue( obj, entry );
+}
+
+static void event_remove_queue( struct object *obj, struct wait_queue_entry *entry )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+
+    if (event->shared && !list_prev( &obj->wait_queue, &entry->entry ) &&
+        !list_next( &obj->wait_queue, &entry->entry ))  /* last waiter */
+        update_shared_state( event->shared, 0, SHARED_EVENT_WAITERS );
+    remove_queue( obj, entry );
+}
+
+static void event_destroy( struct object *obj )
+{
+    struct event *event = (struct event *)obj;
+    assert( obj->ops == &event_ops );
+
+    if (!event->shared) return;
+    /* keep only the generation, and bump it to invalidate the client caches */
+    *event->shared = (*event->shared + SHARED_EVENT_GEN_INC) & SHARED_EVENT_GEN_MASK;
+    free_sync_slot( &event_slots, event->shared );
+}
+
 struct keyed_event *create_keyed_event( struct directory *root, const struct unicode_str *name,
                                         unsigned int attr, const struct security_descriptor *sd )
 {
@@ -357,6 +491,46 @@ DECL_HANDLER(event_op)
     release_object( event );
 }
 
+/* retrieve the shared memory area holding the state of shared events */
+DECL_HANDLER(get_shared_sync_area)
+{
+    struct process *process = current->process;
+
+    if (!init_sync_area()) return;
+    if (!process->sync_epoch)
+    {
+        if (!(process->sync_epoch = alloc_sync_slot( &epoch_slots )))
+        {
+            set_error( STATUS_NO_MEMORY );
+            return;
+        }
+    }
+    reply->size  = SYNC_AREA_SIZE;
+    reply->epoch = process->sync_epoch - sync_area;
+    send_client_fd( process, sync_area_fd, 0 );
+}
+
+/* move the state of an event to the shared sync area */
+DECL_HANDLER(share_event_state)
+{
+    struct event *event;
+
+    /* the client can skip the server for setting and waiting, so it needs both rights */
+    if (!(event = get_event_obj( current->process, req->handle, EVENT_MODIFY_STATE | SYNCHRONIZE )))
+        return;
+
+    if (!event->shared && sync_area && (event->shared = alloc_sync_slot( &event_slots )))
+    {
+        *event->shared = (*event->shared & SHARED_EVENT_GEN_MASK) |
+                         (event->signaled ? SHARED_EVENT_SIGNALED : 0) |
+                         (event->manual_reset ? SHARED_EVENT_MANUAL : 0) |
+                         (list_empty( &event->obj.wait_queue ) ? 0 : SHARED_EVENT_WAITERS);
+    }
+    reply->index = event->shared ? event->shared - sync_area : -1;
+    reply->gen   = event->shared ? *event->shared & SHARED_EVENT_GEN_MASK : 0;
+    release_object( event );
+}
+
 /* return details about the event */
 DECL_HANDLER(query_event)
 {
@@ -365,7 +539,7 @@ DECL_HANDLER(query_event)
     if (!(event = get_event_obj( current->process, req->handle, EVENT_QUERY_STATE ))) return;
 
     reply->manual_reset = event->manual_reset;
-    reply->state = event->signaled;
+    reply->state = is_event_signaled( event );
 
     release_object( event );
 }
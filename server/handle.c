@@ -365,7 +365,7 @@ struct handle_table *copy_handle_table( struct process *process, struct process
 }
 
 /* close a handle and decrement the refcount of the associated object */
-unsigned int close_handle( struct process *process, obj_handle_t handle )
+static unsigned int remove_handle( struct process *process, obj_handle_t handle )
 {
     struct handle_table *table;
     struct handle_entry *entry;
@@ -383,6 +383,16 @@ unsigned int close_handle( struct process *process, obj_handle_t handle )
     return STATUS_SUCCESS;
 }
 
+/* close a handle without the owning process asking for it */
+unsigned int close_handle( struct process *process, obj_handle_t handle )
+{
+    unsigned int ret = remove_handle( process, handle );
+
+    /* the process may have cached information about the handle */
+    if (!ret) notify_remote_handle_close( process );
+    return ret;
+}
+
 /* retrieve the object corresponding to one of the magic pseudo-handles */
 static inline struct object *get_magic_handle( obj_handle_t handle )
 {
@@ -584,7 +594,7 @@ unsigned int get_handle_table_count( struct process *process )
 /* close a handle */
 DECL_HANDLER(close_handle)
 {
-    unsigned int err = close_handle( current->process, req->handle );
+    unsigned int err = remove_handle( current->process, req->handle );
     set_error( err );
 }
 
@@ -615,7 +625,10 @@ DECL_HANDLER(dup_handle)
         }
         /* close the handle no matter what happened */
         if ((req->options & DUP_HANDLE_CLOSE_SOURCE) && (src != dst || req->src_handle != reply->handle))
-            reply->closed = !close_handle( src, req->src_handle );
+        {
+            if (src == current->process) reply->closed = !remove_handle( src, req->src_handle );
+            else reply->closed = !close_handle( src, req->src_handle );
+        }
         reply->self = (src == current->process);
         release_object( src );
     }
@@ -43,18 +43,27 @@
 struct object_name
 {
     struct list         entry;           /* entry in the hash list */
+    struct namespace   *namespace;       /* namespace containing the name */
     struct object      *obj;             /* object owning this name */
     struct object      *parent;          /* parent object */
+    unsigned int        hash;            /* case-insensitive hash of the name */
     data_size_t         len;             /* name length in bytes */
     WCHAR               name[1];
 };
 
 struct namespace
 {
+    struct list         entry;           /* entry in the list of namespaces */
     unsigned int        hash_size;       /* size of hash table */
-    struct list         names[1];        /* array of hash entry lists */
+    unsigned int        count;           /* number of names in the namespace */
+    unsigned int        resizes;         /* number of times the hash table was grown */
+    struct list        *names;           /* array of hash entry lists */
 };
 
+#define NAMESPACE_MAX_LOAD 2  /* average chain length that triggers a resize */
+
+static struct list namespace_list = LIST_INIT(namespace_list);
+
 
 #ifdef DEBUG_OBJECTS
 static struct list object_list = LIST_INIT(object_list);
@@ -120,12 +129,13 @@ void *memdup( const void *data, size_t len )
 
 /*****************************************************************/
 
-static int get_name_hash( const struct namespace *namespace, const WCHAR *name, data_size_t len )
+/* case-insensitive FNV-1a hash of a name */
+static unsigned int get_name_hash( const WCHAR *name, data_size_t len )
 {
-    WCHAR hash = 0;
+    unsigned int hash = 2166136261u;
     len /= sizeof(WCHAR);
-    while (len--) hash ^= tolowerW(*name++);
-    return hash % namespace->hash_size;
+    while (len--) hash = (hash ^ tolowerW(*name++)) * 16777619u;
+    return hash;
 }
 
 /* allocate a name for an object */
@@ -137,6 +147,8 @@ static struct object_name *alloc_name( const struct unicode_str *name )
     {
         ptr->len = name->len;
         ptr->parent = NULL;
+        ptr->namespace = NULL;
+        ptr->hash = get_name_hash( name->str, name->len );
         memcpy( ptr->name, name->str, name->len );
     }
     return ptr;
@@ -147,17 +159,44 @@ static void free_name( struct object *obj )
 {
     struct object_name *ptr = obj->name;
     list_remove( &ptr->entry );
+    if (ptr->namespace) ptr->namespace->count--;
     if (ptr->parent) release_object( ptr->parent );
     free( ptr );
 }
 
+/* grow the hash table of a namespace; on failure the old one is kept */
+static void grow_namespace( struct namespace *namespace )
+{
+    unsigned int i, new_size = namespace->hash_size * 2 + 1;
+    struct list *new_names;
+    struct object_name *ptr, *next;
+
+    if (!(new_names = malloc( new_size * sizeof(*new_names) ))) return;
+    for (i = 0; i < new_size; i++) list_init( &new_names[i] );
+    for (i = 0; i < namespace->hash_size; i++)
+    {
+        /* walk backwards so that the order within each chain is preserved */
+        LIST_FOR_EACH_ENTRY_SAFE_REV( ptr, next, &namespace->names[i], struct object_name, entry )
+        {
+            list_remove( &ptr->entry );
+            list_add_head( &new_names[ptr->hash % new_size], &ptr->entry );
+        }
+    }
+    free( namespace->names );
+    namespace->names = new_names;
+    namespace->hash_size = new_size;
+    namespace->resizes++;
+}
+
 /* set the name of an existing object */
 static void set_object_name( struct namespace *namespace,
                              struct object *obj, struct object_name *ptr )
 {
-    int hash = get_name_hash( namespace, ptr->name, ptr->len );
+    if (namespace->count >= namespace->hash_size * NAMESPACE_MAX_LOAD) grow_namespace( namespace );
 
-    list_add_head( &namespace->names[hash], &ptr->entry );
+    list_add_head( &namespace->names[ptr->hash % namespace->hash_size], &ptr->entry );
+    namespace->count++;
+    ptr->namespace = namespace;
     ptr->obj = obj;
     obj->name = ptr;
 }
@@ -325,14 +364,16 @@ struct object *find_object( const struct namespace *namespace, const struct unic
 {
     const struct list *list;
     struct list *p;
+    unsigned int hash;
 
     if (!name || !name->len) return NULL;
 
-    list = &namespace->names[ get_name_hash( namespace, name->str, name->len ) ];
+    hash = get_name_hash( name->str, name->len );
+    list = &namespace->names[hash % namespace->hash_size];
     LIST_FOR_EACH( p, list )
     {
         const struct object_name *ptr = LIST_ENTRY( p, struct object_name, entry );
-        if (ptr->len != name->len) continue;
+        if (ptr->hash != hash || ptr->len != name->len) continue;
         if (attributes & OBJ_CASE_INSENSITIVE)
         {
             if (!strncmpiW( ptr->name, name->str, name->len/sizeof(WCHAR) ))
@@ -371,15 +412,64 @@ struct namespace *create_namespace( unsigned int hash_size )
     struct namespace *namespace;
     unsigned int i;
 
-    namespace = mem_alloc( sizeof(*namespace) + (hash_size - 1) * sizeof(namespace->names[0]) );
-    if (namespace)
+    if (!(namespace = mem_alloc( sizeof(*namespace) ))) return NULL;
+    if (!(namespace->names = mem_alloc( hash_size * sizeof(namespace->names[0]) )))
     {
-        namespace->hash_size      = hash_size;
-        for (i = 0; i < hash_size; i++) list_init( &namespace->names[i] );
+        free( namespace );
+        return NULL;
     }
+    namespace->hash_size = hash_size;
+    namespace->count     = 0;
+    namespace->resizes   = 0;
+    for (i = 0; i < hash_size; i++) list_init( &namespace->names[i] );
+    list_add_tail( &namespace_list, &namespace->entry );
     return namespace;
 }
 
+/* free a namespace */
+void free_namespace( struct namespace *namespace )
+{
+    struct object_name *ptr, *next;
+    unsigned int i;
+
+    if (!namespace) return;
+    /* detach any remaining names so that freeing them later doesn't touch the namespace */
+    for (i = 0; i < namespace->hash_size; i++)
+    {
+        LIST_FOR_EACH_ENTRY_SAFE( ptr, next, &namespace->names[i], struct object_name, entry )
+        {
+            list_init( &ptr->entry );
+            ptr->namespace = NULL;
+        }
+    }
+    list_remove( &namespace->entry );
+    free( namespace->names );
+    free( namespace );
+}
+
+/* dump the load statistics of all namespaces */
+void dump_namespace_stats( FILE *file )
+{
+    struct namespace *namespace;
+    unsigned int i, used, longest, len;
+    struct list *ptr;
+
+    LIST_FOR_EACH_ENTRY( namespace, &namespace_list, struct namespace, entry )
+    {
+        used = longest = 0;
+        for (i = 0; i < namespace->hash_size; i++)
+        {
+            if (list_empty( &namespace->names[i] )) continue;
+            len = 0;
+            LIST_FOR_EACH( ptr, &namespace->names[i] ) len++;
+            if (len > longest) longest = len;
+            used++;
+        }
+        fprintf( file, "namespace %p %u %u %u %u %u\n", namespace, namespace->count,
+                 namespace->hash_size, used, longest, namespace->resizes );
+    }
+}
+
 /* functions for unimplemented/default object operations */
 
 struct object_type *no_get_type( struct object *obj )
@@ -26,6 +26,7 @@
 #endif
 
 #include <sys/time.h>
+#include <stdio.h>
 #include "wine/server_protocol.h"
 #include "wine/list.h"
 
@@ -124,6 +125,8 @@ extern void *create_named_object( struct namespace *namespace, const struct obje
 extern void unlink_named_object( struct object *obj );
 extern void make_object_static( struct object *obj );
 extern struct namespace *create_namespace( unsigned int hash_size );
+extern void free_namespace( struct namespace *namespace );
+extern void dump_namespace_stats( FILE *file );
 /* grab/release_object can take any pointer, but you better make sure */
 /* that the thing pointed to starts with a struct object... */
 extern struct object *grab_object( void *obj );
@@ -164,6 +167,8 @@ extern struct keyed_event *get_keyed_event_obj( struct process *process, obj_han
 extern void pulse_event( struct event *event );
 extern void set_event( struct event *event );
 extern void reset_event( struct event *event );
+extern void notify_remote_handle_close( struct process *process );
+extern void release_process_sync_epoch( struct process *process );
 
 /* mutex functions */
 
@@ -231,6 +236,7 @@ extern void create_mailslot_device( struct directory *root, const struct unicode
 extern int debug_level;
 extern int foreground;
 extern timeout_t master_socket_timeout;
+extern timeout_t stats_interval;
 extern const char *server_argv0;
 
   /* server start time used for GetTickCount() */
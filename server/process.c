@@ -336,6 +336,9 @@ struct thread *create_process( int fd, struct thread *parent_thread, int inherit
     process->trace_data      = 0;
     process->rawinput_mouse  = NULL;
     process->rawinput_kbd    = NULL;
+    process->profile_count   = 0;
+    process->profile_time    = 0;
+    process->sync_epoch      = NULL;
     list_init( &process->thread_list );
     list_init( &process->locks );
     list_init( &process->classes );
@@ -429,6 +432,7 @@ static void process_destroy( struct object *obj )
     if (process->idle_event) release_object( process->idle_event );
     if (process->id) free_ptid( process->id );
     if (process->token) release_object( process->token );
+    release_process_sync_epoch( process );
 }
 
 /* dump a process on stdout for debugging purposes */
@@ -626,6 +630,7 @@ static void process_killed( struct process *process )
 
     assert( list_empty( &process->thread_list ));
     process->end_time = current_time;
+    profile_process_exit( process );  /* before the exe module is freed */
     if (!process->is_system) close_process_desktop( process );
     process->winstation = 0;
     process->desktop = 0;
@@ -91,6 +91,9 @@ struct process
     struct list          rawinput_devices;/* list of registered rawinput devices */
     const struct rawinput_device *rawinput_mouse; /* rawinput mouse device, if any */
     const struct rawinput_device *rawinput_kbd;   /* rawinput keyboard device, if any */
+    unsigned int         profile_count;   /* number of requests made, when profiling */
+    unsigned long long   profile_time;    /* total service time of the requests in ns */
+    int                 *sync_epoch;      /* remote handle close counter in the shared sync area */
 };
 
 struct process_snapshot
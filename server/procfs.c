@@ -90,7 +90,7 @@ static int open_proc_lwpctl( struct thread *thread )
 /* handle a SIGCHLD signal */
 void sigchld_callback(void)
 {
-    assert( 0 );  /* should only be called when using ptrace */
+    /* nothing to do, registry saving processes are waited for explicitly */
 }
 
 /* initialize the process tracing mechanism */
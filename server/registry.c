@@ -30,12 +30,22 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
 #include <unistd.h>
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -69,9 +79,13 @@ struct key
     unsigned short    namelen;     /* length of key name */
     unsigned short    classlen;    /* length of class name */
     struct key       *parent;      /* parent key */
+    unsigned int      hash;        /* case-insensitive hash of the name */
+    struct key       *hash_next;   /* next key in the parent's hash chain */
     int               last_subkey; /* last in use subkey */
     int               nb_subkeys;  /* count of allocated subkeys */
-    struct key      **subkeys;     /* subkeys array */
+    struct key      **subkeys;     /* subkeys array, sorted by name */
+    unsigned int      hash_size;   /* size of the subkeys hash table, 0 if none */
+    struct key      **hash_table;  /* hash table of subkeys, for keys with many of them */
     int               last_value;  /* last in use value */
     int               nb_values;   /* count of allocated values in array */
     struct key_value *values;      /* values array */
@@ -100,6 +114,7 @@ struct key_value
 
 #define MIN_SUBKEYS  8   /* min. number of allocated subkeys per key */
 #define MIN_VALUES   8   /* min. number of allocated values per key */
+#define MIN_HASHED_SUBKEYS 32  /* min. number of subkeys to use a hash table */
 
 #define MAX_NAME_LEN  255    /* max. length of a key name */
 #define MAX_VALUE_LEN 16383  /* max. length of a value name */
@@ -123,10 +138,20 @@ static struct key_value *find_value( const struct key *key, const struct unicode
 /* information about where to save a registry branch */
 struct save_branch_info
 {
-    struct key  *key;
-    const char  *path;
+    struct key       *key;
+    const char       *path;
+    char             *journal_path;   /* path of the journal file */
+    FILE             *journal;        /* journal of the changes since the last full save */
+    const struct key *journal_key;    /* key of the last journal entry */
+    off_t             snapshot_size;  /* size of the last full save */
+    int               full_save;      /* branch has changes that are not in the journal */
+    pid_t             compact_pid;    /* process doing a background full save */
+    int               compact_fd;     /* pipe to get the result of the background save */
+    off_t             compact_offset; /* journal size when the background save was started */
 };
 
+#define JOURNAL_MIN_COMPACT_SIZE (256 * 1024)  /* min. journal size before a full save */
+
 #define MAX_SAVE_BRANCH_INFO 3
 static int save_branch_count;
 static struct save_branch_info save_branch_info[MAX_SAVE_BRANCH_INFO];
@@ -413,6 +438,7 @@ static void key_destroy( struct object *obj )
         release_object( key->subkeys[i] );
     }
     free( key->subkeys );
+    free( key->hash_table );
     /* unconditionally notify everything waiting on this key */
     while ((ptr = list_head( &key->notify_list )))
     {
@@ -463,6 +489,15 @@ static struct unicode_str *get_path_token( const struct unicode_str *path, struc
 }
 
 /* allocate a key object */
+/* case-insensitive hash of a key name */
+static unsigned int get_key_name_hash( const WCHAR *name, data_size_t len )
+{
+    unsigned int hash = 2166136261u;
+    len /= sizeof(WCHAR);
+    while (len--) hash = (hash ^ tolowerW(*name++)) * 16777619u;
+    return hash;
+}
+
 static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
 {
     struct key *key;
@@ -473,9 +508,13 @@ static struct key *alloc_key( const struct unicode_str *name, timeout_t modif )
         key->namelen     = name->len;
         key->classlen    = 0;
         key->flags       = 0;
+        key->hash        = get_key_name_hash( name->str, name->len );
+        key->hash_next   = NULL;
         key->last_subkey = -1;
         key->nb_subkeys  = 0;
         key->subkeys     = NULL;
+        key->hash_size   = 0;
+        key->hash_table  = NULL;
         key->nb_values   = 0;
         key->last_value  = -1;
         key->values      = NULL;
@@ -540,6 +579,113 @@ static void touch_key( struct key *key, unsigned int change )
         check_notify( k, change & ~REG_NOTIFY_CHANGE_LAST_SET, 0 );
 }
 
+/* find the saved branch that contains a key */
+static struct save_branch_info *get_save_branch( const struct key *key )
+{
+    int i;
+
+    for ( ; key; key = key->parent)
+        for (i = 0; i < save_branch_count; i++)
+            if (save_branch_info[i].key == key) return &save_branch_info[i];
+    return NULL;
+}
+
+/* write the header of a journal file */
+static void save_journal_header( const struct key *key, FILE *f )
+{
+    fprintf( f, "WINE REGISTRY Version 2\n" );
+    fprintf( f, ";; Changes since the last save, all keys relative to " );
+    dump_path( key, NULL, f );
+    fprintf( f, "\n" );
+}
+
+/* open the journal file of a branch for appending */
+static int open_journal( struct save_branch_info *info )
+{
+    struct stat st;
+
+    if (fchdir( config_dir_fd ) == -1) return 0;
+    info->journal = fopen( info->journal_path, "a" );
+    if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
+    if (!info->journal) return 0;
+
+    if (!fstat( fileno( info->journal ), &st ) && !st.st_size)
+        save_journal_header( info->key, info->journal );
+    info->journal_key = NULL;
+    return 1;
+}
+
+/* start a journal entry for a modified key, return the journal file */
+static FILE *get_key_journal( const struct key *key )
+{
+    struct save_branch_info *info;
+
+    if (key->flags & KEY_VOLATILE) return NULL;
+    if (!(info = get_save_branch( key ))) return NULL;
+    if (!info->journal && !open_journal( info ))
+    {
+        info->full_save = 1;
+        return NULL;
+    }
+    if (info->journal_key != key)
+    {
+        fprintf( info->journal, "\n[" );
+        if (key != info->key) dump_path( key, info->key, info->journal );
+        fprintf( info->journal, "] %u\n",
+                 (unsigned int)((key->modif - ticks_1601_to_1970) / TICKS_PER_SEC) );
+        info->journal_key = key;
+    }
+    return info->journal;
+}
+
+/* record the creation of a key in the journal */
+static void journal_create_key( const struct key *key )
+{
+    FILE *f;
+
+    if (!(f = get_key_journal( key ))) return;
+    if (key->class)
+    {
+        fprintf( f, "#class=\"" );
+        dump_strW( key->class, key->classlen / sizeof(WCHAR), f, "\"\"" );
+        fprintf( f, "\"\n" );
+    }
+    if (key->flags & KEY_SYMLINK) fputs( "#link\n", f );
+}
+
+/* record the deletion of a key in the journal */
+static void journal_delete_key( const struct key *key )
+{
+    FILE *f;
+
+    if (!(f = get_key_journal( key ))) return;
+    fputs( "#delete\n", f );
+    get_save_branch( key )->journal_key = NULL;
+}
+
+/* record a new value in the journal */
+static void journal_set_value( const struct key *key, const struct key_value *value )
+{
+    FILE *f;
+
+    if ((f = get_key_journal( key ))) dump_value( value, f );
+}
+
+/* record the deletion of a value in the journal */
+static void journal_delete_value( const struct key *key, const struct key_value *value )
+{
+    FILE *f;
+
+    if (!(f = get_key_journal( key ))) return;
+    if (value->namelen)
+    {
+        fputc( '\"', f );
+        dump_strW( value->name, value->namelen / sizeof(WCHAR), f, "\"\"" );
+        fputs( "\"=-\n", f );
+    }
+    else fputs( "@=-\n", f );
+}
+
 /* try to grow the array of subkeys; return 1 if OK, 0 on error */
 static int grow_subkeys( struct key *key )
 {
@@ -565,12 +711,61 @@ static int grow_subkeys( struct key *key )
     return 1;
 }
 
+/* (re)build the subkeys hash table of a key; on failure lookups fall back to the array */
+static void build_subkey_hash( struct key *key )
+{
+    unsigned int size = key->hash_size ? key->hash_size : MIN_HASHED_SUBKEYS;
+    struct key **table;
+    int i;
+
+    while (size < key->last_subkey + 1) size *= 2;
+    if (!(table = calloc( size * 2, sizeof(*table) ))) return;
+    free( key->hash_table );
+    key->hash_table = table;
+    key->hash_size = size * 2;
+    for (i = 0; i <= key->last_subkey; i++)
+    {
+        struct key **bucket = &table[key->subkeys[i]->hash % key->hash_size];
+        key->subkeys[i]->hash_next = *bucket;
+        *bucket = key->subkeys[i];
+    }
+}
+
+/* add a new subkey to the hash table of its parent */
+static void add_subkey_hash( struct key *parent, struct key *key )
+{
+    struct key **bucket;
+
+    if (parent->last_subkey + 1 > parent->hash_size)
+    {
+        if (parent->last_subkey + 1 >= MIN_HASHED_SUBKEYS) build_subkey_hash( parent );
+        return;
+    }
+    bucket = &parent->hash_table[key->hash % parent->hash_size];
+    key->hash_next = *bucket;
+    *bucket = key;
+}
+
+/* remove a subkey from the hash table of its parent */
+static void remove_subkey_hash( struct key *parent, struct key *key )
+{
+    struct key **ptr;
+
+    if (!parent->hash_table) return;
+    for (ptr = &parent->hash_table[key->hash % parent->hash_size]; *ptr; ptr = &(*ptr)->hash_next)
+    {
+        if (*ptr != key) continue;
+        *ptr = key->hash_next;
+        break;
+    }
+    key->hash_next = NULL;
+}
+
 /* allocate a subkey for a given key, and return its index */
 static struct key *alloc_subkey( struct key *parent, const struct unicode_str *name,
                                  int index, timeout_t modif )
 {
     struct key *key;
-    int i;
 
     if (name->len > MAX_NAME_LEN * sizeof(WCHAR))
     {
@@ -585,9 +780,11 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
     if ((key = alloc_key( name, modif )) != NULL)
     {
         key->parent = parent;
-        for (i = ++parent->last_subkey; i > index; i--)
-            parent->subkeys[i] = parent->subkeys[i-1];
+        memmove( parent->subkeys + index + 1, parent->subkeys + index,
+                 (parent->last_subkey - index + 1) * sizeof(*parent->subkeys) );
         parent->subkeys[index] = key;
+        parent->last_subkey++;
+        add_subkey_hash( parent, key );
         if (is_wow6432node( key->name, key->namelen ) && !is_wow6432node( parent->name, parent->namelen ))
             parent->flags |= KEY_WOW64;
     }
@@ -598,13 +795,15 @@ static struct key *alloc_subkey( struct key *parent, const struct unicode_str *n
 static void free_subkey( struct key *parent, int index )
 {
     struct key *key;
-    int i, nb_subkeys;
+    int nb_subkeys;
 
     assert( index >= 0 );
     assert( index <= parent->last_subkey );
 
     key = parent->subkeys[index];
-    for (i = index; i < parent->last_subkey; i++) parent->subkeys[i] = parent->subkeys[i + 1];
+    remove_subkey_hash( parent, key );
+    memmove( parent->subkeys + index, parent->subkeys + index + 1,
+             (parent->last_subkey - index) * sizeof(*parent->subkeys) );
     parent->last_subkey--;
     key->flags |= KEY_DELETED;
     key->parent = NULL;
@@ -624,20 +823,33 @@ static void free_subkey( struct key *parent, int index )
     }
 }
 
-/* find the named child of a given key and return its index */
-static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
+/* compare a name with the name of a subkey, in the subkeys sort order */
+static inline int compare_subkey_name( const struct key *key, const struct unicode_str *name )
+{
+    data_size_t len = min( key->namelen, name->len );
+    int res = memicmpW( key->name, name->str, len / sizeof(WCHAR) );
+    if (!res) res = key->namelen - name->len;
+    return res;
+}
+
+/* find the index of a named child in the subkeys array, or the index where it should be inserted */
+static struct key *find_subkey_index( const struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
-    data_size_t len;
+
+    /* keys are usually created in sorted order, check for appending first */
+    if (key->last_subkey >= 0 && compare_subkey_name( key->subkeys[key->last_subkey], name ) < 0)
+    {
+        *index = key->last_subkey + 1;
+        return NULL;
+    }
 
     min = 0;
     max = key->last_subkey;
     while (min <= max)
     {
         i = (min + max) / 2;
-        len = min( key->subkeys[i]->namelen, name->len );
-        res = memicmpW( key->subkeys[i]->name, name->str, len / sizeof(WCHAR) );
-        if (!res) res = key->subkeys[i]->namelen - name->len;
+        res = compare_subkey_name( key->subkeys[i], name );
         if (!res)
         {
             *index = i;
@@ -650,6 +862,25 @@ static struct key *find_subkey( const struct key *key, const struct unicode_str
     return NULL;
 }
 
+/* find the named child of a given key; if not found, return the index where it should be inserted */
+static struct key *find_subkey( const struct key *key, const struct unicode_str *name, int *index )
+{
+    if (key->hash_table)
+    {
+        unsigned int hash = get_key_name_hash( name->str, name->len );
+        struct key *subkey;
+
+        for (subkey = key->hash_table[hash % key->hash_size]; subkey; subkey = subkey->hash_next)
+        {
+            if (subkey->hash != hash || subkey->namelen != name->len) continue;
+            if (memicmpW( subkey->name, name->str, name->len / sizeof(WCHAR) )) continue;
+            *index = -1;  /* not needed for existing keys */
+            return subkey;
+        }
+    }
+    return find_subkey_index( key, name, index );
+}
+
 /* return the wow64 variant of the key, or the key itself if none */
 static struct key *find_wow64_subkey( struct key *key, const struct unicode_str *name )
 {
@@ -813,6 +1044,7 @@ static struct key *create_key( struct key *key, const struct unicode_str *name,
         free(key->class);
         if (!(key->class = memdup( class->str, key->classlen ))) key->classlen = 0;
     }
+    journal_create_key( key );
     grab_object( key );
     return key;
 }
@@ -949,6 +1181,7 @@ static int delete_key( struct key *key, int recurse )
 {
     int index;
     struct key *parent = key->parent;
+    struct unicode_str name;
 
     /* must find parent and index */
     if (key == root_key)
@@ -962,9 +1195,10 @@ static int delete_key( struct key *key, int recurse )
         if (0 > delete_key(key->subkeys[key->last_subkey], 1))
             return -1;
 
-    for (index = 0; index <= parent->last_subkey; index++)
-        if (parent->subkeys[index] == key) break;
-    assert( index <= parent->last_subkey );
+    name.str = key->name;
+    name.len = key->namelen;
+    find_subkey_index( parent, &name, &index );
+    assert( index <= parent->last_subkey && parent->subkeys[index] == key );
 
     /* we can only delete a key that has no subkeys */
     if (key->last_subkey >= 0)
@@ -974,6 +1208,7 @@ static int delete_key( struct key *key, int recurse )
     }
 
     if (debug_level > 1) dump_operation( key, NULL, "Delete" );
+    journal_delete_key( key );
     free_subkey( parent, index );
     touch_key( parent, REG_NOTIFY_CHANGE_NAME );
     return 0;
@@ -1004,20 +1239,33 @@ static int grow_values( struct key *key )
     return 1;
 }
 
+/* compare a name with the name of a value, in the values sort order */
+static inline int compare_value_name( const struct key_value *value, const struct unicode_str *name )
+{
+    data_size_t len = min( value->namelen, name->len );
+    int res = memicmpW( value->name, name->str, len / sizeof(WCHAR) );
+    if (!res) res = value->namelen - name->len;
+    return res;
+}
+
 /* find the named value of a given key and return its index in the array */
 static struct key_value *find_value( const struct key *key, const struct unicode_str *name, int *index )
 {
     int i, min, max, res;
-    data_size_t len;
+
+    /* values are usually created in sorted order, check for appending first */
+    if (key->last_value >= 0 && compare_value_name( &key->values[key->last_value], name ) < 0)
+    {
+        *index = key->last_value + 1;
+        return NULL;
+    }
 
     min = 0;
     max = key->last_value;
     while (min <= max)
     {
         i = (min + max) / 2;
-        len = min( key->values[i].namelen, name->len );
-        res = memicmpW( key->values[i].name, name->str, len / sizeof(WCHAR) );
-        if (!res) res = key->values[i].namelen - name->len;
+        res = compare_value_name( &key->values[i], name );
         if (!res)
         {
             *index = i;
@@ -1035,7 +1283,6 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
 {
     struct key_value *value;
     WCHAR *new_name = NULL;
-    int i;
 
     if (name->len > MAX_VALUE_LEN * sizeof(WCHAR))
     {
@@ -1047,7 +1294,9 @@ static struct key_value *insert_value( struct key *key, const struct unicode_str
         if (!grow_values( key )) return NULL;
     }
     if (name->len && !(new_name = memdup( name->str, name->len ))) return NULL;
-    for (i = ++key->last_value; i > index; i--) key->values[i] = key->values[i - 1];
+    memmove( key->values + index + 1, key->values + index,
+             (key->last_value - index + 1) * sizeof(*key->values) );
+    key->last_value++;
     value = &key->values[index];
     value->name    = new_name;
     value->namelen = name->len;
@@ -1101,6 +1350,7 @@ static void set_value( struct key *key, const struct unicode_str *name,
     value->len   = len;
     value->data  = ptr;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
+    journal_set_value( key, value );
     if (debug_level > 1) dump_operation( key, value, "Set" );
 }
 
@@ -1179,7 +1429,7 @@ static void enum_value( struct key *key, int i, int info_class, struct enum_key_
 static void delete_value( struct key *key, const struct unicode_str *name )
 {
     struct key_value *value;
-    int i, index, nb_values;
+    int index, nb_values;
 
     if (!(value = find_value( key, name, &index )))
     {
@@ -1187,9 +1437,11 @@ static void delete_value( struct key *key, const struct unicode_str *name )
         return;
     }
     if (debug_level > 1) dump_operation( key, value, "Delete" );
+    journal_delete_value( key, value );
     free( value->name );
     free( value->data );
-    for (i = index; i < key->last_value; i++) key->values[i] = key->values[i + 1];
+    memmove( key->values + index, key->values + index + 1,
+             (key->last_value - index) * sizeof(*key->values) );
     key->last_value--;
     touch_key( key, REG_NOTIFY_CHANGE_LAST_SET );
 
@@ -1431,6 +1683,7 @@ static int parse_hex( unsigned char *dest, data_size_t *len, const char *buffer
 }
 
 /* parse a value name and create the corresponding value */
+/* a value without data is deleted instead and NULL is returned */
 static struct key_value *parse_value_name( struct key *key, const char *buffer, data_size_t *len,
                                            struct file_load_info *info )
 {
@@ -1457,6 +1710,11 @@ static struct key_value *parse_value_name( struct key *key, const char *buffer,
     if (buffer[*len] != '=') goto error;
     (*len)++;
     while (isspace(buffer[*len])) (*len)++;
+    if (buffer[*len] == '-')  /* deleted value, only found in journals */
+    {
+        if (find_value( key, &name, &index )) delete_value( key, &name );
+        return NULL;
+    }
     if (!(value = find_value( key, &name, &index ))) value = insert_value( key, &name, index );
     return value;
 
@@ -1605,7 +1863,13 @@ static void load_keys( struct key *key, const char *filename, FILE *f, int prefi
             else file_read_error( "Value without key", &info );
             break;
         case '#':   /* option */
-            if (subkey) load_key_option( subkey, p, &info );
+            if (subkey && !strncmp( p, "#delete", 7 ))  /* deleted key, only found in journals */
+            {
+                if (subkey != key) delete_key( subkey, 1 );
+                release_object( subkey );
+                subkey = NULL;
+            }
+            else if (subkey) load_key_option( subkey, p, &info );
             else if (!load_global_option( p, &info )) goto done;
             break;
         case ';':   /* comment */
@@ -1637,19 +1901,285 @@ static void load_registry( struct key *key, obj_handle_t handle )
         FILE *f = fdopen( fd, "r" );
         if (f)
         {
+            struct save_branch_info *info;
+
             load_keys( key, NULL, f, -1 );
             fclose( f );
+            /* the loaded values are not in the journal */
+            if ((info = get_save_branch( key ))) info->full_save = 1;
         }
         else file_set_error();
     }
 }
 
+/* Binary hive files
+ *
+ * A binary hive is a copy of a registry branch file that is written after
+ * each full save of the branch, and that can be mapped and loaded without
+ * any parsing. It is only used if it matches the text file, which remains
+ * the reference format. It contains a header followed by the keys in
+ * depth-first order, each key being followed by its values and subkeys.
+ */
+
+#define HIVE_MAGIC   0x45564948  /* "HIVE" */
+#define HIVE_VERSION 1
+#define HIVE_ALIGN(len) (((size_t)(len) + 7) & ~(size_t)7)
+
+struct hive_header
+{
+    unsigned int       magic;       /* HIVE_MAGIC */
+    unsigned int       version;     /* HIVE_VERSION */
+    unsigned int       arch;        /* prefix type */
+    unsigned int       pad;
+    unsigned long long text_size;   /* size of the matching text file */
+    unsigned long long text_mtime;  /* modification time of the matching text file */
+    unsigned long long text_inode;  /* inode of the matching text file */
+};
+
+struct hive_key
+{
+    timeout_t    modif;     /* last modification time */
+    unsigned int flags;     /* key flags (only KEY_SYMLINK) */
+    unsigned int namelen;   /* length of the key name */
+    unsigned int classlen;  /* length of the class name */
+    unsigned int values;    /* number of values */
+    unsigned int subkeys;   /* number of subkeys */
+    unsigned int pad;
+    /* followed by the name, class, values and subkeys */
+};
+
+struct hive_value
+{
+    unsigned int type;      /* value type */
+    unsigned int namelen;   /* length of the value name */
+    unsigned int len;       /* length of the value data */
+    unsigned int pad;
+    /* followed by the name and data */
+};
+
+/* get the name of the binary hive for a branch file */
+static char *get_hive_path( const char *path )
+{
+    char *ret;
+
+    if ((ret = malloc( strlen(path) + sizeof(".bin") )))
+    {
+        strcpy( ret, path );
+        strcat( ret, ".bin" );
+    }
+    return ret;
+}
+
+/* write a block of hive data followed by its padding */
+static void save_hive_data( const void *data, data_size_t len, FILE *f )
+{
+    static const char zero[8];
+
+    if (!len) return;
+    fwrite( data, len, 1, f );
+    fwrite( zero, HIVE_ALIGN(len) - len, 1, f );
+}
+
+/* save a key and its subkeys to a binary hive */
+static void save_hive_key( const struct key *key, FILE *f )
+{
+    struct hive_key hkey;
+    struct hive_value hvalue;
+    int i;
+
+    memset( &hkey, 0, sizeof(hkey) );
+    hkey.modif    = key->modif;
+    hkey.flags    = key->flags & KEY_SYMLINK;
+    hkey.namelen  = key->namelen;
+    hkey.classlen = key->classlen;
+    hkey.values   = key->last_value + 1;
+    for (i = 0; i <= key->last_subkey; i++)
+        if (!(key->subkeys[i]->flags & KEY_VOLATILE)) hkey.subkeys++;
+    fwrite( &hkey, sizeof(hkey), 1, f );
+    save_hive_data( key->name, key->namelen, f );
+    save_hive_data( key->class, key->classlen, f );
+
+    for (i = 0; i <= key->last_value; i++)
+    {
+        memset( &hvalue, 0, sizeof(hvalue) );
+        hvalue.type    = key->values[i].type;
+        hvalue.namelen = key->values[i].namelen;
+        hvalue.len     = key->values[i].len;
+        fwrite( &hvalue, sizeof(hvalue), 1, f );
+        save_hive_data( key->values[i].name, key->values[i].namelen, f );
+        save_hive_data( key->values[i].data, key->values[i].len, f );
+    }
+    for (i = 0; i <= key->last_subkey; i++)
+        if (!(key->subkeys[i]->flags & KEY_VOLATILE)) save_hive_key( key->subkeys[i], f );
+}
+
+/* save the binary hive of a branch that has just been saved to a text file */
+static void save_hive( const struct key *key, const char *path )
+{
+    struct hive_header header;
+    struct stat st;
+    char *hive_path, *tmp = NULL;
+    FILE *f;
+    int ret = 0;
+
+    if (!(hive_path = get_hive_path( path ))) return;
+    if (stat( path, &st )) goto done;
+    if (!(tmp = malloc( strlen(hive_path) + sizeof(".tmp") ))) goto done;
+    strcpy( tmp, hive_path );
+    strcat( tmp, ".tmp" );
+    if (!(f = fopen( tmp, "w" ))) goto done;
+
+    memset( &header, 0, sizeof(header) );
+    header.magic      = HIVE_MAGIC;
+    header.version    = HIVE_VERSION;
+    header.arch       = prefix_type;
+    header.text_size  = st.st_size;
+    header.text_mtime = st.st_mtime;
+    header.text_inode = st.st_ino;
+    fwrite( &header, sizeof(header), 1, f );
+    save_hive_key( key, f );
+    ret = !fclose( f ) && !rename( tmp, hive_path );
+    if (!ret) unlink( tmp );
+
+done:
+    if (!ret) unlink( hive_path );  /* don't leave a stale hive around */
+    free( hive_path );
+    free( tmp );
+}
+
+/* skip a block of hive data, checking that it fits in the file */
+static const char *skip_hive_data( const char *ptr, const char *end, size_t len )
+{
+    if (!ptr || len > (size_t)(end - ptr) || HIVE_ALIGN(len) > (size_t)(end - ptr)) return NULL;
+    return ptr + HIVE_ALIGN(len);
+}
+
+/* load a key and its subkeys from a binary hive, or only validate them if key is NULL */
+static const char *load_hive_key( struct key *key, const char *ptr, const char *end )
+{
+    const struct hive_key *hkey = (const struct hive_key *)ptr;
+    const struct hive_value *hvalue;
+    struct key_value *value;
+    struct unicode_str name;
+    unsigned int i;
+    int index;
+
+    if (!(ptr = skip_hive_data( ptr, end, sizeof(*hkey) ))) return NULL;
+    if (!(ptr = skip_hive_data( ptr, end, hkey->namelen ))) return NULL;
+    if (!skip_hive_data( ptr, end, hkey->classlen )) return NULL;
+    if (key && hkey->classlen)
+    {
+        free( key->class );
+        if (!(key->class = memdup( ptr, hkey->classlen ))) return NULL;
+        key->classlen = hkey->classlen;
+    }
+    ptr = skip_hive_data( ptr, end, hkey->classlen );
+    if (key) key->flags |= hkey->flags & KEY_SYMLINK;
+
+    for (i = 0; i < hkey->values; i++)
+    {
+        hvalue = (const struct hive_value *)ptr;
+        if (!(ptr = skip_hive_data( ptr, end, sizeof(*hvalue) ))) return NULL;
+        if (hvalue->namelen > MAX_VALUE_LEN * sizeof(WCHAR)) return NULL;
+        name.str = (const WCHAR *)ptr;
+        name.len = hvalue->namelen;
+        if (!(ptr = skip_hive_data( ptr, end, hvalue->namelen ))) return NULL;
+        if (!skip_hive_data( ptr, end, hvalue->len )) return NULL;
+        if (key)
+        {
+            void *data = NULL;
+
+            if (hvalue->len && !(data = memdup( ptr, hvalue->len ))) return NULL;
+            if (!(value = find_value( key, &name, &index )) &&
+                !(value = insert_value( key, &name, index )))
+            {
+                free( data );
+                return NULL;
+            }
+            free( value->data );
+            value->data = data;
+            value->len  = hvalue->len;
+            value->type = hvalue->type;
+        }
+        ptr = skip_hive_data( ptr, end, hvalue->len );
+    }
+
+    for (i = 0; i < hkey->subkeys; i++)
+    {
+        const struct hive_key *hsubkey = (const struct hive_key *)ptr;
+        struct key *subkey = NULL;
+
+        if (!skip_hive_data( ptr, end, sizeof(*hsubkey) )) return NULL;
+        if (!hsubkey->namelen || hsubkey->namelen > MAX_NAME_LEN * sizeof(WCHAR)) return NULL;
+        if (!skip_hive_data( ptr + sizeof(*hsubkey), end, hsubkey->namelen )) return NULL;
+        if (key)
+        {
+            name.str = (const WCHAR *)(ptr + sizeof(*hsubkey));
+            name.len = hsubkey->namelen;
+            if (!(subkey = find_subkey( key, &name, &index )) &&
+                !(subkey = alloc_subkey( key, &name, index, hsubkey->modif )))
+                return NULL;
+        }
+        if (!(ptr = load_hive_key( subkey, ptr, end ))) return NULL;
+    }
+    return ptr;
+}
+
+/* load a branch from its binary hive if it matches the text file */
+static int load_hive( const char *path, struct key *key )
+{
+#ifdef HAVE_SYS_MMAN_H
+    const struct hive_header *header;
+    const char *end;
+    struct stat st, hive_st;
+    char *hive_path;
+    void *base;
+    int fd, ret = 0;
+
+    if (stat( path, &st )) return 0;
+    if (!(hive_path = get_hive_path( path ))) return 0;
+    fd = open( hive_path, O_RDONLY );
+    free( hive_path );
+    if (fd == -1) return 0;
+    if (fstat( fd, &hive_st ) || hive_st.st_size < sizeof(*header) ||
+        (base = mmap( NULL, hive_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        return 0;
+    }
+    close( fd );
+
+    header = base;
+    end = (const char *)base + hive_st.st_size;
+    if (header->magic != HIVE_MAGIC || header->version != HIVE_VERSION) goto done;
+    if (header->text_size != st.st_size || header->text_mtime != st.st_mtime ||
+        header->text_inode != st.st_ino) goto done;
+    if (header->arch != PREFIX_UNKNOWN && prefix_type != PREFIX_UNKNOWN &&
+        header->arch != prefix_type) goto done;
+
+    /* validate everything before loading, so that a bad file has no effect */
+    if (load_hive_key( NULL, (const char *)(header + 1), end ) != end) goto done;
+    if (header->arch != PREFIX_UNKNOWN) prefix_type = header->arch;
+    ret = load_hive_key( key, (const char *)(header + 1), end ) != NULL;
+
+done:
+    munmap( base, hive_st.st_size );
+    return ret;
+#else
+    return 0;
+#endif
+}
+
 /* load one of the initial registry files */
 static int load_init_registry_from_file( const char *filename, struct key *key )
 {
-    FILE *f;
+    struct save_branch_info *info;
+    struct stat st;
+    FILE *f, *journal;
+    char *journal_path;
+    int loaded, hive_loaded;
 
-    if ((f = fopen( filename, "r" )))
+    if (!(loaded = hive_loaded = load_hive( filename, key )) && (f = fopen( filename, "r" )))
     {
         load_keys( key, filename, f, 0 );
         fclose( f );
@@ -1658,14 +2188,40 @@ static int load_init_registry_from_file( const char *filename, struct key *key )
             fprintf( stderr, "%s is not a valid registry file\n", filename );
             return 1;
         }
+        loaded = 1;
+    }
+
+    /* replay the changes made since the last full save */
+    if (!(journal_path = malloc( strlen(filename) + sizeof(".journal") )))
+        fatal_error( "out of memory\n" );
+    strcpy( journal_path, filename );
+    strcat( journal_path, ".journal" );
+    if ((journal = fopen( journal_path, "r" )))
+    {
+        load_keys( key, journal_path, journal, 0 );
+        fclose( journal );
+        clear_error();
+        make_dirty( key );
     }
 
     assert( save_branch_count < MAX_SAVE_BRANCH_INFO );
 
-    save_branch_info[save_branch_count].path = filename;
-    save_branch_info[save_branch_count++].key = (struct key *)grab_object( key );
+    info = &save_branch_info[save_branch_count++];
+    memset( info, 0, sizeof(*info) );
+    info->path = filename;
+    info->key = (struct key *)grab_object( key );
+    info->journal_path = journal_path;
+    info->compact_fd = -1;
+    if (!stat( filename, &st )) info->snapshot_size = st.st_size;
+    if (journal)
+    {
+        /* keep appending to it until the next full save */
+        info->journal = fopen( journal_path, "a" );
+        info->full_save = 1;
+    }
+    if (loaded && !hive_loaded) info->full_save = 1;  /* create the binary hive */
     make_object_static( &key->obj );
-    return (f != NULL);
+    return loaded;
 }
 
 static WCHAR *format_user_registry_path( const SID *sid, struct unicode_str *path )
@@ -1910,10 +2466,155 @@ static int save_branch( struct key *key, const char *path )
 
 done:
     free( tmp );
-    if (ret) make_clean( key );
+    if (ret)
+    {
+        save_hive( key, path );
+        make_clean( key );
+    }
     return ret;
 }
 
+/* flush the journal of a branch and return its size */
+static off_t get_journal_size( struct save_branch_info *info )
+{
+    struct stat st;
+
+    if (!info->journal) return 0;
+    if (fflush( info->journal ) || ferror( info->journal )) info->full_save = 1;
+    if (fstat( fileno( info->journal ), &st )) return 0;
+    return st.st_size;
+}
+
+/* discard the journal entries that are included in the last full save */
+static void trim_journal( struct save_branch_info *info, off_t offset )
+{
+    off_t size = get_journal_size( info );
+    char *data = NULL, *tmp = NULL;
+    FILE *f;
+
+    if (size <= offset)
+    {
+        if (info->journal) fclose( info->journal );
+        info->journal = NULL;
+        unlink( info->journal_path );
+        return;
+    }
+
+    /* copy the newer entries to a new journal; on failure the old one is kept,
+     * replaying the entries that are already saved is harmless */
+    size -= offset;
+    if (!(data = malloc( size ))) return;
+    if (pread( fileno( info->journal ), data, size, offset ) != size) goto done;
+    if (!(tmp = malloc( strlen(info->journal_path) + sizeof(".tmp") ))) goto done;
+    strcpy( tmp, info->journal_path );
+    strcat( tmp, ".tmp" );
+    if (!(f = fopen( tmp, "w" ))) goto done;
+    save_journal_header( info->key, f );
+    fwrite( data, size, 1, f );
+    if (fclose( f ) || rename( tmp, info->journal_path ))
+    {
+        unlink( tmp );
+        goto done;
+    }
+    fclose( info->journal );
+    if (!(info->journal = fopen( info->journal_path, "a" ))) info->full_save = 1;
+    info->journal_key = NULL;
+
+done:
+    free( data );
+    free( tmp );
+}
+
+/* update the journal once a full save of the branch is finished */
+static void end_compaction( struct save_branch_info *info, int success )
+{
+    struct stat st;
+
+    if (success)
+    {
+        trim_journal( info, info->compact_offset );
+        if (!stat( info->path, &st )) info->snapshot_size = st.st_size;
+    }
+    else
+    {
+        make_dirty( info->key );
+        info->full_save = 1;
+    }
+}
+
+/* check whether a background save is finished, optionally waiting for it */
+static void check_compaction( struct save_branch_info *info, int wait )
+{
+    char res = 0;
+
+    if (!wait)
+    {
+        struct pollfd pfd;
+
+        pfd.fd = info->compact_fd;
+        pfd.events = POLLIN;
+        if (poll( &pfd, 1, 0 ) <= 0) return;
+    }
+    if (read( info->compact_fd, &res, 1 ) != 1) res = 0;
+    close( info->compact_fd );
+    waitpid( info->compact_pid, NULL, 0 );
+    info->compact_fd = -1;
+    info->compact_pid = 0;
+    end_compaction( info, res );
+}
+
+/* save a full branch in a child process and trim the journal when it's done */
+static void start_compaction( struct save_branch_info *info )
+{
+    int fds[2];
+    char res;
+
+    info->compact_offset = get_journal_size( info );
+    info->journal_key = NULL;  /* make sure the newer entries start with a key */
+    info->full_save = 0;
+    make_dirty( info->key );
+
+    if (pipe( fds ) != -1)
+    {
+        switch ((info->compact_pid = fork()))
+        {
+        case 0:  /* child */
+            close( fds[0] );
+            signal( SIGHUP, SIG_DFL );
+            signal( SIGINT, SIG_DFL );
+            signal( SIGQUIT, SIG_DFL );
+            signal( SIGTERM, SIG_DFL );
+            signal( SIGUSR1, SIG_DFL );
+            res = save_branch( info->key, info->path );
+            write( fds[1], &res, 1 );
+            _exit( 0 );
+
+        case -1:
+            info->compact_pid = 0;
+            close( fds[0] );
+            close( fds[1] );
+            break;
+
+        default:  /* parent */
+            close( fds[1] );
+            info->compact_fd = fds[0];
+            make_clean( info->key );  /* newer changes will be saved by the next full save */
+            return;
+        }
+    }
+    /* fall back to saving synchronously */
+    end_compaction( info, save_branch( info->key, info->path ));
+}
+
+/* flush the journal of a branch, and save the full branch when the journal grows too large */
+static void save_branch_journal( struct save_branch_info *info )
+{
+    if (info->compact_pid) check_compaction( info, 0 );
+    if (get_journal_size( info ) > max( info->snapshot_size / 2, JOURNAL_MIN_COMPACT_SIZE ))
+        info->full_save = 1;
+    if (info->full_save && !info->compact_pid) start_compaction( info );
+}
+
 /* periodic saving of the registry */
 static void periodic_save( void *arg )
 {
@@ -1921,8 +2622,7 @@ static void periodic_save( void *arg )
 
     if (fchdir( config_dir_fd ) == -1) return;
     save_timeout_user = NULL;
-    for (i = 0; i < save_branch_count; i++)
-        save_branch( save_branch_info[i].key, save_branch_info[i].path );
+    for (i = 0; i < save_branch_count; i++) save_branch_journal( &save_branch_info[i] );
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
     set_periodic_save_timer();
 }
@@ -1942,12 +2642,18 @@ void flush_registry(void)
     if (fchdir( config_dir_fd ) == -1) return;
     for (i = 0; i < save_branch_count; i++)
     {
-        if (!save_branch( save_branch_info[i].key, save_branch_info[i].path ))
+        struct save_branch_info *info = &save_branch_info[i];
+
+        if (info->compact_pid) check_compaction( info, 1 );
+        if (info->full_save) make_dirty( info->key );
+        if (!save_branch( info->key, info->path ))
         {
             fprintf( stderr, "wineserver: could not save registry branch to %s",
-                     save_branch_info[i].path );
+                     info->path );
             perror( " " );
+            get_journal_size( info );  /* flush it */
         }
+        else trim_journal( info, get_journal_size( info ));
     }
     if (fchdir( server_dir_fd ) == -1) fatal_error( "chdir to server dir: %s\n", strerror( errno ));
 }
@@ -65,6 +65,7 @@
 
 #include "file.h"
 #include "process.h"
+#include "unicode.h"
 #define WANT_REQUEST_HANDLERS
 #include "request.h"
 
@@ -77,6 +78,23 @@
 static const char * const server_socket_name = "socket";   /* name of the socket file */
 static const char * const server_lock_name = "lock";       /* name of the server lock file */
 
+/* number of requests of each type since the last statistics dump */
+static unsigned int request_counts[REQ_NB_REQUESTS];
+
+/* request profiling */
+#define PROFILE_BUCKETS 40  /* log2 buckets of service times in ns */
+
+struct request_profile
+{
+    unsigned int       count;                  /* number of calls */
+    unsigned long long total;                  /* total service time in ns */
+    unsigned int       hist[PROFILE_BUCKETS];  /* histogram of service times */
+};
+
+static struct request_profile *request_profiles;  /* NULL if profiling is disabled */
+static FILE *profile_file;
+static unsigned long long profile_start;
+
 struct master_socket
 {
     struct object        obj;        /* object header */
@@ -230,11 +248,117 @@ static void send_reply( union generic_reply *reply )
         fatal_protocol_error( current, "reply write: %s\n", strerror( errno ));
 }
 
+/* get a monotonic time stamp in ns for profiling */
+static unsigned long long get_profile_time(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+
+    if (!clock_gettime( CLOCK_MONOTONIC, &ts ))
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+    return (current_time - server_start_time) * 100;
+}
+
+/* record the service time of a request */
+static void profile_request( enum request req, unsigned long long time )
+{
+    struct request_profile *profile = &request_profiles[req];
+    unsigned int bucket = 0;
+
+    while (bucket < PROFILE_BUCKETS - 1 && (time >> (bucket + 1))) bucket++;
+    profile->count++;
+    profile->total += time;
+    profile->hist[bucket]++;
+}
+
+/* get the upper bound of the service time below which a given percentage of calls fall */
+static unsigned long long get_profile_percentile( const struct request_profile *profile,
+                                                  unsigned int percent )
+{
+    unsigned int i, sum = 0, limit = (profile->count * (unsigned long long)percent + 99) / 100;
+
+    for (i = 0; i < PROFILE_BUCKETS; i++)
+        if ((sum += profile->hist[i]) >= limit) break;
+    return 2ULL << i;
+}
+
+/* write a line of profiling data for a process */
+static void dump_process_profile( FILE *file, struct process *process, const char *state )
+{
+    struct process_dll *exe = get_process_exe_module( process );
+
+    if (!process->profile_count) return;
+    fprintf( file, "process %04x %d %s %u %llu ", process->id, process->unix_pid, state,
+             process->profile_count, process->profile_time );
+    if (exe && exe->filename) dump_strW( exe->filename, exe->namelen / sizeof(WCHAR), file, "\"\"" );
+    else fputc( '-', file );
+    fputc( '\n', file );
+}
+
+/* write the profiling data of an exiting process */
+void profile_process_exit( struct process *process )
+{
+    if (request_profiles) dump_process_profile( profile_file, process, "exited" );
+}
+
+/* enum_processes callback to dump the profile of a running process */
+static int dump_process_profile_cb( struct process *process, void *file )
+{
+    if (process->end_time) return 0;  /* already reported on exit */
+    dump_process_profile( file, process, "running" );
+    return 0;
+}
+
+/* dump the profiling data collected so far */
+static void dump_request_profile(void)
+{
+    unsigned int i;
+
+    if (!request_profiles) return;
+    fprintf( profile_file, "# wineserver profile pid %d elapsed_ns %llu\n",
+             (int)getpid(), get_profile_time() - profile_start );
+    fprintf( profile_file, "# request name count total_ns p50_ns p99_ns\n" );
+    for (i = 0; i < REQ_NB_REQUESTS; i++)
+    {
+        if (!request_profiles[i].count) continue;
+        fprintf( profile_file, "request %s %u %llu %llu %llu\n", get_request_name( i ),
+                 request_profiles[i].count, request_profiles[i].total,
+                 get_profile_percentile( &request_profiles[i], 50 ),
+                 get_profile_percentile( &request_profiles[i], 99 ));
+    }
+    fprintf( profile_file, "# process id unix_pid state count total_ns exe\n" );
+    enum_processes( dump_process_profile_cb, profile_file );
+    fprintf( profile_file, "# namespace address names buckets used_buckets longest_chain resizes\n" );
+    dump_namespace_stats( profile_file );
+    fflush( profile_file );
+}
+
+/* start profiling, or dump the current profile if already started */
+void toggle_request_profile( const char *filename )
+{
+    if (request_profiles)
+    {
+        dump_request_profile();
+        return;
+    }
+    profile_file = stderr;
+    if (filename && *filename && !(profile_file = fopen( filename, "a" )))
+    {
+        fprintf( stderr, "wineserver: cannot open profile file %s: %s\n", filename, strerror( errno ));
+        profile_file = stderr;
+    }
+    if (!(request_profiles = calloc( REQ_NB_REQUESTS, sizeof(*request_profiles) ))) return;
+    profile_start = get_profile_time();
+    atexit( dump_request_profile );
+}
+
 /* call a request handler */
 static void call_req_handler( struct thread *thread )
 {
     union generic_reply reply;
     enum request req = thread->req.request_header.req;
+    unsigned long long start = 0;
 
     current = thread;
     current->reply_size = 0;
@@ -244,7 +368,21 @@ static void call_req_handler( struct thread *thread )
     if (debug_level) trace_request();
 
     if (req < REQ_NB_REQUESTS)
+    {
+        request_counts[req]++;
+        if (request_profiles) start = get_profile_time();
         req_handlers[req]( &current->req, &reply );
+        if (request_profiles)
+        {
+            unsigned long long time = get_profile_time() - start;
+            profile_request( req, time );
+            if (current)
+            {
+                current->process->profile_count++;
+                current->process->profile_time += time;
+            }
+        }
+    }
     else
         set_error( STATUS_NOT_IMPLEMENTED );
 
@@ -266,6 +404,126 @@ static void call_req_handler( struct thread *thread )
     current = NULL;
 }
 
+/* check if a request can be submitted as part of a batch */
+static int is_batchable_request( enum request req )
+{
+    switch (req)
+    {
+    case REQ_close_handle:
+    case REQ_enum_key:
+    case REQ_enum_key_value:
+    case REQ_get_key_value:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* call the handlers of a batch of requests */
+DECL_HANDLER(batch_requests)
+{
+    union generic_request outer_req = current->req;
+    void *outer_data = current->req_data;
+    const char *ptr = outer_data, *end = ptr + get_req_data_size();
+    data_size_t max_size = get_reply_max_size(), total = 0, pos = 0;
+    unsigned int i, count = req->count;
+    char *replies;
+
+    /* validate the requests and compute the total reply size */
+    for (i = 0; i < count; i++)
+    {
+        const struct request_header *header = (const struct request_header *)ptr;
+        data_size_t left = end - ptr;
+
+        if (left < sizeof(union generic_request)) break;
+        left -= sizeof(union generic_request);
+        if (header->request_size > left || BATCH_ALIGN( header->request_size ) > left) break;
+        ptr += sizeof(union generic_request) + BATCH_ALIGN( header->request_size );
+        if (header->reply_size > max_size - total ||
+            sizeof(union generic_reply) + BATCH_ALIGN( header->reply_size ) > max_size - total)
+        {
+            set_error( STATUS_BUFFER_TOO_SMALL );
+            return;
+        }
+        total += sizeof(union generic_reply) + BATCH_ALIGN( header->reply_size );
+    }
+    if (i < count || ptr != end)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        return;
+    }
+    if (!count) return;
+    if (!(replies = mem_alloc( total ))) return;
+
+    ptr = outer_data;
+    for (i = 0; i < count; i++)
+    {
+        union generic_reply sub_reply;
+        enum request sub;
+
+        memcpy( &current->req, ptr, sizeof(union generic_request) );
+        current->req_data = (char *)ptr + sizeof(union generic_request);
+        current->reply_size = 0;
+        ptr += sizeof(union generic_request) + BATCH_ALIGN( current->req.request_header.request_size );
+
+        sub = current->req.request_header.req;
+        clear_error();
+        memset( &sub_reply, 0, sizeof(sub_reply) );
+
+        if (debug_level) trace_request();
+
+        if (sub < REQ_NB_REQUESTS && is_batchable_request( sub ))
+        {
+            unsigned long long start = request_profiles ? get_profile_time() : 0;
+
+            request_counts[sub]++;
+            req_handlers[sub]( &current->req, &sub_reply );
+            if (request_profiles) profile_request( sub, get_profile_time() - start );
+        }
+        else
+            set_error( STATUS_NOT_SUPPORTED );
+
+        sub_reply.reply_header.error = current->error;
+        sub_reply.reply_header.reply_size = current->reply_size;
+        if (debug_level) trace_reply( sub, &sub_reply );
+
+        memcpy( replies + pos, &sub_reply, sizeof(sub_reply) );
+        pos += sizeof(sub_reply);
+        if (current->reply_size)
+        {
+            memcpy( replies + pos, current->reply_data, current->reply_size );
+            memset( replies + pos + current->reply_size, 0,
+                    BATCH_ALIGN( current->reply_size ) - current->reply_size );
+            pos += BATCH_ALIGN( current->reply_size );
+            free( current->reply_data );
+            current->reply_data = NULL;
+        }
+    }
+
+    current->req = outer_req;
+    current->req_data = outer_data;
+    clear_error();
+    reply->count = count;
+    set_reply_data_ptr( replies, pos );
+}
+
+/* dump the request statistics and restart the timer */
+static void request_stats_timeout( void *private )
+{
+    trace_request_stats( request_counts, stats_interval );
+    memset( request_counts, 0, sizeof(request_counts) );
+    add_timeout_user( stats_interval, request_stats_timeout, NULL );
+}
+
+/* start collecting request statistics and profiling data if requested */
+void init_request_stats(void)
+{
+    const char *profile = getenv( "WINESERVERPROFILE" );
+
+    if (stats_interval) add_timeout_user( stats_interval, request_stats_timeout, NULL );
+    if (profile) toggle_request_profile( profile );
+}
+
 /* read a request from a thread */
 void read_request( struct thread *thread )
 {
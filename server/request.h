@@ -58,8 +58,14 @@ extern int wait_for_lock(void);
 extern int kill_lock_owner( int sig );
 extern int server_dir_fd, config_dir_fd;
 
+extern void init_request_stats(void);
+extern void toggle_request_profile( const char *filename );
+extern void profile_process_exit( struct process *process );
+
 extern void trace_request(void);
 extern void trace_reply( enum request req, const union generic_reply *reply );
+extern void trace_request_stats( const unsigned int *counts, timeout_t interval );
+extern const char *get_request_name( enum request req );
 
 /* get the request vararg data */
 static inline const void *get_req_data(void)
@@ -126,6 +132,7 @@ DECL_HANDLER(unload_dll);
 DECL_HANDLER(queue_apc);
 DECL_HANDLER(get_apc_result);
 DECL_HANDLER(close_handle);
+DECL_HANDLER(batch_requests);
 DECL_HANDLER(set_handle_info);
 DECL_HANDLER(dup_handle);
 DECL_HANDLER(open_process);
@@ -133,6 +140,8 @@ DECL_HANDLER(open_thread);
 DECL_HANDLER(select);
 DECL_HANDLER(create_event);
 DECL_HANDLER(event_op);
+DECL_HANDLER(get_shared_sync_area);
+DECL_HANDLER(share_event_state);
 DECL_HANDLER(query_event);
 DECL_HANDLER(open_event);
 DECL_HANDLER(create_keyed_event);
@@ -387,6 +396,7 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_queue_apc,
     (req_handler)req_get_apc_result,
     (req_handler)req_close_handle,
+    (req_handler)req_batch_requests,
     (req_handler)req_set_handle_info,
     (req_handler)req_dup_handle,
     (req_handler)req_open_process,
@@ -394,6 +404,8 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
     (req_handler)req_select,
     (req_handler)req_create_event,
     (req_handler)req_event_op,
+    (req_handler)req_get_shared_sync_area,
+    (req_handler)req_share_event_state,
     (req_handler)req_query_event,
     (req_handler)req_open_event,
     (req_handler)req_create_keyed_event,
@@ -792,6 +804,10 @@ C_ASSERT( FIELD_OFFSET(struct get_apc_result_reply, result) == 8 );
 C_ASSERT( sizeof(struct get_apc_result_reply) == 48 );
 C_ASSERT( FIELD_OFFSET(struct close_handle_request, handle) == 12 );
 C_ASSERT( sizeof(struct close_handle_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct batch_requests_request, count) == 12 );
+C_ASSERT( sizeof(struct batch_requests_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct batch_requests_reply, count) == 8 );
+C_ASSERT( sizeof(struct batch_requests_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct set_handle_info_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct set_handle_info_request, flags) == 16 );
 C_ASSERT( FIELD_OFFSET(struct set_handle_info_request, mask) == 20 );
@@ -840,6 +856,15 @@ C_ASSERT( sizeof(struct create_event_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct event_op_request, handle) == 12 );
 C_ASSERT( FIELD_OFFSET(struct event_op_request, op) == 16 );
 C_ASSERT( sizeof(struct event_op_request) == 24 );
+C_ASSERT( sizeof(struct get_shared_sync_area_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_sync_area_reply, size) == 8 );
+C_ASSERT( FIELD_OFFSET(struct get_shared_sync_area_reply, epoch) == 12 );
+C_ASSERT( sizeof(struct get_shared_sync_area_reply) == 16 );
+C_ASSERT( FIELD_OFFSET(struct share_event_state_request, handle) == 12 );
+C_ASSERT( sizeof(struct share_event_state_request) == 16 );
+C_ASSERT( FIELD_OFFSET(struct share_event_state_reply, index) == 8 );
+C_ASSERT( FIELD_OFFSET(struct share_event_state_reply, gen) == 12 );
+C_ASSERT( sizeof(struct share_event_state_reply) == 16 );
 C_ASSERT( FIELD_OFFSET(struct query_event_request, handle) == 12 );
 C_ASSERT( sizeof(struct query_event_request) == 16 );
 C_ASSERT( FIELD_OFFSET(struct query_event_reply, manual_reset) == 8 );
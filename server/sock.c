@@ -971,6 +971,9 @@ DECL_HANDLER(set_socket_event)
     old_event = sock->event;
     sock->mask    = req->mask;
     sock->hmask   &= ~req->mask; /* re-enable held events */
+    /* events recorded while no mask was set may be stale, they are
+     * reported again by the next poll if they still hold */
+    sock->pmask   &= ~(req->mask & (FD_READ | FD_WRITE | FD_OOB));
     sock->event   = NULL;
     sock->window  = req->window;
     sock->message = req->msg;
@@ -1343,6 +1343,18 @@ static void dump_close_handle_request( const struct close_handle_request *req )
     fprintf( stderr, " handle=%04x", req->handle );
 }
 
+static void dump_batch_requests_request( const struct batch_requests_request *req )
+{
+    fprintf( stderr, " count=%08x", req->count );
+    dump_varargs_bytes( ", requests=", cur_size );
+}
+
+static void dump_batch_requests_reply( const struct batch_requests_reply *req )
+{
+    fprintf( stderr, " count=%08x", req->count );
+    dump_varargs_bytes( ", replies=", cur_size );
+}
+
 static void dump_set_handle_info_request( const struct set_handle_info_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -1433,6 +1445,27 @@ static void dump_event_op_request( const struct event_op_request *req )
     fprintf( stderr, ", op=%d", req->op );
 }
 
+static void dump_get_shared_sync_area_request( const struct get_shared_sync_area_request *req )
+{
+}
+
+static void dump_get_shared_sync_area_reply( const struct get_shared_sync_area_reply *req )
+{
+    fprintf( stderr, " size=%u", req->size );
+    fprintf( stderr, ", epoch=%d", req->epoch );
+}
+
+static void dump_share_event_state_request( const struct share_event_state_request *req )
+{
+    fprintf( stderr, " handle=%04x", req->handle );
+}
+
+static void dump_share_event_state_reply( const struct share_event_state_reply *req )
+{
+    fprintf( stderr, " index=%d", req->index );
+    fprintf( stderr, ", gen=%d", req->gen );
+}
+
 static void dump_query_event_request( const struct query_event_request *req )
 {
     fprintf( stderr, " handle=%04x", req->handle );
@@ -4116,6 +4149,7 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_queue_apc_request,
     (dump_func)dump_get_apc_result_request,
     (dump_func)dump_close_handle_request,
+    (dump_func)dump_batch_requests_request,
     (dump_func)dump_set_handle_info_request,
     (dump_func)dump_dup_handle_request,
     (dump_func)dump_open_process_request,
@@ -4123,6 +4157,8 @@ static const dump_func req_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_select_request,
     (dump_func)dump_create_event_request,
     (dump_func)dump_event_op_request,
+    (dump_func)dump_get_shared_sync_area_request,
+    (dump_func)dump_share_event_state_request,
     (dump_func)dump_query_event_request,
     (dump_func)dump_open_event_request,
     (dump_func)dump_create_keyed_event_request,
@@ -4374,6 +4410,7 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_queue_apc_reply,
     (dump_func)dump_get_apc_result_reply,
     NULL,
+    (dump_func)dump_batch_requests_reply,
     (dump_func)dump_set_handle_info_reply,
     (dump_func)dump_dup_handle_reply,
     (dump_func)dump_open_process_reply,
@@ -4381,6 +4418,8 @@ static const dump_func reply_dumpers[REQ_NB_REQUESTS] = {
     (dump_func)dump_select_reply,
     (dump_func)dump_create_event_reply,
     NULL,
+    (dump_func)dump_get_shared_sync_area_reply,
+    (dump_func)dump_share_event_state_reply,
     (dump_func)dump_query_event_reply,
     (dump_func)dump_open_event_reply,
     (dump_func)dump_create_keyed_event_reply,
@@ -4632,6 +4671,7 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "queue_apc",
     "get_apc_result",
     "close_handle",
+    "batch_requests",
     "set_handle_info",
     "dup_handle",
     "open_process",
@@ -4639,6 +4679,8 @@ static const char * const req_names[REQ_NB_REQUESTS] = {
     "select",
     "create_event",
     "event_op",
+    "get_shared_sync_area",
+    "share_event_state",
     "query_event",
     "open_event",
     "create_keyed_event",
@@ -5020,6 +5062,26 @@ void trace_request(void)
     else fprintf( stderr, "%04x: %d(?)\n", current->id, req );
 }
 
+const char *get_request_name( enum request req )
+{
+    return req < REQ_NB_REQUESTS ? req_names[req] : "unknown";
+}
+
+void trace_request_stats( const unsigned int *counts, timeout_t interval )
+{
+    double secs = (double)-interval / TICKS_PER_SEC;
+    unsigned int i, total = 0;
+
+    for (i = 0; i < REQ_NB_REQUESTS; i++) total += counts[i];
+    if (!total) return;
+    fprintf( stderr, "wineserver: %.1f requests/s\n", total / secs );
+    for (i = 0; i < REQ_NB_REQUESTS; i++)
+    {
+        if (!counts[i]) continue;
+        fprintf( stderr, "wineserver:   %-32s %10.1f/s\n", req_names[i], counts[i] / secs );
+    }
+}
+
 void trace_reply( enum request req, const union generic_reply *reply )
 {
     if (req < REQ_NB_REQUESTS)
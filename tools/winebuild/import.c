@@ -693,6 +693,21 @@ int has_imports(void)
     return (nb_imports - nb_delayed) > 0;
 }
 
+/* get the import hint of a function, i.e. its position in the name table of the exporting dll */
+static int get_import_hint( const DLLSPEC *spec, const ORDDEF *odp )
+{
+    int min = 0, max = spec->nb_names - 1;
+
+    while (min <= max)
+    {
+        int res, pos = (min + max) / 2;
+        if (!(res = strcmp( spec->names[pos]->name, odp->name ))) return pos;
+        if (res > 0) max = pos - 1;
+        else min = pos + 1;
+    }
+    return 0;
+}
+
 /* output the import table of a Win32 module */
 static void output_immediate_imports(void)
 {
@@ -772,7 +787,7 @@ static void output_immediate_imports(void)
             {
                 output( "\t.align %d\n", get_alignment(2) );
                 output( ".L__wine_spec_import_data_%s_%s:\n", dll_name, odp->name );
-                output( "\t.short %d\n", odp->ordinal );
+                output( "\t.short %d\n", get_import_hint( dll_imports[i]->spec, odp ));
                 output( "\t%s \"%s\"\n", get_asm_string_keyword(), odp->name );
             }
         }
@@ -870,7 +870,15 @@ void output_def_file( DLLSPEC *spec, int include_private )
         if (!(odp->flags & FLAG_PRIVATE)) total++;
         else if (!include_private) continue;
 
-        if (odp->type == TYPE_STUB) continue;
+        if (odp->type == TYPE_STUB)
+        {
+            /* stubs can't be imported, but they are needed to compute the import hints */
+            if (!include_private) continue;
+            output( "  %s @%d", name, odp->ordinal );
+            if (!odp->name || (odp->flags & FLAG_ORDINAL)) output( " NONAME" );
+            output( " PRIVATE\n" );
+            continue;
+        }
 
         output( "  %s", name );
 